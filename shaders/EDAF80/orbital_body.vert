@@ -0,0 +1,49 @@
+#version 410
+
+layout (location = 0) in vec3 vertex;
+layout (location = 2) in vec3 texcoord;
+layout (location = 5) in vec4 instance_position_and_spin;
+layout (location = 6) in vec2 instance_scale_and_tilt;
+layout (location = 7) in vec4 instance_previous_position_and_spin;
+
+uniform mat4 vertex_world_to_clip;
+uniform mat4 vertex_parent_to_world;
+uniform float interpolation_factor;
+
+out VS_OUT {
+	vec2 texcoord;
+} vs_out;
+
+
+void main()
+{
+	vs_out.texcoord = texcoord.xy;
+
+	// Move from the previous simulation step towards the current one;
+	// spin angles are wrapped to [-pi, pi], so take the shortest way
+	// around.
+	vec3 position = mix(instance_previous_position_and_spin.xyz,
+	                    instance_position_and_spin.xyz,
+	                    interpolation_factor);
+	float spin_delta = instance_position_and_spin.w - instance_previous_position_and_spin.w;
+	spin_delta -= 6.28318530718 * floor((spin_delta + 3.14159265359) / 6.28318530718);
+	float spin = instance_previous_position_and_spin.w + interpolation_factor * spin_delta;
+
+	// Same as CelestialBody: scale the body, spin it around the y-axis,
+	// and tilt it around the z-axis, before moving it along its orbit.
+	float spin_cos = cos(spin);
+	float spin_sin = sin(spin);
+	float tilt_cos = cos(instance_scale_and_tilt.y);
+	float tilt_sin = sin(instance_scale_and_tilt.y);
+
+	vec3 scaled = instance_scale_and_tilt.x * vertex;
+	vec3 spun = vec3( spin_cos * scaled.x + spin_sin * scaled.z,
+	                  scaled.y,
+	                 -spin_sin * scaled.x + spin_cos * scaled.z);
+	vec3 tilted = vec3(tilt_cos * spun.x - tilt_sin * spun.y,
+	                   tilt_sin * spun.x + tilt_cos * spun.y,
+	                   spun.z);
+
+	vec4 world_position = vertex_parent_to_world * vec4(tilted + position, 1.0);
+	gl_Position = vertex_world_to_clip * world_position;
+}
@@ -20,9 +20,36 @@ uniform int light_index;
 
 uniform sampler2D depth_texture;
 uniform sampler2D normal_texture;
-uniform sampler2D shadow_texture;
+// The shadow maps of all lights, the one of this light being found in
+// layer `light_index`.
+uniform sampler2DArray shadow_texture;
+// The shadow map only covers the lower-left part of its layer, depending on
+// the resolution selected for the light: texture coordinates in [0, 1]
+// over the shadow map have to be multiplied by `shadowmap_scale`, and kept
+// away from its upper edges to avoid reading outside of it.
+uniform vec2 shadowmap_scale;
+// How the shadow map is filtered: 0 for a single depth comparison; 1 for
+// variance shadow maps and 2 for exponential ones, both reading blurred
+// moments of the depth from `shadow_moments_texture`, laid out like
+// `shadow_texture` but with mipmaps.
+uniform int shadow_filtering;
+uniform sampler2DArray shadow_moments_texture;
+// Near and far planes of the lights' projection, the moments being
+// computed from the depth linearised between them.
+uniform vec2 shadow_depth_range;
+uniform float esm_exponent;
+// Variance shadow maps let light bleed through where occluders overlap;
+// that fraction of the visibility is cut off to hide it.
+uniform float vsm_light_bleeding_reduction;
+
+uniform bool use_octahedral_normals;
 
 uniform vec2 inverse_screen_resolution;
+// With dynamic resolution, the scene is only rendered into the lower-left
+// part of the G-buffer textures: screen coordinates in [0, 1], computed
+// using `inverse_screen_resolution`, have to be multiplied by
+// `render_target_scale` to sample them.
+uniform vec2 render_target_scale;
 
 uniform vec3 camera_position;
 
@@ -35,10 +62,55 @@ uniform float light_angle_falloff;
 layout (location = 0) out vec4 light_diffuse_contribution;
 layout (location = 1) out vec4 light_specular_contribution;
 
+#include "common/depth.glsl"
+#include "common/normal_encoding.glsl"
+
+// Fraction of the light reaching a point, from its coordinates in the
+// shadow map of this light, all in [0, 1]. The shadow filtering options
+// only take effect once this gets called while shading, as the moments
+// are not computed until this shader reads them.
+float compute_shadow_visibility(vec3 shadow_coords)
+{
+	vec2 shadowmap_texel_size = 1.0 / textureSize(shadow_texture, 0).xy;
+	vec2 uv = min(shadow_coords.xy * shadowmap_scale, shadowmap_scale - 0.5 * shadowmap_texel_size);
+	vec3 coords = vec3(uv, float(light_index));
+
+	if (shadow_filtering == 0) {
+		float occluder_depth = texture(shadow_texture, coords).r;
+		return shadow_coords.z - 0.0001 <= occluder_depth ? 1.0 : 0.0;
+	}
+
+	float depth = linearise_depth_normalised(shadow_coords.z, shadow_depth_range.x, shadow_depth_range.y);
+
+	// Only the lower-left `shadowmap_scale` part of each level holds the
+	// moments of this light, the rest being left over from other lights
+	// or resolutions. Stop at the level where that part shrinks to a
+	// single texel, and keep half a texel inside of it at the coarsest
+	// level read, so that filtering never reaches outside of it.
+	vec2 moments_size = vec2(textureSize(shadow_moments_texture, 0).xy);
+	vec2 valid_size = shadowmap_scale * moments_size;
+	float max_lod = log2(max(min(valid_size.x, valid_size.y), 1.0));
+	float lod = clamp(textureQueryLod(shadow_moments_texture, shadow_coords.xy * shadowmap_scale).y, 0.0, max_lod);
+	vec2 level_texel_size = exp2(ceil(lod)) / moments_size;
+	vec2 moments_uv = clamp(shadow_coords.xy * shadowmap_scale, 0.5 * level_texel_size, shadowmap_scale - 0.5 * level_texel_size);
+	vec2 moments = textureLod(shadow_moments_texture, vec3(moments_uv, float(light_index)), lod).rg;
+	if (shadow_filtering == 2)
+		return clamp(moments.x * exp(-esm_exponent * depth), 0.0, 1.0);
+
+	// Chebyshev's inequality bounds the fraction of occluders lying
+	// farther than the point.
+	if (depth <= moments.x)
+		return 1.0;
+	float variance = max(moments.y - moments.x * moments.x, 0.00001);
+	float distance_to_mean = depth - moments.x;
+	float max_visibility = variance / (variance + distance_to_mean * distance_to_mean);
+	return clamp((max_visibility - vsm_light_bleeding_reduction) / (1.0 - vsm_light_bleeding_reduction), 0.0, 1.0);
+}
+
 
 void main()
 {
-	vec2 shadowmap_texel_size = 1.0f / textureSize(shadow_texture, 0);
+	vec2 shadowmap_texel_size = 1.0f / textureSize(shadow_texture, 0).xy;
 
 	light_diffuse_contribution  = vec4(0.0, 0.0, 0.0, 1.0);
 	light_specular_contribution = vec4(0.0, 0.0, 0.0, 1.0);
@@ -0,0 +1,61 @@
+#version 410
+
+// Blurs the moments of a shadow map with a separable Gaussian kernel, one
+// axis at a time, so that they can then be filtered like any other
+// texture when sampling them.
+//
+// The horizontal pass reads the depth from the layer `light_index` of the
+// shadow maps, and turns it into moments on the fly; the vertical one
+// reads the moments written by the former. Only the lower-left
+// `source_size` texels hold the shadow map of the light, so taps outside
+// of them get clamped back.
+uniform sampler2DArray shadow_texture;
+uniform sampler2D moments_texture;
+uniform int light_index;
+uniform bool is_vertical;
+uniform ivec2 source_size;
+
+// 1 for variance shadow maps, storing the depth and its square; 2 for
+// exponential ones, storing exp(esm_exponent * depth).
+uniform int filtering;
+// Near and far planes of the lights' projection, the moments being
+// computed from the depth linearised between them.
+uniform vec2 depth_range;
+uniform float esm_exponent;
+uniform int kernel_radius;
+
+layout (pixel_center_integer) in vec4 gl_FragCoord;
+
+layout (location = 0) out vec2 moments;
+
+#include "common/depth.glsl"
+
+vec2 fetch_moments(ivec2 coord)
+{
+	coord = clamp(coord, ivec2(0), source_size - 1);
+	if (is_vertical)
+		return texelFetch(moments_texture, coord, 0).rg;
+
+	float depth = linearise_depth_normalised(texelFetch(shadow_texture, ivec3(coord, light_index), 0).r, depth_range.x, depth_range.y);
+	if (filtering == 1)
+		return vec2(depth, depth * depth);
+	return vec2(exp(esm_exponent * depth), 0.0);
+}
+
+void main()
+{
+	ivec2 coord = ivec2(gl_FragCoord.xy);
+	ivec2 direction = is_vertical ? ivec2(0, 1) : ivec2(1, 0);
+
+	// With a standard deviation of half the radius, the weights at both
+	// ends of the kernel are already down to about 14% of the central one.
+	float sigma = max(0.5 * float(kernel_radius), 0.5);
+	vec2 sum = vec2(0.0);
+	float weights_sum = 0.0;
+	for (int i = -kernel_radius; i <= kernel_radius; ++i) {
+		float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+		sum += weight * fetch_moments(coord + i * direction);
+		weights_sum += weight;
+	}
+	moments = sum / weights_sum;
+}
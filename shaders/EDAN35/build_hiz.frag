@@ -0,0 +1,27 @@
+#version 410
+
+// Builds one level of the max-depth pyramid from the level below it, or
+// from the depth buffer for the first level: each texel keeps the
+// farthest depth of the 2 x 2 block of source texels it covers.
+//
+// The source is always read at its base level, which is set to the level
+// below the one being rendered to.
+uniform sampler2D source_texture;
+uniform ivec2 source_size;
+
+layout (pixel_center_integer) in vec4 gl_FragCoord;
+
+layout (location = 0) out float max_depth;
+
+void main()
+{
+	// Blocks along the right and top edges of odd-sized sources get
+	// clipped, rather than extended, as the level sizes are rounded up.
+	ivec2 min_coord = min(ivec2(gl_FragCoord.xy) * 2, source_size - 1);
+	ivec2 max_coord = min(min_coord + 1, source_size - 1);
+
+	max_depth = max(max(texelFetch(source_texture, min_coord, 0).r,
+	                    texelFetch(source_texture, ivec2(max_coord.x, min_coord.y), 0).r),
+	                max(texelFetch(source_texture, ivec2(min_coord.x, max_coord.y), 0).r,
+	                    texelFetch(source_texture, max_coord, 0).r));
+}
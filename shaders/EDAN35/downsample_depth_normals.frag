@@ -0,0 +1,57 @@
+#version 410
+
+uniform sampler2D depth_texture;
+uniform sampler2D normal_texture;
+
+// Each output pixel covers a block of 2^downsampling x 2^downsampling
+// pixels of the full-resolution textures, clipped to `source_size`.
+uniform int downsampling;
+uniform ivec2 source_size;
+
+uniform float z_near;
+uniform float z_far;
+
+layout (pixel_center_integer) in vec4 gl_FragCoord;
+
+// Minimum and maximum view-space depth found in the block, used for
+// weighting the low-resolution lighting when upsampling it.
+layout (location = 0) out vec2 depth_bounds;
+// The encoded normal of the pixel written to the depth buffer.
+layout (location = 1) out vec4 normal;
+
+#include "common/depth.glsl"
+
+void main()
+{
+	ivec2 output_coord = ivec2(gl_FragCoord.xy);
+	ivec2 block_origin = output_coord << downsampling;
+	int block_size = 1 << downsampling;
+
+	ivec2 min_coord = block_origin;
+	ivec2 max_coord = block_origin;
+	float min_depth = 1.0;
+	float max_depth = 0.0;
+	for (int y = 0; y < block_size; ++y) {
+		for (int x = 0; x < block_size; ++x) {
+			ivec2 coord = min(block_origin + ivec2(x, y), source_size - 1);
+			float depth = texelFetch(depth_texture, coord, 0).r;
+			if (depth <= min_depth) {
+				min_depth = depth;
+				min_coord = coord;
+			}
+			if (depth >= max_depth) {
+				max_depth = depth;
+				max_coord = coord;
+			}
+		}
+	}
+
+	// Alternate between the closest and furthest samples in a checkerboard
+	// pattern, so that both sides of a depth discontinuity get lit.
+	bool use_min = ((output_coord.x + output_coord.y) & 1) == 0;
+	ivec2 selected_coord = use_min ? min_coord : max_coord;
+
+	depth_bounds = vec2(linearise_depth(min_depth, z_near, z_far), linearise_depth(max_depth, z_near, z_far));
+	normal = texelFetch(normal_texture, selected_coord, 0);
+	gl_FragDepth = use_min ? min_depth : max_depth;
+}
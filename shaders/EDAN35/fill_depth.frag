@@ -0,0 +1,8 @@
+#version 410
+
+// Opaque geometry only needs its depth written, which is done without any
+// fragment shader output; discarding nothing keeps early depth testing
+// enabled.
+void main()
+{
+}
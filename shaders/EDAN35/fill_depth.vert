@@ -0,0 +1,33 @@
+#version 410
+
+struct ViewProjTransforms
+{
+	mat4 view_projection;
+	mat4 view_projection_inverse;
+};
+
+layout (std140) uniform CameraViewProjTransforms
+{
+	ViewProjTransforms camera;
+};
+
+uniform mat4 vertex_model_to_world;
+
+layout (location = 0) in vec3 vertex;
+layout (location = 2) in vec3 texcoord;
+
+out VS_OUT {
+	vec2 texcoord;
+} vs_out;
+
+// The G-buffer pass is depth tested with GL_EQUAL against the depth written
+// by this pre-pass, so positions have to be computed exactly as in
+// fill_gbuffer.vert.
+invariant gl_Position;
+
+void main()
+{
+	vs_out.texcoord = texcoord.xy;
+
+	gl_Position = camera.view_projection * vertex_model_to_world * vec4(vertex, 1.0);
+}
@@ -0,0 +1,30 @@
+#version 410
+
+// See fill_gbuffer.frag for a description of the layout.
+struct MaterialTextureLayer
+{
+	ivec4 arrays;
+	ivec4 layers;
+};
+
+layout (std140) uniform MaterialTextureLayers
+{
+	MaterialTextureLayer materials[256];
+};
+
+uniform sampler2DArray material_textures[8];
+uniform int material_index;
+
+in VS_OUT {
+	vec2 texcoord;
+} fs_in;
+
+const int OPACITY_TEXTURE = 3;
+
+// Must discard the same fragments as fill_gbuffer.frag.
+void main()
+{
+	MaterialTextureLayer material = materials[material_index];
+	if (texture(material_textures[material.arrays[OPACITY_TEXTURE]], vec3(fs_in.texcoord, float(material.layers[OPACITY_TEXTURE]))).r < 1.0)
+		discard;
+}
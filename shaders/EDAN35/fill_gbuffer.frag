@@ -1,15 +1,28 @@
 #version 410
 
-uniform bool has_diffuse_texture;
-uniform bool has_specular_texture;
-uniform bool has_normals_texture;
-uniform bool has_opacity_texture;
-uniform sampler2D diffuse_texture;
-uniform sampler2D specular_texture;
-uniform sampler2D normals_texture;
-uniform sampler2D opacity_texture;
+// Where the textures of a material are located: the components refer, in
+// order, to the diffuse, specular, normals and opacity textures. An array
+// index of -1 means the material has no such texture.
+struct MaterialTextureLayer
+{
+	ivec4 arrays;
+	ivec4 layers;
+};
+
+layout (std140) uniform MaterialTextureLayers
+{
+	MaterialTextureLayer materials[256];
+};
+
+uniform sampler2DArray material_textures[8];
+uniform int material_index;
 uniform mat4 normal_model_to_world;
 
+// See `GBufferLayout` in the application for the layouts described by
+// those.
+uniform bool use_octahedral_normals;
+uniform bool is_specular_packed;
+
 in VS_OUT {
 	vec3 normal;
 	vec2 texcoord;
@@ -21,22 +34,49 @@ layout (location = 0) out vec4 geometry_diffuse;
 layout (location = 1) out vec4 geometry_specular;
 layout (location = 2) out vec4 geometry_normal;
 
+const int DIFFUSE_TEXTURE  = 0;
+const int SPECULAR_TEXTURE = 1;
+const int NORMALS_TEXTURE  = 2;
+const int OPACITY_TEXTURE  = 3;
+
+bool has_texture(int type)
+{
+	return materials[material_index].arrays[type] >= 0;
+}
+
+vec4 sample_texture(int type, vec2 texcoord)
+{
+	MaterialTextureLayer material = materials[material_index];
+	return texture(material_textures[material.arrays[type]], vec3(texcoord, float(material.layers[type])));
+}
+
+#include "common/normal_encoding.glsl"
+
 
 void main()
 {
-	if (has_opacity_texture && texture(opacity_texture, fs_in.texcoord).r < 1.0)
+	bool has_diffuse_texture  = has_texture(DIFFUSE_TEXTURE);
+	bool has_specular_texture = has_texture(SPECULAR_TEXTURE);
+	bool has_normals_texture  = has_texture(NORMALS_TEXTURE);
+	bool has_opacity_texture  = has_texture(OPACITY_TEXTURE);
+
+	if (has_opacity_texture && sample_texture(OPACITY_TEXTURE, fs_in.texcoord).r < 1.0)
 		discard;
 
 	// Diffuse color
 	geometry_diffuse = vec4(0.0f);
 	if (has_diffuse_texture)
-		geometry_diffuse = texture(diffuse_texture, fs_in.texcoord);
+		geometry_diffuse = sample_texture(DIFFUSE_TEXTURE, fs_in.texcoord);
 
 	// Specular color
 	geometry_specular = vec4(0.0f);
 	if (has_specular_texture)
-		geometry_specular = texture(specular_texture, fs_in.texcoord);
+		geometry_specular = sample_texture(SPECULAR_TEXTURE, fs_in.texcoord);
+	// Without a specular target, only the specular intensity is kept, in
+	// the alpha channel of the diffuse target.
+	if (is_specular_packed)
+		geometry_diffuse.a = dot(geometry_specular.rgb, vec3(0.2126, 0.7152, 0.0722));
 
-	// Worldspace normal
-	geometry_normal.xyz = vec3(0.0);
+	// Worldspace normal, stored through `encode_normal()`
+	geometry_normal = encode_normal(vec3(0.0), use_octahedral_normals);
 }
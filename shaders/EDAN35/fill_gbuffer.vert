@@ -26,6 +26,8 @@ out VS_OUT {
 	vec3 binormal;
 } vs_out;
 
+// Must match fill_depth.vert, for the optional depth pre-pass.
+invariant gl_Position;
 
 void main() {
 	vs_out.normal   = normalize(normal);
@@ -1,14 +1,30 @@
 #version 410
 
-uniform bool has_opacity_texture;
-uniform sampler2D opacity_texture;
+// See fill_gbuffer.frag for a description of the layout.
+struct MaterialTextureLayer
+{
+	ivec4 arrays;
+	ivec4 layers;
+};
+
+layout (std140) uniform MaterialTextureLayers
+{
+	MaterialTextureLayer materials[256];
+};
 
-in VS_OUT {
+uniform sampler2DArray material_textures[8];
+uniform int material_index;
+
+in GS_OUT {
 	vec2 texcoord;
 } fs_in;
 
+const int OPACITY_TEXTURE = 3;
+
 void main()
 {
-	if (has_opacity_texture && texture(opacity_texture, fs_in.texcoord).r < 1.0)
+	MaterialTextureLayer material = materials[material_index];
+	if (material.arrays[OPACITY_TEXTURE] >= 0
+	 && texture(material_textures[material.arrays[OPACITY_TEXTURE]], vec3(fs_in.texcoord, float(material.layers[OPACITY_TEXTURE]))).r < 1.0)
 		discard;
 }
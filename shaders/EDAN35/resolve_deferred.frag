@@ -5,19 +5,104 @@ uniform sampler2D specular_texture;
 uniform sampler2D light_d_texture;
 uniform sampler2D light_s_texture;
 
+// When set, `specular_texture` is not used, and the specular intensity is
+// found in the alpha channel of `diffuse_texture` instead.
+uniform bool is_specular_packed;
+
+// The light accumulation textures can be 2^light_accumulation_downsampling
+// times smaller than the G-buffer along each axis. They are then upsampled
+// by weighting their texels by how close their depth range and normal are
+// to those of the full-resolution pixel.
+uniform int light_accumulation_downsampling;
+uniform sampler2D depth_texture;
+uniform sampler2D normal_texture;
+uniform sampler2D downsampled_depth_bounds_texture;
+uniform sampler2D downsampled_normal_texture;
+uniform ivec2 downsampled_size; // rendered area of the light accumulation textures
+uniform bool use_octahedral_normals;
+uniform float z_near;
+uniform float z_far;
+
 layout (pixel_center_integer) in vec4 gl_FragCoord;
 
 out vec4 frag_color;
 
+// Relative depth difference at which a texel's weight drops to 1/e.
+const float depth_tolerance = 0.02;
+const float normal_sharpness = 8.0;
+
+#include "common/depth.glsl"
+#include "common/normal_encoding.glsl"
+
+void upsample_lights(ivec2 pixel_coord, out vec3 light_d, out vec3 light_s)
+{
+	float depth = linearise_depth(texelFetch(depth_texture, pixel_coord, 0).r, z_near, z_far);
+	vec3 normal = decode_normal(texelFetch(normal_texture, pixel_coord, 0), use_octahedral_normals);
+
+	// Position of the pixel among the low-resolution texels, whose centres
+	// are at integer coordinates.
+	vec2 coords = (vec2(pixel_coord) + 0.5) / float(1 << light_accumulation_downsampling) - 0.5;
+	ivec2 base = ivec2(floor(coords));
+	vec2 fraction = coords - vec2(base);
+
+	light_d = vec3(0.0);
+	light_s = vec3(0.0);
+	float total_weight = 0.0;
+	float closest_distance = 1.0e30;
+	ivec2 closest_tap = clamp(base, ivec2(0), downsampled_size - 1);
+	for (int i = 0; i < 4; ++i) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 tap = clamp(base + offset, ivec2(0), downsampled_size - 1);
+
+		// Zero when the pixel lies within the depth range of the texel.
+		vec2 bounds = texelFetch(downsampled_depth_bounds_texture, tap, 0).rg;
+		float depth_distance = max(max(bounds.x - depth, depth - bounds.y), 0.0) / depth;
+		vec3 tap_normal = decode_normal(texelFetch(downsampled_normal_texture, tap, 0), use_octahedral_normals);
+
+		vec2 bilinear = mix(1.0 - fraction, fraction, vec2(offset));
+		float weight = bilinear.x * bilinear.y
+		             * exp(-depth_distance / depth_tolerance)
+		             * pow(max(dot(normal, tap_normal), 0.0), normal_sharpness);
+
+		light_d += weight * texelFetch(light_d_texture, tap, 0).rgb;
+		light_s += weight * texelFetch(light_s_texture, tap, 0).rgb;
+		total_weight += weight;
+
+		if (depth_distance < closest_distance) {
+			closest_distance = depth_distance;
+			closest_tap = tap;
+		}
+	}
+
+	// None of the texels matches the pixel, e.g. on thin geometry: fall
+	// back to the one closest in depth.
+	if (total_weight < 1.0e-4) {
+		light_d = texelFetch(light_d_texture, closest_tap, 0).rgb;
+		light_s = texelFetch(light_s_texture, closest_tap, 0).rgb;
+		return;
+	}
+
+	light_d /= total_weight;
+	light_s /= total_weight;
+}
+
 void main()
 {
 	ivec2 pixel_coord = ivec2(gl_FragCoord.xy);
 
-	vec3 diffuse  = texelFetch(diffuse_texture,  pixel_coord, 0).rgb;
-	vec3 specular = texelFetch(specular_texture, pixel_coord, 0).rgb;
+	vec4 diffuse_and_packed_specular = texelFetch(diffuse_texture, pixel_coord, 0);
+	vec3 diffuse  = diffuse_and_packed_specular.rgb;
+	vec3 specular = is_specular_packed ? vec3(diffuse_and_packed_specular.a)
+	                                   : texelFetch(specular_texture, pixel_coord, 0).rgb;
 
-	vec3 light_d  = texelFetch(light_d_texture,  pixel_coord, 0).rgb;
-	vec3 light_s  = texelFetch(light_s_texture,  pixel_coord, 0).rgb;
+	vec3 light_d;
+	vec3 light_s;
+	if (light_accumulation_downsampling == 0) {
+		light_d = texelFetch(light_d_texture, pixel_coord, 0).rgb;
+		light_s = texelFetch(light_s_texture, pixel_coord, 0).rgb;
+	} else {
+		upsample_lights(pixel_coord, light_d, light_s);
+	}
 	const vec3 ambient = vec3(0.15);
 
 	frag_color =  vec4((ambient + light_d) * diffuse + light_s * specular, 1.0);
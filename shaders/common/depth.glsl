@@ -0,0 +1,14 @@
+// Turn a depth read from a depth buffer, in [0, 1], back into the distance
+// along the view direction, for a perspective projection with the given
+// near and far planes.
+float linearise_depth(float depth, float near_plane, float far_plane)
+{
+	return near_plane * far_plane / (far_plane - depth * (far_plane - near_plane));
+}
+
+// Same as `linearise_depth()`, but remapped from [near_plane, far_plane]
+// to [0, 1].
+float linearise_depth_normalised(float depth, float near_plane, float far_plane)
+{
+	return (linearise_depth(depth, near_plane, far_plane) - near_plane) / (far_plane - near_plane);
+}
@@ -0,0 +1,29 @@
+// Normals are either stored remapped from [-1, 1] to [0, 1], or using an
+// octahedral encoding into two components, remapped the same way.
+
+vec2 sign_not_zero(vec2 v)
+{
+	return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec4 encode_normal(vec3 normal, bool is_octahedral)
+{
+	if (!is_octahedral)
+		return vec4(normal * 0.5 + 0.5, 0.0);
+
+	normal /= max(abs(normal.x) + abs(normal.y) + abs(normal.z), 1.0e-6);
+	vec2 encoded = normal.z >= 0.0 ? normal.xy : (1.0 - abs(normal.yx)) * sign_not_zero(normal.xy);
+	return vec4(encoded * 0.5 + 0.5, 0.0, 0.0);
+}
+
+vec3 decode_normal(vec4 stored, bool is_octahedral)
+{
+	if (!is_octahedral)
+		return normalize(stored.xyz * 2.0 - 1.0);
+
+	vec2 encoded = stored.xy * 2.0 - 1.0;
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	if (normal.z < 0.0)
+		normal.xy = (1.0 - abs(normal.yx)) * sign_not_zero(normal.xy);
+	return normalize(normal);
+}
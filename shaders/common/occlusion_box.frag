@@ -0,0 +1,7 @@
+#version 410
+
+// Nothing gets written; the fragments passing the depth test are only
+// counted by the occlusion query around the draw.
+void main()
+{
+}
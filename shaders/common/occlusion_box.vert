@@ -0,0 +1,26 @@
+#version 410
+
+// Generates the 36 vertices of a box, from `gl_VertexID` alone.
+
+uniform vec3 box_min_corner;
+uniform vec3 box_max_corner;
+uniform mat4 vertex_world_to_clip;
+
+// Two triangles per face, with each corner index made of one bit per
+// axis: x for bit 0, y for bit 1 and z for bit 2.
+const int corners[36] = int[36](
+	0, 2, 1,  1, 2, 3,  // -Z
+	4, 5, 6,  5, 7, 6,  // +Z
+	0, 1, 4,  1, 5, 4,  // -Y
+	2, 6, 3,  3, 6, 7,  // +Y
+	0, 4, 2,  2, 4, 6,  // -X
+	1, 3, 5,  3, 7, 5   // +X
+);
+
+void main()
+{
+	int corner = corners[gl_VertexID];
+	vec3 position = mix(box_min_corner, box_max_corner,
+	                    vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+	gl_Position = vertex_world_to_clip * vec4(position, 1.0);
+}
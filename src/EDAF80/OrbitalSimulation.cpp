@@ -0,0 +1,345 @@
+#include "OrbitalSimulation.hpp"
+
+#include "core/opengl.hpp"
+#include "core/ThreadPool.hpp"
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cmath>
+#include <random>
+#include <string>
+
+namespace
+{
+	float const pi = glm::pi<float>();
+	float const half_pi = glm::half_pi<float>();
+	float const two_pi = glm::two_pi<float>();
+	float const inverse_two_pi = 1.0f / glm::two_pi<float>();
+
+	// The helpers below are written without any branches, so that the
+	// loop in `updateBodies()` gets vectorised by the compiler.
+
+	//! \brief Wrap an angle to [-π, π].
+	inline float wrapAngle(float const angle)
+	{
+		// Rounding through a conversion to an integer rather than
+		// with std::round(), as the latter is not vectorised unless
+		// SSE4.1 is enabled.
+		float const turns = angle * inverse_two_pi;
+		float const rounded_turns = static_cast<float>(static_cast<std::int32_t>(turns + std::copysign(0.5f, turns)));
+		return angle - two_pi * rounded_turns;
+	}
+
+	//! \brief Approximate the sine of an angle in [-π, π], with an
+	//!        absolute error of about 0.001.
+	inline float approximateSine(float const angle)
+	{
+		float const B = 4.0f / pi;
+		float const C = -4.0f / (pi * pi);
+		float const P = 0.225f;
+
+		float const y = B * angle + C * angle * std::abs(angle);
+		return P * (y * std::abs(y) - y) + y;
+	}
+
+	//! \brief Approximate the cosine of an angle in [-π, π], with an
+	//!        absolute error of about 0.001.
+	inline float approximateCosine(float const angle)
+	{
+		return approximateSine(wrapAngle(angle + half_pi));
+	}
+
+	// Restrict-qualifying the parameters lets the compiler know that the
+	// arrays do not overlap; without it, the loop is not vectorised as too
+	// many overlap checks would have to be done at runtime.
+	void updateBodies(std::size_t const begin, std::size_t const end,
+	                  float const elapsed_time_s,
+	                  float const* __restrict orbit_radii,
+	                  float const* __restrict orbit_inclination_cosines,
+	                  float const* __restrict orbit_inclination_sines,
+	                  float const* __restrict orbit_speeds,
+	                  float* __restrict orbit_angles,
+	                  float const* __restrict spin_speeds,
+	                  float* __restrict spin_angles,
+	                  float* __restrict positions_and_spins)
+	{
+		for (std::size_t i = begin; i < end; ++i) {
+			float const orbit_angle = wrapAngle(orbit_angles[i] + orbit_speeds[i] * elapsed_time_s);
+			float const spin_angle = wrapAngle(spin_angles[i] + spin_speeds[i] * elapsed_time_s);
+			orbit_angles[i] = orbit_angle;
+			spin_angles[i] = spin_angle;
+
+			// Same as applying a rotation of `orbit_angle` around the
+			// y-axis, followed by a rotation of the inclination around
+			// the z-axis, to the point (radius, 0, 0).
+			float const radius_cosine = orbit_radii[i] * approximateCosine(orbit_angle);
+			positions_and_spins[4u * i + 0u] = radius_cosine * orbit_inclination_cosines[i];
+			positions_and_spins[4u * i + 1u] = radius_cosine * orbit_inclination_sines[i];
+			positions_and_spins[4u * i + 2u] = -orbit_radii[i] * approximateSine(orbit_angle);
+			positions_and_spins[4u * i + 3u] = spin_angle;
+		}
+	}
+}
+
+std::size_t OrbitalSimulation::add_body(OrbitalBodyConfiguration const& configuration)
+{
+	auto const index = get_bodies_nb();
+	resize(index + 1u);
+
+	_orbit_radii[index] = configuration.orbit.radius;
+	_orbit_inclination_cosines[index] = std::cos(configuration.orbit.inclination);
+	_orbit_inclination_sines[index] = std::sin(configuration.orbit.inclination);
+	_orbit_speeds[index] = configuration.orbit.speed;
+	_orbit_angles[index] = wrapAngle(configuration.orbit_angle);
+	_spin_speeds[index] = configuration.spin.speed;
+	_spin_angles[index] = wrapAngle(configuration.spin_angle);
+	_scales_and_tilts[index] = glm::vec2(configuration.scale, configuration.spin.axial_tilt);
+
+	return index;
+}
+
+void OrbitalSimulation::add_belt(std::size_t const bodies_nb,
+                                 BeltConfiguration const& configuration,
+                                 std::uint32_t const seed)
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> radius_distribution(configuration.inner_radius, configuration.outer_radius);
+	std::uniform_real_distribution<float> inclination_distribution(-configuration.max_inclination, configuration.max_inclination);
+	std::uniform_real_distribution<float> angle_distribution(-pi, pi);
+	std::uniform_real_distribution<float> tilt_distribution(-half_pi, half_pi);
+	std::uniform_real_distribution<float> spin_speed_distribution(-configuration.max_spin_speed, configuration.max_spin_speed);
+	std::uniform_real_distribution<float> unit_distribution(0.0f, 1.0f);
+
+	// Scales are picked uniformly on a logarithmic scale, so that small
+	// bodies are more common than large ones.
+	float const scales_ratio = configuration.max_scale / configuration.min_scale;
+
+	auto const first_index = get_bodies_nb();
+	resize(first_index + bodies_nb);
+
+	for (std::size_t i = first_index; i < first_index + bodies_nb; ++i) {
+		float const radius = radius_distribution(generator);
+		float const inclination = inclination_distribution(generator);
+		float const spin_angle = angle_distribution(generator);
+
+		_orbit_radii[i] = radius;
+		_orbit_inclination_cosines[i] = std::cos(inclination);
+		_orbit_inclination_sines[i] = std::sin(inclination);
+		_orbit_speeds[i] = configuration.unit_radius_orbit_speed / (radius * std::sqrt(radius));
+		_orbit_angles[i] = angle_distribution(generator);
+		_spin_speeds[i] = spin_speed_distribution(generator);
+		_spin_angles[i] = spin_angle;
+		_scales_and_tilts[i] = glm::vec2(configuration.min_scale * std::pow(scales_ratio, unit_distribution(generator)),
+		                                 tilt_distribution(generator));
+	}
+}
+
+void OrbitalSimulation::clear()
+{
+	resize(0u);
+}
+
+void OrbitalSimulation::update(std::chrono::microseconds const elapsed_time, ThreadPool& thread_pool,
+                               OrbitalSnapshot& snapshot)
+{
+	auto const start_time = std::chrono::high_resolution_clock::now();
+
+	// Convert the duration from microseconds to seconds.
+	auto const elapsed_time_s = std::chrono::duration<float>(elapsed_time).count();
+
+	snapshot.positions_and_spins.resize(get_bodies_nb());
+	if (snapshot.layout_version != _layout_version) {
+		snapshot.scales_and_tilts = _scales_and_tilts;
+		snapshot.layout_version = _layout_version;
+	}
+	snapshot.step = ++_steps_nb;
+
+	if (!_orbit_radii.empty()) {
+		float* const positions_and_spins = glm::value_ptr(snapshot.positions_and_spins.front());
+		thread_pool.ParallelFor(get_bodies_nb(),
+		                        [this, elapsed_time_s, positions_and_spins](std::size_t begin, std::size_t end, std::size_t /*chunk_index*/){
+		                          updateBodies(begin, end, elapsed_time_s,
+		                                       _orbit_radii.data(), _orbit_inclination_cosines.data(),
+		                                       _orbit_inclination_sines.data(), _orbit_speeds.data(),
+		                                       _orbit_angles.data(), _spin_speeds.data(), _spin_angles.data(),
+		                                       positions_and_spins);
+		                        });
+	}
+
+	_last_update_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+}
+
+void OrbitalSimulation::update(std::chrono::microseconds const elapsed_time, ThreadPool& thread_pool)
+{
+	update(elapsed_time, thread_pool, _snapshot);
+}
+
+OrbitalSnapshot const& OrbitalSimulation::get_snapshot() const
+{
+	return _snapshot;
+}
+
+std::size_t OrbitalSimulation::get_bodies_nb() const
+{
+	return _orbit_radii.size();
+}
+
+std::uint64_t OrbitalSimulation::get_layout_version() const
+{
+	return _layout_version;
+}
+
+std::chrono::microseconds OrbitalSimulation::get_last_update_time() const
+{
+	return _last_update_time;
+}
+
+void OrbitalSimulation::resize(std::size_t const bodies_nb)
+{
+	_orbit_radii.resize(bodies_nb);
+	_orbit_inclination_cosines.resize(bodies_nb);
+	_orbit_inclination_sines.resize(bodies_nb);
+	_orbit_speeds.resize(bodies_nb);
+	_orbit_angles.resize(bodies_nb);
+	_spin_speeds.resize(bodies_nb);
+	_spin_angles.resize(bodies_nb);
+	_scales_and_tilts.resize(bodies_nb);
+
+	++_layout_version;
+}
+
+
+OrbitalBodiesRenderer::OrbitalBodiesRenderer(bonobo::mesh_data const& shape,
+                                             GLuint const* program,
+                                             GLuint diffuse_texture_id) :
+	_vao(shape.vao), _vertices_nb(shape.vertices_nb), _indices_nb(shape.indices_nb),
+	_drawing_mode(shape.drawing_mode), _program(program),
+	_diffuse_texture(diffuse_texture_id)
+{
+	glGenBuffers(static_cast<GLsizei>(_positions_and_spins_buffers.size()), _positions_and_spins_buffers.data());
+	glGenBuffers(1, &_scales_and_tilts_buffer);
+
+	for (std::size_t i = 0u; i < _positions_and_spins_buffers.size(); ++i) {
+		glBindBuffer(GL_ARRAY_BUFFER, _positions_and_spins_buffers[i]);
+		utils::opengl::debug::nameObject(GL_BUFFER, _positions_and_spins_buffers[i], "Orbital bodies positions and spins " + std::to_string(i));
+	}
+
+	// The buffers feeding the positions and spins change depending on
+	// which snapshots are being interpolated, so they only get attached in
+	// `render()`.
+	glBindVertexArray(_vao);
+
+	glEnableVertexAttribArray(position_and_spin_location);
+	glVertexAttribDivisor(position_and_spin_location, 1u);
+	glEnableVertexAttribArray(previous_position_and_spin_location);
+	glVertexAttribDivisor(previous_position_and_spin_location, 1u);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _scales_and_tilts_buffer);
+	utils::opengl::debug::nameObject(GL_BUFFER, _scales_and_tilts_buffer, "Orbital bodies scales and tilts");
+	glEnableVertexAttribArray(scale_and_tilt_location);
+	glVertexAttribPointer(scale_and_tilt_location, 2, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<GLvoid const*>(0x0));
+	glVertexAttribDivisor(scale_and_tilt_location, 1u);
+
+	glBindVertexArray(0u);
+	glBindBuffer(GL_ARRAY_BUFFER, 0u);
+}
+
+OrbitalBodiesRenderer::~OrbitalBodiesRenderer()
+{
+	glDeleteBuffers(1, &_scales_and_tilts_buffer);
+	_scales_and_tilts_buffer = 0u;
+	glDeleteBuffers(static_cast<GLsizei>(_positions_and_spins_buffers.size()), _positions_and_spins_buffers.data());
+	_positions_and_spins_buffers.fill(0u);
+}
+
+void OrbitalBodiesRenderer::upload(OrbitalSnapshot const& previous, OrbitalSnapshot const& current)
+{
+	_instances_nb = static_cast<GLsizei>(current.positions_and_spins.size());
+	if (_instances_nb == 0)
+		return;
+
+	utils::opengl::debug::beginDebugGroup("Upload orbital bodies");
+
+	// Scales and tilts never change during the simulation, so they only
+	// need uploading when bodies were added or removed.
+	if (_uploaded_layout_version != current.layout_version) {
+		glBindBuffer(GL_ARRAY_BUFFER, _scales_and_tilts_buffer);
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(current.scales_and_tilts.size() * sizeof(glm::vec2)),
+		             current.scales_and_tilts.data(), GL_STATIC_DRAW);
+		_uploaded_layout_version = current.layout_version;
+	}
+
+	bool const can_interpolate = previous.layout_version == current.layout_version;
+	_current_buffer = upload_positions(current, previous.step);
+	_previous_buffer = can_interpolate ? upload_positions(previous, current.step) : _current_buffer;
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+	utils::opengl::debug::endDebugGroup();
+}
+
+void OrbitalBodiesRenderer::upload(OrbitalSnapshot const& snapshot)
+{
+	upload(snapshot, snapshot);
+}
+
+std::size_t OrbitalBodiesRenderer::upload_positions(OrbitalSnapshot const& snapshot,
+                                                    std::uint64_t const step_to_keep)
+{
+	for (std::size_t i = 0u; i < _uploaded_steps.size(); ++i)
+		if (_uploaded_steps[i] == snapshot.step)
+			return i;
+
+	std::size_t const buffer = _uploaded_steps[0] != step_to_keep ? 0u : 1u;
+
+	// Orphan the previous storage before writing to it, so that the
+	// driver can hand out a new one rather than waiting for the GPU to be
+	// done with the draw call of the previous frame.
+	auto const size = static_cast<GLsizeiptr>(snapshot.positions_and_spins.size() * sizeof(glm::vec4));
+	glBindBuffer(GL_ARRAY_BUFFER, _positions_and_spins_buffers[buffer]);
+	glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, snapshot.positions_and_spins.data());
+	_uploaded_steps[buffer] = snapshot.step;
+
+	return buffer;
+}
+
+void OrbitalBodiesRenderer::render(glm::mat4 const& view_projection,
+                                   glm::mat4 const& parent_transform,
+                                   float interpolation_factor) const
+{
+	if (_instances_nb == 0 || _program == nullptr || *_program == 0u)
+		return;
+
+	utils::opengl::debug::beginDebugGroup("Render orbital bodies");
+
+	glUseProgram(*_program);
+
+	glUniformMatrix4fv(glGetUniformLocation(*_program, "vertex_world_to_clip"), 1, GL_FALSE, glm::value_ptr(view_projection));
+	glUniformMatrix4fv(glGetUniformLocation(*_program, "vertex_parent_to_world"), 1, GL_FALSE, glm::value_ptr(parent_transform));
+	glUniform1f(glGetUniformLocation(*_program, "interpolation_factor"), interpolation_factor);
+	glUniform1i(glGetUniformLocation(*_program, "has_diffuse_texture"), _diffuse_texture != 0u ? 1 : 0);
+	glUniform1i(glGetUniformLocation(*_program, "diffuse_texture"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, _diffuse_texture);
+
+	glBindVertexArray(_vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _positions_and_spins_buffers[_current_buffer]);
+	glVertexAttribPointer(position_and_spin_location, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<GLvoid const*>(0x0));
+	glBindBuffer(GL_ARRAY_BUFFER, _positions_and_spins_buffers[_previous_buffer]);
+	glVertexAttribPointer(previous_position_and_spin_location, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<GLvoid const*>(0x0));
+	glBindBuffer(GL_ARRAY_BUFFER, 0u);
+
+	if (_indices_nb > 0)
+		glDrawElementsInstanced(_drawing_mode, _indices_nb, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(0x0), _instances_nb);
+	else
+		glDrawArraysInstanced(_drawing_mode, 0, _vertices_nb, _instances_nb);
+	glBindVertexArray(0u);
+
+	glBindTexture(GL_TEXTURE_2D, 0u);
+	glUseProgram(0u);
+
+	utils::opengl::debug::endDebugGroup();
+}
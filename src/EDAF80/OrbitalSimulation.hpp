@@ -0,0 +1,231 @@
+#pragma once
+
+#include "CelestialBody.hpp"
+
+#include "core/helpers.hpp"
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+//! \brief Parameters describing a single body of an `OrbitalSimulation`.
+struct OrbitalBodyConfiguration
+{
+	OrbitConfiguration orbit;  //!< Orbit around the centre of the simulation.
+	SpinConfiguration spin;    //!< Rotation around the body's own axis.
+	float scale{1.0f};         //!< Uniform scale applied to the body's geometry.
+	float orbit_angle{0.0f};   //!< Initial angle in radians along the orbit.
+	float spin_angle{0.0f};    //!< Initial angle in radians around the rotational axis.
+};
+
+//! \brief Parameters used to randomly generate a belt of bodies, like the
+//!        asteroid belt found between Mars and Jupiter.
+struct BeltConfiguration
+{
+	float inner_radius{1.0f};             //!< Distance in metres from the centre to the inner edge of the belt.
+	float outer_radius{2.0f};             //!< Distance in metres from the centre to the outer edge of the belt.
+	float max_inclination{0.0f};          //!< Maximum angle in radians between a body's orbital plane and the belt's.
+	float min_scale{1.0f};                //!< Smallest scale a body can get.
+	float max_scale{1.0f};                //!< Largest scale a body can get.
+	float max_spin_speed{0.0f};           //!< Largest spin speed, in radians per second, a body can get.
+	float unit_radius_orbit_speed{1.0f};  //!< Orbit speed in radians per second at a distance of 1 m; following Kepler's third law, the speed at a distance r is that value divided by r^(3/2).
+};
+
+//! \brief State of an `OrbitalSimulation` needed to render it, as written
+//!        by `OrbitalSimulation::update()`.
+struct OrbitalSnapshot
+{
+	std::vector<glm::vec4> positions_and_spins;  //!< Position relative to the centre of the simulation in xyz, spin angle in w.
+	std::vector<glm::vec2> scales_and_tilts;     //!< Scale in x, axial tilt in y; those only change when bodies are added or removed.
+	std::uint64_t layout_version{0u};            //!< Value of `OrbitalSimulation::get_layout_version()` when written.
+	std::uint64_t step{0u};                      //!< Number of updates done before this snapshot was written.
+};
+
+//! \brief Simulates the orbit and spin of a large number of bodies all
+//!        orbiting around a same centre.
+//!
+//! Contrary to `CelestialBody`, which computes one matrix per transform
+//! and per body, the parameters of all bodies are stored as structures of
+//! arrays, and updated by tight loops without any branches which the
+//! compiler can vectorise. The update is furthermore spread over the
+//! threads of a `ThreadPool`.
+//!
+//! The result of an update is an `OrbitalSnapshot`, holding for each body
+//! its position relative to the centre of the simulation and its spin
+//! angle, ready to be uploaded as per-instance attributes; see
+//! `OrbitalBodiesRenderer`. Updates can write into an external snapshot,
+//! so that they can be run on a different thread than the rendering one;
+//! see `SimulationScheduler` and `SnapshotBuffer`.
+class OrbitalSimulation
+{
+public:
+	//! \brief Add a single body to the simulation.
+	//!
+	//! @return the index of the newly added body
+	std::size_t add_body(OrbitalBodyConfiguration const& configuration);
+
+	//! \brief Add `bodies_nb` randomly generated bodies to the
+	//!        simulation.
+	//!
+	//! @param [in] bodies_nb how many bodies to generate
+	//! @param [in] configuration ranges in which the parameters of the
+	//!             bodies are picked
+	//! @param [in] seed seed used by the random number generator, so that
+	//!             a same belt can be generated again
+	void add_belt(std::size_t bodies_nb, BeltConfiguration const& configuration,
+	              std::uint32_t seed = 0u);
+
+	//! \brief Remove all bodies from the simulation.
+	void clear();
+
+	//! \brief Advance the orbit and spin of all bodies, and write the
+	//!        result into `snapshot`.
+	//!
+	//! @param [in] elapsed_time Amount of time (in microseconds) to
+	//!             advance the simulation by
+	//! @param [in] thread_pool Threads to spread the update over
+	//! @param [out] snapshot Where to write the new state of the bodies;
+	//!              its buffers are reused if large enough
+	void update(std::chrono::microseconds elapsed_time, ThreadPool& thread_pool,
+	            OrbitalSnapshot& snapshot);
+
+	//! \brief Advance the orbit and spin of all bodies, and write the
+	//!        result into the snapshot returned by `get_snapshot()`.
+	void update(std::chrono::microseconds elapsed_time, ThreadPool& thread_pool);
+
+	//! \brief Return the snapshot written by the last call to
+	//!        `update()` without an explicit snapshot.
+	OrbitalSnapshot const& get_snapshot() const;
+
+	//! \brief Return how many bodies are being simulated.
+	std::size_t get_bodies_nb() const;
+
+	//! \brief Return a number which changes every time bodies are added
+	//!        or removed.
+	std::uint64_t get_layout_version() const;
+
+	//! \brief Return the time spent by the last call to `update()`.
+	std::chrono::microseconds get_last_update_time() const;
+
+private:
+	void resize(std::size_t bodies_nb);
+
+	// Orbit parameters
+	std::vector<float> _orbit_radii;
+	std::vector<float> _orbit_inclination_cosines;
+	std::vector<float> _orbit_inclination_sines;
+	std::vector<float> _orbit_speeds;
+	std::vector<float> _orbit_angles;
+
+	// Spin parameters
+	std::vector<float> _spin_speeds;
+	std::vector<float> _spin_angles;
+
+	// Parameters which do not change during the simulation
+	std::vector<glm::vec2> _scales_and_tilts;
+
+	OrbitalSnapshot _snapshot;
+
+	std::uint64_t _layout_version{0u};
+	std::uint64_t _steps_nb{0u};
+	std::chrono::microseconds _last_update_time{0};
+};
+
+//! \brief Renders all bodies of an `OrbitalSimulation` with a single
+//!        instanced draw call.
+//!
+//! Two snapshots can be uploaded, and the bodies are drawn in between
+//! them: this lets the simulation run at a fixed rate independent of the
+//! frame rate, while still being rendered smoothly. Each snapshot is only
+//! uploaded once, when it first gets used.
+//!
+//! The per-instance data is fed to the shader program through the
+//! following vertex attributes, on top of the ones of the shape:
+//!
+//! \code{.glsl}
+//! layout (location = 5) in vec4 instance_position_and_spin;
+//! layout (location = 6) in vec2 instance_scale_and_tilt;
+//! layout (location = 7) in vec4 instance_previous_position_and_spin;
+//! \endcode
+//!
+//! along with the uniforms `vertex_world_to_clip`, `vertex_parent_to_world`,
+//! `interpolation_factor`, `diffuse_texture` and `has_diffuse_texture`; see
+//! `shaders/EDAF80/orbital_body.vert`.
+class OrbitalBodiesRenderer
+{
+public:
+	static constexpr GLuint position_and_spin_location = 5u;
+	static constexpr GLuint scale_and_tilt_location = 6u;
+	static constexpr GLuint previous_position_and_spin_location = 7u;
+
+	//! \brief Create the instance buffers and attach them to the vertex
+	//!        array of `shape`.
+	//!
+	//! @param [in] shape Geometry used for each body; its vertex array
+	//!             object gets modified, so it should not be shared with
+	//!             other objects
+	//! @param [in] program Shader program used to render the bodies
+	//! @param [in] diffuse_texture_id Identifier of the diffuse texture
+	//!             used, or 0 for none
+	OrbitalBodiesRenderer(bonobo::mesh_data const& shape, GLuint const* program,
+	                      GLuint diffuse_texture_id);
+	~OrbitalBodiesRenderer();
+
+	OrbitalBodiesRenderer(OrbitalBodiesRenderer const&) = delete;
+	OrbitalBodiesRenderer& operator=(OrbitalBodiesRenderer const&) = delete;
+
+	//! \brief Upload the two snapshots to interpolate between, unless
+	//!        they were already uploaded.
+	//!
+	//! If bodies were added or removed between the two snapshots, only
+	//! `current` is used.
+	void upload(OrbitalSnapshot const& previous, OrbitalSnapshot const& current);
+
+	//! \brief Upload a single snapshot, to be rendered as is.
+	void upload(OrbitalSnapshot const& snapshot);
+
+	//! \brief Render all instances uploaded by the last call to
+	//!        `upload()`.
+	//!
+	//! @param [in] view_projection Matrix transforming from world space to
+	//!             clip space
+	//! @param [in] parent_transform Matrix transforming from the centre of
+	//!             the simulation to world space
+	//! @param [in] interpolation_factor How far to move the bodies from
+	//!             the previous snapshot to the current one, between 0 and 1
+	void render(glm::mat4 const& view_projection,
+	            glm::mat4 const& parent_transform = glm::mat4(1.0f),
+	            float interpolation_factor = 1.0f) const;
+
+private:
+	GLuint _vao{0u};
+	GLsizei _vertices_nb{0};
+	GLsizei _indices_nb{0};
+	GLenum _drawing_mode{GL_TRIANGLES};
+	GLuint const* _program{nullptr};
+	GLuint _diffuse_texture{0u};
+
+	static constexpr std::uint64_t no_step = static_cast<std::uint64_t>(-1);
+
+	//! \brief Return the buffer holding the positions of `snapshot`,
+	//!        uploading them if needed without overwriting the buffer
+	//!        holding the step `step_to_keep`.
+	std::size_t upload_positions(OrbitalSnapshot const& snapshot, std::uint64_t step_to_keep);
+
+	std::array<GLuint, 2> _positions_and_spins_buffers{ {0u, 0u} };
+	std::array<std::uint64_t, 2> _uploaded_steps{ {no_step, no_step} };
+	std::size_t _previous_buffer{0u};
+	std::size_t _current_buffer{0u};
+	GLuint _scales_and_tilts_buffer{0u};
+	GLsizei _instances_nb{0};
+	std::uint64_t _uploaded_layout_version{static_cast<std::uint64_t>(-1)};
+};
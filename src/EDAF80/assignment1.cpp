@@ -1,4 +1,5 @@
 #include "CelestialBody.hpp"
+#include "OrbitalSimulation.hpp"
 #include "config.hpp"
 #include "parametric_shapes.hpp"
 #include "core/Bonobo.h"
@@ -6,16 +7,22 @@
 #include "core/helpers.hpp"
 #include "core/node.hpp"
 #include "core/ShaderProgramManager.hpp"
+#include "core/SimulationScheduler.hpp"
+#include "core/SnapshotBuffer.hpp"
+#include "core/ThreadPool.hpp"
 
 #include <imgui.h>
 
 #include <clocale>
+#include <cmath>
 #include <cstdlib>
 
+#include <array>
+#include <atomic>
 #include <stack>
 
 
-int main()
+int main(int argc, char* argv[])
 {
 	std::setlocale(LC_ALL, "");
 
@@ -24,7 +31,7 @@ int main()
 	//
 	// Set up the framework
 	//
-	Bonobo framework;
+	Bonobo framework(argc, argv);
 
 	//
 	// Set up the camera
@@ -65,6 +72,9 @@ int main()
 	}
 	bonobo::mesh_data const& sphere = objects.front();
 	auto const saturn_ring_shape = parametric_shapes::createCircleRing(0.675f, 0.45f, 80u, 8u);
+	// Asteroids are tiny on screen and there can be hundreds of thousands
+	// of them, so use a much coarser sphere than for the planets.
+	auto const asteroid_shape = parametric_shapes::createSphere(1.0f, 6u, 4u);
 
 
 	//
@@ -95,6 +105,18 @@ int main()
 
 		return EXIT_FAILURE;
 	}
+	GLuint orbital_body_shader = 0u;
+	program_manager.CreateAndRegisterProgram("Orbital Body",
+		{ { ShaderType::vertex, "EDAF80/orbital_body.vert" },
+		  { ShaderType::fragment, "EDAF80/default.frag" } },
+		orbital_body_shader);
+	if (orbital_body_shader == 0u) {
+		LogError("Failed to generate the “Orbital Body” shader program: exiting.");
+
+		bonobo::deinit();
+
+		return EXIT_FAILURE;
+	}
 
 
 	//
@@ -140,6 +162,16 @@ int main()
 	SpinConfiguration const neptune_spin{ glm::radians(-28.0f), glm::two_pi<float>() / 2.0f };
 	OrbitConfiguration const neptune_orbit{ 19.0f, glm::radians(-6.4f), glm::two_pi<float>() / 3200.0f };
 
+	BeltConfiguration asteroid_belt_configuration;
+	asteroid_belt_configuration.inner_radius = 6.5f;
+	asteroid_belt_configuration.outer_radius = 9.5f;
+	asteroid_belt_configuration.max_inclination = glm::radians(4.0f);
+	asteroid_belt_configuration.min_scale = 0.002f;
+	asteroid_belt_configuration.max_scale = 0.012f;
+	asteroid_belt_configuration.max_spin_speed = glm::two_pi<float>() / 2.0f;
+	// Match the Earth's orbit: 2π/20 rad/s at a distance of 4 m.
+	asteroid_belt_configuration.unit_radius_orbit_speed = earth_orbit.speed * earth_orbit.radius * std::sqrt(earth_orbit.radius);
+
 
 	//
 	// Load all textures.
@@ -218,6 +250,65 @@ int main()
 	sun.add_child(&uranus);
 	sun.add_child(&neptune);
 
+	glm::mat4 const solar_system_transform = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f));
+
+
+	//
+	// Set up the asteroid belt: it is simulated at a fixed rate on its own
+	// thread, which publishes snapshots that get interpolated between
+	// while rendering.
+	//
+	ThreadPool thread_pool;
+	OrbitalSimulation asteroid_belt;
+	SnapshotBuffer<OrbitalSnapshot> asteroid_belt_snapshots;
+	OrbitalBodiesRenderer asteroid_belt_renderer(asteroid_shape, &orbital_body_shader, moon_texture);
+	int asteroids_nb = 100000;
+	std::atomic<int> requested_asteroids_nb{ asteroids_nb };
+	SimulationScheduler simulation(std::chrono::microseconds(1000000 / 60),
+	                               [&](SimulationScheduler::Step const& step){
+		auto const bodies_nb = static_cast<std::size_t>(requested_asteroids_nb.load());
+		if (bodies_nb != asteroid_belt.get_bodies_nb()) {
+			asteroid_belt.clear();
+			asteroid_belt.add_belt(bodies_nb, asteroid_belt_configuration);
+		}
+
+		auto& snapshot = asteroid_belt_snapshots.BeginWrite();
+		asteroid_belt.update(step.timestep, thread_pool, snapshot);
+		asteroid_belt_snapshots.EndWrite(step.time);
+	});
+	bool use_fixed_steps_per_frame = false;
+	simulation.Start();
+
+	// One query per frame that can be in flight, each one only read back
+	// once its result is available, so that timing the draw never waits
+	// for the GPU.
+	std::array<GLuint, 4> asteroid_belt_queries;
+	glGenQueries(static_cast<GLsizei>(asteroid_belt_queries.size()), asteroid_belt_queries.data());
+	std::array<bool, 4> are_asteroid_belt_queries_pending = { false, false, false, false };
+	std::size_t next_asteroid_belt_query = 0u;
+	GLuint64 asteroid_belt_gpu_time_ns = 0u;
+	std::chrono::microseconds asteroid_belt_upload_time{ 0 };
+
+	//
+	// The benchmark renders a fixed number of frames for each body count,
+	// with vsync disabled, and logs the average timings once done.
+	//
+	struct BenchmarkResult
+	{
+		int bodies_nb{ 0 };
+		std::chrono::microseconds frame_time{ 0 };
+		std::chrono::microseconds update_time{ 0 };
+		std::chrono::microseconds upload_time{ 0 };
+		std::chrono::nanoseconds gpu_time{ 0 };
+	};
+	std::array<int, 7> const benchmark_bodies_nbs = { 1000, 10000, 50000, 100000, 250000, 500000, 1000000 };
+	std::array<BenchmarkResult, benchmark_bodies_nbs.size()> benchmark_results;
+	int const benchmark_warmup_frames_nb = 10;
+	int const benchmark_measured_frames_nb = 120;
+	bool is_benchmark_running = false;
+	std::size_t benchmark_step = 0u;
+	int benchmark_frame = 0;
+
 
 
 
@@ -244,7 +335,7 @@ int main()
 		// Compute timings information
 		//
 		auto const now_time = std::chrono::high_resolution_clock::now();
-		auto const delta_time_us = std::chrono::duration_cast<std::chrono::microseconds>(now_time - last_time);
+		auto const delta_time_us = input_handler.GetTimeStep(std::chrono::duration_cast<std::chrono::microseconds>(now_time - last_time));
 		auto const animation_delta_time_us = !pause_animation ? std::chrono::duration_cast<std::chrono::microseconds>(delta_time_us * time_scale) : 0us;
 		last_time = now_time;
 
@@ -267,6 +358,20 @@ int main()
 			window_manager.ToggleFullscreenStatusForWindow(window);
 
 
+		//
+		// Advance the simulation: it normally runs on its own thread, but
+		// it can instead be stepped once per frame, so that a given number
+		// of frames always simulates the same thing.
+		//
+		bool const step_manually = use_fixed_steps_per_frame || is_benchmark_running;
+		if (step_manually && simulation.IsRunning())
+			simulation.Stop();
+		else if (!step_manually && !simulation.IsRunning())
+			simulation.Start();
+		if (step_manually && !pause_animation)
+			simulation.RunSteps(1u);
+
+
 		// Retrieve the actual framebuffer size: for HiDPI monitors,
 		// you might end up with a framebuffer larger than what you
 		// actually asked for. For example, if you ask for a 1920x1080
@@ -302,11 +407,11 @@ int main()
 		// TODO: Replace this explicit rendering of the Earth and Moon
 		// with a traversal of the scene graph and rendering of all its
 		// nodes.
-		glm::mat4 earthMatrix = earth.render(animation_delta_time_us, camera.GetWorldToClipMatrix(), glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f)), show_basis);
+		glm::mat4 earthMatrix = earth.render(animation_delta_time_us, camera.GetWorldToClipMatrix(), solar_system_transform, show_basis);
 		moon.render(animation_delta_time_us, camera.GetWorldToClipMatrix(), earthMatrix, show_basis);
 
 		std::stack<CelestialBodyRef> celestialBodies;
-		celestialBodies.push({ &sun,glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f)) });
+		celestialBodies.push({ &sun, solar_system_transform });
 
 		while (!celestialBodies.empty()) {
 			CelestialBodyRef curr = celestialBodies.top();
@@ -318,16 +423,118 @@ int main()
 			}
 		}
 
+		//
+		// Render the asteroid belt
+		//
+		float asteroid_belt_interpolation_factor = 1.0f;
+		{
+			auto const upload_start_time = std::chrono::high_resolution_clock::now();
+			auto const snapshots = asteroid_belt_snapshots.AcquireRead();
+			if (snapshots.IsValid()) {
+				asteroid_belt_renderer.upload(*snapshots.previous, *snapshots.current);
+				asteroid_belt_interpolation_factor = snapshots.GetInterpolationFactor();
+			}
+			asteroid_belt_snapshots.ReleaseRead();
+			asteroid_belt_upload_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - upload_start_time);
+		}
+
+		// Queries complete in order, starting from the one about to be
+		// reused.
+		for (std::size_t i = 0u; i < asteroid_belt_queries.size(); ++i) {
+			auto const query_index = (next_asteroid_belt_query + i) % asteroid_belt_queries.size();
+			if (!are_asteroid_belt_queries_pending[query_index])
+				continue;
+
+			GLint is_available = GL_FALSE;
+			glGetQueryObjectiv(asteroid_belt_queries[query_index], GL_QUERY_RESULT_AVAILABLE, &is_available);
+			if (is_available != GL_TRUE)
+				break;
+			glGetQueryObjectui64v(asteroid_belt_queries[query_index], GL_QUERY_RESULT, &asteroid_belt_gpu_time_ns);
+			are_asteroid_belt_queries_pending[query_index] = false;
+		}
+
+		// If the GPU is more frames behind than there are queries, skip
+		// timing this frame rather than waiting for it.
+		bool const is_asteroid_belt_timed = !are_asteroid_belt_queries_pending[next_asteroid_belt_query];
+		if (is_asteroid_belt_timed)
+			glBeginQuery(GL_TIME_ELAPSED, asteroid_belt_queries[next_asteroid_belt_query]);
+		asteroid_belt_renderer.render(camera.GetWorldToClipMatrix(), solar_system_transform, asteroid_belt_interpolation_factor);
+		if (is_asteroid_belt_timed) {
+			glEndQuery(GL_TIME_ELAPSED);
+			are_asteroid_belt_queries_pending[next_asteroid_belt_query] = true;
+			next_asteroid_belt_query = (next_asteroid_belt_query + 1u) % asteroid_belt_queries.size();
+		}
+
+		if (is_benchmark_running) {
+			auto& result = benchmark_results[benchmark_step];
+			if (benchmark_frame >= benchmark_warmup_frames_nb) {
+				result.frame_time += delta_time_us;
+				result.update_time += simulation.GetLastStepDuration();
+				result.upload_time += asteroid_belt_upload_time;
+				result.gpu_time += std::chrono::nanoseconds(asteroid_belt_gpu_time_ns);
+			}
+
+			if (++benchmark_frame == benchmark_warmup_frames_nb + benchmark_measured_frames_nb) {
+				result.frame_time /= benchmark_measured_frames_nb;
+				result.update_time /= benchmark_measured_frames_nb;
+				result.upload_time /= benchmark_measured_frames_nb;
+				result.gpu_time /= benchmark_measured_frames_nb;
+				benchmark_frame = 0;
+
+				if (++benchmark_step == benchmark_results.size()) {
+					is_benchmark_running = false;
+					glfwSwapInterval(static_cast<int>(WindowManager::SwapStrategy::enable_vsync));
+
+					LogInfo("Asteroid belt benchmark, using %zu threads (averaged over %d frames):", thread_pool.GetChunksNb(), benchmark_measured_frames_nb);
+					LogInfo("  bodies  | frame (ms) | step (ms)   | upload (ms) | GPU draw (ms)");
+					for (auto const& r : benchmark_results)
+						LogInfo("  %7d | %10.3f | %11.3f | %11.3f | %13.3f", r.bodies_nb,
+						        std::chrono::duration<double, std::milli>(r.frame_time).count(),
+						        std::chrono::duration<double, std::milli>(r.update_time).count(),
+						        std::chrono::duration<double, std::milli>(r.upload_time).count(),
+						        std::chrono::duration<double, std::milli>(r.gpu_time).count());
+
+					requested_asteroids_nb = asteroids_nb;
+				} else {
+					requested_asteroids_nb = benchmark_bodies_nbs[benchmark_step];
+				}
+			}
+		}
+
 		//
 		// Add controls to the scene.
 		//
 		bool const opened = ImGui::Begin("Scene controls", nullptr, ImGuiWindowFlags_None);
 		if (opened)
 		{
-			ImGui::Checkbox("Pause the animation", &pause_animation);
-			ImGui::SliderFloat("Time scale", &time_scale, 1e-1f, 10.0f);
+			if (ImGui::Checkbox("Pause the animation", &pause_animation))
+				simulation.SetPaused(pause_animation);
+			if (ImGui::SliderFloat("Time scale", &time_scale, 1e-1f, 10.0f))
+				simulation.SetTimeScale(time_scale);
+			ImGui::Checkbox("Step the simulation once per frame", &use_fixed_steps_per_frame);
 			ImGui::Separator();
 			ImGui::Checkbox("Show basis", &show_basis);
+			ImGui::Separator();
+			ImGui::SliderInt("Asteroids", &asteroids_nb, 0, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+			if (!is_benchmark_running && ImGui::IsItemDeactivatedAfterEdit())
+				requested_asteroids_nb = asteroids_nb;
+			ImGui::Text("Simulation step: %.3f ms on %zu threads", std::chrono::duration<float, std::milli>(simulation.GetLastStepDuration()).count(), thread_pool.GetChunksNb());
+			ImGui::Text("Skipped steps: %llu", static_cast<unsigned long long>(simulation.GetSkippedStepsNb()));
+			ImGui::Text("Upload: %.3f ms", std::chrono::duration<float, std::milli>(asteroid_belt_upload_time).count());
+			ImGui::Text("GPU draw: %.3f ms", static_cast<float>(asteroid_belt_gpu_time_ns) / 1.0e6f);
+			if (is_benchmark_running) {
+				ImGui::Text("Benchmarking %d bodies (%zu/%zu)...", benchmark_bodies_nbs[benchmark_step], benchmark_step + 1u, benchmark_bodies_nbs.size());
+			} else if (ImGui::Button("Run benchmark")) {
+				for (std::size_t i = 0u; i < benchmark_results.size(); ++i) {
+					benchmark_results[i] = BenchmarkResult();
+					benchmark_results[i].bodies_nb = benchmark_bodies_nbs[i];
+				}
+				is_benchmark_running = true;
+				benchmark_step = 0u;
+				benchmark_frame = 0;
+				requested_asteroids_nb = benchmark_bodies_nbs[0];
+				glfwSwapInterval(static_cast<int>(WindowManager::SwapStrategy::disable_vsync));
+			}
 		}
 		ImGui::End();
 
@@ -343,9 +550,11 @@ int main()
 		//
 		// Queue the computed frame for display on screen
 		//
-		glfwSwapBuffers(window);
+		window_manager.SwapBuffers(window);
 	}
 
+	glDeleteQueries(static_cast<GLsizei>(asteroid_belt_queries.size()), asteroid_belt_queries.data());
+
 	glDeleteTextures(1, &neptune_texture);
 	glDeleteTextures(1, &uranus_texture);
 	glDeleteTextures(1, &saturn_ring_texture);
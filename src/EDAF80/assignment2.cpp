@@ -179,7 +179,7 @@ edaf80::Assignment2::run()
 
 	while (!glfwWindowShouldClose(window)) {
 		auto const nowTime = std::chrono::high_resolution_clock::now();
-		auto const deltaTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(nowTime - lastTime);
+		auto const deltaTimeUs = inputHandler.GetTimeStep(std::chrono::duration_cast<std::chrono::microseconds>(nowTime - lastTime));
 		lastTime = nowTime;
 
 		auto & io = ImGui::GetIO();
@@ -280,15 +280,15 @@ edaf80::Assignment2::run()
 			Log::View::Render();
 		mWindowManager.RenderImGuiFrame(show_gui);
 
-		glfwSwapBuffers(window);
+		mWindowManager.SwapBuffers(window);
 	}
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 	std::setlocale(LC_ALL, "");
 
-	Bonobo framework;
+	Bonobo framework(argc, argv);
 
 	try {
 		edaf80::Assignment2 assignment2(framework.GetWindowManager());
@@ -0,0 +1,92 @@
+#include "DynamicResolution.hpp"
+
+#include "core/Log.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Changes of scale smaller than this are ignored.
+	float const scale_dead_band = 0.02f;
+
+	// How much of the way to the ideal scale is covered by each report,
+	// when going down and up respectively.
+	float const scale_decrease_factor = 0.5f;
+	float const scale_increase_factor = 0.1f;
+
+	// Part of the target frame time always left to the scaled passes, even
+	// when the other ones take longer than the target on their own.
+	float const min_scaled_passes_share = 0.1f;
+}
+
+DynamicResolution::DynamicResolution() = default;
+
+void DynamicResolution::report_gpu_time(float const scale, std::chrono::nanoseconds const scaled_passes_time,
+                                        std::chrono::nanoseconds const other_passes_time)
+{
+	if (!_is_enabled || scale <= 0.0f || scaled_passes_time.count() <= 0)
+		return;
+
+	// What the scaled passes would cost at full resolution.
+	auto const full_resolution_time_ns = static_cast<float>(scaled_passes_time.count()) / (scale * scale);
+
+	auto const target_ns = static_cast<float>(std::chrono::duration_cast<std::chrono::nanoseconds>(_target_frame_time).count());
+	auto const budget_ns = std::max(target_ns - static_cast<float>(other_passes_time.count()), min_scaled_passes_share * target_ns);
+	auto const ideal_scale = std::min(std::max(std::sqrt(budget_ns / full_resolution_time_ns), _min_scale), 1.0f);
+
+	auto const difference = ideal_scale - _scale;
+	if (std::abs(difference) < scale_dead_band && ideal_scale != 1.0f && ideal_scale != _min_scale)
+		return;
+
+	_scale += difference * (difference < 0.0f ? scale_decrease_factor : scale_increase_factor);
+	_scale = std::min(std::max(_scale, _min_scale), 1.0f);
+}
+
+float DynamicResolution::get_scale() const
+{
+	return _is_enabled ? _scale : 1.0f;
+}
+
+void DynamicResolution::set_enabled(bool const is_enabled)
+{
+	_is_enabled = is_enabled;
+	if (!is_enabled)
+		_scale = 1.0f;
+}
+
+bool DynamicResolution::is_enabled() const
+{
+	return _is_enabled;
+}
+
+void DynamicResolution::set_target_frame_time(std::chrono::microseconds const target)
+{
+	if (target.count() <= 0) {
+		LogError("The target frame time has to be positive.");
+		return;
+	}
+
+	_target_frame_time = target;
+}
+
+std::chrono::microseconds DynamicResolution::get_target_frame_time() const
+{
+	return _target_frame_time;
+}
+
+void DynamicResolution::set_min_scale(float const min_scale)
+{
+	if (min_scale <= 0.0f || min_scale > 1.0f) {
+		LogError("The minimum resolution scale has to be in ]0, 1].");
+		return;
+	}
+
+	_min_scale = min_scale;
+	_scale = std::max(_scale, _min_scale);
+}
+
+float DynamicResolution::get_min_scale() const
+{
+	return _min_scale;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+
+//! \brief Picks the resolution to render at, so that the GPU time of a
+//!        frame stays within a target.
+//!
+//! The resolution is given as a scale applied to both axes of the
+//! framebuffer, between a minimum and 1. It is derived from GPU timings
+//! reported with `report_gpu_time()`, split between the passes whose cost
+//! depends on the number of pixels rendered, assumed proportional to it,
+//! and the other ones, like shadow map updates or the GUI, assumed
+//! constant.
+//!
+//! The scale drops as soon as the frame goes over its target, but only
+//! slowly goes back up, and small changes are ignored, to avoid
+//! oscillating between two resolutions.
+//!
+//! A typical frame looks like:
+//!
+//! \code{.cpp}
+//! auto const scale = controller.get_scale();
+//! // Render the scene at `scale` times the framebuffer size.
+//! // Later on, once the GPU times of that frame are known:
+//! controller.report_gpu_time(scale, scaled_passes_time, other_passes_time);
+//! \endcode
+class DynamicResolution
+{
+public:
+	//! \brief Start at full resolution, targeting 60 FPS.
+	DynamicResolution();
+
+	//! \brief Report the GPU times of a frame rendered at `scale`, and
+	//!        update the scale of the next frames accordingly.
+	//!
+	//! @param [in] scale the scale the frame was rendered with, which may
+	//!             differ from the current one as timings are only known
+	//!             a few frames later
+	//! @param [in] scaled_passes_time GPU time of the passes rendered at
+	//!             the scaled resolution
+	//! @param [in] other_passes_time GPU time of all other passes
+	void report_gpu_time(float scale, std::chrono::nanoseconds scaled_passes_time, std::chrono::nanoseconds other_passes_time);
+
+	//! \brief Scale to render the next frame at.
+	float get_scale() const;
+
+	//! \brief When disabled, the scale stays at 1.
+	void set_enabled(bool is_enabled);
+	bool is_enabled() const;
+
+	void set_target_frame_time(std::chrono::microseconds target);
+	std::chrono::microseconds get_target_frame_time() const;
+
+	//! \brief Set the lowest scale the controller can pick, in ]0, 1].
+	void set_min_scale(float min_scale);
+	float get_min_scale() const;
+
+private:
+	bool _is_enabled{ false };
+	float _scale{ 1.0f };
+	float _min_scale{ 0.5f };
+	std::chrono::microseconds _target_frame_time{ 1000000 / 60 };
+};
@@ -0,0 +1,264 @@
+#include "LightCulling.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define LIGHT_CULLING_USE_SSE 1
+#	include <emmintrin.h>
+#else
+#	define LIGHT_CULLING_USE_SSE 0
+#endif
+
+namespace
+{
+	// Four lanes of floats and of booleans, mapped onto SSE registers when
+	// available, so that the culling below is only written once.
+#if LIGHT_CULLING_USE_SSE
+	struct Mask4 { __m128 v; };
+	struct Float4
+	{
+		__m128 v;
+
+		Float4() : v(_mm_setzero_ps()) {}
+		explicit Float4(__m128 value) : v(value) {}
+		explicit Float4(float value) : v(_mm_set1_ps(value)) {}
+		static Float4 load(float const* values) { return Float4(_mm_loadu_ps(values)); }
+		void store(float* values) const { _mm_storeu_ps(values, v); }
+	};
+	inline Float4 operator+(Float4 lhs, Float4 rhs) { return Float4(_mm_add_ps(lhs.v, rhs.v)); }
+	inline Float4 operator-(Float4 lhs, Float4 rhs) { return Float4(_mm_sub_ps(lhs.v, rhs.v)); }
+	inline Float4 operator*(Float4 lhs, Float4 rhs) { return Float4(_mm_mul_ps(lhs.v, rhs.v)); }
+	inline Float4 operator/(Float4 lhs, Float4 rhs) { return Float4(_mm_div_ps(lhs.v, rhs.v)); }
+	inline Float4 min(Float4 lhs, Float4 rhs) { return Float4(_mm_min_ps(lhs.v, rhs.v)); }
+	inline Float4 max(Float4 lhs, Float4 rhs) { return Float4(_mm_max_ps(lhs.v, rhs.v)); }
+	inline Float4 sqrt(Float4 value) { return Float4(_mm_sqrt_ps(value.v)); }
+	inline Mask4 operator<(Float4 lhs, Float4 rhs) { return { _mm_cmplt_ps(lhs.v, rhs.v) }; }
+	inline Mask4 operator<=(Float4 lhs, Float4 rhs) { return { _mm_cmple_ps(lhs.v, rhs.v) }; }
+	inline Mask4 operator&(Mask4 lhs, Mask4 rhs) { return { _mm_and_ps(lhs.v, rhs.v) }; }
+	inline Mask4 operator|(Mask4 lhs, Mask4 rhs) { return { _mm_or_ps(lhs.v, rhs.v) }; }
+	inline Float4 select(Mask4 mask, Float4 if_true, Float4 if_false)
+	{
+		return Float4(_mm_or_ps(_mm_and_ps(mask.v, if_true.v), _mm_andnot_ps(mask.v, if_false.v)));
+	}
+	inline Mask4 no_lanes() { return { _mm_setzero_ps() }; }
+	inline bool lane(Mask4 mask, int index) { return ((_mm_movemask_ps(mask.v) >> index) & 1) != 0; }
+#else
+	struct Mask4 { std::array<bool, 4> v; };
+	struct Float4
+	{
+		std::array<float, 4> v;
+
+		Float4() : v{ { 0.0f, 0.0f, 0.0f, 0.0f } } {}
+		explicit Float4(float value) : v{ { value, value, value, value } } {}
+		static Float4 load(float const* values) { Float4 result; std::copy(values, values + 4, result.v.begin()); return result; }
+		void store(float* values) const { std::copy(v.begin(), v.end(), values); }
+	};
+	template <typename Operation>
+	inline Float4 apply(Float4 lhs, Float4 rhs, Operation operation)
+	{
+		Float4 result;
+		for (int i = 0; i < 4; ++i)
+			result.v[i] = operation(lhs.v[i], rhs.v[i]);
+		return result;
+	}
+	template <typename Operation>
+	inline Mask4 compare(Float4 lhs, Float4 rhs, Operation operation)
+	{
+		Mask4 result;
+		for (int i = 0; i < 4; ++i)
+			result.v[i] = operation(lhs.v[i], rhs.v[i]);
+		return result;
+	}
+	inline Float4 operator+(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return a + b; }); }
+	inline Float4 operator-(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return a - b; }); }
+	inline Float4 operator*(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return a * b; }); }
+	inline Float4 operator/(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return a / b; }); }
+	inline Float4 min(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return std::min(a, b); }); }
+	inline Float4 max(Float4 lhs, Float4 rhs) { return apply(lhs, rhs, [](float a, float b){ return std::max(a, b); }); }
+	inline Float4 sqrt(Float4 value) { return apply(value, value, [](float a, float){ return std::sqrt(a); }); }
+	inline Mask4 operator<(Float4 lhs, Float4 rhs) { return compare(lhs, rhs, [](float a, float b){ return a < b; }); }
+	inline Mask4 operator<=(Float4 lhs, Float4 rhs) { return compare(lhs, rhs, [](float a, float b){ return a <= b; }); }
+	inline Mask4 operator&(Mask4 lhs, Mask4 rhs) { Mask4 result; for (int i = 0; i < 4; ++i) result.v[i] = lhs.v[i] && rhs.v[i]; return result; }
+	inline Mask4 operator|(Mask4 lhs, Mask4 rhs) { Mask4 result; for (int i = 0; i < 4; ++i) result.v[i] = lhs.v[i] || rhs.v[i]; return result; }
+	inline Float4 select(Mask4 mask, Float4 if_true, Float4 if_false)
+	{
+		Float4 result;
+		for (int i = 0; i < 4; ++i)
+			result.v[i] = mask.v[i] ? if_true.v[i] : if_false.v[i];
+		return result;
+	}
+	inline Mask4 no_lanes() { return { { { false, false, false, false } } }; }
+	inline bool lane(Mask4 mask, int index) { return mask.v[index]; }
+#endif
+
+	struct Vec4x4
+	{
+		Float4 x, y, z;
+	};
+
+	inline Float4 dot(Vec4x4 const& lhs, Vec4x4 const& rhs)
+	{
+		return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+	}
+
+	inline Vec4x4 operator+(Vec4x4 const& lhs, Vec4x4 const& rhs) { return { lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z }; }
+	inline Vec4x4 operator*(Vec4x4 const& lhs, Float4 rhs) { return { lhs.x * rhs, lhs.y * rhs, lhs.z * rhs }; }
+
+	// Planes of the view frustum, pointing inwards, extracted from the
+	// view-projection as described by Gribb and Hartmann.
+	std::array<glm::vec4, 6> extractFrustumPlanes(glm::mat4 const& world_to_clip)
+	{
+		auto const row = [&world_to_clip](int index){
+			return glm::vec4(world_to_clip[0][index], world_to_clip[1][index], world_to_clip[2][index], world_to_clip[3][index]);
+		};
+		std::array<glm::vec4, 6> planes = {{
+			row(3) + row(0), row(3) - row(0),
+			row(3) + row(1), row(3) - row(1),
+			row(3) + row(2), row(3) - row(2)
+		}};
+		for (auto& plane : planes)
+			plane /= std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		return planes;
+	}
+}
+
+void LightCones::resize(std::size_t const cones_nb)
+{
+	_cones_nb = cones_nb;
+	auto const padded_cones_nb = (cones_nb + 3u) & ~std::size_t(3u);
+	for (auto* const values : { &_apex_x, &_apex_y, &_apex_z, &_direction_x, &_direction_y, &_direction_z, &_length, &_base_radius })
+		values->resize(padded_cones_nb, 0.0f);
+}
+
+std::size_t LightCones::size() const
+{
+	return _cones_nb;
+}
+
+void LightCones::set_cone(std::size_t const cone, glm::vec3 const& apex, glm::vec3 const& direction, float const length, float const base_radius)
+{
+	_apex_x[cone] = apex.x;
+	_apex_y[cone] = apex.y;
+	_apex_z[cone] = apex.z;
+	_direction_x[cone] = direction.x;
+	_direction_y[cone] = direction.y;
+	_direction_z[cone] = direction.z;
+	_length[cone] = length;
+	_base_radius[cone] = base_radius;
+}
+
+void cull_light_cones(glm::mat4 const& world_to_clip, glm::ivec2 const& viewport_size,
+                      LightCones const& cones, std::vector<LightConeBounds>& bounds)
+{
+	bounds.assign(cones.size(), LightConeBounds());
+
+	auto const planes = extractFrustumPlanes(world_to_clip);
+	Float4 const zero(0.0f);
+	Float4 const one(1.0f);
+	Float4 const half(0.5f);
+
+	for (std::size_t first = 0; first < cones.size(); first += 4u) {
+		Vec4x4 const apex = { Float4::load(&cones._apex_x[first]), Float4::load(&cones._apex_y[first]), Float4::load(&cones._apex_z[first]) };
+		Vec4x4 const direction = { Float4::load(&cones._direction_x[first]), Float4::load(&cones._direction_y[first]), Float4::load(&cones._direction_z[first]) };
+		auto const length = Float4::load(&cones._length[first]);
+		auto const base_radius = Float4::load(&cones._base_radius[first]);
+		auto const base_center = apex + direction * length;
+
+		//
+		// A cone is outside of a plane when both its apex and the point of
+		// its base furthest along the plane's normal are.
+		//
+		auto is_outside = no_lanes();
+		for (auto const& plane : planes) {
+			Vec4x4 const normal = { Float4(plane.x), Float4(plane.y), Float4(plane.z) };
+			auto const apex_distance = dot(normal, apex) + Float4(plane.w);
+			auto const cos_angle = dot(normal, direction);
+			auto const sin_angle = sqrt(max(one - cos_angle * cos_angle, zero));
+			auto const base_distance = apex_distance + length * cos_angle + base_radius * sin_angle;
+			is_outside = is_outside | ((apex_distance < zero) & (base_distance < zero));
+		}
+
+		//
+		// Project the apex and the corners of the square circumscribing the
+		// base, spanned by two vectors orthogonal to the direction.
+		//
+		auto const is_mostly_vertical = Float4(0.9f) <= max(direction.y, zero - direction.y);
+		Vec4x4 const helper = { select(is_mostly_vertical, one, zero), select(is_mostly_vertical, zero, one), zero };
+		Vec4x4 tangent = { direction.y * helper.z - direction.z * helper.y,
+		                   direction.z * helper.x - direction.x * helper.z,
+		                   direction.x * helper.y - direction.y * helper.x };
+		tangent = tangent * (base_radius / sqrt(dot(tangent, tangent)));
+		Vec4x4 const bitangent = { direction.y * tangent.z - direction.z * tangent.y,
+		                           direction.z * tangent.x - direction.x * tangent.z,
+		                           direction.x * tangent.y - direction.y * tangent.x };
+
+		std::array<Vec4x4, 5> const points = {{
+			apex,
+			base_center + tangent + bitangent,
+			base_center + tangent + bitangent * Float4(-1.0f),
+			base_center + tangent * Float4(-1.0f) + bitangent,
+			base_center + tangent * Float4(-1.0f) + bitangent * Float4(-1.0f)
+		}};
+
+		Float4 min_x(1.0f), min_y(1.0f), min_z(1.0f);
+		Float4 max_x(-1.0f), max_y(-1.0f), max_z(-1.0f);
+		bool first_point = true;
+		auto is_crossing_camera_plane = no_lanes();
+		for (auto const& point : points) {
+			auto const transform_row = [&world_to_clip, &point](int index){
+				return Float4(world_to_clip[0][index]) * point.x + Float4(world_to_clip[1][index]) * point.y
+				     + Float4(world_to_clip[2][index]) * point.z + Float4(world_to_clip[3][index]);
+			};
+			auto const w = transform_row(3);
+			is_crossing_camera_plane = is_crossing_camera_plane | (w <= Float4(1.0e-6f));
+			auto const inverse_w = one / max(w, Float4(1.0e-6f));
+			auto const x = transform_row(0) * inverse_w;
+			auto const y = transform_row(1) * inverse_w;
+			auto const z = transform_row(2) * inverse_w;
+			min_x = first_point ? x : min(min_x, x);
+			min_y = first_point ? y : min(min_y, y);
+			min_z = first_point ? z : min(min_z, z);
+			max_x = first_point ? x : max(max_x, x);
+			max_y = first_point ? y : max(max_y, y);
+			max_z = first_point ? z : max(max_z, z);
+			first_point = false;
+		}
+
+		// From normalised device coordinates to window coordinates.
+		auto const to_window = [&](Float4 value){ return min(max(value * half + half, zero), one); };
+		std::array<float, 4> window_min_x, window_min_y, window_min_z, window_max_x, window_max_y, window_max_z;
+		to_window(min_x).store(window_min_x.data());
+		to_window(min_y).store(window_min_y.data());
+		to_window(min_z).store(window_min_z.data());
+		to_window(max_x).store(window_max_x.data());
+		to_window(max_y).store(window_max_y.data());
+		to_window(max_z).store(window_max_z.data());
+
+		auto const lanes_nb = static_cast<int>(std::min<std::size_t>(4u, cones.size() - first));
+		for (int i = 0; i < lanes_nb; ++i) {
+			auto& cone_bounds = bounds[first + static_cast<std::size_t>(i)];
+			if (lane(is_outside, i))
+				continue;
+
+			if (lane(is_crossing_camera_plane, i)) {
+				cone_bounds.is_visible = true;
+				cone_bounds.scissor_box = glm::ivec4(0, 0, viewport_size.x, viewport_size.y);
+				cone_bounds.depth_bounds = glm::vec2(0.0f, 1.0f);
+				continue;
+			}
+
+			auto const x0 = static_cast<int>(std::floor(window_min_x[i] * static_cast<float>(viewport_size.x)));
+			auto const y0 = static_cast<int>(std::floor(window_min_y[i] * static_cast<float>(viewport_size.y)));
+			auto const x1 = static_cast<int>(std::ceil(window_max_x[i] * static_cast<float>(viewport_size.x)));
+			auto const y1 = static_cast<int>(std::ceil(window_max_y[i] * static_cast<float>(viewport_size.y)));
+			if (x1 <= x0 || y1 <= y0)
+				continue;
+
+			cone_bounds.is_visible = true;
+			cone_bounds.scissor_box = glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+			cone_bounds.depth_bounds = glm::vec2(window_min_z[i], window_max_z[i]);
+		}
+	}
+}
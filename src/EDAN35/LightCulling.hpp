@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstddef>
+#include <vector>
+
+//! \brief Part of the screen a light cone can affect.
+struct LightConeBounds
+{
+	bool is_visible{ false };       //!< whether the cone intersects the view frustum at all
+	glm::ivec4 scissor_box{ 0 };    //!< x, y, width and height, in pixels
+	glm::vec2 depth_bounds{ 0.0f, 1.0f }; //!< range of window-space depths
+};
+
+//! \brief Light cones, each described by its apex, the direction it
+//!        opens towards, its length and the radius of its base.
+//!
+//! Each component is stored in its own array, padded to a multiple of
+//! four cones, so that `cull_light_cones()` can process four cones at
+//! once with SIMD instructions.
+class LightCones
+{
+public:
+	void resize(std::size_t cones_nb);
+	std::size_t size() const;
+
+	//! \brief Set the cone at index `cone`; `direction` has to be
+	//!        normalised.
+	void set_cone(std::size_t cone, glm::vec3 const& apex, glm::vec3 const& direction, float length, float base_radius);
+
+private:
+	friend void cull_light_cones(glm::mat4 const& world_to_clip, glm::ivec2 const& viewport_size,
+	                             LightCones const& cones, std::vector<LightConeBounds>& bounds);
+
+	std::size_t _cones_nb{ 0u };
+	std::vector<float> _apex_x, _apex_y, _apex_z;
+	std::vector<float> _direction_x, _direction_y, _direction_z;
+	std::vector<float> _length, _base_radius;
+};
+
+//! \brief Test light cones against the view frustum, and compute the
+//!        screen-space rectangle and depth range of the visible ones.
+//!
+//! The bounds are conservative: they are computed from the apex and the
+//! corners of the square circumscribing the base of each cone. Cones
+//! crossing the plane of the camera cover the whole viewport and depth
+//! range.
+//!
+//! @param [in] world_to_clip view-projection of the camera
+//! @param [in] viewport_size size in pixels of the viewport the cones are
+//!             rendered to
+//! @param [in] cones the cones to test
+//! @param [out] bounds filled in with one entry per cone
+void cull_light_cones(glm::mat4 const& world_to_clip, glm::ivec2 const& viewport_size,
+                      LightCones const& cones, std::vector<LightConeBounds>& bounds);
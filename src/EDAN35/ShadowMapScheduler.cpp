@@ -0,0 +1,199 @@
+#include "ShadowMapScheduler.hpp"
+
+#include "core/Log.h"
+
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace
+{
+	// Matrices are recomputed every frame, so they are compared with some
+	// tolerance to ignore rounding differences.
+	bool areMatricesSimilar(glm::mat4 const& lhs, glm::mat4 const& rhs)
+	{
+		for (int column = 0; column < 4; ++column)
+			for (int row = 0; row < 4; ++row) {
+				auto const tolerance = 1.0e-5f * std::max(1.0f, std::abs(lhs[column][row]));
+				if (std::abs(lhs[column][row] - rhs[column][row]) > tolerance)
+					return false;
+			}
+		return true;
+	}
+
+	// How much a new measurement weighs in the estimated cost of an update.
+	double const cost_smoothing_factor = 0.2;
+}
+
+ShadowMapScheduler::ShadowMapScheduler(std::size_t const lights_nb) :
+	_shadow_maps(lights_nb)
+{
+	_scheduled_lights.reserve(lights_nb);
+}
+
+void ShadowMapScheduler::update_light(std::size_t const light, glm::mat4 const& world_to_clip, glm::uvec2 const& resolution)
+{
+	auto& shadow_map = _shadow_maps[light];
+	shadow_map.world_to_clip = world_to_clip;
+	shadow_map.resolution = resolution;
+	if (!areMatricesSimilar(shadow_map.rendered_world_to_clip, world_to_clip)
+	    || shadow_map.rendered_resolution != resolution)
+		mark_dirty(shadow_map);
+}
+
+void ShadowMapScheduler::invalidate(std::size_t const light)
+{
+	mark_dirty(_shadow_maps[light]);
+}
+
+void ShadowMapScheduler::set_visible(std::size_t const light, bool const is_visible)
+{
+	_shadow_maps[light].is_visible = is_visible;
+}
+
+void ShadowMapScheduler::invalidate_all()
+{
+	for (auto& shadow_map : _shadow_maps)
+		mark_dirty(shadow_map);
+}
+
+void ShadowMapScheduler::invalidate_bounds(glm::vec3 const& min_corner, glm::vec3 const& max_corner)
+{
+	std::array<glm::vec4, 8> corners;
+	for (std::size_t i = 0; i < corners.size(); ++i)
+		corners[i] = glm::vec4((i & 1u) ? max_corner.x : min_corner.x,
+		                       (i & 2u) ? max_corner.y : min_corner.y,
+		                       (i & 4u) ? max_corner.z : min_corner.z,
+		                       1.0f);
+
+	for (auto& shadow_map : _shadow_maps) {
+		// The box is outside of the frustum if all its corners are on the
+		// outer side of a same clipping plane.
+		std::array<glm::vec4, 8> clip_corners;
+		for (std::size_t i = 0; i < corners.size(); ++i)
+			clip_corners[i] = shadow_map.rendered_world_to_clip * corners[i];
+
+		bool is_outside = false;
+		for (int axis = 0; axis < 3 && !is_outside; ++axis) {
+			is_outside = std::all_of(clip_corners.begin(), clip_corners.end(), [axis](glm::vec4 const& corner){ return corner[axis] >  corner.w; })
+			          || std::all_of(clip_corners.begin(), clip_corners.end(), [axis](glm::vec4 const& corner){ return corner[axis] < -corner.w; });
+		}
+		if (!is_outside)
+			mark_dirty(shadow_map);
+	}
+}
+
+std::vector<std::size_t> const& ShadowMapScheduler::schedule(std::size_t const active_lights_nb)
+{
+	++_frame_index;
+	_scheduled_lights.clear();
+
+	auto const lights_nb = std::min(active_lights_nb, _shadow_maps.size());
+	for (std::size_t i = 0; i < lights_nb; ++i)
+		if (_shadow_maps[i].is_visible && (_shadow_maps[i].is_dirty || !_is_caching_enabled))
+			_scheduled_lights.push_back(i);
+
+	if (_is_caching_enabled) {
+		// Oldest updates first; the sort is stable so that lights that
+		// became dirty at the same time are updated in order.
+		std::stable_sort(_scheduled_lights.begin(), _scheduled_lights.end(),
+		                 [this](std::size_t const lhs, std::size_t const rhs){
+			return _shadow_maps[lhs].dirty_since < _shadow_maps[rhs].dirty_since;
+		});
+
+		auto const budget_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(_budget).count());
+		std::size_t updates_nb = 1u;
+		while (updates_nb < _scheduled_lights.size()
+		       && static_cast<double>(updates_nb + 1u) * _estimated_update_cost_ns <= budget_ns)
+			++updates_nb;
+		_pending_updates_nb = _scheduled_lights.size() - std::min(updates_nb, _scheduled_lights.size());
+		_scheduled_lights.resize(std::min(updates_nb, _scheduled_lights.size()));
+	} else {
+		_pending_updates_nb = 0u;
+	}
+
+	for (auto const light : _scheduled_lights) {
+		auto& shadow_map = _shadow_maps[light];
+		shadow_map.rendered_world_to_clip = shadow_map.world_to_clip;
+		shadow_map.rendered_resolution = shadow_map.resolution;
+		shadow_map.is_dirty = false;
+	}
+
+	return _scheduled_lights;
+}
+
+void ShadowMapScheduler::report_gpu_time(std::size_t const updated_maps_nb, std::chrono::nanoseconds const elapsed_time)
+{
+	if (updated_maps_nb == 0u)
+		return;
+
+	auto const update_cost_ns = static_cast<double>(elapsed_time.count()) / static_cast<double>(updated_maps_nb);
+	if (_has_estimated_update_cost) {
+		_estimated_update_cost_ns += cost_smoothing_factor * (update_cost_ns - _estimated_update_cost_ns);
+	} else {
+		_estimated_update_cost_ns = update_cost_ns;
+		_has_estimated_update_cost = true;
+	}
+}
+
+void ShadowMapScheduler::set_budget(std::chrono::microseconds const budget)
+{
+	if (budget.count() < 0) {
+		LogError("The shadow map update budget can not be negative.");
+		return;
+	}
+
+	_budget = budget;
+}
+
+std::chrono::microseconds ShadowMapScheduler::get_budget() const
+{
+	return _budget;
+}
+
+void ShadowMapScheduler::set_caching_enabled(bool const is_enabled)
+{
+	_is_caching_enabled = is_enabled;
+}
+
+bool ShadowMapScheduler::is_caching_enabled() const
+{
+	return _is_caching_enabled;
+}
+
+glm::mat4 const& ShadowMapScheduler::get_rendered_world_to_clip(std::size_t const light) const
+{
+	return _shadow_maps[light].rendered_world_to_clip;
+}
+
+glm::uvec2 const& ShadowMapScheduler::get_rendered_resolution(std::size_t const light) const
+{
+	return _shadow_maps[light].rendered_resolution;
+}
+
+bool ShadowMapScheduler::is_dirty(std::size_t const light) const
+{
+	return _shadow_maps[light].is_dirty;
+}
+
+std::size_t ShadowMapScheduler::get_pending_updates_nb() const
+{
+	return _pending_updates_nb;
+}
+
+std::chrono::nanoseconds ShadowMapScheduler::get_estimated_update_cost() const
+{
+	return std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(_estimated_update_cost_ns));
+}
+
+void ShadowMapScheduler::mark_dirty(ShadowMap& shadow_map)
+{
+	// A map that was already dirty keeps its place in the queue.
+	if (shadow_map.is_dirty)
+		return;
+
+	shadow_map.is_dirty = true;
+	shadow_map.dirty_since = _frame_index;
+}
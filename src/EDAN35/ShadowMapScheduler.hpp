@@ -0,0 +1,133 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! \brief Decides which shadow maps need to be re-rendered each frame.
+//!
+//! Shadow maps are kept from one frame to the next, and one is only
+//! re-rendered when it became dirty: either the view-projection or the
+//! resolution of its light changed, or it was explicitly invalidated, for
+//! example because geometry inside the light's frustum moved.
+//!
+//! When more maps are dirty than fit in the GPU-time budget, updates are
+//! spread over several frames, the maps which have been dirty for the
+//! longest going first. The cost of updating a map is estimated from the
+//! GPU times reported with `report_gpu_time()`. At least one dirty map is
+//! updated every frame, so that all of them eventually get updated however
+//! small the budget.
+//!
+//! As a map that was not updated still holds what its light saw at the
+//! time of its last update, lookups into it have to use the
+//! view-projection and resolution it was rendered with, as given by
+//! `get_rendered_world_to_clip()` and `get_rendered_resolution()`, rather
+//! than the light's current ones.
+//!
+//! A typical frame looks like:
+//!
+//! \code{.cpp}
+//! for (std::size_t i = 0; i < lights_nb; ++i)
+//! 	scheduler.update_light(i, light_world_to_clip[i], light_resolution[i]);
+//! for (auto const light : scheduler.schedule(lights_nb))
+//! 	// Clear and render the shadow map of `light`.
+//! // Use `scheduler.get_rendered_world_to_clip(i)` for shadow lookups.
+//! // Later on, once the GPU time of the updates is known:
+//! scheduler.report_gpu_time(updated_maps_nb, elapsed_time);
+//! \endcode
+class ShadowMapScheduler
+{
+public:
+	//! \brief Create a scheduler for up to `lights_nb` lights, whose
+	//!        shadow maps all start dirty.
+	explicit ShadowMapScheduler(std::size_t lights_nb);
+
+	//! \brief Give the current view-projection of a light, and the
+	//!        resolution its shadow map should have, marking the map dirty
+	//!        if either differs from what it was rendered with.
+	void update_light(std::size_t light, glm::mat4 const& world_to_clip, glm::uvec2 const& resolution);
+
+	//! \brief Mark the shadow map of a light dirty.
+	void invalidate(std::size_t light);
+
+	//! \brief Lights whose influence cannot be seen, for example because
+	//!        their cone lies outside of the view, get their updates
+	//!        deferred until they become visible again.
+	void set_visible(std::size_t light, bool is_visible);
+
+	//! \brief Mark all shadow maps dirty, for example after reloading the
+	//!        shaders.
+	void invalidate_all();
+
+	//! \brief Mark dirty the shadow maps whose frustum overlaps a
+	//!        world-space box, for example because geometry inside of it
+	//!        moved.
+	void invalidate_bounds(glm::vec3 const& min_corner, glm::vec3 const& max_corner);
+
+	//! \brief Select which shadow maps to update this frame; they are
+	//!        considered up-to-date as soon as this returns.
+	//!
+	//! @param [in] active_lights_nb only lights with an index below that
+	//!             are considered
+	//! @return the indices of the lights whose shadow map should be
+	//!         rendered this frame
+	std::vector<std::size_t> const& schedule(std::size_t active_lights_nb);
+
+	//! \brief Report how long the GPU took to update `updated_maps_nb`
+	//!        shadow maps, to refine the estimated cost of an update.
+	void report_gpu_time(std::size_t updated_maps_nb, std::chrono::nanoseconds elapsed_time);
+
+	//! \brief Set how much GPU time the updates of a frame should fit in.
+	void set_budget(std::chrono::microseconds budget);
+	std::chrono::microseconds get_budget() const;
+
+	//! \brief When caching is disabled, all active shadow maps are updated
+	//!        every frame, regardless of them being dirty.
+	void set_caching_enabled(bool is_enabled);
+	bool is_caching_enabled() const;
+
+	//! \brief View-projection the shadow map of `light` was last rendered
+	//!        with.
+	glm::mat4 const& get_rendered_world_to_clip(std::size_t light) const;
+
+	//! \brief Resolution the shadow map of `light` was last rendered with.
+	glm::uvec2 const& get_rendered_resolution(std::size_t light) const;
+
+	bool is_dirty(std::size_t light) const;
+
+	//! \brief Number of active and visible shadow maps left dirty by the
+	//!        last call to `schedule()`.
+	std::size_t get_pending_updates_nb() const;
+
+	//! \brief Current estimate of the GPU time needed to update a single
+	//!        shadow map.
+	std::chrono::nanoseconds get_estimated_update_cost() const;
+
+private:
+	struct ShadowMap {
+		glm::mat4 world_to_clip{ 1.0f };           //!< latest view-projection given for the light
+		glm::mat4 rendered_world_to_clip{ 1.0f };  //!< view-projection the map was last rendered with
+		glm::uvec2 resolution{ 0u };                //!< latest resolution given for the light
+		glm::uvec2 rendered_resolution{ 0u };       //!< resolution the map was last rendered with
+		bool is_dirty{ true };
+		bool is_visible{ true };
+		std::uint64_t dirty_since{ 0u };  //!< frame at which the map became dirty
+	};
+
+	void mark_dirty(ShadowMap& shadow_map);
+
+	std::vector<ShadowMap> _shadow_maps;
+	std::vector<std::size_t> _scheduled_lights;
+	std::uint64_t _frame_index{ 0u };
+	std::size_t _pending_updates_nb{ 0u };
+
+	std::chrono::microseconds _budget{ 1000 };
+	bool _is_caching_enabled{ true };
+	double _estimated_update_cost_ns{ 0.0 };
+	bool _has_estimated_update_cost{ false };
+};
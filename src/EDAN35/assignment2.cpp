@@ -3,14 +3,26 @@
 #define GLM_FORCE_PURE 1
 
 #include "assignment2.hpp"
+#include "DynamicResolution.hpp"
+#include "LightCulling.hpp"
+#include "ShadowMapScheduler.hpp"
 
 #include "config.hpp"
 #include "core/Bonobo.h"
+#include "core/CommandList.hpp"
 #include "core/FPSCamera.h"
+#include "core/FrameCapture.hpp"
+#include "core/FrameDataRing.hpp"
+#include "core/FrameGraph.hpp"
 #include "core/helpers.hpp"
 #include "core/node.hpp"
+#include "core/OcclusionCuller.hpp"
 #include "core/opengl.hpp"
+#include "core/Profiler.h"
 #include "core/ShaderProgramManager.hpp"
+#include "core/SimulationScheduler.hpp"
+#include "core/SnapshotBuffer.hpp"
+#include "core/ThreadPool.hpp"
 
 #include <imgui.h>
 #include <glm/glm.hpp>
@@ -18,21 +30,48 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <tinyfiledialogs.h>
 
+#include <algorithm>
 #include <array>
 #include <clocale>
+#include <cmath>
 #include <cstdlib>
+#include <limits>
 #include <stdexcept>
+#include <utility>
 
 namespace constant
 {
+	constexpr int levels_nb(uint32_t size)
+	{
+		return size <= 1u ? 1 : 1 + levels_nb(size >> 1u);
+	}
+
 	constexpr uint32_t shadowmap_res_x = 1024;
 	constexpr uint32_t shadowmap_res_y = 1024;
+	// Shadow maps only use part of their layer, down to 1/2^shadowmap_max_lod
+	// of the resolution above along each axis, depending on how much of the
+	// screen their light covers.
+	constexpr int      shadowmap_max_lod = 3;
+	// The filtered shadow maps get a full mipmap chain, down to 1 x 1.
+	constexpr int      shadow_moments_levels_nb = levels_nb(shadowmap_res_x > shadowmap_res_y ? shadowmap_res_x : shadowmap_res_y);
 
 	constexpr float  scale_lengths       = 100.0f; // The scene is expressed in centimetres rather than metres, hence the x100.
 
 	constexpr size_t lights_nb           = 4;
 	constexpr float  light_intensity     = 72.0f * (scale_lengths * scale_lengths);
 	constexpr float  light_angle_falloff = glm::radians(37.0f);
+
+	// The clustered lights are binned into clusters made of screen-space
+	// tiles of `cluster_tile_size` pixels, each split into
+	// `cluster_depth_slices_nb` slices along the view direction.
+	constexpr uint32_t clustered_lights_max_nb   = 4096;
+	constexpr uint32_t cluster_tile_size         = 32;
+	constexpr uint32_t cluster_depth_slices_nb   = 16;
+	constexpr uint32_t cluster_average_lights_nb = 64; // Used for sizing the list of light indices shared by all clusters.
+
+	// Size of a DrawElementsIndirectCommand; non-indexed meshes use the
+	// first four values of theirs as a DrawArraysIndirectCommand.
+	constexpr size_t indirect_draw_command_size = 5 * sizeof(GLuint);
 }
 
 namespace
@@ -42,19 +81,105 @@ namespace
 		return static_cast<std::underlying_type_t<E>>(e);
 	}
 
-	enum class Texture : uint32_t {
-		DepthBuffer = 0u,
-		ShadowMap,
-		GBufferDiffuse,
-		GBufferSpecular,
-		GBufferWorldSpaceNormal,
-		LightDiffuseContribution,
-		LightSpecularContribution,
-		Result,
+	enum class NormalEncoding : int {
+		RemappedXYZ8 = 0, // XYZ remapped to [0, 1], in RGBA8
+		Octahedral8,      // octahedral encoding, in RG8
+		Octahedral16,     // octahedral encoding, in RG16
 		Count
 	};
-	using Textures = std::array<GLuint, toU(Texture::Count)>;
-	Textures createTextures(GLsizei framebuffer_width, GLsizei framebuffer_height);
+	enum class LightAccumulationFormat : int {
+		RGBA8 = 0,  // clamped to [0, 1]
+		RGBA16F,
+		R11G11B10F,
+		Count
+	};
+	// How many times smaller than the G-buffer the light accumulation
+	// textures are along each axis, as a power of two.
+	enum class LightAccumulationResolution : int {
+		Full = 0,
+		Half,
+		Quarter,
+		Count
+	};
+
+	// How the shadow maps are sampled: either directly, or through moments
+	// of their depth, which get blurred and can then be filtered by the
+	// hardware, mipmaps included.
+	enum class ShadowFiltering : int {
+		Depth = 0,    // single depth comparison
+		Variance,     // depth and squared depth, bounding the visibility
+		Exponential,  // exponential of the depth
+		Count
+	};
+
+	struct TextureFormat
+	{
+		GLenum internal_format;
+		GLenum format;
+		GLenum type;
+		size_t bytes_per_pixel;
+	};
+	// Indexed by NormalEncoding.
+	std::array<TextureFormat, toU(NormalEncoding::Count)> const normal_formats = {{
+		{ GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,  4u },
+		{ GL_RG8,   GL_RG,   GL_UNSIGNED_BYTE,  2u },
+		{ GL_RG16,  GL_RG,   GL_UNSIGNED_SHORT, 4u }
+	}};
+	// Indexed by LightAccumulationFormat.
+	std::array<TextureFormat, toU(LightAccumulationFormat::Count)> const light_accumulation_formats = {{
+		{ GL_RGBA8,          GL_RGBA, GL_UNSIGNED_BYTE, 4u },
+		{ GL_RGBA16F,        GL_RGBA, GL_HALF_FLOAT,    8u },
+		{ GL_R11F_G11F_B10F, GL_RGB,  GL_FLOAT,         4u }
+	}};
+	TextureFormat const color_format         = { GL_RGBA8,              GL_RGBA,            GL_UNSIGNED_BYTE, 4u };
+	TextureFormat const depth_stencil_format = { GL_DEPTH24_STENCIL8,   GL_DEPTH_COMPONENT, GL_FLOAT,         4u };
+	TextureFormat const depth_bounds_format  = { GL_RG32F,              GL_RG,              GL_FLOAT,         8u };
+	TextureFormat const shadow_map_format    = { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT,         4u };
+	// Indexed by ShadowFiltering; unfiltered shadow maps have no moments.
+	std::array<TextureFormat, toU(ShadowFiltering::Count)> const shadow_moments_formats = {{
+		{ GL_NONE,  GL_NONE, GL_NONE,  0u },
+		{ GL_RG32F, GL_RG,   GL_FLOAT, 8u },
+		{ GL_R32F,  GL_RED,  GL_FLOAT, 4u }
+	}};
+
+	// How the G-buffer and light accumulation textures are stored, trading
+	// precision for memory bandwidth.
+	struct GBufferLayout
+	{
+		NormalEncoding normal_encoding{ NormalEncoding::RemappedXYZ8 };
+		// Store the specular intensity in the alpha channel of the diffuse
+		// texture, rather than a specular colour in its own texture.
+		bool pack_specular{ false };
+		LightAccumulationFormat light_accumulation_format{ LightAccumulationFormat::RGBA8 };
+		LightAccumulationResolution light_accumulation_resolution{ LightAccumulationResolution::Full };
+	};
+
+	// Size of the light accumulation textures matching a G-buffer of `size`
+	// pixels along one axis.
+	int getLightAccumulationSize(int size, LightAccumulationResolution resolution);
+
+	// Bytes per pixel written and read, from and to the G-buffer, depth
+	// buffer and light accumulation textures, by the different passes.
+	// Passes working at a lower resolution are accounted for per
+	// full-resolution pixel, hence the fractional amounts.
+	struct GBufferTraffic
+	{
+		float gbuffer_written{ 0.0f };
+		float gbuffer_read{ 0.0f };
+		float downsample_written{ 0.0f };
+		float downsample_read{ 0.0f };
+		float light_written{ 0.0f }; // per light, assuming it covers the pixel
+		float light_read{ 0.0f };
+		float clusters_written{ 0.0f };
+		float clusters_read{ 0.0f };
+		float resolve_written{ 0.0f };
+		float resolve_read{ 0.0f };
+	};
+	GBufferTraffic computeGBufferTraffic(GBufferLayout const& layout);
+
+	// Description of a texture sized relative to the framebuffer, for the
+	// frame graph.
+	FrameGraph::TextureDescription describeTexture(std::string const& name, TextureFormat const& format, GLsizei size_divisor = 1);
 
 	enum class Sampler : uint32_t {
 		Nearest = 0u,
@@ -65,37 +190,31 @@ namespace
 	using Samplers = std::array<GLuint, toU(Sampler::Count)>;
 	Samplers createSamplers();
 
-	enum class FBO : uint32_t {
-		GBuffer = 0u,
-		ShadowMap,
-		LightAccumulation,
-		Resolve,
-		FinalWithDepth,
-		Count
-	};
-	using FBOs = std::array<GLuint, toU(FBO::Count)>;
-	FBOs createFramebufferObjects(Textures const& textures);
-
-	enum class ElapsedTimeQuery : uint32_t {
-		GbufferGeneration = 0u,
-		ShadowMap0Generation,
-		Light0Accumulation = ShadowMap0Generation + static_cast<uint32_t>(constant::lights_nb),
-		Resolve = Light0Accumulation + static_cast<uint32_t>(constant::lights_nb),
-		ConeWireframe,
-		GUI,
-		CopyToFramebuffer,
-		Count
-	};
-	using ElapsedTimeQueries = std::array<GLuint, toU(ElapsedTimeQuery::Count)>;
-	ElapsedTimeQueries createElapsedTimeQueries();
-
+	// Binding points of the uniform blocks whose content changes every
+	// frame; their data is sub-allocated from a `FrameDataRing`.
 	enum class UBO : uint32_t {
 		CameraViewProjTransforms = 0u,
 		LightViewProjTransforms,
 		Count
 	};
-	using UBOs = std::array<GLuint, toU(UBO::Count)>;
-	UBOs createUniformBufferObjects();
+
+	// The uniform buffer describing where the material textures are located
+	// is created when loading the scene, and bound right after the ones
+	// above.
+	constexpr GLuint material_texture_layers_binding = toU(UBO::Count);
+
+	// Binding points of the shader storage blocks used by the clustered
+	// lighting path and by the occlusion culling of the meshes.
+	enum class SSBO : uint32_t {
+		ClusteredLights = 0u,
+		ClusterLightRanges,
+		ClusterLightIndices,
+		OcclusionBounds,
+		OcclusionVisibility,
+		OcclusionDrawCommands,
+		OcclusionStatistics,
+		Count
+	};
 
 	struct ViewProjTransforms
 	{
@@ -103,40 +222,86 @@ namespace
 		glm::mat4 view_projection_inverse = glm::mat4(1.0f);
 	};
 
-	struct GeometryTextureData
+	// Matches the layout of `ClusteredLight` in the clustered lighting
+	// shaders; the position is given in view space.
+	struct ClusteredLight
+	{
+		glm::vec4 view_position_and_radius = glm::vec4(0.0f);
+		glm::vec4 color_and_intensity = glm::vec4(0.0f);
+	};
+
+	// The buffers filled in by the binning pass and read by the shading
+	// pass, sized for a given framebuffer resolution.
+	struct ClusterGrid
+	{
+		glm::uvec3 clusters_nb{ 0u };
+		GLuint light_ranges{ 0u };
+		GLuint light_indices{ 0u };
+		GLuint light_indices_capacity{ 0u };
+	};
+	ClusterGrid createClusterGrid(GLsizei framebuffer_width, GLsizei framebuffer_height);
+
+	// Max-depth pyramid of the depth buffer, starting at half the
+	// framebuffer resolution and rounding up, down to a single texel; each
+	// level has its own framebuffer for being rendered to.
+	struct HiZPyramid
+	{
+		GLuint texture{ 0u };
+		std::vector<GLuint> framebuffers;
+	};
+	HiZPyramid createHiZPyramid(GLsizei framebuffer_width, GLsizei framebuffer_height);
+	void deleteHiZPyramid(HiZPyramid& pyramid);
+
+	// The buffers used for culling the meshes on the GPU: the bounding box
+	// of each mesh, whether the first phase kept it, one indirect draw
+	// command per mesh for each phase, and a ring of counters of the
+	// meshes drawn by each phase, read back a few frames later.
+	struct OcclusionCullingBuffers
 	{
-		GLuint diffuse_texture_id{ 0u };
-		GLuint specular_texture_id{ 0u };
-		GLuint normals_texture_id{ 0u };
-		GLuint opacity_texture_id{ 0u };
+		GLuint bounds{ 0u };
+		GLuint visibility{ 0u };
+		std::array<GLuint, 2> draw_commands{ { 0u, 0u } };
+		std::vector<GLuint> statistics;
 	};
+	OcclusionCullingBuffers createOcclusionCullingBuffers(std::vector<bonobo::mesh_data> const& meshes, size_t statistics_frames_nb);
+	void deleteOcclusionCullingBuffers(OcclusionCullingBuffers& buffers);
 
 	struct GBufferShaderLocations
 	{
 		GLuint ubo_CameraViewProjTransforms{ 0u };
 		GLuint vertex_model_to_world{ 0u };
 		GLuint normal_model_to_world{ 0u };
-		GLuint diffuse_texture{ 0u };
-		GLuint specular_texture{ 0u };
-		GLuint normals_texture{ 0u };
-		GLuint opacity_texture{ 0u };
-		GLuint has_diffuse_texture{ 0u };
-		GLuint has_specular_texture{ 0u };
-		GLuint has_normals_texture{ 0u };
-		GLuint has_opacity_texture{ 0u };
+		GLuint ubo_MaterialTextureLayers{ 0u };
+		GLuint material_textures{ 0u };
+		GLuint material_index{ 0u };
+		GLuint use_octahedral_normals{ 0u };
+		GLuint is_specular_packed{ 0u };
 	};
 	void fillGBufferShaderLocations(GLuint gbuffer_shader, GBufferShaderLocations& locations);
 
 	struct FillShadowmapShaderLocations
 	{
 		GLuint ubo_LightViewProjTransforms{ 0u };
-		GLuint light_index{ 0u };
+		GLuint updated_lights{ 0u };
 		GLuint vertex_model_to_world{ 0u };
-		GLuint opacity_texture{ 0u };
-		GLuint has_opacity_texture{ 0u };
+		GLuint ubo_MaterialTextureLayers{ 0u };
+		GLuint material_textures{ 0u };
+		GLuint material_index{ 0u };
 	};
 	void fillShadowmapShaderLocations(GLuint shadowmap_shader, FillShadowmapShaderLocations& locations);
 
+	// Shared by the opaque and alpha-tested depth pre-pass programs; the
+	// opaque one has no material uniforms.
+	struct FillDepthShaderLocations
+	{
+		GLuint ubo_CameraViewProjTransforms{ 0u };
+		GLuint vertex_model_to_world{ 0u };
+		GLuint ubo_MaterialTextureLayers{ 0u };
+		GLuint material_textures{ 0u };
+		GLuint material_index{ 0u };
+	};
+	void fillDepthShaderLocations(GLuint depth_shader, FillDepthShaderLocations& locations);
+
 	struct AccumulateLightsShaderLocations
 	{
 		GLuint ubo_CameraViewProjTransforms{ 0u };
@@ -148,8 +313,16 @@ namespace
 		GLuint depth_texture{ 0u };
 		GLuint normal_texture{ 0u };
 		GLuint shadow_texture{ 0u };
+		GLuint shadowmap_scale{ 0u };
+		GLuint shadow_filtering{ 0u };
+		GLuint shadow_moments_texture{ 0u };
+		GLuint shadow_depth_range{ 0u };
+		GLuint esm_exponent{ 0u };
+		GLuint vsm_light_bleeding_reduction{ 0u };
+		GLuint use_octahedral_normals{ 0u };
 		GLuint camera_position{ 0u };
 		GLuint inverse_screen_resolution{ 0u };
+		GLuint render_target_scale{ 0u };
 		GLuint light_color{ 0u };
 		GLuint light_position{ 0u };
 		GLuint light_direction{ 0u };
@@ -158,7 +331,72 @@ namespace
 	};
 	void fillAccumulateLightsShaderLocations(GLuint accumulate_lights_shader, AccumulateLightsShaderLocations& locations);
 
+	struct ClusterLightsShaderLocations
+	{
+		GLuint lights_nb{ 0u };
+		GLuint light_indices_capacity{ 0u };
+		GLuint clusters_nb{ 0u };
+		GLuint tile_size{ 0u };
+		GLuint inverse_screen_resolution{ 0u };
+		GLuint clip_to_view{ 0u };
+		GLuint z_near{ 0u };
+		GLuint z_far{ 0u };
+	};
+	void fillClusterLightsShaderLocations(GLuint cluster_lights_shader, ClusterLightsShaderLocations& locations);
+
+	struct ShadeClustersShaderLocations
+	{
+		GLuint depth_texture{ 0u };
+		GLuint normal_texture{ 0u };
+		GLuint clusters_nb{ 0u };
+		GLuint tile_size{ 0u };
+		GLuint inverse_screen_resolution{ 0u };
+		GLuint clip_to_view{ 0u };
+		GLuint world_to_view{ 0u };
+		GLuint z_near{ 0u };
+		GLuint z_far{ 0u };
+		GLuint use_octahedral_normals{ 0u };
+		GLuint light_accumulation_format{ 0u };
+	};
+	void fillShadeClustersShaderLocations(GLuint shade_clusters_shader, ShadeClustersShaderLocations& locations);
+
+	struct CullMeshesShaderLocations
+	{
+		GLuint meshes_nb{ 0u };
+		GLuint phase{ 0u };
+		GLuint world_to_clip{ 0u };
+		GLuint render_size{ 0u };
+		GLuint levels_nb{ 0u };
+		GLuint is_pyramid_valid{ 0u };
+		GLuint hiz_texture{ 0u };
+	};
+	void fillCullMeshesShaderLocations(GLuint cull_meshes_shader, CullMeshesShaderLocations& locations);
+
 	bonobo::mesh_data loadCone();
+
+	// Whether a world-space box is, at least partially, inside the frustum
+	// described by `world_to_clip`.
+	bool isBoxInFrustum(glm::vec3 const& min_corner, glm::vec3 const& max_corner, glm::mat4 const& world_to_clip);
+
+	// Whether the shadow cast by a world-space box can land inside the
+	// frustum described by `camera_world_to_clip`. The light looks down
+	// the -Z axis of its view space and stops lighting at `light_far_plane`.
+	bool canShadowReachFrustum(glm::vec3 const& min_corner, glm::vec3 const& max_corner,
+	                           glm::mat4 const& light_world_to_view, glm::mat4 const& light_view_to_world, float light_far_plane,
+	                           glm::mat4 const& camera_world_to_clip);
+
+	// Level of detail, as a power-of-two divisor of the full shadow map
+	// resolution, for a light whose influence is bounded by the given
+	// world-space sphere, such that a shadow map texel covers about
+	// `1 / texels_per_pixel` pixels of the screen. Coarser levels than
+	// `current_lod` are only selected once clearly below their threshold,
+	// to avoid re-rendering shadow maps back and forth.
+	int selectShadowMapLod(glm::vec3 const& center, float radius,
+	                       glm::mat4 const& camera_world_to_view, glm::mat4 const& camera_view_to_clip, float framebuffer_height,
+	                       float texels_per_pixel, int current_lod, int finest_lod);
+
+	glm::uvec2 getShadowMapResolution(int lod);
+
 } // namespace
 
 edan35::Assignment2::Assignment2(WindowManager& windowManager) :
@@ -185,39 +423,15 @@ edan35::Assignment2::~Assignment2()
 void
 edan35::Assignment2::run()
 {
-	// Load the geometry of Sponza
-	auto const sponza_geometry = bonobo::loadObjects(config::resources_path("sponza/sponza.obj"));
+	// Load the geometry of Sponza, with all its textures batched into
+	// texture arrays so they can be bound once for the whole scene.
+	bonobo::material_texture_batch sponza_material_textures;
+	auto const sponza_geometry = bonobo::loadObjects(config::resources_path("sponza/sponza.obj"), &sponza_material_textures);
 	if (sponza_geometry.empty()) {
 		LogError("Failed to load the Sponza model");
 		return;
 	}
-	std::vector<GeometryTextureData> sponza_geometry_texture_data;
-	sponza_geometry_texture_data.reserve(sponza_geometry.size());
-	for (auto const& geometry : sponza_geometry) {
-		auto const diffuse_texture = geometry.bindings.find("diffuse_texture");
-		auto const specular_texture = geometry.bindings.find("specular_texture");
-		auto const normals_texture = geometry.bindings.find("normals_texture");
-		auto const opacity_texture = geometry.bindings.find("opacity_texture");
-
-		GeometryTextureData data;
-		if (diffuse_texture != geometry.bindings.end())
-		{
-			data.diffuse_texture_id = diffuse_texture->second;
-		}
-		if (specular_texture != geometry.bindings.end())
-		{
-			data.specular_texture_id = specular_texture->second;
-		}
-		if (normals_texture != geometry.bindings.end())
-		{
-			data.normals_texture_id = normals_texture->second;
-		}
-		if (opacity_texture != geometry.bindings.end())
-		{
-			data.opacity_texture_id = opacity_texture->second;
-		}
-		sponza_geometry_texture_data.emplace_back(std::move(data));
-	}
+	glBindBufferBase(GL_UNIFORM_BUFFER, material_texture_layers_binding, sponza_material_textures.materials_ubo);
 
 	auto const cone_geometry = loadCone();
 	Node cone;
@@ -237,11 +451,12 @@ edan35::Assignment2::run()
 	// Setup OpenGL objects
 	// Look further down in this file to see the implementation of those functions.
 	//
-	Textures const textures = createTextures(framebuffer_width, framebuffer_height);
-	FBOs const fbos = createFramebufferObjects(textures);
+	GBufferLayout gbuffer_layout;
+	// The render targets and their framebuffers are created by the frame
+	// graph, from the passes declared every frame.
+	FrameGraph frame_graph;
 	Samplers const samplers = createSamplers();
-	ElapsedTimeQueries const elapsed_time_queries = createElapsedTimeQueries();
-	UBOs const ubos = createUniformBufferObjects();
+	FrameDataRing frame_data(16 * 1024 + constant::clustered_lights_max_nb * sizeof(ClusteredLight));
 
 	//
 	// Load all the shader programs used
@@ -269,9 +484,34 @@ edan35::Assignment2::run()
 	GBufferShaderLocations fill_gbuffer_shader_locations;
 	fillGBufferShaderLocations(fill_gbuffer_shader, fill_gbuffer_shader_locations);
 
+	GLuint fill_depth_shader = 0u;
+	program_manager.CreateAndRegisterProgram("Fill depth",
+	                                         { { ShaderType::vertex, "EDAN35/fill_depth.vert" },
+	                                           { ShaderType::fragment, "EDAN35/fill_depth.frag" } },
+	                                         fill_depth_shader);
+	if (fill_depth_shader == 0u) {
+		LogError("Failed to load depth filling shader");
+		return;
+	}
+	FillDepthShaderLocations fill_depth_shader_locations;
+	fillDepthShaderLocations(fill_depth_shader, fill_depth_shader_locations);
+
+	GLuint fill_depth_alpha_tested_shader = 0u;
+	program_manager.CreateAndRegisterProgram("Fill depth (alpha-tested)",
+	                                         { { ShaderType::vertex, "EDAN35/fill_depth.vert" },
+	                                           { ShaderType::fragment, "EDAN35/fill_depth_alpha_tested.frag" } },
+	                                         fill_depth_alpha_tested_shader);
+	if (fill_depth_alpha_tested_shader == 0u) {
+		LogError("Failed to load alpha-tested depth filling shader");
+		return;
+	}
+	FillDepthShaderLocations fill_depth_alpha_tested_shader_locations;
+	fillDepthShaderLocations(fill_depth_alpha_tested_shader, fill_depth_alpha_tested_shader_locations);
+
 	GLuint fill_shadowmap_shader = 0u;
 	program_manager.CreateAndRegisterProgram("Fill shadow map",
 	                                         { { ShaderType::vertex, "EDAN35/fill_shadowmap.vert" },
+	                                           { ShaderType::geometry, "EDAN35/fill_shadowmap.geom" },
 	                                           { ShaderType::fragment, "EDAN35/fill_shadowmap.frag" } },
 	                                         fill_shadowmap_shader);
 	if (fill_shadowmap_shader == 0u) {
@@ -293,6 +533,26 @@ edan35::Assignment2::run()
 	AccumulateLightsShaderLocations accumulate_light_shader_locations;
 	fillAccumulateLightsShaderLocations(accumulate_lights_shader, accumulate_light_shader_locations);
 
+	GLuint blur_shadow_moments_shader = 0u;
+	program_manager.CreateAndRegisterProgram("Blur shadow moments",
+	                                         { { ShaderType::vertex, "EDAN35/resolve_deferred.vert" },
+	                                           { ShaderType::fragment, "EDAN35/blur_shadow_moments.frag" } },
+	                                         blur_shadow_moments_shader);
+	if (blur_shadow_moments_shader == 0u) {
+		LogError("Failed to load shadow moments blurring shader");
+		return;
+	}
+
+	GLuint downsample_depth_normals_shader = 0u;
+	program_manager.CreateAndRegisterProgram("Downsample depth and normals",
+	                                         { { ShaderType::vertex, "EDAN35/resolve_deferred.vert" },
+	                                           { ShaderType::fragment, "EDAN35/downsample_depth_normals.frag" } },
+	                                         downsample_depth_normals_shader);
+	if (downsample_depth_normals_shader == 0u) {
+		LogError("Failed to load depth and normals downsampling shader");
+		return;
+	}
+
 	GLuint resolve_deferred_shader = 0u;
 	program_manager.CreateAndRegisterProgram("Resolve deferred",
 	                                         { { ShaderType::vertex, "EDAN35/resolve_deferred.vert" },
@@ -313,12 +573,124 @@ edan35::Assignment2::run()
 		return;
 	}
 
+	//
+	// The clustered lighting path relies on compute shaders and shader
+	// storage buffers, which both require OpenGL 4.3.
+	//
+	bool const is_clustered_lighting_supported = GLAD_GL_VERSION_4_3 != 0;
+	GLuint cluster_lights_shader = 0u;
+	GLuint shade_clusters_shader = 0u;
+	ClusterLightsShaderLocations cluster_lights_shader_locations;
+	ShadeClustersShaderLocations shade_clusters_shader_locations;
+	ClusterGrid cluster_grid;
+	if (is_clustered_lighting_supported) {
+		program_manager.CreateAndRegisterComputeProgram("Cluster lights", "EDAN35/cluster_lights.comp", cluster_lights_shader);
+		if (cluster_lights_shader == 0u) {
+			LogError("Failed to load light clustering shader");
+			return;
+		}
+		fillClusterLightsShaderLocations(cluster_lights_shader, cluster_lights_shader_locations);
+
+		program_manager.CreateAndRegisterComputeProgram("Shade clusters", "EDAN35/shade_clusters.comp", shade_clusters_shader);
+		if (shade_clusters_shader == 0u) {
+			LogError("Failed to load clusters shading shader");
+			return;
+		}
+		fillShadeClustersShaderLocations(shade_clusters_shader, shade_clusters_shader_locations);
+
+		cluster_grid = createClusterGrid(framebuffer_width, framebuffer_height);
+	} else {
+		LogWarning("OpenGL 4.3 is not available: clustered lighting is disabled.");
+	}
+
+	//
+	// The occlusion culling of the meshes fills in indirect draw commands
+	// from a compute shader, which both require OpenGL 4.3 as well.
+	//
+	bool const is_occlusion_culling_supported = GLAD_GL_VERSION_4_3 != 0;
+	GLuint build_hiz_shader = 0u;
+	GLuint cull_meshes_shader = 0u;
+	CullMeshesShaderLocations cull_meshes_shader_locations;
+	if (is_occlusion_culling_supported) {
+		program_manager.CreateAndRegisterProgram("Build Hi-Z pyramid",
+		                                         { { ShaderType::vertex, "EDAN35/resolve_deferred.vert" },
+		                                           { ShaderType::fragment, "EDAN35/build_hiz.frag" } },
+		                                         build_hiz_shader);
+		if (build_hiz_shader == 0u) {
+			LogError("Failed to load Hi-Z pyramid building shader");
+			return;
+		}
+
+		program_manager.CreateAndRegisterComputeProgram("Cull meshes", "EDAN35/cull_meshes.comp", cull_meshes_shader);
+		if (cull_meshes_shader == 0u) {
+			LogError("Failed to load meshes culling shader");
+			return;
+		}
+		fillCullMeshesShaderLocations(cull_meshes_shader, cull_meshes_shader_locations);
+	} else {
+		LogWarning("OpenGL 4.3 is not available: occlusion culling is disabled.");
+	}
+
 	auto const set_uniforms = [](GLuint /*program*/){};
 
 	ViewProjTransforms camera_view_proj_transforms;
 	std::array<ViewProjTransforms, constant::lights_nb> light_view_proj_transforms;
+	std::array<glm::mat4, constant::lights_nb> light_world_matrices;
+	std::array<glm::mat4, constant::lights_nb> light_view_matrices;
+	std::array<glm::mat4, constant::lights_nb> light_view_to_world_matrices;
 
-	const GLuint debug_texture_id = bonobo::getDebugTextureID();
+	//
+	// Setup the frame preparation: each chunk of the scene gets recorded by
+	// a different thread into its own command lists, which are then
+	// replayed in order while rendering.
+	//
+	ThreadPool thread_pool;
+	std::vector<CommandList> gbuffer_command_lists(thread_pool.GetChunksNb());
+	std::vector<CommandList> shadowmap_command_lists(thread_pool.GetChunksNb());
+
+	// The optional depth pre-pass draws the opaque geometry front to back,
+	// followed by the alpha-tested geometry, whose discarded fragments
+	// prevent early depth testing; each kind is recorded in its own lists
+	// as they use different programs.
+	bool use_depth_prepass = false;
+	std::vector<CommandList> depth_prepass_command_lists(thread_pool.GetChunksNb());
+	std::vector<CommandList> alpha_tested_depth_prepass_command_lists(thread_pool.GetChunksNb());
+	std::vector<bool> is_geometry_alpha_tested(sponza_geometry.size());
+	for (size_t i = 0; i < sponza_geometry.size(); ++i) {
+		auto const material_id = sponza_geometry[i].material_id;
+		is_geometry_alpha_tested[i] = material_id < sponza_material_textures.materials.size()
+		                              && sponza_material_textures.materials[material_id].arrays[3] >= 0;
+	}
+	std::vector<std::pair<float, size_t>> depth_prepass_order;
+	depth_prepass_order.reserve(sponza_geometry.size());
+	size_t opaque_geometry_nb = 0;
+
+	auto const record_draw = [](CommandList& commands, bonobo::mesh_data const& geometry){
+		commands.BindVertexArray(geometry.vao);
+		if (geometry.ibo != 0u)
+			commands.DrawIndexed(geometry.drawing_mode, geometry.indices_nb);
+		else
+			commands.Draw(geometry.drawing_mode, geometry.vertices_nb);
+	};
+	// Same as above, with the parameters taken from the `draw_index`-th
+	// command of the indirect draw buffer bound when replaying.
+	auto const record_indirect_draw = [](CommandList& commands, bonobo::mesh_data const& geometry, size_t draw_index){
+		auto const offset = static_cast<GLintptr>(draw_index * constant::indirect_draw_command_size);
+		commands.BindVertexArray(geometry.vao);
+		if (geometry.ibo != 0u)
+			commands.DrawIndexedIndirect(geometry.drawing_mode, offset);
+		else
+			commands.DrawIndirect(geometry.drawing_mode, offset);
+	};
+	// Same as `record_draw`, only drawing if any sample passed within
+	// `condition_query`, unless it is 0.
+	auto const record_conditional_draw = [&record_draw](CommandList& commands, bonobo::mesh_data const& geometry, GLuint condition_query){
+		if (condition_query != 0u)
+			commands.BeginConditionalRender(condition_query, GL_QUERY_WAIT);
+		record_draw(commands, geometry);
+		if (condition_query != 0u)
+			commands.EndConditionalRender();
+	};
 
 	auto const bind_texture_with_sampler = [](GLenum target, unsigned int slot, GLuint program, std::string const& name, GLuint texture, GLuint sampler){
 		glActiveTexture(GL_TEXTURE0 + slot);
@@ -327,6 +699,28 @@ edan35::Assignment2::run()
 		glBindSampler(slot, sampler);
 	};
 
+	// Bind all texture arrays of the Sponza materials to the first texture
+	// units, and point the `material_textures` sampler array to them.
+	auto const bind_material_textures = [&sponza_material_textures,&samplers](GLuint material_textures_location){
+		std::array<GLint, bonobo::max_material_texture_arrays> slots;
+		for (std::size_t i = 0; i < slots.size(); ++i) {
+			auto const& texture_arrays = sponza_material_textures.texture_arrays;
+			slots[i] = static_cast<GLint>(i);
+			glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+			glBindTexture(GL_TEXTURE_2D_ARRAY, i < texture_arrays.size() ? texture_arrays[i] : 0u);
+			glBindSampler(static_cast<GLuint>(i), samplers[toU(Sampler::Mipmaps)]);
+		}
+		glUniform1iv(material_textures_location, static_cast<GLsizei>(slots.size()), slots.data());
+	};
+	auto const unbind_material_textures = [](){
+		for (std::size_t i = 0; i < bonobo::max_material_texture_arrays; ++i) {
+			glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(i));
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
+			glBindSampler(static_cast<GLuint>(i), 0u);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	};
+
 
 	//
 	// Setup lights properties
@@ -355,6 +749,114 @@ edan35::Assignment2::run()
 	TRSTransformf lightOffsetTransform;
 	lightOffsetTransform.SetTranslate(glm::vec3(0.0f, 0.0f, -0.4f) * constant::scale_lengths);
 
+	// Shadow maps are kept across frames, and only re-rendered once their
+	// light moved; see `ShadowMapScheduler`.
+	ShadowMapScheduler shadow_map_scheduler(constant::lights_nb);
+	bool cache_shadow_maps = shadow_map_scheduler.is_caching_enabled();
+	float shadow_map_budget_ms = std::chrono::duration<float, std::milli>(shadow_map_scheduler.get_budget()).count();
+	size_t shadow_maps_updated_nb = 0;
+
+	// Shadow casters are culled against the frustum of each light, and
+	// optionally when their shadow cannot be seen by the camera. In the
+	// latter case, the shadow map depends on the camera and has to be
+	// updated whenever the camera moves.
+	bool cull_casters_outside_view = true;
+	GLuint camera_dependent_shadow_maps_mask = 0u;
+	glm::mat4 previous_camera_world_to_clip(1.0f);
+	std::array<size_t, constant::lights_nb> shadow_casters_nb;
+	shadow_casters_nb.fill(0);
+	std::vector<std::array<size_t, constant::lights_nb>> chunks_shadow_casters_nb(thread_pool.GetChunksNb());
+	std::vector<GLuint> chunks_camera_dependent_shadow_maps_mask(thread_pool.GetChunksNb());
+
+	// The resolution of each shadow map follows the screen footprint of
+	// its light, up to a user-selected maximum.
+	bool use_adaptive_shadow_maps = true;
+	int finest_shadow_map_lod = 0;
+	float shadow_map_texels_per_pixel = 1.0f;
+	std::array<int, constant::lights_nb> shadow_map_lods;
+	shadow_map_lods.fill(0);
+
+	// Filtered shadow maps store moments of the depth, blurred by two
+	// separable passes after each update; the exponential ones have to be
+	// kept below e^88, the largest power of e a 32-bit float can hold.
+	int shadow_filtering = toU(ShadowFiltering::Depth);
+	int shadow_blur_radius = 2;
+	float esm_exponent = 80.0f;
+	float vsm_light_bleeding_reduction = 0.2f;
+
+	//
+	// Setup the clustered lights: unshadowed point lights scattered across
+	// the scene, each circling around its own anchor.
+	//
+	struct ClusteredLightAnimation
+	{
+		glm::vec3 anchor;
+		float radius;
+		float orbit_radius;
+		float angular_speed;
+		float phase;
+	};
+	std::vector<ClusteredLightAnimation> clustered_light_animations(constant::clustered_lights_max_nb);
+	std::vector<ClusteredLight> clustered_lights(constant::clustered_lights_max_nb);
+	int clustered_lights_nb = 1024;
+	float clustered_light_intensity = 1.0f;
+	bool use_clustered_lights = is_clustered_lighting_supported;
+
+	auto const random_unit = [](){
+		return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+	};
+	auto const scene_min = glm::vec3(-17.0f, 0.2f, -6.5f) * constant::scale_lengths;
+	auto const scene_max = glm::vec3( 16.0f, 11.0f, 6.0f) * constant::scale_lengths;
+	for (size_t i = 0; i < clustered_light_animations.size(); ++i) {
+		auto& animation = clustered_light_animations[i];
+		animation.anchor = glm::mix(scene_min, scene_max, glm::vec3(random_unit(), random_unit(), random_unit()));
+		animation.radius = (1.0f + 2.0f * random_unit()) * constant::scale_lengths;
+		animation.orbit_radius = (0.2f + 0.8f * random_unit()) * constant::scale_lengths;
+		animation.angular_speed = (random_unit() < 0.5f ? -1.0f : 1.0f) * (0.2f + 0.8f * random_unit());
+		animation.phase = glm::two_pi<float>() * random_unit();
+
+		clustered_lights[i].color_and_intensity = glm::vec4(0.2f + 0.8f * random_unit(),
+		                                                    0.2f + 0.8f * random_unit(),
+		                                                    0.2f + 0.8f * random_unit(),
+		                                                    0.0f);
+	}
+
+	//
+	// Animate the lights at a fixed rate on their own thread: each step
+	// publishes the animation time and the rotation angle of every light,
+	// and frames interpolate between the two latest ones.
+	//
+	using LightAngles = std::array<float, constant::lights_nb>;
+	struct LightAnimationSnapshot
+	{
+		float seconds_nb;
+		LightAngles angles;
+	};
+	SnapshotBuffer<LightAnimationSnapshot> light_animation_snapshots;
+	auto light_animation_seconds_nb = 0.0f; // only accessed by the steps
+	SimulationScheduler light_animation(std::chrono::microseconds(1000000 / 60),
+	                                    [&](SimulationScheduler::Step const& step){
+		light_animation_seconds_nb += std::chrono::duration<decltype(light_animation_seconds_nb)>(step.timestep).count();
+
+		auto& snapshot = light_animation_snapshots.BeginWrite();
+		snapshot.seconds_nb = light_animation_seconds_nb;
+		for (size_t i = 0; i < snapshot.angles.size(); ++i)
+			snapshot.angles[i] = glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(constant::lights_nb) + 0.1f * light_animation_seconds_nb;
+		light_animation_snapshots.EndWrite(step.time);
+	});
+	// Run a first step right away, so that the first frame already has a
+	// snapshot to read from.
+	light_animation.RunSteps(1u);
+	// When recording or replaying inputs, frames advance by a fixed time
+	// step, and so do the lights, for replays to be reproducible: they are
+	// then stepped from the render loop rather than following the wall
+	// clock.
+	bool const use_fixed_time_step = inputHandler.IsRecording() || inputHandler.IsReplaying();
+	auto const light_animation_timestep = std::chrono::microseconds(1000000 / 60);
+	auto light_animation_lag = std::chrono::microseconds(0);
+	if (!use_fixed_time_step)
+		light_animation.Start();
+
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClearDepthf(1.0f);
@@ -362,37 +864,163 @@ edan35::Assignment2::run()
 	glEnable(GL_CULL_FACE);
 
 
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[toU(FBO::Resolve)]);
-
+	// The scene is rendered into the lower-left part of the render targets,
+	// which are allocated at the framebuffer size, and upscaled when
+	// copied to the default framebuffer.
+	DynamicResolution dynamic_resolution;
+	bool use_dynamic_resolution = dynamic_resolution.is_enabled();
+	float target_frame_time_ms = std::chrono::duration<float, std::milli>(dynamic_resolution.get_target_frame_time()).count();
+	float min_resolution_scale = dynamic_resolution.get_min_scale();
+
+	// GPU timings are only known a few frames later; remember how many shadow
+	// maps each of those frames updated, and the resolution it was rendered
+	// at, to report them to the scheduler and resolution controller.
+	Profiler profiler;
+	std::vector<std::pair<uint64_t, size_t>> shadow_maps_updated_per_frame(profiler.GetFramesNb(), std::make_pair(~uint64_t(0u), size_t(0u)));
+	std::vector<std::pair<uint64_t, float>> resolution_scale_per_frame(profiler.GetFramesNb(), std::make_pair(~uint64_t(0u), 1.0f));
+	// Marks the top-level profiler zones whose GPU time grows with the
+	// resolution the scene is rendered at.
+	std::uint32_t const scaled_resolution_zone = 1u << 0u;
+
+	// The light volumes can first mark, in the stencil buffer, the pixels
+	// whose depth lies inside them, to only shade those.
+	bool use_stencil_light_volumes = false;
+	// The fragments shaded by each light are counted with occlusion
+	// queries, read back once their set of queries gets reused a few
+	// frames later, alongside the mask of the lights which issued one.
+	std::vector<GLuint> shaded_fragments_queries(profiler.GetFramesNb() * constant::lights_nb, 0u);
+	glGenQueries(static_cast<GLsizei>(shaded_fragments_queries.size()), shaded_fragments_queries.data());
+	std::vector<std::pair<uint64_t, GLuint>> shaded_fragments_query_frames(profiler.GetFramesNb(), std::make_pair(~uint64_t(0u), 0u));
+	std::array<GLuint64, constant::lights_nb> shaded_fragments_nb;
+	shaded_fragments_nb.fill(0u);
+
+	// The G-buffer pass first only draws the meshes which were visible
+	// against the max-depth pyramid of the previous frame, builds a new
+	// pyramid from them, and then draws the meshes it reveals were
+	// wrongly culled. The pyramid is only valid for the camera and the
+	// render resolution it was built with, and gets invalidated whenever
+	// its content could be lost or stale.
+	bool use_occlusion_culling = is_occlusion_culling_supported;
+	HiZPyramid hiz_pyramid;
+	OcclusionCullingBuffers occlusion_culling_buffers;
+	if (is_occlusion_culling_supported) {
+		hiz_pyramid = createHiZPyramid(framebuffer_width, framebuffer_height);
+		occlusion_culling_buffers = createOcclusionCullingBuffers(sponza_geometry, profiler.GetFramesNb());
+	}
+	bool is_hiz_pyramid_valid = false;
+	glm::mat4 hiz_world_to_clip(1.0f);
+	glm::ivec2 hiz_render_size(1);
+	// Whether each set of counters holds results to be read back, once
+	// its fence got signalled.
+	std::vector<GLsync> occlusion_statistics_fences(occlusion_culling_buffers.statistics.size(), nullptr);
+	std::array<GLuint, 2> occluded_drawn_meshes_nb{ { 0u, 0u } };
+
+	// Without OpenGL 4.3, the large meshes can be tested with occlusion
+	// queries instead: their boxes are rasterised against the depth buffer
+	// once complete, and the results used during the next frame. Smaller
+	// meshes are not worth a query.
+	bool use_occlusion_queries = !is_occlusion_culling_supported;
+	int occlusion_query_mode = static_cast<int>(OcclusionCuller::Mode::PreviousFrameResults);
+	int occlusion_query_min_triangles_nb = 5000;
+	int occlusion_query_visible_results_nb = 4;
+	int occlusion_query_skipped_frames_nb = 8;
+	OcclusionCuller occlusion_culler;
+	occlusion_culler.SetObjectsNb(sponza_geometry.size());
+	for (size_t i = 0; i < sponza_geometry.size(); ++i)
+		occlusion_culler.SetBox(i, sponza_geometry[i].bounding_box_min, sponza_geometry[i].bounding_box_max);
+
+	auto const cull_meshes = [&](int phase, glm::mat4 const& world_to_clip, glm::ivec2 const& render_size, bool is_pyramid_valid, GLuint statistics){
+		glUseProgram(cull_meshes_shader);
+		glUniform1ui(cull_meshes_shader_locations.meshes_nb, static_cast<GLuint>(sponza_geometry.size()));
+		glUniform1i(cull_meshes_shader_locations.phase, phase);
+		glUniformMatrix4fv(cull_meshes_shader_locations.world_to_clip, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+		glUniform2iv(cull_meshes_shader_locations.render_size, 1, glm::value_ptr(render_size));
+		glUniform1i(cull_meshes_shader_locations.levels_nb, static_cast<GLint>(hiz_pyramid.framebuffers.size()));
+		glUniform1i(cull_meshes_shader_locations.is_pyramid_valid, is_pyramid_valid ? 1 : 0);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, hiz_pyramid.texture);
+		glUniform1i(cull_meshes_shader_locations.hiz_texture, 0);
+		glBindSampler(0, samplers[toU(Sampler::Nearest)]);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::OcclusionBounds), occlusion_culling_buffers.bounds);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::OcclusionVisibility), occlusion_culling_buffers.visibility);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::OcclusionDrawCommands), occlusion_culling_buffers.draw_commands[phase - 1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::OcclusionStatistics), statistics);
+
+		glDispatchCompute((static_cast<GLuint>(sponza_geometry.size()) + 63u) / 64u, 1u, 1u);
+		// The draw commands are consumed by the G-buffer pass, and the
+		// visibility by the second phase.
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		glBindSampler(0, 0u);
+		glBindTexture(GL_TEXTURE_2D, 0u);
+		glUseProgram(0u);
+	};
 
-	auto seconds_nb = 0.0f;
-	std::array<GLuint64, toU(ElapsedTimeQuery::Count)> pass_elapsed_times;
+	// Lights whose cone lies outside of the view are skipped, and the
+	// other ones only rasterised within their screen-space rectangle and,
+	// when supported, depth range.
+	bool cull_lights = true;
+	bool use_light_scissor = true;
+	LightCones light_cones;
+	std::vector<LightConeBounds> light_cone_bounds;
+
+	// Not part of core OpenGL, hence loaded by hand when available.
+	GLenum const depth_bounds_test_ext = 0x8890; // GL_DEPTH_BOUNDS_TEST_EXT
+	using DepthBoundsEXTProc = void (APIENTRYP)(GLclampd zmin, GLclampd zmax);
+	DepthBoundsEXTProc depth_bounds_ext = nullptr;
+	if (glfwExtensionSupported("GL_EXT_depth_bounds_test") == GLFW_TRUE)
+		depth_bounds_ext = reinterpret_cast<DepthBoundsEXTProc>(glfwGetProcAddress("glDepthBoundsEXT"));
+	bool use_light_depth_bounds = depth_bounds_ext != nullptr;
+	uint64_t frame_index = 0u;
+	uint64_t last_reported_frame_index = ~uint64_t(0u);
 	auto lastTime = std::chrono::high_resolution_clock::now();
 	bool show_textures = true;
+	int shown_shadow_map = 0;
 	bool show_cone_wireframe = false;
 
 	bool show_logs = true;
 	bool show_gui = true;
 	bool shader_reload_failed = false;
-	bool copy_elapsed_times = true;
-	bool first_frame = true;
 	bool show_basis = false;
 	float basis_thickness_scale = 40.0f;
 	float basis_length_scale = 400.0f;
+	int normal_encoding = static_cast<int>(gbuffer_layout.normal_encoding);
+	int light_accumulation_format = static_cast<int>(gbuffer_layout.light_accumulation_format);
+	bool pack_specular = gbuffer_layout.pack_specular;
+	int light_accumulation_resolution = static_cast<int>(gbuffer_layout.light_accumulation_resolution);
+
+	// Frames are captured on demand from the GUI, or over all measured
+	// frames of a benchmark when asked on the command line; they are read
+	// back once upscaled, before the GUI is drawn on top.
+	FrameCapture frame_capture;
+	auto const& benchmark_settings = mWindowManager.GetBenchmarkSettings();
+	bool has_benchmark_capture_started = false;
+	std::array<char, 256> capture_prefix = {{ "capture" }};
+	int capture_format = toU(FrameCapture::Format::PngSequence);
 
 	while (!glfwWindowShouldClose(window)) {
 		auto const nowTime = std::chrono::high_resolution_clock::now();
 		auto const deltaTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(nowTime - lastTime);
 		lastTime = nowTime;
-		if (!are_lights_paused)
-			seconds_nb += std::chrono::duration<decltype(seconds_nb)>(deltaTimeUs).count();
+
+		profiler.SetCollectingStatistics(mWindowManager.IsMeasuringFrames());
+		profiler.BeginFrame();
+
+		if (!benchmark_settings.capture_prefix.empty() && !has_benchmark_capture_started && mWindowManager.IsMeasuringFrames()) {
+			has_benchmark_capture_started = true;
+			frame_capture.Start(benchmark_settings.capture_prefix,
+			                    benchmark_settings.capture_raw_video ? FrameCapture::Format::RawVideo : FrameCapture::Format::PngSequence);
+		}
 
 		auto& io = ImGui::GetIO();
 		inputHandler.SetUICapture(io.WantCaptureMouse, io.WantCaptureKeyboard);
 
 		glfwPollEvents();
 		inputHandler.Advance();
-		mCamera.Update(deltaTimeUs, inputHandler);
+		auto const timeStepUs = inputHandler.GetTimeStep(deltaTimeUs);
+		mCamera.Update(timeStepUs, inputHandler);
 
 		camera_view_proj_transforms.view_projection = mCamera.GetWorldToClipMatrix();
 		camera_view_proj_transforms.view_projection_inverse = mCamera.GetClipToWorldMatrix();
@@ -411,8 +1039,47 @@ edan35::Assignment2::run()
 			else
 			{
 				fillGBufferShaderLocations(fill_gbuffer_shader, fill_gbuffer_shader_locations);
+				fillDepthShaderLocations(fill_depth_shader, fill_depth_shader_locations);
+				fillDepthShaderLocations(fill_depth_alpha_tested_shader, fill_depth_alpha_tested_shader_locations);
 				fillShadowmapShaderLocations(fill_shadowmap_shader, fill_shadowmap_shader_locations);
+				shadow_map_scheduler.invalidate_all();
 				fillAccumulateLightsShaderLocations(accumulate_lights_shader, accumulate_light_shader_locations);
+				if (is_clustered_lighting_supported) {
+					fillClusterLightsShaderLocations(cluster_lights_shader, cluster_lights_shader_locations);
+					fillShadeClustersShaderLocations(shade_clusters_shader, shade_clusters_shader_locations);
+				}
+				if (is_occlusion_culling_supported) {
+					fillCullMeshesShaderLocations(cull_meshes_shader, cull_meshes_shader_locations);
+					is_hiz_pyramid_valid = false;
+				}
+			}
+		}
+		// Apply the layout picked from the GUI during the previous frame;
+		// the frame graph re-creates the textures affected by it.
+		gbuffer_layout.normal_encoding = static_cast<NormalEncoding>(normal_encoding);
+		gbuffer_layout.light_accumulation_format = static_cast<LightAccumulationFormat>(light_accumulation_format);
+		gbuffer_layout.pack_specular = pack_specular;
+		gbuffer_layout.light_accumulation_resolution = static_cast<LightAccumulationResolution>(light_accumulation_resolution);
+
+		// The render targets follow the framebuffer size through the frame
+		// graph, while the cluster grid and the Hi-Z pyramid have to be
+		// re-created by hand.
+		int new_framebuffer_width = 0, new_framebuffer_height = 0;
+		glfwGetFramebufferSize(window, &new_framebuffer_width, &new_framebuffer_height);
+		new_framebuffer_width = std::max(new_framebuffer_width, 1);
+		new_framebuffer_height = std::max(new_framebuffer_height, 1);
+		if (new_framebuffer_width != framebuffer_width || new_framebuffer_height != framebuffer_height) {
+			framebuffer_width = new_framebuffer_width;
+			framebuffer_height = new_framebuffer_height;
+			if (is_clustered_lighting_supported) {
+				glDeleteBuffers(1, &cluster_grid.light_indices);
+				glDeleteBuffers(1, &cluster_grid.light_ranges);
+				cluster_grid = createClusterGrid(framebuffer_width, framebuffer_height);
+			}
+			if (is_occlusion_culling_supported) {
+				deleteHiZPyramid(hiz_pyramid);
+				hiz_pyramid = createHiZPyramid(framebuffer_width, framebuffer_height);
+				is_hiz_pyramid_valid = false;
 			}
 		}
 		if (inputHandler.GetKeycodeState(GLFW_KEY_F3) & JUST_RELEASED)
@@ -422,163 +1089,821 @@ edan35::Assignment2::run()
 
 		mWindowManager.NewImGuiFrame();
 
-		if (!first_frame && show_gui && copy_elapsed_times) {
-			// Copy all timings back from the GPU to the CPU.
-			for (GLuint i = 0; i < pass_elapsed_times.size(); ++i) {
-				glGetQueryObjectui64v(elapsed_time_queries[i], GL_QUERY_RESULT, pass_elapsed_times.data() + i);
+		// Let the scheduler know how long the shadow map updates took, and
+		// the resolution controller how long the whole frame took, once the
+		// GPU timings of a frame have been read back by the profiler.
+		if (auto const* const latest_frame = profiler.GetLatestFrame()) {
+			if (latest_frame->index != last_reported_frame_index) {
+				last_reported_frame_index = latest_frame->index;
+				auto const& updated_nb = shadow_maps_updated_per_frame[latest_frame->index % shadow_maps_updated_per_frame.size()];
+				auto const* const shadow_maps_zone = latest_frame->FindZone("Update shadow maps");
+				if (updated_nb.first == latest_frame->index && shadow_maps_zone != nullptr && shadow_maps_zone->has_gpu_times) {
+					// Prefiltering is part of the cost of each update.
+					auto update_time = shadow_maps_zone->GetGpuDuration();
+					auto const* const prefilter_zone = latest_frame->FindZone("Prefilter shadow maps");
+					if (prefilter_zone != nullptr && prefilter_zone->has_gpu_times)
+						update_time += prefilter_zone->GetGpuDuration();
+					shadow_map_scheduler.report_gpu_time(updated_nb.second, update_time);
+				}
+
+				auto const& rendered_scale = resolution_scale_per_frame[latest_frame->index % resolution_scale_per_frame.size()];
+				if (rendered_scale.first == latest_frame->index) {
+					auto scaled_passes_time = std::chrono::nanoseconds(0);
+					auto other_passes_time = std::chrono::nanoseconds(0);
+					for (auto const& zone : latest_frame->zones) {
+						if (zone.depth != 0u || !zone.has_gpu_times)
+							continue;
+						if ((zone.flags & scaled_resolution_zone) != 0u)
+							scaled_passes_time += zone.GetGpuDuration();
+						else
+							other_passes_time += zone.GetGpuDuration();
+					}
+					dynamic_resolution.report_gpu_time(rendered_scale.second, scaled_passes_time, other_passes_time);
+				}
 			}
 		}
 
+		auto const resolution_scale = dynamic_resolution.get_scale();
+		resolution_scale_per_frame[frame_index % resolution_scale_per_frame.size()] = std::make_pair(frame_index, resolution_scale);
+		auto const render_width = std::max(1, static_cast<int>(std::lround(resolution_scale * static_cast<float>(framebuffer_width))));
+		auto const render_height = std::max(1, static_cast<int>(std::lround(resolution_scale * static_cast<float>(framebuffer_height))));
+		auto const light_render_width = getLightAccumulationSize(render_width, gbuffer_layout.light_accumulation_resolution);
+		auto const light_render_height = getLightAccumulationSize(render_height, gbuffer_layout.light_accumulation_resolution);
+		auto const is_light_accumulation_downsampled = gbuffer_layout.light_accumulation_resolution != LightAccumulationResolution::Full;
+		auto const are_occlusion_queries_used = use_occlusion_queries && !use_occlusion_culling;
+		// The moments are only computed once the light shader reads them,
+		// i.e. once its shading code calls `compute_shadow_visibility()`;
+		// until then, the filtering passes would only cost GPU time.
+		auto const are_shadow_moments_read = static_cast<GLint>(accumulate_light_shader_locations.shadow_moments_texture) != -1;
+		auto const active_shadow_filtering = are_shadow_moments_read ? shadow_filtering : toU(ShadowFiltering::Depth);
+		auto const are_shadow_maps_filtered = static_cast<ShadowFiltering>(active_shadow_filtering) != ShadowFiltering::Depth;
+
+
+		//
+		// Declare the passes of the frame, in the order they run, and the
+		// textures each of them reads and writes. The frame graph culls the
+		// passes whose output goes unused, creates the textures at the
+		// current framebuffer size, letting the ones whose lifetimes do not
+		// overlap share their storage, and creates the framebuffers.
+		//
+		frame_graph.BeginFrame(glm::ivec2(framebuffer_width, framebuffer_height));
+		auto const& normal_format = normal_formats[toU(gbuffer_layout.normal_encoding)];
+		auto const& light_format = light_accumulation_formats[toU(gbuffer_layout.light_accumulation_format)];
+		auto const light_size_divisor = GLsizei(1) << toU(gbuffer_layout.light_accumulation_resolution);
+		auto const depth_buffer = frame_graph.CreateTexture(describeTexture("Depth buffer", depth_stencil_format));
+		auto const gbuffer_diffuse = frame_graph.CreateTexture(describeTexture("GBuffer diffuse", color_format));
+		auto const gbuffer_specular = frame_graph.CreateTexture(describeTexture("GBuffer specular", color_format));
+		auto const gbuffer_normals = frame_graph.CreateTexture(describeTexture("GBuffer normals", normal_format));
+		auto const downsampled_depth_buffer = frame_graph.CreateTexture(describeTexture("Downsampled depth buffer", depth_stencil_format, light_size_divisor));
+		auto const downsampled_depth_bounds = frame_graph.CreateTexture(describeTexture("Downsampled depth bounds", depth_bounds_format, light_size_divisor));
+		auto const downsampled_normals = frame_graph.CreateTexture(describeTexture("Downsampled normals", normal_format, light_size_divisor));
+		auto const light_diffuse = frame_graph.CreateTexture(describeTexture("Light diffuse contribution", light_format, light_size_divisor));
+		auto const light_specular = frame_graph.CreateTexture(describeTexture("Light specular contribution", light_format, light_size_divisor));
+		auto const result = frame_graph.CreateTexture(describeTexture("Final result", color_format));
+		// One layer per light, kept from one frame to the next; see
+		// `ShadowMapScheduler`.
+		auto shadow_maps_description = describeTexture("Shadow maps", shadow_map_format);
+		shadow_maps_description.fixed_size = glm::ivec2(constant::shadowmap_res_x, constant::shadowmap_res_y);
+		shadow_maps_description.layers_nb = static_cast<GLsizei>(constant::lights_nb);
+		shadow_maps_description.is_persistent = true;
+		auto const shadow_maps = frame_graph.CreateTexture(shadow_maps_description);
+		// Blurred moments of the shadow maps, only used when filtering them.
+		auto const& shadow_moments_format = shadow_moments_formats[active_shadow_filtering];
+		auto shadow_moments_description = describeTexture("Shadow moments", shadow_moments_format);
+		shadow_moments_description.fixed_size = shadow_maps_description.fixed_size;
+		shadow_moments_description.layers_nb = shadow_maps_description.layers_nb;
+		shadow_moments_description.levels_nb = constant::shadow_moments_levels_nb;
+		shadow_moments_description.is_persistent = true;
+		auto const shadow_moments = frame_graph.CreateTexture(shadow_moments_description);
+		auto blurred_shadow_moments_description = describeTexture("Shadow moments, horizontally blurred", shadow_moments_format);
+		blurred_shadow_moments_description.fixed_size = shadow_maps_description.fixed_size;
+		auto const blurred_shadow_moments = frame_graph.CreateTexture(blurred_shadow_moments_description);
+
+		// The light passes read the depth and normals matching the
+		// resolution they run at.
+		auto const light_depth_buffer = is_light_accumulation_downsampled ? downsampled_depth_buffer : depth_buffer;
+		auto const light_normals = is_light_accumulation_downsampled ? downsampled_normals : gbuffer_normals;
+
+		// Culled unless the G-buffer pass tests against its depth.
+		auto const depth_prepass = frame_graph.AddPass("Depth pre-pass");
+		frame_graph.Write(depth_prepass, depth_buffer, GL_DEPTH_ATTACHMENT);
+
+		auto const gbuffer_pass = frame_graph.AddPass("Fill G-buffer");
+		if (use_depth_prepass)
+			frame_graph.Read(gbuffer_pass, depth_buffer);
+		frame_graph.Write(gbuffer_pass, gbuffer_diffuse, GL_COLOR_ATTACHMENT0);
+		if (!gbuffer_layout.pack_specular)
+			frame_graph.Write(gbuffer_pass, gbuffer_specular, GL_COLOR_ATTACHMENT1);
+		frame_graph.Write(gbuffer_pass, gbuffer_normals, GL_COLOR_ATTACHMENT2);
+		frame_graph.Write(gbuffer_pass, depth_buffer, GL_DEPTH_ATTACHMENT);
+
+		// With occlusion culling, the pyramid is built from the depth of the
+		// meshes drawn so far, and kept for the next frame; the meshes it
+		// reveals were wrongly culled are then added to the G-buffer.
+		auto const build_hiz_pass = frame_graph.AddPass("Build Hi-Z pyramid", use_occlusion_culling);
+		auto const disoccluded_gbuffer_pass = frame_graph.AddPass("Fill G-buffer, disoccluded meshes");
+		if (use_occlusion_culling) {
+			frame_graph.Read(build_hiz_pass, depth_buffer);
+
+			frame_graph.Read(disoccluded_gbuffer_pass, gbuffer_diffuse);
+			if (!gbuffer_layout.pack_specular)
+				frame_graph.Read(disoccluded_gbuffer_pass, gbuffer_specular);
+			frame_graph.Read(disoccluded_gbuffer_pass, gbuffer_normals);
+			frame_graph.Read(disoccluded_gbuffer_pass, depth_buffer);
+			frame_graph.Write(disoccluded_gbuffer_pass, gbuffer_diffuse, GL_COLOR_ATTACHMENT0);
+			if (!gbuffer_layout.pack_specular)
+				frame_graph.Write(disoccluded_gbuffer_pass, gbuffer_specular, GL_COLOR_ATTACHMENT1);
+			frame_graph.Write(disoccluded_gbuffer_pass, gbuffer_normals, GL_COLOR_ATTACHMENT2);
+			frame_graph.Write(disoccluded_gbuffer_pass, depth_buffer, GL_DEPTH_ATTACHMENT);
+		}
+
+		// Tests against the depth buffer without modifying it, but it has to
+		// be attached for drawing.
+		auto const occlusion_queries_pass = frame_graph.AddPass("Issue occlusion queries", are_occlusion_queries_used);
+		if (are_occlusion_queries_used) {
+			frame_graph.Read(occlusion_queries_pass, depth_buffer);
+			frame_graph.Write(occlusion_queries_pass, depth_buffer, GL_DEPTH_ATTACHMENT);
+		}
+
+		// Culled when the lights are accumulated at full resolution, as
+		// nothing reads its output then.
+		auto const downsample_pass = frame_graph.AddPass("Downsample depth and normals");
+		frame_graph.Read(downsample_pass, depth_buffer);
+		frame_graph.Read(downsample_pass, gbuffer_normals);
+		frame_graph.Write(downsample_pass, downsampled_depth_bounds, GL_COLOR_ATTACHMENT0);
+		frame_graph.Write(downsample_pass, downsampled_normals, GL_COLOR_ATTACHMENT1);
+		frame_graph.Write(downsample_pass, downsampled_depth_buffer, GL_DEPTH_ATTACHMENT);
+
+		auto const shadow_maps_pass = frame_graph.AddPass("Update shadow maps");
+		frame_graph.Write(shadow_maps_pass, shadow_maps, GL_DEPTH_ATTACHMENT);
+
+		// Culled unless the shadow maps are filtered; the vertical pass
+		// renders to one layer of the moments at a time, like the shadow
+		// maps pass.
+		auto const blur_shadow_maps_horizontally_pass = frame_graph.AddPass("Blur shadow maps horizontally");
+		auto const blur_shadow_maps_vertically_pass = frame_graph.AddPass("Blur shadow maps vertically");
+		if (are_shadow_maps_filtered) {
+			frame_graph.Read(blur_shadow_maps_horizontally_pass, shadow_maps);
+			frame_graph.Write(blur_shadow_maps_horizontally_pass, blurred_shadow_moments, GL_COLOR_ATTACHMENT0);
+			frame_graph.Read(blur_shadow_maps_vertically_pass, blurred_shadow_moments);
+			frame_graph.Write(blur_shadow_maps_vertically_pass, shadow_moments, GL_COLOR_ATTACHMENT0);
+		}
+
+		auto const light_accumulation_pass = frame_graph.AddPass("Accumulate lights");
+		frame_graph.Read(light_accumulation_pass, light_depth_buffer);
+		frame_graph.Read(light_accumulation_pass, light_normals);
+		frame_graph.Read(light_accumulation_pass, shadow_maps);
+		if (are_shadow_maps_filtered)
+			frame_graph.Read(light_accumulation_pass, shadow_moments);
+		frame_graph.Write(light_accumulation_pass, light_diffuse, GL_COLOR_ATTACHMENT0);
+		frame_graph.Write(light_accumulation_pass, light_specular, GL_COLOR_ATTACHMENT1);
+		// The stencil part is used for masking the light volumes.
+		frame_graph.Write(light_accumulation_pass, light_depth_buffer, GL_DEPTH_STENCIL_ATTACHMENT);
+
+		// Adds to the light accumulation textures through images; culled
+		// when the clustered lights are disabled.
+		auto const shade_clusters_pass = frame_graph.AddPass("Shade clusters");
+		if (use_clustered_lights) {
+			frame_graph.Read(shade_clusters_pass, light_depth_buffer);
+			frame_graph.Read(shade_clusters_pass, light_normals);
+			frame_graph.Read(shade_clusters_pass, light_diffuse);
+			frame_graph.Read(shade_clusters_pass, light_specular);
+			frame_graph.Write(shade_clusters_pass, light_diffuse);
+			frame_graph.Write(shade_clusters_pass, light_specular);
+		}
+
+		auto const resolve_pass = frame_graph.AddPass("Resolve");
+		frame_graph.Read(resolve_pass, gbuffer_diffuse);
+		if (!gbuffer_layout.pack_specular)
+			frame_graph.Read(resolve_pass, gbuffer_specular);
+		frame_graph.Read(resolve_pass, light_diffuse);
+		frame_graph.Read(resolve_pass, light_specular);
+		if (is_light_accumulation_downsampled) {
+			frame_graph.Read(resolve_pass, depth_buffer);
+			frame_graph.Read(resolve_pass, gbuffer_normals);
+			frame_graph.Read(resolve_pass, downsampled_depth_bounds);
+			frame_graph.Read(resolve_pass, downsampled_normals);
+		}
+		frame_graph.Write(resolve_pass, result, GL_COLOR_ATTACHMENT0);
+
+		// Culled unless some debug elements are shown.
+		auto const show_debug_elements = show_cone_wireframe || show_basis;
+		auto const debug_elements_pass = frame_graph.AddPass("Draw debug elements");
+		if (show_debug_elements) {
+			frame_graph.Read(debug_elements_pass, result);
+			frame_graph.Read(debug_elements_pass, depth_buffer);
+			frame_graph.Write(debug_elements_pass, result, GL_COLOR_ATTACHMENT0);
+			frame_graph.Write(debug_elements_pass, depth_buffer, GL_DEPTH_ATTACHMENT);
+		}
+
+		auto const upscale_pass = frame_graph.AddPass("Upscale to default framebuffer", true);
+		frame_graph.Read(upscale_pass, result, GL_COLOR_ATTACHMENT0);
+
+		// Draws into the default framebuffer; declaring the previewed
+		// textures keeps them alive until then.
+		auto const gui_pass = frame_graph.AddPass("Draw GUI", true);
+		if (show_textures) {
+			frame_graph.Read(gui_pass, gbuffer_diffuse);
+			if (!gbuffer_layout.pack_specular)
+				frame_graph.Read(gui_pass, gbuffer_specular);
+			frame_graph.Read(gui_pass, gbuffer_normals);
+			frame_graph.Read(gui_pass, depth_buffer);
+			frame_graph.Read(gui_pass, shadow_maps);
+			frame_graph.Read(gui_pass, light_diffuse);
+			frame_graph.Read(gui_pass, light_specular);
+		}
+
+		frame_graph.Compile();
+		auto const light_depth_texture = frame_graph.GetTexture(light_depth_buffer);
+		auto const light_normal_texture = frame_graph.GetTexture(light_normals);
+
+
+		//
+		// Prepare the frame on all cores: compute the lights' transforms,
+		// and record the draw calls of the G-buffer and shadow map passes.
+		//
+		profiler.BeginZone("Prepare frame", Profiler::ZoneType::Cpu);
+		if (use_fixed_time_step && !are_lights_paused) {
+			light_animation_lag += timeStepUs;
+			for (; light_animation_lag >= light_animation_timestep; light_animation_lag -= light_animation_timestep)
+				light_animation.RunSteps(1u);
+		}
+		LightAngles light_angles;
+		float light_animation_time;
+		{
+			auto const snapshots = light_animation_snapshots.AcquireRead();
+			auto const interpolation_factor = use_fixed_time_step ? 1.0f : snapshots.GetInterpolationFactor();
+			light_animation_time = glm::mix(snapshots.previous->seconds_nb, snapshots.current->seconds_nb, interpolation_factor);
+			for (size_t i = 0; i < light_angles.size(); ++i)
+				light_angles[i] = glm::mix(snapshots.previous->angles[i], snapshots.current->angles[i], interpolation_factor);
+			light_animation_snapshots.ReleaseRead();
+		}
+
+		auto const world_to_view = mCamera.GetWorldToViewMatrix();
+		auto const view_to_clip = mCamera.GetViewToClipMatrix();
+		auto const clip_to_view = mCamera.GetClipToViewMatrix();
+		thread_pool.ParallelFor(static_cast<size_t>(lights_nb), [&](size_t begin, size_t end, size_t /*chunk_index*/){
+			for (size_t i = begin; i < end; ++i) {
+				auto& lightTransform = lightTransforms[i];
+				lightTransform.SetRotate(light_angles[i], glm::vec3(0.0f, 1.0f, 0.0f));
+
+				auto const light_view_matrix = lightOffsetTransform.GetMatrixInverse() * lightTransform.GetMatrixInverse();
+				auto const light_world_to_clip_matrix = lightProjection * light_view_matrix;
+
+				light_view_matrices[i] = light_view_matrix;
+				light_view_to_world_matrices[i] = glm::inverse(light_view_matrix);
+				light_world_matrices[i] = light_view_to_world_matrices[i] * coneScaleTransform.GetMatrix();
+				light_view_proj_transforms[i].view_projection = light_world_to_clip_matrix;
+				light_view_proj_transforms[i].view_projection_inverse = glm::inverse(light_world_to_clip_matrix);
+
+				// The light cone is bounded by the sphere centred on its
+				// base, as it opens at 45 degrees.
+				if (use_adaptive_shadow_maps) {
+					auto const cone_length = lightProjectionFarPlane * 0.8f;
+					auto const cone_base_center = glm::vec3(light_view_to_world_matrices[i] * glm::vec4(0.0f, 0.0f, -cone_length, 1.0f));
+					shadow_map_lods[i] = selectShadowMapLod(cone_base_center, cone_length,
+					                                        world_to_view, view_to_clip, static_cast<float>(render_height),
+					                                        shadow_map_texels_per_pixel, shadow_map_lods[i], finest_shadow_map_lod);
+				} else {
+					shadow_map_lods[i] = finest_shadow_map_lod;
+				}
+			}
+		});
+
+		// The cone mesh has its apex at the origin and its base of radius 1
+		// at z = -1, before being scaled.
+		auto const cone_length = lightProjectionFarPlane * 0.8f;
+		light_cones.resize(static_cast<size_t>(lights_nb));
+		for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i)
+			light_cones.set_cone(i, glm::vec3(light_world_matrices[i][3]), glm::normalize(-glm::vec3(light_world_matrices[i][2])), cone_length, cone_length);
+		cull_light_cones(camera_view_proj_transforms.view_projection, glm::ivec2(light_render_width, light_render_height), light_cones, light_cone_bounds);
+		if (!cull_lights)
+			for (auto& bounds : light_cone_bounds)
+				bounds = { true, glm::ivec4(0, 0, light_render_width, light_render_height), glm::vec2(0.0f, 1.0f) };
+		size_t visible_lights_nb = 0u;
+		for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i) {
+			shadow_map_scheduler.set_visible(i, light_cone_bounds[i].is_visible);
+			if (light_cone_bounds[i].is_visible)
+				++visible_lights_nb;
+		}
 
+		for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i)
+			shadow_map_scheduler.update_light(i, light_view_proj_transforms[i].view_projection, getShadowMapResolution(shadow_map_lods[i]));
+		if (camera_view_proj_transforms.view_projection != previous_camera_world_to_clip) {
+			for (size_t i = 0; i < constant::lights_nb; ++i)
+				if ((camera_dependent_shadow_maps_mask & (1u << i)) != 0u)
+					shadow_map_scheduler.invalidate(i);
+			previous_camera_world_to_clip = camera_view_proj_transforms.view_projection;
+		}
+		auto const& updated_shadow_maps = shadow_map_scheduler.schedule(static_cast<size_t>(lights_nb));
+		shadow_maps_updated_nb = updated_shadow_maps.size();
+		shadow_maps_updated_per_frame[frame_index % shadow_maps_updated_per_frame.size()] = std::make_pair(frame_index, shadow_maps_updated_nb);
+		GLuint updated_shadow_maps_mask = 0u;
+		for (auto const light : updated_shadow_maps)
+			updated_shadow_maps_mask |= 1u << light;
+		// Shadow maps that are not updated this frame have to be looked
+		// up with the transforms they were rendered with.
 		for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i) {
-			auto& lightTransform = lightTransforms[i];
-			lightTransform.SetRotate(glm::two_pi<float>() * static_cast<float>(i) / static_cast<float>(constant::lights_nb) + 0.1f * seconds_nb, glm::vec3(0.0f, 1.0f, 0.0f));
+			if ((updated_shadow_maps_mask & (1u << i)) != 0u)
+				continue;
+			light_view_proj_transforms[i].view_projection = shadow_map_scheduler.get_rendered_world_to_clip(i);
+			light_view_proj_transforms[i].view_projection_inverse = glm::inverse(light_view_proj_transforms[i].view_projection);
+		}
 
-			auto const light_view_matrix = lightOffsetTransform.GetMatrixInverse() * lightTransform.GetMatrixInverse();
-			auto const light_world_matrix = glm::inverse(light_view_matrix) * coneScaleTransform.GetMatrix();
-			auto const light_world_to_clip_matrix = lightProjection * light_view_matrix;
+		if (use_clustered_lights) {
+			auto const intensity = clustered_light_intensity * constant::scale_lengths * constant::scale_lengths;
+			thread_pool.ParallelFor(static_cast<size_t>(clustered_lights_nb), [&](size_t begin, size_t end, size_t /*chunk_index*/){
+				for (size_t i = begin; i < end; ++i) {
+					auto const& animation = clustered_light_animations[i];
+					auto const angle = animation.phase + animation.angular_speed * light_animation_time;
+					auto const world_position = animation.anchor + animation.orbit_radius * glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
 
-			light_view_proj_transforms[i].view_projection = light_world_to_clip_matrix;
-			light_view_proj_transforms[i].view_projection_inverse = glm::inverse(light_world_to_clip_matrix);
+					clustered_lights[i].view_position_and_radius = glm::vec4(glm::vec3(world_to_view * glm::vec4(world_position, 1.0f)), animation.radius);
+					clustered_lights[i].color_and_intensity.a = intensity;
+				}
+			});
+		}
+
+		// Decide which meshes to draw from the occlusion queries of the
+		// previous frames.
+		if (are_occlusion_queries_used) {
+			occlusion_culler.SetMode(static_cast<OcclusionCuller::Mode>(occlusion_query_mode));
+			occlusion_culler.SetQuerySkipping(occlusion_query_visible_results_nb, occlusion_query_skipped_frames_nb);
+			for (size_t i = 0; i < sponza_geometry.size(); ++i) {
+				auto const& geometry = sponza_geometry[i];
+				auto const triangles_nb = (geometry.ibo != 0u ? geometry.indices_nb : geometry.vertices_nb) / 3u;
+				occlusion_culler.SetEnabled(i, triangles_nb >= static_cast<size_t>(occlusion_query_min_triangles_nb));
+			}
+			occlusion_culler.BeginFrame();
+		}
+
+		// Sort the geometry for the depth pre-pass: the alpha-tested one
+		// last, and otherwise by increasing distance between the camera and
+		// the bounding box.
+		depth_prepass_order.clear();
+		opaque_geometry_nb = 0;
+		if (use_depth_prepass) {
+			auto const camera_position = mCamera.mWorld.GetTranslation();
+			for (size_t i = 0; i < sponza_geometry.size(); ++i) {
+				auto const& geometry = sponza_geometry[i];
+				auto const closest_point = glm::clamp(camera_position, geometry.bounding_box_min, geometry.bounding_box_max);
+				auto const to_closest_point = closest_point - camera_position;
+				auto const distance_squared = glm::dot(to_closest_point, to_closest_point);
+				if (is_geometry_alpha_tested[i]) {
+					depth_prepass_order.emplace_back(std::numeric_limits<float>::max(), i);
+				} else {
+					depth_prepass_order.emplace_back(distance_squared, i);
+					++opaque_geometry_nb;
+				}
+			}
+			std::sort(depth_prepass_order.begin(), depth_prepass_order.end());
 		}
 
+		for (auto& commands : depth_prepass_command_lists)
+			commands.Reset();
+		for (auto& commands : alpha_tested_depth_prepass_command_lists)
+			commands.Reset();
+		thread_pool.ParallelFor(depth_prepass_order.size(), [&](size_t begin, size_t end, size_t chunk_index){
+			auto& opaque_commands = depth_prepass_command_lists[chunk_index];
+			auto& alpha_tested_commands = alpha_tested_depth_prepass_command_lists[chunk_index];
+			for (size_t i = begin; i < end; ++i) {
+				// Meshes culled from the G-buffer have to be culled from
+				// the depth buffer as well, or their pixels would be left
+				// unwritten by the G-buffer pass. With GPU culling, the
+				// pre-pass uses the same draw commands as the first phase.
+				auto const mesh = depth_prepass_order[i].second;
+				if (are_occlusion_queries_used && !occlusion_culler.IsDrawn(mesh))
+					continue;
+				auto const condition_query = are_occlusion_queries_used ? occlusion_culler.GetConditionQuery(mesh) : 0u;
+
+				auto const& geometry = sponza_geometry[mesh];
+				auto const vertex_model_to_world = glm::mat4(1.0f);
+				auto const record_prepass_draw = [&](CommandList& commands){
+					if (use_occlusion_culling)
+						record_indirect_draw(commands, geometry, mesh);
+					else
+						record_conditional_draw(commands, geometry, condition_query);
+				};
+
+				if (i < opaque_geometry_nb) {
+					opaque_commands.SetUniform(static_cast<GLint>(fill_depth_shader_locations.vertex_model_to_world), vertex_model_to_world);
+					record_prepass_draw(opaque_commands);
+				} else {
+					alpha_tested_commands.BeginDebugGroup(geometry.name);
+					alpha_tested_commands.SetUniform(static_cast<GLint>(fill_depth_alpha_tested_shader_locations.vertex_model_to_world), vertex_model_to_world);
+					alpha_tested_commands.SetUniform(static_cast<GLint>(fill_depth_alpha_tested_shader_locations.material_index), static_cast<int>(geometry.material_id));
+					record_prepass_draw(alpha_tested_commands);
+					alpha_tested_commands.EndDebugGroup();
+				}
+			}
+		});
+
+		for (auto& commands : gbuffer_command_lists)
+			commands.Reset();
+		for (auto& commands : shadowmap_command_lists)
+			commands.Reset();
+		for (auto& chunk_shadow_casters_nb : chunks_shadow_casters_nb)
+			chunk_shadow_casters_nb.fill(0);
+		std::fill(chunks_camera_dependent_shadow_maps_mask.begin(), chunks_camera_dependent_shadow_maps_mask.end(), 0u);
+		thread_pool.ParallelFor(sponza_geometry.size(), [&](size_t begin, size_t end, size_t chunk_index){
+			auto& gbuffer_commands = gbuffer_command_lists[chunk_index];
+			auto& shadowmap_commands = shadowmap_command_lists[chunk_index];
+			auto& chunk_shadow_casters_nb = chunks_shadow_casters_nb[chunk_index];
+			auto& chunk_camera_dependent_shadow_maps_mask = chunks_camera_dependent_shadow_maps_mask[chunk_index];
+			for (size_t i = begin; i < end; ++i) {
+				auto const& geometry = sponza_geometry[i];
+
+				auto const vertex_model_to_world = glm::mat4(1.0f);
+				auto const normal_model_to_world = glm::mat4(1.0f);
+
+				if (!are_occlusion_queries_used || occlusion_culler.IsDrawn(i)) {
+					gbuffer_commands.BeginDebugGroup(geometry.name);
+					gbuffer_commands.SetUniform(static_cast<GLint>(fill_gbuffer_shader_locations.vertex_model_to_world), vertex_model_to_world);
+					gbuffer_commands.SetUniform(static_cast<GLint>(fill_gbuffer_shader_locations.normal_model_to_world), normal_model_to_world);
+					gbuffer_commands.SetUniform(static_cast<GLint>(fill_gbuffer_shader_locations.material_index), static_cast<int>(geometry.material_id));
+					if (use_occlusion_culling)
+						record_indirect_draw(gbuffer_commands, geometry, i);
+					else
+						record_conditional_draw(gbuffer_commands, geometry, are_occlusion_queries_used ? occlusion_culler.GetConditionQuery(i) : 0u);
+					gbuffer_commands.EndDebugGroup();
+				}
+
+				// Only draw the geometry into the shadow maps of the lights
+				// it can cast a shadow for; the Sponza geometry is already
+				// in world space, so its bounds can be used as is.
+				int casting_lights_mask = 0;
+				for (auto const light : updated_shadow_maps) {
+					if (!isBoxInFrustum(geometry.bounding_box_min, geometry.bounding_box_max, light_view_proj_transforms[light].view_projection))
+						continue;
+					if (cull_casters_outside_view
+					 && !canShadowReachFrustum(geometry.bounding_box_min, geometry.bounding_box_max,
+					                           light_view_matrices[light], light_view_to_world_matrices[light], lightProjectionFarPlane,
+					                           camera_view_proj_transforms.view_projection)) {
+						chunk_camera_dependent_shadow_maps_mask |= 1u << light;
+						continue;
+					}
+
+					casting_lights_mask |= 1 << light;
+					++chunk_shadow_casters_nb[light];
+				}
+				if (casting_lights_mask == 0)
+					continue;
+
+				shadowmap_commands.BeginDebugGroup(geometry.name);
+				shadowmap_commands.SetUniform(static_cast<GLint>(fill_shadowmap_shader_locations.vertex_model_to_world), vertex_model_to_world);
+				shadowmap_commands.SetUniform(static_cast<GLint>(fill_shadowmap_shader_locations.material_index), static_cast<int>(geometry.material_id));
+				shadowmap_commands.SetUniform(static_cast<GLint>(fill_shadowmap_shader_locations.updated_lights), casting_lights_mask);
+				record_draw(shadowmap_commands, geometry);
+				shadowmap_commands.EndDebugGroup();
+			}
+		});
+
+		for (auto const light : updated_shadow_maps) {
+			shadow_casters_nb[light] = 0;
+			camera_dependent_shadow_maps_mask &= ~(1u << light);
+		}
+		for (size_t chunk = 0; chunk < chunks_shadow_casters_nb.size(); ++chunk) {
+			for (auto const light : updated_shadow_maps)
+				shadow_casters_nb[light] += chunks_shadow_casters_nb[chunk][light];
+			camera_dependent_shadow_maps_mask |= chunks_camera_dependent_shadow_maps_mask[chunk];
+		}
+		profiler.EndZone();
+
 
 		//
 		// Update per-frame changing UBOs.
 		//
-		glBindBuffer(GL_UNIFORM_BUFFER, ubos[toU(UBO::CameraViewProjTransforms)]);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera_view_proj_transforms), &camera_view_proj_transforms);
-		glBindBuffer(GL_UNIFORM_BUFFER, ubos[toU(UBO::LightViewProjTransforms)]);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(light_view_proj_transforms), light_view_proj_transforms.data());
-		glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+		frame_data.BeginFrame();
+		auto const camera_view_proj_transforms_data = frame_data.Upload(camera_view_proj_transforms);
+		auto const light_view_proj_transforms_data = frame_data.Upload(light_view_proj_transforms);
+		FrameDataRing::Allocation clustered_lights_data;
+		if (use_clustered_lights)
+			clustered_lights_data = frame_data.Upload(clustered_lights.data(), static_cast<GLsizeiptr>(clustered_lights_nb * sizeof(ClusteredLight)));
+		frame_data.Flush();
+		frame_data.BindRange(GL_UNIFORM_BUFFER, toU(UBO::CameraViewProjTransforms), camera_view_proj_transforms_data);
+		frame_data.BindRange(GL_UNIFORM_BUFFER, toU(UBO::LightViewProjTransforms), light_view_proj_transforms_data);
+		if (use_clustered_lights)
+			frame_data.BindRange(GL_SHADER_STORAGE_BUFFER, toU(SSBO::ClusteredLights), clustered_lights_data);
 
 
 		if (!shader_reload_failed) {
+			// The counters of this frame reuse the buffer of a frame the
+			// GPU should be done with by now; they are only read back if so.
+			GLuint occlusion_statistics = 0u;
+			if (use_occlusion_culling) {
+				auto const statistics_slot = frame_index % occlusion_culling_buffers.statistics.size();
+				occlusion_statistics = occlusion_culling_buffers.statistics[statistics_slot];
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, occlusion_statistics);
+				auto& fence = occlusion_statistics_fences[statistics_slot];
+				if (fence != nullptr) {
+					auto const wait_result = glClientWaitSync(fence, 0, 0u);
+					if (wait_result == GL_ALREADY_SIGNALED || wait_result == GL_CONDITION_SATISFIED)
+						glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(occluded_drawn_meshes_nb), occluded_drawn_meshes_nb.data());
+					glDeleteSync(fence);
+					fence = nullptr;
+				}
+				GLuint const no_meshes = 0u;
+				glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &no_meshes);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+			}
+
+			profiler.BeginZone("Cull meshes");
+			if (use_occlusion_culling)
+				cull_meshes(1, hiz_world_to_clip, hiz_render_size, is_hiz_pyramid_valid, occlusion_statistics);
+			profiler.EndZone();
+
 			//
-			// Pass 1: Render scene into the g-buffer
+			// Pass 0: Optionally fill the depth buffer first, so that the
+			//         g-buffer pass only shades visible fragments; only
+			//         with the meshes kept by the first culling phase, if
+			//         any, as the disoccluded ones are drawn without it
 			//
-			utils::opengl::debug::beginDebugGroup("Fill G-buffer");
-			glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::GbufferGeneration)]);
-
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::GBuffer)]);
-			glViewport(0, 0, framebuffer_width, framebuffer_height);
-			glClear(GL_DEPTH_BUFFER_BIT);
-			// XXX: Is any other clearing needed?
+			profiler.BeginZone("Depth pre-pass", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(depth_prepass)) {
+				glViewport(0, 0, render_width, render_height);
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				if (use_occlusion_culling)
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, occlusion_culling_buffers.draw_commands[0]);
+				glUseProgram(fill_depth_shader);
+				for (auto const& commands : depth_prepass_command_lists)
+					commands.Replay();
+
+				glUseProgram(fill_depth_alpha_tested_shader);
+				bind_material_textures(fill_depth_alpha_tested_shader_locations.material_textures);
+				for (auto const& commands : alpha_tested_depth_prepass_command_lists)
+					commands.Replay();
+				unbind_material_textures();
+				if (use_occlusion_culling)
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0u);
+				glBindVertexArray(0u);
+				glUseProgram(0u);
+			}
+			profiler.EndZone();
 
-			glUseProgram(fill_gbuffer_shader);
-			glUniform1i(fill_gbuffer_shader_locations.diffuse_texture, 0);
-			glUniform1i(fill_gbuffer_shader_locations.specular_texture, 1);
-			glUniform1i(fill_gbuffer_shader_locations.normals_texture, 2);
-			glUniform1i(fill_gbuffer_shader_locations.opacity_texture, 3);
-			for (std::size_t i = 0; i < sponza_geometry.size(); ++i)
-			{
-				auto const& geometry = sponza_geometry[i];
-				auto const& texture_data = sponza_geometry_texture_data[i];
+			//
+			// Pass 1: Render scene into the g-buffer
+			//
+			// The G-buffer is filled twice when culling meshes: first with
+			// the draw commands of the meshes kept by the first phase, then
+			// with the ones of the meshes the second phase found visible.
+			auto const fill_gbuffer = [&](GLuint draw_commands, bool is_depth_prefilled){
+				if (is_depth_prefilled) {
+					// Only keep the fragments which ended up on top during
+					// the pre-pass; the depth buffer is already complete.
+					glDepthFunc(GL_EQUAL);
+					glDepthMask(GL_FALSE);
+				}
 
-				utils::opengl::debug::beginDebugGroup(geometry.name);
+				glUseProgram(fill_gbuffer_shader);
+				glUniform1i(fill_gbuffer_shader_locations.use_octahedral_normals, gbuffer_layout.normal_encoding != NormalEncoding::RemappedXYZ8 ? 1 : 0);
+				glUniform1i(fill_gbuffer_shader_locations.is_specular_packed, gbuffer_layout.pack_specular ? 1 : 0);
+				bind_material_textures(fill_gbuffer_shader_locations.material_textures);
+				if (use_occlusion_culling)
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_commands);
+				for (auto const& commands : gbuffer_command_lists)
+					commands.Replay();
+				if (use_occlusion_culling)
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0u);
+				unbind_material_textures();
+				glBindVertexArray(0u);
+				glUseProgram(0u);
+				glDepthMask(GL_TRUE);
+				glDepthFunc(GL_LESS);
+			};
 
-				auto const vertex_model_to_world = glm::mat4(1.0f);
-				auto const normal_model_to_world = glm::mat4(1.0f);
+			profiler.BeginZone("Fill G-buffer", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
 
-				glUniformMatrix4fv(fill_gbuffer_shader_locations.vertex_model_to_world, 1, GL_FALSE, glm::value_ptr(vertex_model_to_world));
-				glUniformMatrix4fv(fill_gbuffer_shader_locations.normal_model_to_world, 1, GL_FALSE, glm::value_ptr(normal_model_to_world));
+			frame_graph.BeginPass(gbuffer_pass);
+			glViewport(0, 0, render_width, render_height);
+			if (!use_depth_prepass)
+				glClear(GL_DEPTH_BUFFER_BIT);
+			// XXX: Is any other clearing needed?
+			fill_gbuffer(occlusion_culling_buffers.draw_commands[0], use_depth_prepass);
 
-				auto const default_sampler = samplers[toU(Sampler::Nearest)];
-				auto const mipmap_sampler = samplers[toU(Sampler::Mipmaps)];
+			profiler.EndZone();
 
-				glUniform1i(fill_gbuffer_shader_locations.has_diffuse_texture, texture_data.diffuse_texture_id != 0u ? 1 : 0);
-				glBindSampler(0u, texture_data.diffuse_texture_id != 0u ? mipmap_sampler : default_sampler);
+			//
+			// Pass 1.1: Optionally build the max-depth pyramid of the meshes
+			//           drawn so far, each level from the one below it
+			//
+			profiler.BeginZone("Build Hi-Z pyramid", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(build_hiz_pass)) {
+				glUseProgram(build_hiz_shader);
 				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, texture_data.diffuse_texture_id != 0u ? texture_data.diffuse_texture_id : debug_texture_id);
-
-				glUniform1i(fill_gbuffer_shader_locations.has_specular_texture, texture_data.specular_texture_id != 0u ? 1 : 0);
-				glBindSampler(1u, texture_data.specular_texture_id != 0u ? mipmap_sampler : default_sampler);
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, texture_data.specular_texture_id != 0u ? texture_data.specular_texture_id : debug_texture_id);
+				glUniform1i(glGetUniformLocation(build_hiz_shader, "source_texture"), 0);
+				glBindSampler(0, samplers[toU(Sampler::Nearest)]);
+				auto const source_size_location = glGetUniformLocation(build_hiz_shader, "source_size");
+
+				// Only the part covered by the render resolution is built.
+				auto source_size = glm::ivec2(render_width, render_height);
+				for (size_t level = 0; level < hiz_pyramid.framebuffers.size(); ++level) {
+					if (level == 0) {
+						glBindTexture(GL_TEXTURE_2D, frame_graph.GetTexture(depth_buffer));
+					} else {
+						// Restrict sampling to the previous level, so that
+						// rendering to the current one is no feedback loop.
+						glBindTexture(GL_TEXTURE_2D, hiz_pyramid.texture);
+						glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level - 1));
+						glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level - 1));
+					}
+					auto const level_size = glm::max((source_size + 1) / 2, glm::ivec2(1));
+					glBindFramebuffer(GL_DRAW_FRAMEBUFFER, hiz_pyramid.framebuffers[level]);
+					glViewport(0, 0, level_size.x, level_size.y);
+					glUniform2iv(source_size_location, 1, glm::value_ptr(source_size));
+
+					bonobo::drawFullscreen();
+
+					source_size = level_size;
+				}
+				glBindTexture(GL_TEXTURE_2D, hiz_pyramid.texture);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(hiz_pyramid.framebuffers.size()) - 1);
+				glBindTexture(GL_TEXTURE_2D, 0u);
+				glBindSampler(0, 0u);
+				glUseProgram(0u);
 
-				glUniform1i(fill_gbuffer_shader_locations.has_normals_texture, texture_data.normals_texture_id != 0u ? 1 : 0);
-				glBindSampler(2u, texture_data.normals_texture_id != 0u ? mipmap_sampler : default_sampler);
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, texture_data.normals_texture_id != 0u ? texture_data.normals_texture_id : debug_texture_id);
+				hiz_world_to_clip = view_projection;
+				hiz_render_size = glm::ivec2(render_width, render_height);
+				is_hiz_pyramid_valid = true;
+			}
+			profiler.EndZone();
 
-				glUniform1i(fill_gbuffer_shader_locations.has_opacity_texture, texture_data.opacity_texture_id != 0u ? 1 : 0);
-				glBindSampler(3u, texture_data.opacity_texture_id != 0u ? mipmap_sampler : default_sampler);
-				glActiveTexture(GL_TEXTURE3);
-				glBindTexture(GL_TEXTURE_2D, texture_data.opacity_texture_id != 0u ? texture_data.opacity_texture_id : debug_texture_id);
+			//
+			// Pass 1.2: Optionally draw the meshes culled by the first phase
+			//           which are visible against the new pyramid
+			//
+			profiler.BeginZone("Fill G-buffer, disoccluded meshes", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(disoccluded_gbuffer_pass)) {
+				cull_meshes(2, view_projection, glm::ivec2(render_width, render_height), true, occlusion_statistics);
 
-				glBindVertexArray(geometry.vao);
-				if (geometry.ibo != 0u)
-					glDrawElements(geometry.drawing_mode, geometry.indices_nb, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(0x0));
-				else
-					glDrawArrays(geometry.drawing_mode, 0, geometry.vertices_nb);
+				glViewport(0, 0, render_width, render_height);
+				fill_gbuffer(occlusion_culling_buffers.draw_commands[1], false);
 
+				auto& fence = occlusion_statistics_fences[frame_index % occlusion_statistics_fences.size()];
+				fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			}
+			profiler.EndZone();
 
-				utils::opengl::debug::endDebugGroup();
+			//
+			// Pass 1.3: Optionally test the boxes of the large meshes
+			//           against the depth buffer, for the next frame
+			//
+			profiler.BeginZone("Issue occlusion queries", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(occlusion_queries_pass)) {
+				glViewport(0, 0, render_width, render_height);
+				occlusion_culler.IssueQueries(view_projection, mCamera.mWorld.GetTranslation(), mCamera.mNear);
 			}
-			glBindTexture(GL_TEXTURE_2D, 0);
-			glBindVertexArray(0u);
-			glUseProgram(0u);
+			profiler.EndZone();
 
-			glEndQuery(GL_TIME_ELAPSED);
-			utils::opengl::debug::endDebugGroup();
+			//
+			// Pass 1.4: Optionally downsample the depth and normals, for
+			//           accumulating lights at a lower resolution
+			//
+			profiler.BeginZone("Downsample depth and normals", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(downsample_pass)) {
+				glViewport(0, 0, light_render_width, light_render_height);
+				// Every pixel is written to, including its depth.
+				glDepthFunc(GL_ALWAYS);
+
+				glUseProgram(downsample_depth_normals_shader);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 0, downsample_depth_normals_shader, "depth_texture", frame_graph.GetTexture(depth_buffer), samplers[toU(Sampler::Nearest)]);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 1, downsample_depth_normals_shader, "normal_texture", frame_graph.GetTexture(gbuffer_normals), samplers[toU(Sampler::Nearest)]);
+				glUniform1i(glGetUniformLocation(downsample_depth_normals_shader, "downsampling"), toU(gbuffer_layout.light_accumulation_resolution));
+				glUniform2i(glGetUniformLocation(downsample_depth_normals_shader, "source_size"), render_width, render_height);
+				glUniform1f(glGetUniformLocation(downsample_depth_normals_shader, "z_near"), mCamera.mNear);
+				glUniform1f(glGetUniformLocation(downsample_depth_normals_shader, "z_far"), mCamera.mFar);
+
+				bonobo::drawFullscreen();
+
+				glBindSampler(1, 0u);
+				glBindSampler(0, 0u);
+				glUseProgram(0u);
+				glDepthFunc(GL_LESS);
+			}
+			profiler.EndZone();
 
 
 
 			//
 			// Pass 2: Generate shadowmaps and accumulate lights' contribution
 			//
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::LightAccumulation)]);
-			glViewport(0, 0, framebuffer_width, framebuffer_height);
-			// XXX: Is any clearing needed?
-			for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i) {
-				auto const& lightTransform = lightTransforms[i];
-				auto const light_view_matrix = lightOffsetTransform.GetMatrixInverse() * lightTransform.GetMatrixInverse();
-				auto const light_world_matrix = glm::inverse(light_view_matrix) * coneScaleTransform.GetMatrix();
-				auto const light_world_to_clip_matrix = lightProjection * light_view_matrix;
 
-				//
-				// Pass 2.1: Generate shadow map for light i
-				//
-				utils::opengl::debug::beginDebugGroup("Create shadow map " + std::to_string(i));
-				glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::ShadowMap0Generation) + i]);
+			//
+			// Pass 2.1: Update the shadow maps scheduled for this frame at
+			//           once, each light rendering into its own layer of the
+			//           shadow map array
+			//
+			profiler.BeginZone("Update shadow maps");
+			if (!updated_shadow_maps.empty()) {
+				frame_graph.BeginPass(shadow_maps_pass);
+
+				// Only clear the layers being updated, the other ones are
+				// kept from previous frames: each one is attached on its own
+				// while being cleared, before attaching all of them back.
+				auto const shadow_maps_texture = frame_graph.GetTexture(shadow_maps);
+				for (auto const light : updated_shadow_maps) {
+					glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_maps_texture, 0, static_cast<GLint>(light));
+					glClear(GL_DEPTH_BUFFER_BIT);
+				}
+				glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadow_maps_texture, 0);
 
-				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::ShadowMap)]);
-				glViewport(0, 0, constant::shadowmap_res_x, constant::shadowmap_res_y);
-				// XXX: Is any clearing needed?
+				// Each light renders into the lower-left part of its layer
+				// matching its resolution, through its own viewport.
+				for (auto const light : updated_shadow_maps) {
+					auto const resolution = shadow_map_scheduler.get_rendered_resolution(light);
+					glViewportIndexedf(static_cast<GLuint>(light), 0.0f, 0.0f, static_cast<float>(resolution.x), static_cast<float>(resolution.y));
+				}
 
 				glUseProgram(fill_shadowmap_shader);
-				glUniform1i(fill_shadowmap_shader_locations.light_index, static_cast<int>(i));
-				glUniform1i(fill_shadowmap_shader_locations.opacity_texture, 0);
-				for (std::size_t i = 0; i < sponza_geometry.size(); ++i)
-				{
-					auto const& geometry = sponza_geometry[i];
-					auto const& texture_data = sponza_geometry_texture_data[i];
-
-					utils::opengl::debug::beginDebugGroup(geometry.name);
-
-					auto const vertex_model_to_world = glm::mat4(1.0f);
-					glUniformMatrix4fv(fill_shadowmap_shader_locations.vertex_model_to_world, 1, GL_FALSE, glm::value_ptr(vertex_model_to_world));
-
-					glUniform1i(fill_shadowmap_shader_locations.has_opacity_texture, texture_data.opacity_texture_id != 0u ? 1 : 0);
-					glBindSampler(0u, texture_data.opacity_texture_id != 0u ? samplers[toU(Sampler::Mipmaps)] : samplers[toU(Sampler::Nearest)]);
-					glActiveTexture(GL_TEXTURE0);
-					glBindTexture(GL_TEXTURE_2D, texture_data.opacity_texture_id != 0u ? texture_data.opacity_texture_id : debug_texture_id);
-
-					glBindVertexArray(geometry.vao);
-					if (geometry.ibo != 0u)
-						glDrawElements(geometry.drawing_mode, geometry.indices_nb, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(0x0));
-					else
-						glDrawArrays(geometry.drawing_mode, 0, geometry.vertices_nb);
+				bind_material_textures(fill_shadowmap_shader_locations.material_textures);
+				for (auto const& commands : shadowmap_command_lists)
+					commands.Replay();
+				unbind_material_textures();
+				glBindVertexArray(0u);
+				glUseProgram(0u);
+			}
+			profiler.EndZone();
+
+			//
+			// Pass 2.2: Turn the updated shadow maps into moments, blurred
+			//           horizontally then vertically, and rebuild the
+			//           mipmaps of all of them
+			//
+			profiler.BeginZone("Prefilter shadow maps");
+			if (are_shadow_maps_filtered && !updated_shadow_maps.empty()) {
+				glUseProgram(blur_shadow_moments_shader);
+				glUniform1i(glGetUniformLocation(blur_shadow_moments_shader, "filtering"), shadow_filtering);
+				glUniform2f(glGetUniformLocation(blur_shadow_moments_shader, "depth_range"), lightProjectionNearPlane, lightProjectionFarPlane);
+				glUniform1f(glGetUniformLocation(blur_shadow_moments_shader, "esm_exponent"), esm_exponent);
+				glUniform1i(glGetUniformLocation(blur_shadow_moments_shader, "kernel_radius"), shadow_blur_radius);
+				bind_texture_with_sampler(GL_TEXTURE_2D_ARRAY, 0, blur_shadow_moments_shader, "shadow_texture", frame_graph.GetTexture(shadow_maps), samplers[toU(Sampler::Nearest)]);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 1, blur_shadow_moments_shader, "moments_texture", frame_graph.GetTexture(blurred_shadow_moments), samplers[toU(Sampler::Nearest)]);
+
+				auto const shadow_moments_texture = frame_graph.GetTexture(shadow_moments);
+				for (auto const light : updated_shadow_maps) {
+					auto const resolution = shadow_map_scheduler.get_rendered_resolution(light);
+					glViewport(0, 0, static_cast<GLsizei>(resolution.x), static_cast<GLsizei>(resolution.y));
+					glUniform1i(glGetUniformLocation(blur_shadow_moments_shader, "light_index"), static_cast<GLint>(light));
+					glUniform2i(glGetUniformLocation(blur_shadow_moments_shader, "source_size"), static_cast<GLint>(resolution.x), static_cast<GLint>(resolution.y));
+
+					frame_graph.BeginPass(blur_shadow_maps_horizontally_pass);
+					glUniform1i(glGetUniformLocation(blur_shadow_moments_shader, "is_vertical"), 0);
+					bonobo::drawFullscreen();
+
+					frame_graph.BeginPass(blur_shadow_maps_vertically_pass);
+					glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow_moments_texture, 0, static_cast<GLint>(light));
+					glUniform1i(glGetUniformLocation(blur_shadow_moments_shader, "is_vertical"), 1);
+					bonobo::drawFullscreen();
+					glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadow_moments_texture, 0);
+				}
 
+				glBindSampler(1, 0u);
+				glBindSampler(0, 0u);
+				glUseProgram(0u);
 
-					utils::opengl::debug::endDebugGroup();
+				// Regenerates the levels of the layers which were not
+				// updated as well, as they cannot be picked individually.
+				// The coarse levels also average in the unused part of
+				// each layer; the light pass never reads from those.
+				glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_moments_texture);
+				glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
+			}
+			profiler.EndZone();
+
+			auto const query_slot = frame_index % shaded_fragments_query_frames.size();
+			auto& issued_queries = shaded_fragments_query_frames[query_slot];
+			if (issued_queries.first != ~uint64_t(0u)) {
+				for (size_t i = 0; i < constant::lights_nb; ++i) {
+					// Culled lights did not shade anything.
+					if ((issued_queries.second & (1u << i)) == 0u) {
+						shaded_fragments_nb[i] = 0u;
+						continue;
+					}
+					auto const query = shaded_fragments_queries[query_slot * constant::lights_nb + i];
+					GLuint is_available = GL_FALSE;
+					glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &is_available);
+					if (is_available == GL_TRUE)
+						glGetQueryObjectui64v(query, GL_QUERY_RESULT, &shaded_fragments_nb[i]);
 				}
-				glBindTexture(GL_TEXTURE_2D, 0);
-				glBindVertexArray(0u);
-				glUseProgram(0u);
+			}
+			issued_queries = std::make_pair(frame_index, 0u);
 
-				glEndQuery(GL_TIME_ELAPSED);
-				utils::opengl::debug::endDebugGroup();
+			frame_graph.BeginPass(light_accumulation_pass);
+			glViewport(0, 0, light_render_width, light_render_height);
+			if (use_stencil_light_volumes)
+				glClear(GL_STENCIL_BUFFER_BIT);
+			// XXX: Is any clearing needed?
+			for (size_t i = 0; i < static_cast<size_t>(lights_nb); ++i) {
+				auto const& cone_bounds = light_cone_bounds[i];
+				if (!cone_bounds.is_visible)
+					continue;
+				issued_queries.second |= 1u << i;
+
+				auto const& lightTransform = lightTransforms[i];
+				auto const& light_world_matrix = light_world_matrices[i];
+				auto const& light_world_to_clip_matrix = light_view_proj_transforms[i].view_projection;
 
 
 				glCullFace(GL_FRONT);
@@ -588,21 +1913,60 @@ edan35::Assignment2::run()
 				glBlendEquationSeparate(GL_FUNC_ADD, GL_MIN);
 				glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
 				//
-				// Pass 2.2: Accumulate light i contribution
-				utils::opengl::debug::beginDebugGroup("Accumulate light " + std::to_string(i));
-				glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::Light0Accumulation) + i]);
+				// Pass 2.3: Accumulate light i contribution
+				profiler.BeginZone("Accumulate light " + std::to_string(i), Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+
+				if (use_light_scissor) {
+					glEnable(GL_SCISSOR_TEST);
+					glScissor(cone_bounds.scissor_box.x, cone_bounds.scissor_box.y, cone_bounds.scissor_box.z, cone_bounds.scissor_box.w);
+				}
+				if (use_light_depth_bounds && depth_bounds_ext != nullptr) {
+					// Tested against the depth already in the depth buffer,
+					// rather than the one of the fragments being drawn.
+					glEnable(depth_bounds_test_ext);
+					depth_bounds_ext(cone_bounds.depth_bounds.x, cone_bounds.depth_bounds.y);
+				}
+
+				if (use_stencil_light_volumes) {
+					// Mark the pixels lying in front of the cone's back
+					// faces but behind its front faces. Counting the faces
+					// failing the depth test, rather than passing it, keeps
+					// working with the camera inside the cone.
+					glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+					glDisable(GL_CULL_FACE);
+					glDepthFunc(GL_LESS);
+					glEnable(GL_STENCIL_TEST);
+					glStencilFunc(GL_ALWAYS, 0, 0xFF);
+					glStencilOpSeparate(GL_BACK,  GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+					glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+
+					glUseProgram(fill_depth_shader);
+					glUniformMatrix4fv(fill_depth_shader_locations.vertex_model_to_world, 1, GL_FALSE, glm::value_ptr(light_world_matrix));
+					glBindVertexArray(cone_geometry.vao);
+					glDrawArrays(cone_geometry.drawing_mode, 0, cone_geometry.vertices_nb);
+
+					// Only shade the marked pixels, resetting them for the
+					// next light.
+					glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+					glEnable(GL_CULL_FACE);
+					glDepthFunc(GL_GREATER);
+					glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+					glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+				}
 
-				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::LightAccumulation)]);
 				glUseProgram(accumulate_lights_shader);
-				glViewport(0, 0, framebuffer_width, framebuffer_height);
 				// XXX: Is any clearing needed?
 
 				glUniform1i(accumulate_light_shader_locations.light_index, static_cast<int>(i));
+				glUniform1i(accumulate_light_shader_locations.use_octahedral_normals, gbuffer_layout.normal_encoding != NormalEncoding::RemappedXYZ8 ? 1 : 0);
 				glUniformMatrix4fv(accumulate_light_shader_locations.vertex_model_to_world, 1, GL_FALSE, glm::value_ptr(light_world_matrix));
 				glUniform3fv(accumulate_light_shader_locations.camera_position, 1, glm::value_ptr(mCamera.mWorld.GetTranslation()));
 				glUniform2f(accumulate_light_shader_locations.inverse_screen_resolution,
-				            1.0f / static_cast<float>(framebuffer_width),
-				            1.0f / static_cast<float>(framebuffer_height));
+				            1.0f / static_cast<float>(light_render_width),
+				            1.0f / static_cast<float>(light_render_height));
+				glUniform2f(accumulate_light_shader_locations.render_target_scale,
+				            static_cast<float>(light_render_width) / static_cast<float>(getLightAccumulationSize(framebuffer_width, gbuffer_layout.light_accumulation_resolution)),
+				            static_cast<float>(light_render_height) / static_cast<float>(getLightAccumulationSize(framebuffer_height, gbuffer_layout.light_accumulation_resolution)));
 				glUniform3fv(accumulate_light_shader_locations.light_color, 1, glm::value_ptr(lightColors[i]));
 				glUniform3fv(accumulate_light_shader_locations.light_position, 1, glm::value_ptr(lightTransform.GetTranslation()));
 				glUniform3fv(accumulate_light_shader_locations.light_direction, 1, glm::value_ptr(lightTransform.GetFront()));
@@ -610,32 +1974,53 @@ edan35::Assignment2::run()
 				glUniform1f(accumulate_light_shader_locations.light_angle_falloff, constant::light_angle_falloff);
 
 				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::DepthBuffer)]);
+				glBindTexture(GL_TEXTURE_2D, light_depth_texture);
 				glUniform1i(accumulate_light_shader_locations.depth_texture, 0);
 				glBindSampler(0, samplers[toU(Sampler::Linear)]);
 
 				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::GBufferWorldSpaceNormal)]);
+				glBindTexture(GL_TEXTURE_2D, light_normal_texture);
 				glUniform1i(accumulate_light_shader_locations.normal_texture, 1);
 				glBindSampler(1, samplers[toU(Sampler::Linear)]);
 
 				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::ShadowMap)]);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, frame_graph.GetTexture(shadow_maps));
 				glUniform1i(accumulate_light_shader_locations.shadow_texture, 2);
+				auto const shadowmap_resolution = shadow_map_scheduler.get_rendered_resolution(i);
+				glUniform2f(accumulate_light_shader_locations.shadowmap_scale,
+				            static_cast<float>(shadowmap_resolution.x) / static_cast<float>(constant::shadowmap_res_x),
+				            static_cast<float>(shadowmap_resolution.y) / static_cast<float>(constant::shadowmap_res_y));
 				glBindSampler(2, samplers[toU(Sampler::Linear)]);
 
+				glUniform1i(accumulate_light_shader_locations.shadow_filtering, active_shadow_filtering);
+				glUniform2f(accumulate_light_shader_locations.shadow_depth_range, lightProjectionNearPlane, lightProjectionFarPlane);
+				glUniform1f(accumulate_light_shader_locations.esm_exponent, esm_exponent);
+				glUniform1f(accumulate_light_shader_locations.vsm_light_bleeding_reduction, vsm_light_bleeding_reduction);
+				// Always pointed to its own unit, as samplers of different
+				// types cannot share one.
+				glActiveTexture(GL_TEXTURE3);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, are_shadow_maps_filtered ? frame_graph.GetTexture(shadow_moments) : 0u);
+				glUniform1i(accumulate_light_shader_locations.shadow_moments_texture, 3);
+				glBindSampler(3, samplers[toU(Sampler::Mipmaps)]);
+
+				glBeginQuery(GL_SAMPLES_PASSED, shaded_fragments_queries[query_slot * constant::lights_nb + i]);
 				glBindVertexArray(cone_geometry.vao);
 				glDrawArrays(cone_geometry.drawing_mode, 0, cone_geometry.vertices_nb);
+				glEndQuery(GL_SAMPLES_PASSED);
 
 				glBindVertexArray(0u);
 				glUseProgram(0u);
+				glBindSampler(3u, 0u);
 				glBindSampler(2u, 0u);
 				glBindSampler(1u, 0u);
 				glBindSampler(0u, 0u);
 
-				glEndQuery(GL_TIME_ELAPSED);
-				utils::opengl::debug::endDebugGroup();
+				profiler.EndZone();
 
+				if (use_light_depth_bounds && depth_bounds_ext != nullptr)
+					glDisable(depth_bounds_test_ext);
+				glDisable(GL_SCISSOR_TEST);
+				glDisable(GL_STENCIL_TEST);
 				glDepthMask(GL_TRUE);
 				glDepthFunc(GL_LESS);
 				glDisable(GL_BLEND);
@@ -643,101 +2028,244 @@ edan35::Assignment2::run()
 			}
 
 
+			//
+			// Pass 2.4: Bin the clustered lights into the clusters they touch
+			//
+			auto const inverse_screen_resolution = glm::vec2(1.0f / static_cast<float>(light_render_width),
+			                                                 1.0f / static_cast<float>(light_render_height));
+			// The tiles keep covering the same part of the screen when the
+			// lights are accumulated at a lower resolution.
+			auto const cluster_tile_size = constant::cluster_tile_size >> toU(gbuffer_layout.light_accumulation_resolution);
+
+			profiler.BeginZone("Bin clustered lights", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (use_clustered_lights) {
+				GLuint const no_indices = 0u;
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, cluster_grid.light_indices);
+				glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &no_indices);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::ClusterLightRanges), cluster_grid.light_ranges);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, toU(SSBO::ClusterLightIndices), cluster_grid.light_indices);
+
+				glUseProgram(cluster_lights_shader);
+				glUniform1ui(cluster_lights_shader_locations.lights_nb, static_cast<GLuint>(clustered_lights_nb));
+				glUniform1ui(cluster_lights_shader_locations.light_indices_capacity, cluster_grid.light_indices_capacity);
+				glUniform3uiv(cluster_lights_shader_locations.clusters_nb, 1, glm::value_ptr(cluster_grid.clusters_nb));
+				glUniform2ui(cluster_lights_shader_locations.tile_size, cluster_tile_size, cluster_tile_size);
+				glUniform2fv(cluster_lights_shader_locations.inverse_screen_resolution, 1, glm::value_ptr(inverse_screen_resolution));
+				glUniformMatrix4fv(cluster_lights_shader_locations.clip_to_view, 1, GL_FALSE, glm::value_ptr(clip_to_view));
+				glUniform1f(cluster_lights_shader_locations.z_near, mCamera.mNear);
+				glUniform1f(cluster_lights_shader_locations.z_far, mCamera.mFar);
+
+				glDispatchCompute(cluster_grid.clusters_nb.x, cluster_grid.clusters_nb.y, cluster_grid.clusters_nb.z);
+				glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+				glUseProgram(0u);
+			}
+			profiler.EndZone();
+
+			//
+			// Pass 2.5: Accumulate the clustered lights' contribution, going
+			//           once over each pixel
+			//
+			profiler.BeginZone("Shade clusters", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+			if (frame_graph.BeginPass(shade_clusters_pass)) {
+				glUseProgram(shade_clusters_shader);
+				glUniform3uiv(shade_clusters_shader_locations.clusters_nb, 1, glm::value_ptr(cluster_grid.clusters_nb));
+				glUniform2ui(shade_clusters_shader_locations.tile_size, cluster_tile_size, cluster_tile_size);
+				glUniform2fv(shade_clusters_shader_locations.inverse_screen_resolution, 1, glm::value_ptr(inverse_screen_resolution));
+				glUniformMatrix4fv(shade_clusters_shader_locations.clip_to_view, 1, GL_FALSE, glm::value_ptr(clip_to_view));
+				glUniformMatrix4fv(shade_clusters_shader_locations.world_to_view, 1, GL_FALSE, glm::value_ptr(world_to_view));
+				glUniform1f(shade_clusters_shader_locations.z_near, mCamera.mNear);
+				glUniform1f(shade_clusters_shader_locations.z_far, mCamera.mFar);
+				glUniform1i(shade_clusters_shader_locations.use_octahedral_normals, gbuffer_layout.normal_encoding != NormalEncoding::RemappedXYZ8 ? 1 : 0);
+				glUniform1i(shade_clusters_shader_locations.light_accumulation_format, static_cast<GLint>(gbuffer_layout.light_accumulation_format));
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, light_depth_texture);
+				glUniform1i(shade_clusters_shader_locations.depth_texture, 0);
+				glBindSampler(0, samplers[toU(Sampler::Nearest)]);
+
+				glActiveTexture(GL_TEXTURE1);
+				glBindTexture(GL_TEXTURE_2D, light_normal_texture);
+				glUniform1i(shade_clusters_shader_locations.normal_texture, 1);
+				glBindSampler(1, samplers[toU(Sampler::Nearest)]);
+
+				// Each format has its own pair of image units; see
+				// shade_clusters.comp.
+				auto const light_image_format = light_accumulation_formats[toU(gbuffer_layout.light_accumulation_format)].internal_format;
+				auto const light_image_unit = 2u * toU(gbuffer_layout.light_accumulation_format);
+				glBindImageTexture(light_image_unit,      frame_graph.GetTexture(light_diffuse),  0, GL_FALSE, 0, GL_READ_WRITE, light_image_format);
+				glBindImageTexture(light_image_unit + 1u, frame_graph.GetTexture(light_specular), 0, GL_FALSE, 0, GL_READ_WRITE, light_image_format);
+
+				glDispatchCompute((static_cast<GLuint>(light_render_width) + 15u) / 16u, (static_cast<GLuint>(light_render_height) + 15u) / 16u, 1u);
+				// The resolve pass and the texture previews sample the
+				// accumulation textures.
+				glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+				glBindImageTexture(light_image_unit + 1u, 0u, 0, GL_FALSE, 0, GL_READ_WRITE, light_image_format);
+				glBindImageTexture(light_image_unit,      0u, 0, GL_FALSE, 0, GL_READ_WRITE, light_image_format);
+				glBindSampler(1u, 0u);
+				glBindSampler(0u, 0u);
+				glActiveTexture(GL_TEXTURE0);
+				glUseProgram(0u);
+			}
+			profiler.EndZone();
+
+
 			//
 			// Pass 3: Compute final image using both the g-buffer and  the light accumulation buffer
 			//
-			utils::opengl::debug::beginDebugGroup("Resolve");
-			glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::Resolve)]);
+			profiler.BeginZone("Resolve", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
 
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::Resolve)]);
+			frame_graph.BeginPass(resolve_pass);
 			glUseProgram(resolve_deferred_shader);
-			glViewport(0, 0, framebuffer_width, framebuffer_height);
+			glViewport(0, 0, render_width, render_height);
 			// XXX: Is any clearing needed?
 
-			bind_texture_with_sampler(GL_TEXTURE_2D, 0, resolve_deferred_shader, "diffuse_texture", textures[toU(Texture::GBufferDiffuse)], samplers[toU(Sampler::Nearest)]);
-			bind_texture_with_sampler(GL_TEXTURE_2D, 1, resolve_deferred_shader, "specular_texture", textures[toU(Texture::GBufferSpecular)], samplers[toU(Sampler::Nearest)]);
-			bind_texture_with_sampler(GL_TEXTURE_2D, 2, resolve_deferred_shader, "light_d_texture", textures[toU(Texture::LightDiffuseContribution)], samplers[toU(Sampler::Nearest)]);
-			bind_texture_with_sampler(GL_TEXTURE_2D, 3, resolve_deferred_shader, "light_s_texture", textures[toU(Texture::LightSpecularContribution)], samplers[toU(Sampler::Nearest)]);
+			bind_texture_with_sampler(GL_TEXTURE_2D, 0, resolve_deferred_shader, "diffuse_texture", frame_graph.GetTexture(gbuffer_diffuse), samplers[toU(Sampler::Nearest)]);
+			bind_texture_with_sampler(GL_TEXTURE_2D, 1, resolve_deferred_shader, "specular_texture", frame_graph.GetTexture(gbuffer_specular), samplers[toU(Sampler::Nearest)]);
+			bind_texture_with_sampler(GL_TEXTURE_2D, 2, resolve_deferred_shader, "light_d_texture", frame_graph.GetTexture(light_diffuse), samplers[toU(Sampler::Nearest)]);
+			bind_texture_with_sampler(GL_TEXTURE_2D, 3, resolve_deferred_shader, "light_s_texture", frame_graph.GetTexture(light_specular), samplers[toU(Sampler::Nearest)]);
+			glUniform1i(glGetUniformLocation(resolve_deferred_shader, "is_specular_packed"), gbuffer_layout.pack_specular ? 1 : 0);
+			glUniform1i(glGetUniformLocation(resolve_deferred_shader, "light_accumulation_downsampling"), toU(gbuffer_layout.light_accumulation_resolution));
+			if (is_light_accumulation_downsampled) {
+				bind_texture_with_sampler(GL_TEXTURE_2D, 4, resolve_deferred_shader, "depth_texture", frame_graph.GetTexture(depth_buffer), samplers[toU(Sampler::Nearest)]);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 5, resolve_deferred_shader, "normal_texture", frame_graph.GetTexture(gbuffer_normals), samplers[toU(Sampler::Nearest)]);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 6, resolve_deferred_shader, "downsampled_depth_bounds_texture", frame_graph.GetTexture(downsampled_depth_bounds), samplers[toU(Sampler::Nearest)]);
+				bind_texture_with_sampler(GL_TEXTURE_2D, 7, resolve_deferred_shader, "downsampled_normal_texture", frame_graph.GetTexture(downsampled_normals), samplers[toU(Sampler::Nearest)]);
+				glUniform2i(glGetUniformLocation(resolve_deferred_shader, "downsampled_size"), light_render_width, light_render_height);
+				glUniform1i(glGetUniformLocation(resolve_deferred_shader, "use_octahedral_normals"), gbuffer_layout.normal_encoding != NormalEncoding::RemappedXYZ8 ? 1 : 0);
+				glUniform1f(glGetUniformLocation(resolve_deferred_shader, "z_near"), mCamera.mNear);
+				glUniform1f(glGetUniformLocation(resolve_deferred_shader, "z_far"), mCamera.mFar);
+			}
 
 			bonobo::drawFullscreen();
 
+			if (is_light_accumulation_downsampled) {
+				glBindSampler(7, 0u);
+				glBindSampler(6, 0u);
+				glBindSampler(5, 0u);
+				glBindSampler(4, 0u);
+			}
 			glBindSampler(3, 0u);
 			glBindSampler(2, 0u);
 			glBindSampler(1, 0u);
 			glBindSampler(0, 0u);
 			glUseProgram(0u);
 
-			glEndQuery(GL_TIME_ELAPSED);
-			utils::opengl::debug::endDebugGroup();
+			profiler.EndZone();
 		}
 
 
-		auto const show_debug_elements = show_cone_wireframe || show_basis;
-		if (show_debug_elements) {
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::FinalWithDepth)]);
+		if (frame_graph.BeginPass(debug_elements_pass)) {
+			//
+			// Draw wireframe cones on top of the final image for debugging purposes
+			//
+			if (show_cone_wireframe) {
+				profiler.BeginZone("Draw cone wireframe", Profiler::ZoneType::CpuAndGpu, scaled_resolution_zone);
+
+				glDisable(GL_CULL_FACE);
+				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+				for (size_t i = 0; i < lights_nb; ++i) {
+					cone.render(view_projection,
+					            lightTransforms[i].GetMatrix() * lightOffsetTransform.GetMatrix() * coneScaleTransform.GetMatrix(),
+					            render_light_cones_shader, set_uniforms);
+				}
+				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+				glEnable(GL_CULL_FACE);
+				profiler.EndZone();
+			}
+
+
+			//
+			// Display 3D helpers
+			//
+			if (show_basis) {
+				bonobo::renderBasis(basis_thickness_scale, basis_length_scale, mCamera.GetWorldToClipMatrix());
+			}
 		}
 
 
 		//
-		// Draw wireframe cones on top of the final image for debugging purposes
+		// Upscale the result to the default framebuffer; the GUI is then
+		// drawn on top of it, at the full resolution.
 		//
-		glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::ConeWireframe)]);
-		if (show_cone_wireframe) {
-			utils::opengl::debug::beginDebugGroup("Draw cone wireframe");
-
-			glDisable(GL_CULL_FACE);
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			for (size_t i = 0; i < lights_nb; ++i) {
-				cone.render(view_projection,
-				            lightTransforms[i].GetMatrix() * lightOffsetTransform.GetMatrix() * coneScaleTransform.GetMatrix(),
-				            render_light_cones_shader, set_uniforms);
-			}
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glEnable(GL_CULL_FACE);
-			utils::opengl::debug::endDebugGroup();
-		}
-		glEndQuery(GL_TIME_ELAPSED);
+		profiler.BeginZone("Upscale to default framebuffer");
+
+		// Binds the result to GL_READ_FRAMEBUFFER.
+		frame_graph.BeginPass(upscale_pass);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0u);
+		glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, framebuffer_width, framebuffer_height, GL_COLOR_BUFFER_BIT,
+		                  render_width == framebuffer_width && render_height == framebuffer_height ? GL_NEAREST : GL_LINEAR);
+
+		profiler.EndZone();
+
+		profiler.BeginZone("Capture frame");
+		frame_capture.Capture(0u, GL_BACK, glm::ivec2(framebuffer_width, framebuffer_height));
+		profiler.EndZone();
 
 
-		utils::opengl::debug::beginDebugGroup("Draw GUI");
-		glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::GUI)]);
+		profiler.BeginZone("Draw GUI");
 
 		//
-		// Display 3D helpers
+		// Reset viewport back to normal
 		//
-		if (show_basis) {
-			bonobo::renderBasis(basis_thickness_scale, basis_length_scale, mCamera.GetWorldToClipMatrix());
-		}
-
-		// If the basis and cone wireframe were not shown, FBO::Resolve
-		// is still bound so there is no need to rebind it.
-		if (show_debug_elements) {
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[toU(FBO::Resolve)]);
-		}
+		glViewport(0, 0, framebuffer_width, framebuffer_height);
 
 		//
 		// Output content of the g-buffer as well as of the shadowmap, for debugging purposes
 		//
 		if (show_textures) {
-			bonobo::displayTexture({-0.95f, -0.95f}, {-0.55f, -0.55f}, textures[toU(Texture::GBufferDiffuse)],            samplers[toU(Sampler::Linear)], {0, 1, 2, -1}, glm::uvec2(framebuffer_width, framebuffer_height));
-			bonobo::displayTexture({-0.45f, -0.95f}, {-0.05f, -0.55f}, textures[toU(Texture::GBufferSpecular)],           samplers[toU(Sampler::Linear)], {0, 1, 2, -1}, glm::uvec2(framebuffer_width, framebuffer_height));
-			bonobo::displayTexture({ 0.05f, -0.95f}, { 0.45f, -0.55f}, textures[toU(Texture::GBufferWorldSpaceNormal)],   samplers[toU(Sampler::Linear)], {0, 1, 2, -1}, glm::uvec2(framebuffer_width, framebuffer_height));
-			bonobo::displayTexture({ 0.55f, -0.95f}, { 0.95f, -0.55f}, textures[toU(Texture::DepthBuffer)],               samplers[toU(Sampler::Linear)], {0, 0, 0, -1}, glm::uvec2(framebuffer_width, framebuffer_height), true, mCamera.mNear, mCamera.mFar);
-			bonobo::displayTexture({-0.95f,  0.55f}, {-0.55f,  0.95f}, textures[toU(Texture::ShadowMap)],                 samplers[toU(Sampler::Linear)], {0, 0, 0, -1}, glm::uvec2(framebuffer_width, framebuffer_height), true, lightProjectionNearPlane, lightProjectionFarPlane);
-			bonobo::displayTexture({-0.45f,  0.55f}, {-0.05f,  0.95f}, textures[toU(Texture::LightDiffuseContribution)],  samplers[toU(Sampler::Linear)], {0, 1, 2, -1}, glm::uvec2(framebuffer_width, framebuffer_height));
-			bonobo::displayTexture({ 0.05f,  0.55f}, { 0.45f,  0.95f}, textures[toU(Texture::LightSpecularContribution)], samplers[toU(Sampler::Linear)], {0, 1, 2, -1}, glm::uvec2(framebuffer_width, framebuffer_height));
+			auto const size = glm::uvec2(framebuffer_width, framebuffer_height);
+			auto const linear = samplers[toU(Sampler::Linear)];
+			bonobo::displayTexture({-0.95f, -0.95f}, {-0.55f, -0.55f}, frame_graph.GetTexture(gbuffer_diffuse),  linear, {0, 1, 2, -1}, size);
+			if (gbuffer_layout.pack_specular)
+				bonobo::displayTexture({-0.45f, -0.95f}, {-0.05f, -0.55f}, frame_graph.GetTexture(gbuffer_diffuse),  linear, {3, 3, 3, -1}, size);
+			else
+				bonobo::displayTexture({-0.45f, -0.95f}, {-0.05f, -0.55f}, frame_graph.GetTexture(gbuffer_specular), linear, {0, 1, 2, -1}, size);
+			bonobo::displayTexture({ 0.05f, -0.95f}, { 0.45f, -0.55f}, frame_graph.GetTexture(gbuffer_normals),  linear, {0, 1, 2, -1}, size);
+			bonobo::displayTexture({ 0.55f, -0.95f}, { 0.95f, -0.55f}, frame_graph.GetTexture(depth_buffer),     linear, {0, 0, 0, -1}, size, true, mCamera.mNear, mCamera.mFar);
+			bonobo::displayTexture({-0.95f,  0.55f}, {-0.55f,  0.95f}, frame_graph.GetTexture(shadow_maps),      linear, {0, 0, 0, -1}, size, true, lightProjectionNearPlane, lightProjectionFarPlane, std::min(shown_shadow_map, lights_nb - 1));
+			bonobo::displayTexture({-0.45f,  0.55f}, {-0.05f,  0.95f}, frame_graph.GetTexture(light_diffuse),    linear, {0, 1, 2, -1}, size);
+			bonobo::displayTexture({ 0.05f,  0.55f}, { 0.45f,  0.95f}, frame_graph.GetTexture(light_specular),   linear, {0, 1, 2, -1}, size);
 		}
 
-		//
-		// Reset viewport back to normal
-		//
-		glViewport(0, 0, framebuffer_width, framebuffer_height);
-
 		bool opened = ImGui::Begin("Render Time", nullptr, ImGuiWindowFlags_None);
 		if (opened) {
 			ImGui::Text("Frame CPU time: %.3f ms", std::chrono::duration<float, std::milli>(deltaTimeUs).count());
+			ImGui::Text("Render resolution: %d x %d (%.0f%% of %d x %d)", render_width, render_height,
+			            100.0f * resolution_scale, framebuffer_width, framebuffer_height);
+			ImGui::Text("Visible lights: %zu / %d", visible_lights_nb, lights_nb);
+			if (use_occlusion_culling)
+				ImGui::Text("Drawn meshes: %u + %u disoccluded / %zu", occluded_drawn_meshes_nb[0], occluded_drawn_meshes_nb[1], sponza_geometry.size());
+			if (are_occlusion_queries_used) {
+				auto const& statistics = occlusion_culler.GetStatistics();
+				ImGui::Text("Occlusion queries: %zu issued, %zu skipped, for %zu / %zu meshes",
+				            statistics.issued_queries_nb, statistics.skipped_queries_nb, statistics.tested_objects_nb, sponza_geometry.size());
+				ImGui::Text("Draws saved: %zu per geometry pass%s", statistics.culled_draws_nb,
+				            occlusion_culler.GetMode() == OcclusionCuller::Mode::ConditionalRendering ? " (from the latest results read back)" : "");
+			}
+			ImGui::Text("Frame data fence wait: %.3f ms (%u frames in flight, %s)",
+			            std::chrono::duration<float, std::milli>(frame_data.GetLastFenceWaitTime()).count(),
+			            frame_data.GetFramesNb(), frame_data.IsPersistentlyMapped() ? "persistently mapped" : "copied");
+			if (frame_capture.IsCapturing()) {
+				auto const statistics = frame_capture.GetStatistics();
+				ImGui::Text("Frame capture: %.3f ms CPU, %llu written, %zu queued, %llu dropped, %llu failed",
+				            std::chrono::duration<float, std::milli>(statistics.last_capture_time).count(),
+				            static_cast<unsigned long long>(statistics.written_frames_nb), statistics.queued_frames_nb,
+				            static_cast<unsigned long long>(statistics.dropped_frames_nb),
+				            static_cast<unsigned long long>(statistics.failed_frames_nb));
+			}
 
-			ImGui::Checkbox("Copy elapsed times back to CPU", &copy_elapsed_times);
+			// Timings of the most recent frame the GPU is done with; see the
+			// "Profiler" window for all zones and their history.
+			auto const* const latest_frame = profiler.GetLatestFrame();
+			auto const show_gpu_time = [latest_frame](std::string const& zone_name){
+				auto const* const zone = latest_frame != nullptr ? latest_frame->FindZone(zone_name) : nullptr;
+				if (zone != nullptr && zone->has_gpu_times)
+					ImGui::Text("%.3f", std::chrono::duration<float, std::milli>(zone->GetGpuDuration()).count());
+				else
+					ImGui::TextDisabled("-");
+			};
 
 			if (ImGui::BeginTable("Pass durations", 2, ImGuiTableFlags_SizingFixedFit))
 			{
@@ -745,115 +2273,358 @@ edan35::Assignment2::run()
 				ImGui::TableSetupColumn("GPU time [ms]");
 				ImGui::TableHeadersRow();
 
+				if (use_occlusion_culling) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Meshes culling");
+					ImGui::TableNextColumn();
+					show_gpu_time("Cull meshes");
+				}
+
+				if (use_depth_prepass) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Depth pre-pass");
+					ImGui::TableNextColumn();
+					show_gpu_time("Depth pre-pass");
+				}
+
 				ImGui::TableNextColumn();
 				ImGui::Text("Gbuffer gen.");
 				ImGui::TableNextColumn();
-				ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::GbufferGeneration)] / 1000000.0f);
+				show_gpu_time("Fill G-buffer");
+
+				if (use_occlusion_culling) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Hi-Z pyramid");
+					ImGui::TableNextColumn();
+					show_gpu_time("Build Hi-Z pyramid");
+
+					ImGui::TableNextColumn();
+					ImGui::Text("Gbuffer gen., disoccluded");
+					ImGui::TableNextColumn();
+					show_gpu_time("Fill G-buffer, disoccluded meshes");
+				}
+
+				if (are_occlusion_queries_used) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Occlusion queries");
+					ImGui::TableNextColumn();
+					show_gpu_time("Issue occlusion queries");
+				}
+
+				if (is_light_accumulation_downsampled) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Depth and normals downsampling");
+					ImGui::TableNextColumn();
+					show_gpu_time("Downsample depth and normals");
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::Text("Shadow maps");
+				ImGui::TableNextColumn();
+				show_gpu_time("Update shadow maps");
+
+				if (are_shadow_maps_filtered) {
+					ImGui::TableNextColumn();
+					ImGui::Text("  Prefiltering");
+					ImGui::TableNextColumn();
+					show_gpu_time("Prefilter shadow maps");
+				}
+
+				ImGui::TableNextColumn();
+				ImGui::Text("  %zu updated, %zu pending", shadow_maps_updated_nb, shadow_map_scheduler.get_pending_updates_nb());
+				ImGui::TableNextColumn();
+				ImGui::Text("~%.3f each", std::chrono::duration<float, std::milli>(shadow_map_scheduler.get_estimated_update_cost()).count());
 
 				for (std::size_t i = 0; i < lights_nb; ++i) {
+					auto const& cone_bounds = light_cone_bounds[i];
 					ImGui::TableNextColumn();
 					ImGui::Text("Light %zu", i);
 					ImGui::TableNextColumn();
-					ImGui::Text("");
+					if (cone_bounds.is_visible)
+						ImGui::Text("%d x %d px, depth [%.4f, %.4f]", cone_bounds.scissor_box.z, cone_bounds.scissor_box.w,
+						            cone_bounds.depth_bounds.x, cone_bounds.depth_bounds.y);
+					else
+						ImGui::TextDisabled("culled");
+
+					ImGui::TableNextColumn();
+					ImGui::Text("  Shadow casters");
+					ImGui::TableNextColumn();
+					ImGui::Text("%zu / %zu", shadow_casters_nb[i], sponza_geometry.size());
 
+					auto const shadowmap_resolution = shadow_map_scheduler.get_rendered_resolution(i);
 					ImGui::TableNextColumn();
-					ImGui::Text("  Shadow map");
+					ImGui::Text("  Shadow map resolution");
 					ImGui::TableNextColumn();
-					ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::ShadowMap0Generation) + i] / 1000000.0f);
+					ImGui::Text("%u x %u", shadowmap_resolution.x, shadowmap_resolution.y);
 
 					ImGui::TableNextColumn();
 					ImGui::Text("  Light accumulation");
 					ImGui::TableNextColumn();
-					ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::Light0Accumulation) + i] / 1000000.0f);
+					show_gpu_time("Accumulate light " + std::to_string(i));
+
+					ImGui::TableNextColumn();
+					ImGui::Text("  Shaded fragments");
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu (%.1f%%)", static_cast<unsigned long long>(shaded_fragments_nb[i]),
+					            100.0f * static_cast<float>(shaded_fragments_nb[i]) / static_cast<float>(light_render_width * light_render_height));
+				}
+
+				if (use_clustered_lights) {
+					ImGui::TableNextColumn();
+					ImGui::Text("%d clustered lights", clustered_lights_nb);
+					ImGui::TableNextColumn();
+					ImGui::Text("");
+
+					ImGui::TableNextColumn();
+					ImGui::Text("  Binning");
+					ImGui::TableNextColumn();
+					show_gpu_time("Bin clustered lights");
+
+					ImGui::TableNextColumn();
+					ImGui::Text("  Shading");
+					ImGui::TableNextColumn();
+					show_gpu_time("Shade clusters");
 				}
 
 				ImGui::TableNextColumn();
 				ImGui::Text("Resolve");
 				ImGui::TableNextColumn();
-				ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::Resolve)] / 1000000.0f);
+				show_gpu_time("Resolve");
 
 				ImGui::TableNextColumn();
 				ImGui::Text("Cone wireframe");
 				ImGui::TableNextColumn();
-				ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::ConeWireframe)] / 1000000.0f);
+				show_gpu_time("Draw cone wireframe");
 
 				ImGui::TableNextColumn();
-				ImGui::Text("GUI");
+				ImGui::Text("Upscale to framebuffer");
 				ImGui::TableNextColumn();
-				ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::GUI)] / 1000000.0f);
+				show_gpu_time("Upscale to default framebuffer");
+
+				if (frame_capture.IsCapturing()) {
+					ImGui::TableNextColumn();
+					ImGui::Text("Frame capture");
+					ImGui::TableNextColumn();
+					show_gpu_time("Capture frame");
+				}
 
 				ImGui::TableNextColumn();
-				ImGui::Text("Copy to framebuffer");
+				ImGui::Text("GUI");
 				ImGui::TableNextColumn();
-				ImGui::Text("%.3f", pass_elapsed_times[toU(ElapsedTimeQuery::CopyToFramebuffer)] / 1000000.0f);
+				show_gpu_time("Draw GUI");
+
+				ImGui::EndTable();
+			}
+
+			// Upper bound of the traffic to the G-buffer and light
+			// accumulation textures, as if every light covered the whole
+			// screen; it ignores any compression done by the GPU.
+			auto const traffic = computeGBufferTraffic(gbuffer_layout);
+			float written_bytes = traffic.gbuffer_written + traffic.downsample_written + static_cast<float>(lights_nb) * traffic.light_written + traffic.resolve_written;
+			float read_bytes = traffic.gbuffer_read + traffic.downsample_read + static_cast<float>(lights_nb) * traffic.light_read + traffic.resolve_read;
+			if (use_clustered_lights) {
+				written_bytes += traffic.clusters_written;
+				read_bytes += traffic.clusters_read;
+			}
+			if (ImGui::BeginTable("G-buffer traffic", 3, ImGuiTableFlags_SizingFixedFit))
+			{
+				ImGui::TableSetupColumn("Pass");
+				ImGui::TableSetupColumn("Written [B/px]");
+				ImGui::TableSetupColumn("Read [B/px]");
+				ImGui::TableHeadersRow();
+
+				auto const add_row = [](char const* pass, float written, float read){
+					ImGui::TableNextColumn();
+					ImGui::Text("%s", pass);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", written);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", read);
+				};
+				add_row("Gbuffer gen.", traffic.gbuffer_written, traffic.gbuffer_read);
+				if (is_light_accumulation_downsampled)
+					add_row("Downsampling", traffic.downsample_written, traffic.downsample_read);
+				add_row("Each light", traffic.light_written, traffic.light_read);
+				if (use_clustered_lights)
+					add_row("Clustered lights", traffic.clusters_written, traffic.clusters_read);
+				add_row("Resolve", traffic.resolve_written, traffic.resolve_read);
+				add_row("Total", written_bytes, read_bytes);
 
 				ImGui::EndTable();
 			}
+			auto const frame_traffic_mib = [written_bytes, read_bytes](int width, int height){
+				return (written_bytes + read_bytes) * static_cast<float>(width) * static_cast<float>(height) / (1024.0f * 1024.0f);
+			};
+			ImGui::Text("Per frame: %.1f MiB at %d x %d, %.1f MiB at 3840 x 2160",
+			            frame_traffic_mib(render_width, render_height), render_width, render_height,
+			            frame_traffic_mib(3840, 2160));
 		}
 		ImGui::End();
 
 		opened = ImGui::Begin("Scene Controls", nullptr, ImGuiWindowFlags_None);
 		if (opened) {
-			ImGui::Checkbox("Pause lights", &are_lights_paused);
+			if (ImGui::Checkbox("Pause lights", &are_lights_paused))
+				light_animation.SetPaused(are_lights_paused);
 			ImGui::SliderInt("Number of lights", &lights_nb, 1, static_cast<int>(constant::lights_nb));
+			ImGui::Checkbox("Depth pre-pass", &use_depth_prepass);
+			ImGui::Checkbox("Stencil-masked light volumes", &use_stencil_light_volumes);
+			ImGui::Checkbox("Cull lights outside the view", &cull_lights);
+			ImGui::Checkbox("Scissor lights to their screen bounds", &use_light_scissor);
+			ImGui::BeginDisabled(depth_bounds_ext == nullptr);
+			ImGui::Checkbox("Depth bounds test (GL_EXT_depth_bounds_test)", &use_light_depth_bounds);
+			ImGui::EndDisabled();
+			// Shadow maps cached with or without the casters outside the
+			// view would otherwise be kept as is.
+			if (ImGui::Checkbox("Cull shadow casters outside the view", &cull_casters_outside_view))
+				shadow_map_scheduler.invalidate_all();
+			if (ImGui::Checkbox("Cache shadow maps", &cache_shadow_maps))
+				shadow_map_scheduler.set_caching_enabled(cache_shadow_maps);
+			if (ImGui::SliderFloat("Shadow map budget [ms]", &shadow_map_budget_ms, 0.0f, 10.0f, "%.2f"))
+				shadow_map_scheduler.set_budget(std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(shadow_map_budget_ms * 1000.0f)));
+			ImGui::Checkbox("Adaptive shadow map resolution", &use_adaptive_shadow_maps);
+			char const* const shadow_map_resolutions[] = { "1024 x 1024", "512 x 512", "256 x 256", "128 x 128" };
+			static_assert(sizeof(shadow_map_resolutions) / sizeof(shadow_map_resolutions[0]) == constant::shadowmap_max_lod + 1,
+			              "There should be one label per shadow map level of detail.");
+			ImGui::Combo("Max shadow map resolution", &finest_shadow_map_lod, shadow_map_resolutions, constant::shadowmap_max_lod + 1);
+			ImGui::BeginDisabled(!use_adaptive_shadow_maps);
+			ImGui::SliderFloat("Shadow map texels per pixel", &shadow_map_texels_per_pixel, 0.25f, 4.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+			ImGui::EndDisabled();
+			// The moments have to be recomputed from all shadow maps.
+			ImGui::BeginDisabled(!are_shadow_moments_read);
+			if (ImGui::Combo("Shadow filtering", &shadow_filtering, "None\0Variance shadow maps\0Exponential shadow maps\0"))
+				shadow_map_scheduler.invalidate_all();
+			if (!are_shadow_moments_read)
+				ImGui::TextWrapped("Call compute_shadow_visibility() from accumulate_lights.frag, then reload the shaders, to filter the shadow maps.");
+			ImGui::BeginDisabled(shadow_filtering == toU(ShadowFiltering::Depth));
+			if (ImGui::SliderInt("Shadow blur radius [texels]", &shadow_blur_radius, 1, 8))
+				shadow_map_scheduler.invalidate_all();
+			ImGui::EndDisabled();
+			ImGui::BeginDisabled(shadow_filtering != toU(ShadowFiltering::Exponential));
+			if (ImGui::SliderFloat("ESM exponent", &esm_exponent, 1.0f, 85.0f, "%.1f"))
+				shadow_map_scheduler.invalidate_all();
+			ImGui::EndDisabled();
+			ImGui::BeginDisabled(shadow_filtering != toU(ShadowFiltering::Variance));
+			ImGui::SliderFloat("VSM light bleeding reduction", &vsm_light_bleeding_reduction, 0.0f, 0.9f, "%.2f");
+			ImGui::EndDisabled();
+			ImGui::EndDisabled();
+			ImGui::Separator();
+			if (ImGui::Checkbox("Dynamic resolution", &use_dynamic_resolution))
+				dynamic_resolution.set_enabled(use_dynamic_resolution);
+			ImGui::BeginDisabled(!use_dynamic_resolution);
+			if (ImGui::SliderFloat("Target GPU frame time [ms]", &target_frame_time_ms, 1.0f, 50.0f, "%.1f"))
+				dynamic_resolution.set_target_frame_time(std::chrono::microseconds(static_cast<std::chrono::microseconds::rep>(target_frame_time_ms * 1000.0f)));
+			if (ImGui::SliderFloat("Min resolution scale", &min_resolution_scale, 0.25f, 1.0f, "%.2f"))
+				dynamic_resolution.set_min_scale(min_resolution_scale);
+			ImGui::EndDisabled();
+			ImGui::Separator();
+			ImGui::BeginDisabled(!is_clustered_lighting_supported);
+			ImGui::Checkbox("Clustered lights (OpenGL 4.3)", &use_clustered_lights);
+			ImGui::SliderInt("Number of clustered lights", &clustered_lights_nb, 1, static_cast<int>(constant::clustered_lights_max_nb), "%d", ImGuiSliderFlags_Logarithmic);
+			ImGui::SliderFloat("Clustered light intensity", &clustered_light_intensity, 0.1f, 10.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+			ImGui::Text("Clusters: %u x %u x %u", cluster_grid.clusters_nb.x, cluster_grid.clusters_nb.y, cluster_grid.clusters_nb.z);
+			ImGui::EndDisabled();
+			ImGui::BeginDisabled(!is_occlusion_culling_supported);
+			if (ImGui::Checkbox("GPU occlusion culling (OpenGL 4.3)", &use_occlusion_culling))
+				is_hiz_pyramid_valid = false;
+			ImGui::EndDisabled();
+			ImGui::BeginDisabled(use_occlusion_culling);
+			ImGui::Checkbox("Occlusion queries for large meshes", &use_occlusion_queries);
+			ImGui::Combo("Occlusion query results", &occlusion_query_mode, "Read back a frame later\0Conditional rendering\0");
+			ImGui::SliderInt("Min triangles per queried mesh", &occlusion_query_min_triangles_nb, 100, 100000, "%d", ImGuiSliderFlags_Logarithmic);
+			ImGui::SliderInt("Visible results before skipping queries", &occlusion_query_visible_results_nb, 1, 16);
+			ImGui::SliderInt("Frames without queries", &occlusion_query_skipped_frames_nb, 0, 64);
+			ImGui::EndDisabled();
+			ImGui::Combo("G-buffer normals", &normal_encoding, "XYZ (RGBA8)\0Octahedral (RG8)\0Octahedral (RG16)\0");
+			ImGui::Checkbox("Pack specular intensity into diffuse alpha", &pack_specular);
+			ImGui::Combo("Light accumulation format", &light_accumulation_format, "RGBA8\0RGBA16F\0R11G11B10F\0");
+			ImGui::Combo("Light accumulation resolution", &light_accumulation_resolution, "Full\0Half\0Quarter\0");
+			ImGui::Separator();
 			ImGui::Checkbox("Show textures", &show_textures);
+			ImGui::SliderInt("Shown shadow map", &shown_shadow_map, 0, lights_nb - 1);
 			ImGui::Checkbox("Show light cones wireframe", &show_cone_wireframe);
 			ImGui::Separator();
 			ImGui::Checkbox("Show basis", &show_basis);
 			ImGui::SliderFloat("Basis thickness scale", &basis_thickness_scale, 0.0f, 100.0f);
 			ImGui::SliderFloat("Basis length scale", &basis_length_scale, 0.0f, 100.0f);
+			ImGui::Separator();
+			ImGui::BeginDisabled(frame_capture.IsCapturing());
+			ImGui::InputText("Capture prefix", capture_prefix.data(), capture_prefix.size());
+			ImGui::Combo("Capture format", &capture_format, "PNG sequence\0Raw video (RGB24)\0");
+			ImGui::EndDisabled();
+			if (!frame_capture.IsCapturing()) {
+				if (ImGui::Button("Start capture"))
+					frame_capture.Start(capture_prefix.data(), static_cast<FrameCapture::Format>(capture_format));
+			} else if (ImGui::Button("Stop capture")) {
+				frame_capture.Stop();
+			}
 		}
 		ImGui::End();
 
+		profiler.RenderImGui();
+		frame_graph.RenderImGui();
 		if (show_logs)
 			Log::View::Render();
 		mWindowManager.RenderImGuiFrame(show_gui);
 
-		glEndQuery(GL_TIME_ELAPSED);
-		utils::opengl::debug::endDebugGroup();
-
-		//
-		// Blit the result back to the default framebuffer.
-		//
-		utils::opengl::debug::beginDebugGroup("Copy to default framebuffer");
-		glBeginQuery(GL_TIME_ELAPSED, elapsed_time_queries[toU(ElapsedTimeQuery::CopyToFramebuffer)]);
-
-		// FBO::Resolve has already been bound to GL_READ_FRAMEBUFFER before rendering the first frame,
-		// as no other frame buffer gets bound to it.
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0u);
-		glBlitFramebuffer(0, 0, framebuffer_width, framebuffer_height, 0, 0, framebuffer_width, framebuffer_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		profiler.EndZone();
 
-		glEndQuery(GL_TIME_ELAPSED);
-		utils::opengl::debug::endDebugGroup();
+		frame_data.EndFrame();
+		profiler.EndFrame();
+		++frame_index;
 
-		glfwSwapBuffers(window);
+		mWindowManager.SwapBuffers(window);
 
-		first_frame = false;
 	}
-
-	glDeleteBuffers(static_cast<GLsizei>(ubos.size()), ubos.data());
-	glDeleteQueries(static_cast<GLsizei>(elapsed_time_queries.size()), elapsed_time_queries.data());
+	frame_capture.Stop();
+
+	if (mWindowManager.IsBenchmarking())
+		profiler.ReportStatistics(mWindowManager.GetBenchmarkSettings().pass_statistics_filename);
+
+	glDeleteQueries(static_cast<GLsizei>(shaded_fragments_queries.size()), shaded_fragments_queries.data());
+	for (auto const fence : occlusion_statistics_fences)
+		if (fence != nullptr)
+			glDeleteSync(fence);
+	deleteOcclusionCullingBuffers(occlusion_culling_buffers);
+	deleteHiZPyramid(hiz_pyramid);
+	glDeleteBuffers(1, &cluster_grid.light_indices);
+	glDeleteBuffers(1, &cluster_grid.light_ranges);
+	glDeleteBuffers(1, &sponza_material_textures.materials_ubo);
+	glDeleteTextures(static_cast<GLsizei>(sponza_material_textures.texture_arrays.size()), sponza_material_textures.texture_arrays.data());
 	glDeleteSamplers(static_cast<GLsizei>(samplers.size()), samplers.data());
-	glDeleteFramebuffers(static_cast<GLsizei>(fbos.size()), fbos.data());
-	glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
 
+	glDeleteProgram(cull_meshes_shader);
+	cull_meshes_shader = 0u;
+	glDeleteProgram(build_hiz_shader);
+	build_hiz_shader = 0u;
+	glDeleteProgram(shade_clusters_shader);
+	shade_clusters_shader = 0u;
+	glDeleteProgram(cluster_lights_shader);
+	cluster_lights_shader = 0u;
 	glDeleteProgram(resolve_deferred_shader);
 	resolve_deferred_shader = 0u;
+	glDeleteProgram(downsample_depth_normals_shader);
+	downsample_depth_normals_shader = 0u;
+	glDeleteProgram(blur_shadow_moments_shader);
+	blur_shadow_moments_shader = 0u;
 	glDeleteProgram(accumulate_lights_shader);
 	accumulate_lights_shader = 0u;
 	glDeleteProgram(fill_shadowmap_shader);
 	fill_shadowmap_shader = 0u;
+	glDeleteProgram(fill_depth_alpha_tested_shader);
+	fill_depth_alpha_tested_shader = 0u;
+	glDeleteProgram(fill_depth_shader);
+	fill_depth_shader = 0u;
 	glDeleteProgram(fill_gbuffer_shader);
 	fill_gbuffer_shader = 0u;
 	glDeleteProgram(fallback_shader);
 	fallback_shader = 0u;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 	std::setlocale(LC_ALL, "");
 
-	Bonobo framework;
+	Bonobo framework(argc, argv);
 
 	try {
 		edan35::Assignment2 assignment2(framework.GetWindowManager());
@@ -865,45 +2636,15 @@ int main()
 
 namespace
 {
-Textures createTextures(GLsizei framebuffer_width, GLsizei framebuffer_height)
+FrameGraph::TextureDescription describeTexture(std::string const& name, TextureFormat const& format, GLsizei size_divisor)
 {
-	Textures textures;
-	glGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::DepthBuffer)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, framebuffer_width, framebuffer_height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::DepthBuffer)], "Depth buffer");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::ShadowMap)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, constant::shadowmap_res_x, constant::shadowmap_res_y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::ShadowMap)], "Shadow map");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::GBufferDiffuse)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::GBufferDiffuse)], "GBuffer diffuse");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::GBufferSpecular)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::GBufferSpecular)], "GBuffer specular");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::GBufferWorldSpaceNormal)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::GBufferWorldSpaceNormal)], "GBuffer normals");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::LightDiffuseContribution)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::LightDiffuseContribution)], "Light diffuse contribution");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::LightSpecularContribution)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::LightSpecularContribution)], "Light specular contribution");
-
-	glBindTexture(GL_TEXTURE_2D, textures[toU(Texture::Result)]);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, framebuffer_width, framebuffer_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-	utils::opengl::debug::nameObject(GL_TEXTURE, textures[toU(Texture::Result)], "Final result");
-
-	glBindTexture(GL_TEXTURE_2D, 0u);
-	return textures;
+	FrameGraph::TextureDescription description;
+	description.name = name;
+	description.internal_format = format.internal_format;
+	description.format = format.format;
+	description.type = format.type;
+	description.size_divisor = size_divisor;
+	return description;
 }
 
 Samplers createSamplers()
@@ -929,159 +2670,46 @@ Samplers createSamplers()
 	return samplers;
 }
 
-FBOs createFramebufferObjects(Textures const& textures)
-{
-	auto const validate_fbo = [](std::string const& fbo_name){
-		auto const status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-		if (status == GL_FRAMEBUFFER_COMPLETE)
-			return;
-
-		LogError("Framebuffer \"%s\" is not complete: check the logs for additional information.", fbo_name.data());
-	};
-
-	FBOs fbos;
-	glGenFramebuffers(static_cast<GLsizei>(fbos.size()), fbos.data());
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbos[toU(FBO::GBuffer)]);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[toU(Texture::GBufferDiffuse)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[toU(Texture::GBufferSpecular)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, textures[toU(Texture::GBufferWorldSpaceNormal)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[toU(Texture::DepthBuffer)], 0);
-	glReadBuffer(GL_NONE); // Disable reading back from the colour attachments, as unnecessary in this assignment.
-	// Configure the mapping from fragment shader outputs to colour attachments.
-	std::array<GLenum, 3> const gbuffer_draws = {
-		GL_COLOR_ATTACHMENT0, // The fragment shader output at location 0 will be written to colour attachment 0 (i.e. the diffuse texture).
-		GL_COLOR_ATTACHMENT1, // The fragment shader output at location 1 will be written to colour attachment 1 (i.e. the specular texture).
-		GL_COLOR_ATTACHMENT2  // The fragment shader output at location 2 will be written to colour attachment 2 (i.e. the normal texture).
-	};
-	glDrawBuffers(static_cast<GLsizei>(gbuffer_draws.size()), gbuffer_draws.data());
-	validate_fbo("GBuffer");
-	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, fbos[toU(FBO::GBuffer)], "GBuffer");
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbos[toU(FBO::ShadowMap)]);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[toU(Texture::ShadowMap)], 0);
-	validate_fbo("Shadow map generation");
-	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, fbos[toU(FBO::ShadowMap)], "Shadow map generation");
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbos[toU(FBO::LightAccumulation)]);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[toU(Texture::LightDiffuseContribution)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[toU(Texture::LightSpecularContribution)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[toU(Texture::DepthBuffer)], 0);
-	glReadBuffer(GL_NONE); // Disable reading back from the colour attachments, as unnecessary in this assignment.
-	// Configure the mapping from fragment shader outputs to colour attachments.
-	std::array<GLenum, 2> const light_accumulation_draws = {
-		GL_COLOR_ATTACHMENT0, // The fragment shader output at location 0 will be written to colour attachment 0 (i.e. the light diffuse contribution texture).
-		GL_COLOR_ATTACHMENT1  // The fragment shader output at location 1 will be written to colour attachment 1 (i.e. the light specular contribution texture).
-	};
-	glDrawBuffers(static_cast<GLsizei>(light_accumulation_draws.size()), light_accumulation_draws.data());
-	validate_fbo("Light accumulation");
-	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, fbos[toU(FBO::LightAccumulation)], "Light acccumulation");
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbos[toU(FBO::Resolve)]);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[toU(Texture::Result)], 0);
-	glReadBuffer(GL_COLOR_ATTACHMENT0); // Colour attachment result 0 (i.e. the rendering result texture) will be blitted to the screen.
-	glDrawBuffer(GL_COLOR_ATTACHMENT0); // The fragment shader output at location 0 will be written to colour attachment 0 (i.e. the rendering result texture).
-	validate_fbo("Resolve");
-	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, fbos[toU(FBO::Resolve)], "Resolve");
-
-	glBindFramebuffer(GL_FRAMEBUFFER, fbos[toU(FBO::FinalWithDepth)]);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[toU(Texture::Result)], 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[toU(Texture::DepthBuffer)], 0);
-	glReadBuffer(GL_NONE); // Disable reading back from the colour attachments, as unnecessary in this assignment.
-	glDrawBuffer(GL_COLOR_ATTACHMENT0); // The fragment shader output at location 0 will be written to colour attachment 0 (i.e. the rendering result texture).
-	validate_fbo("Final with depth");
-	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, fbos[toU(FBO::FinalWithDepth)], "Cone wireframe");
-
-	glBindFramebuffer(GL_FRAMEBUFFER, 0u);
-	return fbos;
-}
-
-ElapsedTimeQueries createElapsedTimeQueries()
-{
-	ElapsedTimeQueries queries;
-	glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
-
-	if (utils::opengl::debug::isSupported())
-	{
-		// Queries (like any other OpenGL object) need to have been used at least
-		// once to ensure their resources have been allocated so we can call
-		// `glObjectLabel()` on them.
-		auto const register_query = [](GLuint const query) {
-			glBeginQuery(GL_TIME_ELAPSED, query);
-			glEndQuery(GL_TIME_ELAPSED);
-		};
-
-		register_query(queries[toU(ElapsedTimeQuery::GbufferGeneration)]);
-		utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::GbufferGeneration)], "GBuffer generation");
-
-		for (size_t i = 0; i < constant::lights_nb; ++i)
-		{
-			register_query(queries[toU(ElapsedTimeQuery::ShadowMap0Generation) + i]);
-			utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::ShadowMap0Generation) + i], "Shadow map " + std::to_string(i) + " generation");
-
-			register_query(queries[toU(ElapsedTimeQuery::Light0Accumulation) + i]);
-			utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::Light0Accumulation) + i], "Light" + std::to_string(i) + " accumulation");
-		}
-
-		register_query(queries[toU(ElapsedTimeQuery::Resolve)]);
-		utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::Resolve)], "Resolve");
-
-		register_query(queries[toU(ElapsedTimeQuery::ConeWireframe)]);
-		utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::ConeWireframe)], "Cone wireframe");
-
-		register_query(queries[toU(ElapsedTimeQuery::GUI)]);
-		utils::opengl::debug::nameObject(GL_QUERY, queries[toU(ElapsedTimeQuery::GUI)], "GUI");
-	}
-
-	return queries;
-}
-
-UBOs createUniformBufferObjects()
-{
-	UBOs ubos;
-	glGenBuffers(static_cast<GLsizei>(ubos.size()), ubos.data());
-
-	glBindBuffer(GL_UNIFORM_BUFFER, ubos[toU(UBO::CameraViewProjTransforms)]);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewProjTransforms), nullptr, GL_STREAM_DRAW);
-	glBindBufferBase(GL_UNIFORM_BUFFER, toU(UBO::CameraViewProjTransforms), ubos[toU(UBO::CameraViewProjTransforms)]);
-	utils::opengl::debug::nameObject(GL_BUFFER, ubos[toU(UBO::CameraViewProjTransforms)], "Camera view-projection transforms");
-
-	glBindBuffer(GL_UNIFORM_BUFFER, ubos[toU(UBO::LightViewProjTransforms)]);
-	glBufferData(GL_UNIFORM_BUFFER, constant::lights_nb * sizeof(ViewProjTransforms), nullptr, GL_STREAM_DRAW);
-	glBindBufferBase(GL_UNIFORM_BUFFER, toU(UBO::LightViewProjTransforms), ubos[toU(UBO::LightViewProjTransforms)]);
-	utils::opengl::debug::nameObject(GL_BUFFER, ubos[toU(UBO::LightViewProjTransforms)], "Light view-projection transforms");
-
-	glBindBuffer(GL_UNIFORM_BUFFER, 0u);
-	return ubos;
-}
-
 void fillGBufferShaderLocations(GLuint gbuffer_shader, GBufferShaderLocations& locations)
 {
 	locations.ubo_CameraViewProjTransforms = glGetUniformBlockIndex(gbuffer_shader, "CameraViewProjTransforms");
 	locations.vertex_model_to_world = glGetUniformLocation(gbuffer_shader, "vertex_model_to_world");
 	locations.normal_model_to_world = glGetUniformLocation(gbuffer_shader, "normal_model_to_world");
-	locations.diffuse_texture = glGetUniformLocation(gbuffer_shader, "diffuse_texture");
-	locations.specular_texture = glGetUniformLocation(gbuffer_shader, "specular_texture");
-	locations.normals_texture = glGetUniformLocation(gbuffer_shader, "normals_texture");
-	locations.opacity_texture = glGetUniformLocation(gbuffer_shader, "opacity_texture");
-	locations.has_diffuse_texture = glGetUniformLocation(gbuffer_shader, "has_diffuse_texture");
-	locations.has_specular_texture = glGetUniformLocation(gbuffer_shader, "has_specular_texture");
-	locations.has_normals_texture = glGetUniformLocation(gbuffer_shader, "has_normals_texture");
-	locations.has_opacity_texture = glGetUniformLocation(gbuffer_shader, "has_opacity_texture");
+	locations.ubo_MaterialTextureLayers = glGetUniformBlockIndex(gbuffer_shader, "MaterialTextureLayers");
+	locations.material_textures = glGetUniformLocation(gbuffer_shader, "material_textures");
+	locations.material_index = glGetUniformLocation(gbuffer_shader, "material_index");
+	locations.use_octahedral_normals = glGetUniformLocation(gbuffer_shader, "use_octahedral_normals");
+	locations.is_specular_packed = glGetUniformLocation(gbuffer_shader, "is_specular_packed");
 
 	glUniformBlockBinding(gbuffer_shader, locations.ubo_CameraViewProjTransforms, toU(UBO::CameraViewProjTransforms));
+	glUniformBlockBinding(gbuffer_shader, locations.ubo_MaterialTextureLayers, material_texture_layers_binding);
 
 }
 
 void fillShadowmapShaderLocations(GLuint shadowmap_shader, FillShadowmapShaderLocations& locations)
 {
 	locations.ubo_LightViewProjTransforms = glGetUniformBlockIndex(shadowmap_shader, "LightViewProjTransforms");
-	locations.light_index = glGetUniformLocation(shadowmap_shader, "light_index");
+	locations.updated_lights = glGetUniformLocation(shadowmap_shader, "updated_lights");
 	locations.vertex_model_to_world = glGetUniformLocation(shadowmap_shader, "vertex_model_to_world");
-	locations.opacity_texture = glGetUniformLocation(shadowmap_shader, "opacity_texture");
-	locations.has_opacity_texture = glGetUniformLocation(shadowmap_shader, "has_opacity_texture");
+	locations.ubo_MaterialTextureLayers = glGetUniformBlockIndex(shadowmap_shader, "MaterialTextureLayers");
+	locations.material_textures = glGetUniformLocation(shadowmap_shader, "material_textures");
+	locations.material_index = glGetUniformLocation(shadowmap_shader, "material_index");
 
 	glUniformBlockBinding(shadowmap_shader, locations.ubo_LightViewProjTransforms, toU(UBO::LightViewProjTransforms));
+	glUniformBlockBinding(shadowmap_shader, locations.ubo_MaterialTextureLayers, material_texture_layers_binding);
+}
+
+void fillDepthShaderLocations(GLuint depth_shader, FillDepthShaderLocations& locations)
+{
+	locations.ubo_CameraViewProjTransforms = glGetUniformBlockIndex(depth_shader, "CameraViewProjTransforms");
+	locations.vertex_model_to_world = glGetUniformLocation(depth_shader, "vertex_model_to_world");
+	locations.ubo_MaterialTextureLayers = glGetUniformBlockIndex(depth_shader, "MaterialTextureLayers");
+	locations.material_textures = glGetUniformLocation(depth_shader, "material_textures");
+	locations.material_index = glGetUniformLocation(depth_shader, "material_index");
+
+	glUniformBlockBinding(depth_shader, locations.ubo_CameraViewProjTransforms, toU(UBO::CameraViewProjTransforms));
+	if (locations.ubo_MaterialTextureLayers != GL_INVALID_INDEX)
+		glUniformBlockBinding(depth_shader, locations.ubo_MaterialTextureLayers, material_texture_layers_binding);
 }
 
 void fillAccumulateLightsShaderLocations(GLuint accumulate_lights_shader, AccumulateLightsShaderLocations& locations)
@@ -1095,8 +2723,16 @@ void fillAccumulateLightsShaderLocations(GLuint accumulate_lights_shader, Accumu
 	locations.depth_texture = glGetUniformLocation(accumulate_lights_shader, "depth_texture");
 	locations.normal_texture = glGetUniformLocation(accumulate_lights_shader, "normal_texture");
 	locations.shadow_texture = glGetUniformLocation(accumulate_lights_shader, "shadow_texture");
+	locations.shadowmap_scale = glGetUniformLocation(accumulate_lights_shader, "shadowmap_scale");
+	locations.shadow_filtering = glGetUniformLocation(accumulate_lights_shader, "shadow_filtering");
+	locations.shadow_moments_texture = glGetUniformLocation(accumulate_lights_shader, "shadow_moments_texture");
+	locations.shadow_depth_range = glGetUniformLocation(accumulate_lights_shader, "shadow_depth_range");
+	locations.esm_exponent = glGetUniformLocation(accumulate_lights_shader, "esm_exponent");
+	locations.vsm_light_bleeding_reduction = glGetUniformLocation(accumulate_lights_shader, "vsm_light_bleeding_reduction");
+	locations.use_octahedral_normals = glGetUniformLocation(accumulate_lights_shader, "use_octahedral_normals");
 	locations.camera_position = glGetUniformLocation(accumulate_lights_shader, "camera_position");
 	locations.inverse_screen_resolution = glGetUniformLocation(accumulate_lights_shader, "inverse_screen_resolution");
+	locations.render_target_scale = glGetUniformLocation(accumulate_lights_shader, "render_target_scale");
 	locations.light_color = glGetUniformLocation(accumulate_lights_shader, "light_color");
 	locations.light_position = glGetUniformLocation(accumulate_lights_shader, "light_position");
 	locations.light_direction = glGetUniformLocation(accumulate_lights_shader, "light_direction");
@@ -1107,6 +2743,177 @@ void fillAccumulateLightsShaderLocations(GLuint accumulate_lights_shader, Accumu
 	glUniformBlockBinding(accumulate_lights_shader, locations.ubo_LightViewProjTransforms, toU(UBO::LightViewProjTransforms));
 }
 
+ClusterGrid createClusterGrid(GLsizei framebuffer_width, GLsizei framebuffer_height)
+{
+	ClusterGrid grid;
+	grid.clusters_nb = glm::uvec3((static_cast<GLuint>(framebuffer_width) + constant::cluster_tile_size - 1u) / constant::cluster_tile_size,
+	                              (static_cast<GLuint>(framebuffer_height) + constant::cluster_tile_size - 1u) / constant::cluster_tile_size,
+	                              constant::cluster_depth_slices_nb);
+	auto const clusters_nb = grid.clusters_nb.x * grid.clusters_nb.y * grid.clusters_nb.z;
+	grid.light_indices_capacity = clusters_nb * constant::cluster_average_lights_nb;
+
+	glGenBuffers(1, &grid.light_ranges);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid.light_ranges);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, clusters_nb * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_COPY);
+	utils::opengl::debug::nameObject(GL_BUFFER, grid.light_ranges, "Cluster light ranges");
+
+	// The list starts with the number of indices used so far.
+	glGenBuffers(1, &grid.light_indices);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, grid.light_indices);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (1u + grid.light_indices_capacity) * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	utils::opengl::debug::nameObject(GL_BUFFER, grid.light_indices, "Cluster light indices");
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+	LogInfo("Clustered lighting uses %u x %u x %u clusters, with room for %u light indices.",
+	        grid.clusters_nb.x, grid.clusters_nb.y, grid.clusters_nb.z, grid.light_indices_capacity);
+
+	return grid;
+}
+
+HiZPyramid createHiZPyramid(GLsizei framebuffer_width, GLsizei framebuffer_height)
+{
+	HiZPyramid pyramid;
+	auto size = glm::max((glm::ivec2(framebuffer_width, framebuffer_height) + 1) / 2, glm::ivec2(1));
+	GLint levels_nb = 1;
+	for (auto level_size = size; level_size.x > 1 || level_size.y > 1; level_size = glm::max((level_size + 1) / 2, glm::ivec2(1)))
+		++levels_nb;
+
+	glGenTextures(1, &pyramid.texture);
+	glBindTexture(GL_TEXTURE_2D, pyramid.texture);
+	for (GLint level = 0; level < levels_nb; ++level) {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, nullptr);
+		size = glm::max((size + 1) / 2, glm::ivec2(1));
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels_nb - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0u);
+	utils::opengl::debug::nameObject(GL_TEXTURE, pyramid.texture, "Hi-Z pyramid");
+
+	pyramid.framebuffers.resize(static_cast<size_t>(levels_nb), 0u);
+	glGenFramebuffers(levels_nb, pyramid.framebuffers.data());
+	for (GLint level = 0; level < levels_nb; ++level) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pyramid.framebuffers[level]);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid.texture, level);
+		if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			LogError("Framebuffer for level %d of the Hi-Z pyramid is incomplete.", level);
+		utils::opengl::debug::nameObject(GL_FRAMEBUFFER, pyramid.framebuffers[level], "Hi-Z pyramid level " + std::to_string(level));
+	}
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0u);
+
+	LogInfo("The Hi-Z pyramid has %d levels, starting at %d x %d.",
+	        levels_nb, std::max((framebuffer_width + 1) / 2, 1), std::max((framebuffer_height + 1) / 2, 1));
+
+	return pyramid;
+}
+
+void deleteHiZPyramid(HiZPyramid& pyramid)
+{
+	glDeleteFramebuffers(static_cast<GLsizei>(pyramid.framebuffers.size()), pyramid.framebuffers.data());
+	pyramid.framebuffers.clear();
+	glDeleteTextures(1, &pyramid.texture);
+	pyramid.texture = 0u;
+}
+
+OcclusionCullingBuffers createOcclusionCullingBuffers(std::vector<bonobo::mesh_data> const& meshes, size_t statistics_frames_nb)
+{
+	OcclusionCullingBuffers buffers;
+
+	// The Sponza geometry is already in world space, so its bounds can be
+	// used as is.
+	std::vector<glm::vec4> bounds;
+	bounds.reserve(2u * meshes.size());
+	// Only the instance count gets written by the culling shader.
+	std::vector<GLuint> draw_commands(5u * meshes.size(), 0u);
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		auto const& mesh = meshes[i];
+		bounds.emplace_back(mesh.bounding_box_min, 1.0f);
+		bounds.emplace_back(mesh.bounding_box_max, 1.0f);
+		draw_commands[5u * i] = static_cast<GLuint>(mesh.ibo != 0u ? mesh.indices_nb : mesh.vertices_nb);
+		draw_commands[5u * i + 1u] = 1u;
+	}
+
+	glGenBuffers(1, &buffers.bounds);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.bounds);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bounds.size() * sizeof(glm::vec4)), bounds.data(), GL_STATIC_DRAW);
+	utils::opengl::debug::nameObject(GL_BUFFER, buffers.bounds, "Occlusion culling bounds");
+
+	glGenBuffers(1, &buffers.visibility);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.visibility);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(meshes.size() * sizeof(GLuint)), nullptr, GL_DYNAMIC_COPY);
+	utils::opengl::debug::nameObject(GL_BUFFER, buffers.visibility, "Occlusion culling visibility");
+
+	glGenBuffers(static_cast<GLsizei>(buffers.draw_commands.size()), buffers.draw_commands.data());
+	for (size_t phase = 0; phase < buffers.draw_commands.size(); ++phase) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.draw_commands[phase]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(draw_commands.size() * sizeof(GLuint)), draw_commands.data(), GL_DYNAMIC_COPY);
+		utils::opengl::debug::nameObject(GL_BUFFER, buffers.draw_commands[phase], "Occlusion culling draw commands, phase " + std::to_string(phase + 1u));
+	}
+
+	buffers.statistics.resize(statistics_frames_nb, 0u);
+	glGenBuffers(static_cast<GLsizei>(buffers.statistics.size()), buffers.statistics.data());
+	for (auto const statistics : buffers.statistics) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, statistics);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+		utils::opengl::debug::nameObject(GL_BUFFER, statistics, "Occlusion culling statistics");
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0u);
+
+	return buffers;
+}
+
+void deleteOcclusionCullingBuffers(OcclusionCullingBuffers& buffers)
+{
+	glDeleteBuffers(static_cast<GLsizei>(buffers.statistics.size()), buffers.statistics.data());
+	buffers.statistics.clear();
+	glDeleteBuffers(static_cast<GLsizei>(buffers.draw_commands.size()), buffers.draw_commands.data());
+	buffers.draw_commands.fill(0u);
+	glDeleteBuffers(1, &buffers.visibility);
+	buffers.visibility = 0u;
+	glDeleteBuffers(1, &buffers.bounds);
+	buffers.bounds = 0u;
+}
+
+void fillClusterLightsShaderLocations(GLuint cluster_lights_shader, ClusterLightsShaderLocations& locations)
+{
+	locations.lights_nb = glGetUniformLocation(cluster_lights_shader, "lights_nb");
+	locations.light_indices_capacity = glGetUniformLocation(cluster_lights_shader, "light_indices_capacity");
+	locations.clusters_nb = glGetUniformLocation(cluster_lights_shader, "clusters_nb");
+	locations.tile_size = glGetUniformLocation(cluster_lights_shader, "tile_size");
+	locations.inverse_screen_resolution = glGetUniformLocation(cluster_lights_shader, "inverse_screen_resolution");
+	locations.clip_to_view = glGetUniformLocation(cluster_lights_shader, "clip_to_view");
+	locations.z_near = glGetUniformLocation(cluster_lights_shader, "z_near");
+	locations.z_far = glGetUniformLocation(cluster_lights_shader, "z_far");
+}
+
+void fillShadeClustersShaderLocations(GLuint shade_clusters_shader, ShadeClustersShaderLocations& locations)
+{
+	locations.depth_texture = glGetUniformLocation(shade_clusters_shader, "depth_texture");
+	locations.normal_texture = glGetUniformLocation(shade_clusters_shader, "normal_texture");
+	locations.clusters_nb = glGetUniformLocation(shade_clusters_shader, "clusters_nb");
+	locations.tile_size = glGetUniformLocation(shade_clusters_shader, "tile_size");
+	locations.inverse_screen_resolution = glGetUniformLocation(shade_clusters_shader, "inverse_screen_resolution");
+	locations.clip_to_view = glGetUniformLocation(shade_clusters_shader, "clip_to_view");
+	locations.world_to_view = glGetUniformLocation(shade_clusters_shader, "world_to_view");
+	locations.z_near = glGetUniformLocation(shade_clusters_shader, "z_near");
+	locations.z_far = glGetUniformLocation(shade_clusters_shader, "z_far");
+	locations.use_octahedral_normals = glGetUniformLocation(shade_clusters_shader, "use_octahedral_normals");
+	locations.light_accumulation_format = glGetUniformLocation(shade_clusters_shader, "light_accumulation_format");
+}
+
+void fillCullMeshesShaderLocations(GLuint cull_meshes_shader, CullMeshesShaderLocations& locations)
+{
+	locations.meshes_nb = glGetUniformLocation(cull_meshes_shader, "meshes_nb");
+	locations.phase = glGetUniformLocation(cull_meshes_shader, "phase");
+	locations.world_to_clip = glGetUniformLocation(cull_meshes_shader, "world_to_clip");
+	locations.render_size = glGetUniformLocation(cull_meshes_shader, "render_size");
+	locations.levels_nb = glGetUniformLocation(cull_meshes_shader, "levels_nb");
+	locations.is_pyramid_valid = glGetUniformLocation(cull_meshes_shader, "is_pyramid_valid");
+	locations.hiz_texture = glGetUniformLocation(cull_meshes_shader, "hiz_texture");
+}
+
 bonobo::mesh_data
 loadCone()
 {
@@ -1202,4 +3009,147 @@ loadCone()
 
 	return cone;
 }
+
+bool isOutsideFrustum(glm::vec4 const* clip_points, size_t points_nb)
+{
+	// Outside if all points are on the outer side of a same clipping
+	// plane.
+	for (int axis = 0; axis < 3; ++axis) {
+		bool are_all_beyond_max = true;
+		bool are_all_beyond_min = true;
+		for (size_t i = 0; i < points_nb; ++i) {
+			are_all_beyond_max = are_all_beyond_max && clip_points[i][axis] >  clip_points[i].w;
+			are_all_beyond_min = are_all_beyond_min && clip_points[i][axis] < -clip_points[i].w;
+		}
+		if (are_all_beyond_max || are_all_beyond_min)
+			return true;
+	}
+	return false;
+}
+
+glm::vec4 getBoxCorner(glm::vec3 const& min_corner, glm::vec3 const& max_corner, size_t index)
+{
+	return glm::vec4((index & 1u) ? max_corner.x : min_corner.x,
+	                 (index & 2u) ? max_corner.y : min_corner.y,
+	                 (index & 4u) ? max_corner.z : min_corner.z,
+	                 1.0f);
+}
+
+bool isBoxInFrustum(glm::vec3 const& min_corner, glm::vec3 const& max_corner, glm::mat4 const& world_to_clip)
+{
+	std::array<glm::vec4, 8> clip_corners;
+	for (size_t i = 0; i < clip_corners.size(); ++i)
+		clip_corners[i] = world_to_clip * getBoxCorner(min_corner, max_corner, i);
+	return !isOutsideFrustum(clip_corners.data(), clip_corners.size());
+}
+
+bool canShadowReachFrustum(glm::vec3 const& min_corner, glm::vec3 const& max_corner,
+                           glm::mat4 const& light_world_to_view, glm::mat4 const& light_view_to_world, float light_far_plane,
+                           glm::mat4 const& camera_world_to_clip)
+{
+	// Within the range of the light, the shadow of the box is contained in
+	// the convex hull of its corners and of their projections, away from
+	// the light, onto the far plane of the light.
+	std::array<glm::vec4, 16> clip_points;
+	for (size_t i = 0; i < 8; ++i) {
+		auto const world_corner = getBoxCorner(min_corner, max_corner, i);
+		auto const view_corner = light_world_to_view * world_corner;
+
+		// Projecting corners next to or behind the light is not possible;
+		// assume the shadow can be seen.
+		auto const depth = -view_corner.z;
+		if (depth <= 0.0f)
+			return true;
+
+		auto const projected_view_corner = glm::vec4(glm::vec3(view_corner) * std::max(light_far_plane / depth, 1.0f), 1.0f);
+		clip_points[2 * i]     = camera_world_to_clip * world_corner;
+		clip_points[2 * i + 1] = camera_world_to_clip * (light_view_to_world * projected_view_corner);
+	}
+	return !isOutsideFrustum(clip_points.data(), clip_points.size());
+}
+
+int selectShadowMapLod(glm::vec3 const& center, float radius,
+                       glm::mat4 const& camera_world_to_view, glm::mat4 const& camera_view_to_clip, float framebuffer_height,
+                       float texels_per_pixel, int current_lod, int finest_lod)
+{
+	// Lights out of view are only given a coarse shadow map, as they could
+	// come back into view before their map gets updated again.
+	if (!isBoxInFrustum(center - glm::vec3(radius), center + glm::vec3(radius), camera_view_to_clip * camera_world_to_view))
+		return constant::shadowmap_max_lod;
+
+	// Height, in pixels, of the projection of the sphere, which covers the
+	// whole screen when the camera is inside of it.
+	auto footprint = framebuffer_height;
+	auto const distance = glm::length(glm::vec3(camera_world_to_view * glm::vec4(center, 1.0f)));
+	if (distance > radius) {
+		auto const tan_angular_radius = radius / std::sqrt(distance * distance - radius * radius);
+		footprint = std::min(footprint, tan_angular_radius * camera_view_to_clip[1][1] * framebuffer_height);
+	}
+
+	// Coarsest level still providing the requested resolution.
+	auto const lod_for = [finest_lod](float resolution){
+		int lod = finest_lod;
+		while (lod < constant::shadowmap_max_lod
+		       && static_cast<float>(getShadowMapResolution(lod + 1).y) >= resolution)
+			++lod;
+		return lod;
+	};
+	auto const desired_resolution = footprint * texels_per_pixel;
+	auto lod = lod_for(desired_resolution);
+	if (lod > current_lod)
+		lod = std::max(current_lod, lod_for(desired_resolution * 1.25f));
+	return std::max(lod, finest_lod);
+}
+
+glm::uvec2 getShadowMapResolution(int lod)
+{
+	return glm::uvec2(constant::shadowmap_res_x >> lod, constant::shadowmap_res_y >> lod);
+}
+
+int getLightAccumulationSize(int size, LightAccumulationResolution resolution)
+{
+	auto const shift = toU(resolution);
+	return (size + (1 << shift) - 1) >> shift;
+}
+
+GBufferTraffic computeGBufferTraffic(GBufferLayout const& layout)
+{
+	size_t const depth_bytes = 4u; // GL_DEPTH24_STENCIL8
+	size_t const result_bytes = 4u;
+	size_t const diffuse_bytes = 4u;
+	size_t const specular_bytes = layout.pack_specular ? 0u : 4u;
+	size_t const normal_bytes = normal_formats[toU(layout.normal_encoding)].bytes_per_pixel;
+	size_t const light_bytes = 2u * light_accumulation_formats[toU(layout.light_accumulation_format)].bytes_per_pixel;
+	size_t const depth_bounds_bytes = 8u; // GL_RG32F
+
+	// Share of the full-resolution pixels shaded by the light passes.
+	auto const light_pixels_ratio = 1.0f / static_cast<float>(1 << (2 * toU(layout.light_accumulation_resolution)));
+	auto const is_downsampled = layout.light_accumulation_resolution != LightAccumulationResolution::Full;
+
+	GBufferTraffic traffic;
+	// Depth test and write, and the G-buffer textures.
+	traffic.gbuffer_written = static_cast<float>(depth_bytes + diffuse_bytes + specular_bytes + normal_bytes);
+	traffic.gbuffer_read = static_cast<float>(depth_bytes);
+	// Depth and normal fetches of every pixel, and writes of the depth
+	// bounds, depth and normal of every block.
+	if (is_downsampled) {
+		traffic.downsample_written = light_pixels_ratio * static_cast<float>(depth_bounds_bytes + depth_bytes + normal_bytes);
+		traffic.downsample_read = static_cast<float>(depth_bytes + normal_bytes);
+	}
+	// Depth test and fetch, normal fetch, and blending onto both light
+	// accumulation textures.
+	traffic.light_written = light_pixels_ratio * static_cast<float>(light_bytes);
+	traffic.light_read = light_pixels_ratio * static_cast<float>(2u * depth_bytes + normal_bytes + light_bytes);
+	// Depth and normal fetches, and image loads and stores.
+	traffic.clusters_written = light_pixels_ratio * static_cast<float>(light_bytes);
+	traffic.clusters_read = light_pixels_ratio * static_cast<float>(depth_bytes + normal_bytes + light_bytes);
+	traffic.resolve_written = static_cast<float>(result_bytes);
+	traffic.resolve_read = static_cast<float>(diffuse_bytes + specular_bytes) + light_pixels_ratio * static_cast<float>(light_bytes);
+	// The upsampling also fetches the full-resolution depth and normal, and
+	// the low-resolution depth bounds and normals, each texel being shared
+	// by neighbouring pixels.
+	if (is_downsampled)
+		traffic.resolve_read += static_cast<float>(depth_bytes + normal_bytes) + light_pixels_ratio * static_cast<float>(depth_bounds_bytes + normal_bytes);
+	return traffic;
+}
 } // namespace
@@ -1,7 +1,13 @@
 #include "Bonobo.h"
 #include "Log.h"
 
-Bonobo::Bonobo() {
+Bonobo::Bonobo() : Bonobo(0, nullptr)
+{
+}
+
+Bonobo::Bonobo(int argc, char const* const argv[]) :
+	windowManager(WindowManager::ParseBenchmarkSettings(argc, argv))
+{
 	LogInfo("Framework initialisation done.");
 }
 
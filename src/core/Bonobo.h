@@ -7,6 +7,9 @@
 class Bonobo {
 public:
 	Bonobo();
+	//! \brief Set up the framework, reading the benchmark settings of the
+	//!        window manager from the command line.
+	Bonobo(int argc, char const* const argv[]);
 	~Bonobo();
 	WindowManager& GetWindowManager() noexcept;
 
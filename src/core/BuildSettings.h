@@ -21,7 +21,7 @@
 #define ENABLE_PARAM_CHECK				1
 
 /*
-*	Enables (1) or disables (0) CPU profiling (found in Profiler.h)
+*	Enables (1) or disables (0) CPU and GPU profiling (found in Profiler.h)
 *	Turn off for maximum performance.
 */
 #define ENABLE_PROFILING				1
@@ -0,0 +1,259 @@
+#include "CommandList.hpp"
+
+#include "core/opengl.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
+
+enum class CommandList::Type : std::uint32_t {
+	UseProgram = 0u,
+	SetUniformInt,
+	SetUniformFloat,
+	SetUniformVec3,
+	SetUniformMat4,
+	BindVertexArray,
+	Draw,
+	DrawIndexed,
+	DrawIndirect,
+	DrawIndexedIndirect,
+	BeginConditionalRender,
+	EndConditionalRender,
+	BeginDebugGroup,
+	EndDebugGroup
+};
+
+namespace
+{
+	template<typename T>
+	struct UniformPayload {
+		GLint location;
+		T value;
+	};
+
+	struct DrawPayload {
+		GLenum mode;
+		GLsizei count;
+	};
+
+	struct DrawIndirectPayload {
+		GLenum mode;
+		GLintptr offset;
+	};
+
+	struct ConditionalRenderPayload {
+		GLuint query;
+		GLenum mode;
+	};
+
+	template<typename T>
+	T readPayload(std::uint8_t const* payload)
+	{
+		T value;
+		std::memcpy(&value, payload, sizeof(T));
+		return value;
+	}
+}
+
+void
+CommandList::Reset()
+{
+	mArena.clear();
+	mCommandsNb = 0u;
+}
+
+void
+CommandList::UseProgram(GLuint program)
+{
+	Push(Type::UseProgram, &program, sizeof(program));
+}
+
+void
+CommandList::SetUniform(GLint location, int value)
+{
+	UniformPayload<int> const payload{ location, value };
+	Push(Type::SetUniformInt, &payload, sizeof(payload));
+}
+
+void
+CommandList::SetUniform(GLint location, float value)
+{
+	UniformPayload<float> const payload{ location, value };
+	Push(Type::SetUniformFloat, &payload, sizeof(payload));
+}
+
+void
+CommandList::SetUniform(GLint location, glm::vec3 const& value)
+{
+	UniformPayload<glm::vec3> const payload{ location, value };
+	Push(Type::SetUniformVec3, &payload, sizeof(payload));
+}
+
+void
+CommandList::SetUniform(GLint location, glm::mat4 const& value)
+{
+	UniformPayload<glm::mat4> const payload{ location, value };
+	Push(Type::SetUniformMat4, &payload, sizeof(payload));
+}
+
+void
+CommandList::BindVertexArray(GLuint vao)
+{
+	Push(Type::BindVertexArray, &vao, sizeof(vao));
+}
+
+void
+CommandList::Draw(GLenum mode, GLsizei vertices_nb)
+{
+	DrawPayload const payload{ mode, vertices_nb };
+	Push(Type::Draw, &payload, sizeof(payload));
+}
+
+void
+CommandList::DrawIndexed(GLenum mode, GLsizei indices_nb)
+{
+	DrawPayload const payload{ mode, indices_nb };
+	Push(Type::DrawIndexed, &payload, sizeof(payload));
+}
+
+void
+CommandList::DrawIndirect(GLenum mode, GLintptr indirect_offset)
+{
+	DrawIndirectPayload const payload{ mode, indirect_offset };
+	Push(Type::DrawIndirect, &payload, sizeof(payload));
+}
+
+void
+CommandList::DrawIndexedIndirect(GLenum mode, GLintptr indirect_offset)
+{
+	DrawIndirectPayload const payload{ mode, indirect_offset };
+	Push(Type::DrawIndexedIndirect, &payload, sizeof(payload));
+}
+
+void
+CommandList::BeginConditionalRender(GLuint query, GLenum mode)
+{
+	ConditionalRenderPayload const payload{ query, mode };
+	Push(Type::BeginConditionalRender, &payload, sizeof(payload));
+}
+
+void
+CommandList::EndConditionalRender()
+{
+	Push(Type::EndConditionalRender, nullptr, 0u);
+}
+
+void
+CommandList::BeginDebugGroup(std::string const& message)
+{
+	Push(Type::BeginDebugGroup, message.data(), message.size());
+}
+
+void
+CommandList::EndDebugGroup()
+{
+	Push(Type::EndDebugGroup, nullptr, 0u);
+}
+
+void
+CommandList::Replay() const
+{
+	std::size_t offset = 0u;
+	while (offset < mArena.size()) {
+		auto const header = readPayload<Header>(mArena.data() + offset);
+		auto const payload = mArena.data() + offset + sizeof(Header);
+		offset += sizeof(Header) + header.payload_size;
+
+		switch (header.type) {
+		case Type::UseProgram:
+			glUseProgram(readPayload<GLuint>(payload));
+			break;
+		case Type::SetUniformInt:
+		{
+			auto const uniform = readPayload<UniformPayload<int>>(payload);
+			glUniform1i(uniform.location, uniform.value);
+			break;
+		}
+		case Type::SetUniformFloat:
+		{
+			auto const uniform = readPayload<UniformPayload<float>>(payload);
+			glUniform1f(uniform.location, uniform.value);
+			break;
+		}
+		case Type::SetUniformVec3:
+		{
+			auto const uniform = readPayload<UniformPayload<glm::vec3>>(payload);
+			glUniform3fv(uniform.location, 1, glm::value_ptr(uniform.value));
+			break;
+		}
+		case Type::SetUniformMat4:
+		{
+			auto const uniform = readPayload<UniformPayload<glm::mat4>>(payload);
+			glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(uniform.value));
+			break;
+		}
+		case Type::BindVertexArray:
+			glBindVertexArray(readPayload<GLuint>(payload));
+			break;
+		case Type::Draw:
+		{
+			auto const draw = readPayload<DrawPayload>(payload);
+			glDrawArrays(draw.mode, 0, draw.count);
+			break;
+		}
+		case Type::DrawIndexed:
+		{
+			auto const draw = readPayload<DrawPayload>(payload);
+			glDrawElements(draw.mode, draw.count, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(0x0));
+			break;
+		}
+		case Type::DrawIndirect:
+		{
+			auto const draw = readPayload<DrawIndirectPayload>(payload);
+			glDrawArraysIndirect(draw.mode, reinterpret_cast<GLvoid const*>(draw.offset));
+			break;
+		}
+		case Type::DrawIndexedIndirect:
+		{
+			auto const draw = readPayload<DrawIndirectPayload>(payload);
+			glDrawElementsIndirect(draw.mode, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(draw.offset));
+			break;
+		}
+		case Type::BeginConditionalRender:
+		{
+			auto const condition = readPayload<ConditionalRenderPayload>(payload);
+			glBeginConditionalRender(condition.query, condition.mode);
+			break;
+		}
+		case Type::EndConditionalRender:
+			glEndConditionalRender();
+			break;
+		case Type::BeginDebugGroup:
+			utils::opengl::debug::beginDebugGroup(std::string(reinterpret_cast<char const*>(payload), header.payload_size));
+			break;
+		case Type::EndDebugGroup:
+			utils::opengl::debug::endDebugGroup();
+			break;
+		}
+	}
+}
+
+std::size_t
+CommandList::GetCommandsNb() const
+{
+	return mCommandsNb;
+}
+
+void
+CommandList::Push(Type type, void const* payload, std::size_t payload_size)
+{
+	Header const header{ type, static_cast<std::uint32_t>(payload_size) };
+
+	auto const offset = mArena.size();
+	mArena.resize(offset + sizeof(Header) + payload_size);
+	std::memcpy(mArena.data() + offset, &header, sizeof(Header));
+	if (payload_size != 0u)
+		std::memcpy(mArena.data() + offset + sizeof(Header), payload, payload_size);
+
+	++mCommandsNb;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! \brief A list of rendering commands, recorded without any OpenGL call
+//!        and replayed later on.
+//!
+//! Recording only appends small plain structures to an arena owned by the
+//! list, so it can happen on any thread; this makes it possible for
+//! several threads to prepare a frame in parallel, each one recording into
+//! its own list. The lists are then replayed in order on the thread owning
+//! the OpenGL context, which is the only one issuing OpenGL calls.
+//!
+//! The arena keeps its memory across calls to `Reset()`, so that recording
+//! a frame similar to the previous one does not allocate.
+class CommandList
+{
+public:
+	//! \brief Remove all recorded commands.
+	void Reset();
+
+	void UseProgram(GLuint program);
+	void SetUniform(GLint location, int value);
+	void SetUniform(GLint location, float value);
+	void SetUniform(GLint location, glm::vec3 const& value);
+	void SetUniform(GLint location, glm::mat4 const& value);
+	void BindVertexArray(GLuint vao);
+
+	//! \brief Draw `vertices_nb` vertices from the bound vertex array.
+	void Draw(GLenum mode, GLsizei vertices_nb);
+
+	//! \brief Draw `indices_nb` indices of type GL_UNSIGNED_INT from the
+	//!        index buffer of the bound vertex array.
+	void DrawIndexed(GLenum mode, GLsizei indices_nb);
+
+	//! \brief Draw from the bound vertex array, with the parameters found
+	//!        at `indirect_offset` bytes into the buffer bound to
+	//!        GL_DRAW_INDIRECT_BUFFER when replaying.
+	void DrawIndirect(GLenum mode, GLintptr indirect_offset);
+
+	//! \brief Same as `DrawIndirect()`, using indices of type
+	//!        GL_UNSIGNED_INT from the index buffer of the bound vertex
+	//!        array.
+	void DrawIndexedIndirect(GLenum mode, GLintptr indirect_offset);
+
+	//! \brief Only perform the following draws if any sample passed
+	//!        within `query`, until `EndConditionalRender()`.
+	void BeginConditionalRender(GLuint query, GLenum mode);
+	void EndConditionalRender();
+
+	//! \brief Record the start of a debug group; the message is copied.
+	void BeginDebugGroup(std::string const& message);
+	void EndDebugGroup();
+
+	//! \brief Issue all recorded commands, in order; it has to be called
+	//!        from the thread owning the OpenGL context.
+	void Replay() const;
+
+	std::size_t GetCommandsNb() const;
+
+private:
+	enum class Type : std::uint32_t;
+	struct Header {
+		Type type;
+		std::uint32_t payload_size;
+	};
+
+	void Push(Type type, void const* payload, std::size_t payload_size);
+
+	std::vector<std::uint8_t> mArena;
+	std::size_t mCommandsNb{ 0u };
+};
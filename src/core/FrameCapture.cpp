@@ -0,0 +1,306 @@
+#include "FrameCapture.hpp"
+
+#include "core/Log.h"
+#include "core/opengl.hpp"
+
+#include <stb_image_write.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+FrameCapture::FrameCapture(std::uint32_t buffers_nb, std::size_t max_queued_frames_nb) : mMaxQueuedFramesNb(max_queued_frames_nb)
+{
+	if (buffers_nb == 0u || max_queued_frames_nb == 0u)
+		throw std::runtime_error("A frame capture needs at least one readback buffer, and room for one queued frame.");
+
+	mReadbacks.resize(buffers_nb);
+	for (std::size_t i = 0; i < mReadbacks.size(); ++i) {
+		auto& readback = mReadbacks[i];
+		glGenBuffers(1, &readback.buffer);
+		assert(readback.buffer != 0u);
+		// The buffer only gets created once bound.
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+		utils::opengl::debug::nameObject(GL_BUFFER, readback.buffer, "Frame capture readback " + std::to_string(i));
+	}
+}
+
+FrameCapture::~FrameCapture()
+{
+	Stop();
+
+	for (auto& readback : mReadbacks) {
+		if (readback.fence != nullptr)
+			glDeleteSync(readback.fence);
+		glDeleteBuffers(1, &readback.buffer);
+	}
+}
+
+bool
+FrameCapture::Start(std::string const& prefix, Format format)
+{
+	Stop();
+
+	mPrefix = prefix;
+	mFormat = format;
+	mVideoSize = glm::ivec2(0);
+	if (format == Format::RawVideo) {
+		auto const filename = prefix + ".rgb";
+		mVideoFile.open(filename, std::ios::binary | std::ios::trunc);
+		if (!mVideoFile.is_open()) {
+			LogError("Failed to open \"%s\" for capturing frames.", filename.c_str());
+			return false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStatistics = Statistics();
+		mLastError.clear();
+		mIsStopping = false;
+	}
+	mNextFrameIndex = 0u;
+	mReportedFailedFramesNb = 0u;
+	mWorker = std::thread(&FrameCapture::WorkerLoop, this);
+	mIsCapturing = true;
+
+	LogInfo("Capturing frames to \"%s%s\".", prefix.c_str(), format == Format::RawVideo ? ".rgb" : "_*.png");
+	return true;
+}
+
+void
+FrameCapture::Stop()
+{
+	if (!mIsCapturing)
+		return;
+
+	// Collect the readbacks still in flight, oldest first.
+	for (std::size_t i = 0; i < mReadbacks.size(); ++i) {
+		auto& readback = mReadbacks[(mNextReadback + i) % mReadbacks.size()];
+		if (readback.fence != nullptr)
+			Collect(readback);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mIsStopping = true;
+	}
+	mFrameQueued.notify_one();
+	mWorker.join();
+	mIsCapturing = false;
+
+	auto const statistics = GetStatistics();
+	if (mFormat == Format::RawVideo) {
+		mVideoFile.close();
+		LogInfo("Wrote %llu frames of %d x %d pixels to \"%s.rgb\"; it can be encoded with, e.g., "
+		        "`ffmpeg -f rawvideo -pixel_format rgb24 -video_size %dx%d -framerate 60 -i %s.rgb %s.mp4`.",
+		        static_cast<unsigned long long>(statistics.written_frames_nb), mVideoSize.x, mVideoSize.y, mPrefix.c_str(),
+		        mVideoSize.x, mVideoSize.y, mPrefix.c_str(), mPrefix.c_str());
+	} else {
+		LogInfo("Wrote %llu frames to \"%s_*.png\".", static_cast<unsigned long long>(statistics.written_frames_nb), mPrefix.c_str());
+	}
+	if (statistics.dropped_frames_nb > 0u)
+		LogWarning("%llu captured frames were dropped, as they could not be written fast enough.",
+		           static_cast<unsigned long long>(statistics.dropped_frames_nb));
+}
+
+bool
+FrameCapture::IsCapturing() const
+{
+	return mIsCapturing;
+}
+
+void
+FrameCapture::Capture(GLuint framebuffer, GLenum read_buffer, glm::ivec2 const& size)
+{
+	if (!mIsCapturing || size.x <= 0 || size.y <= 0)
+		return;
+
+	auto const capture_start_time = std::chrono::high_resolution_clock::now();
+
+	// The buffer about to be reused holds the oldest readback, which has
+	// most likely completed by now.
+	auto& readback = mReadbacks[mNextReadback];
+	if (readback.fence != nullptr)
+		Collect(readback);
+
+	auto const bytes_nb = static_cast<GLsizeiptr>(size.x) * static_cast<GLsizeiptr>(size.y) * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	if (readback.capacity < bytes_nb) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes_nb, nullptr, GL_STREAM_READ);
+		readback.capacity = bytes_nb;
+	}
+
+	// Assignments are free to leave any framebuffer bound for reading.
+	GLint previous_read_framebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(read_buffer);
+
+	// With a pack buffer bound, this only records a copy into it, rather
+	// than waiting for the frame to be rendered.
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previous_read_framebuffer));
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.size = size;
+	readback.frame_index = mNextFrameIndex++;
+	mNextReadback = (mNextReadback + 1u) % static_cast<std::uint32_t>(mReadbacks.size());
+
+	auto const capture_end_time = std::chrono::high_resolution_clock::now();
+
+	std::string error;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStatistics.last_capture_time = std::chrono::duration_cast<std::chrono::microseconds>(capture_end_time - capture_start_time);
+		if (mStatistics.failed_frames_nb != mReportedFailedFramesNb) {
+			mReportedFailedFramesNb = mStatistics.failed_frames_nb;
+			error = mLastError;
+		}
+	}
+	if (!error.empty())
+		LogError("%s", error.c_str());
+}
+
+FrameCapture::Statistics
+FrameCapture::GetStatistics() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStatistics;
+}
+
+void
+FrameCapture::Collect(Readback& readback)
+{
+	auto status = glClientWaitSync(readback.fence, 0, 0);
+	while (status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u); // 1 ms
+	if (status == GL_WAIT_FAILED)
+		LogError("Failed to wait on the readback of captured frame %llu.", static_cast<unsigned long long>(readback.frame_index));
+	glDeleteSync(readback.fence);
+	readback.fence = nullptr;
+
+	// Drop the frame if the background thread is lagging too far behind,
+	// rather than using more and more memory.
+	Frame frame;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mStatistics.captured_frames_nb;
+		if (mQueuedFrames.size() >= mMaxQueuedFramesNb) {
+			++mStatistics.dropped_frames_nb;
+			return;
+		}
+		if (!mRecycledPixels.empty()) {
+			frame.pixels = std::move(mRecycledPixels.back());
+			mRecycledPixels.pop_back();
+		}
+	}
+	frame.index = readback.frame_index;
+	frame.size = readback.size;
+	auto const bytes_nb = static_cast<std::size_t>(readback.size.x) * static_cast<std::size_t>(readback.size.y) * 4u;
+	frame.pixels.resize(bytes_nb);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	auto const data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes_nb), GL_MAP_READ_BIT);
+	if (data != nullptr) {
+		std::memcpy(frame.pixels.data(), data, bytes_nb);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0u);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (data == nullptr) {
+		++mStatistics.failed_frames_nb;
+		mLastError = "Failed to map the readback of captured frame " + std::to_string(frame.index) + ".";
+		mRecycledPixels.push_back(std::move(frame.pixels));
+		return;
+	}
+	mQueuedFrames.push_back(std::move(frame));
+	mStatistics.queued_frames_nb = mQueuedFrames.size();
+	mFrameQueued.notify_one();
+}
+
+void
+FrameCapture::WorkerLoop()
+{
+	// Kept from one frame to the next, to avoid reallocating it.
+	std::vector<std::uint8_t> rgb_pixels;
+	std::string error;
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true) {
+		mFrameQueued.wait(lock, [this]{ return mIsStopping || !mQueuedFrames.empty(); });
+		// Only stop once all queued frames are written.
+		if (mQueuedFrames.empty())
+			break;
+
+		auto frame = std::move(mQueuedFrames.front());
+		mQueuedFrames.pop_front();
+		mStatistics.queued_frames_nb = mQueuedFrames.size();
+		lock.unlock();
+
+		auto const is_written = Write(frame, rgb_pixels, error);
+
+		lock.lock();
+		if (is_written) {
+			++mStatistics.written_frames_nb;
+		} else {
+			++mStatistics.failed_frames_nb;
+			mLastError = error;
+		}
+		mRecycledPixels.push_back(std::move(frame.pixels));
+	}
+}
+
+bool
+FrameCapture::Write(Frame const& frame, std::vector<std::uint8_t>& rgb_pixels, std::string& error)
+{
+	// Drop the alpha channel, which is not meaningful, and flip the rows,
+	// as OpenGL stores the bottom row first whereas images and videos
+	// start from the top.
+	auto const width = static_cast<std::size_t>(frame.size.x);
+	auto const height = static_cast<std::size_t>(frame.size.y);
+	auto const row_size = width * 3u;
+	rgb_pixels.resize(row_size * height);
+	for (std::size_t y = 0; y < height; ++y) {
+		auto const* source = frame.pixels.data() + (height - 1u - y) * width * 4u;
+		auto* destination = rgb_pixels.data() + y * row_size;
+		for (std::size_t x = 0; x < width; ++x, source += 4, destination += 3) {
+			destination[0] = source[0];
+			destination[1] = source[1];
+			destination[2] = source[2];
+		}
+	}
+
+	if (mFormat == Format::PngSequence) {
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "_%06llu.png", static_cast<unsigned long long>(frame.index));
+		auto const filename = mPrefix + suffix;
+		if (stbi_write_png(filename.c_str(), frame.size.x, frame.size.y, 3, rgb_pixels.data(), static_cast<int>(row_size)) == 0) {
+			error = "Failed to write captured frame " + std::to_string(frame.index) + " to \"" + filename + "\".";
+			return false;
+		}
+		return true;
+	}
+
+	// Raw video has no header, so all frames have to share the size of
+	// the first one.
+	if (mVideoSize == glm::ivec2(0))
+		mVideoSize = frame.size;
+	if (frame.size != mVideoSize) {
+		error = "Skipped captured frame " + std::to_string(frame.index) + ", of " + std::to_string(frame.size.x) + " x "
+		      + std::to_string(frame.size.y) + " pixels, as the video is " + std::to_string(mVideoSize.x) + " x "
+		      + std::to_string(mVideoSize.y) + " pixels.";
+		return false;
+	}
+	mVideoFile.write(reinterpret_cast<char const*>(rgb_pixels.data()), static_cast<std::streamsize>(rgb_pixels.size()));
+	if (!mVideoFile.good()) {
+		error = "Failed to write captured frame " + std::to_string(frame.index) + " to \"" + mPrefix + ".rgb\".";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! \brief Records frames to disk without stalling the rendering.
+//!
+//! Reading pixels straight into CPU memory makes the driver wait for the
+//! GPU to finish the frame. Instead, each captured frame is read into one
+//! of several pixel buffer objects, guarded by a fence, and only copied
+//! out a few frames later, once the GPU is done with it. The copies are
+//! then handed to a background thread, which flips and encodes them,
+//! either as a sequence of PNG images or appended to a single raw video
+//! file.
+//!
+//! If the encoding cannot keep up, frames get dropped rather than queued
+//! indefinitely; see `GetStatistics()`.
+//!
+//! \code{.cpp}
+//! frame_capture.Start("capture", FrameCapture::Format::PngSequence);
+//! while (rendering) {
+//! 	// Render the frame into some framebuffer.
+//! 	frame_capture.Capture(framebuffer, GL_COLOR_ATTACHMENT0, size);
+//! }
+//! frame_capture.Stop();
+//! \endcode
+class FrameCapture
+{
+public:
+	enum class Format : int {
+		PngSequence = 0,  //!< one `<prefix>_<frame index>.png` file per frame
+		RawVideo          //!< all frames appended to `<prefix>.rgb`, as 8-bit RGB with the top row first
+	};
+
+	struct Statistics {
+		std::uint64_t captured_frames_nb{ 0u };  //!< read back since `Start()`
+		std::uint64_t written_frames_nb{ 0u };
+		std::uint64_t dropped_frames_nb{ 0u };   //!< skipped because too many frames were waiting to be written
+		std::uint64_t failed_frames_nb{ 0u };    //!< which could not be written, or did not match the video size
+		std::size_t   queued_frames_nb{ 0u };    //!< copied out, and waiting to be written
+		std::chrono::microseconds last_capture_time{ 0 };   //!< spent by the last call to `Capture()`
+	};
+
+	//! @param [in] buffers_nb how many readbacks can be in flight at once
+	//! @param [in] max_queued_frames_nb how many frames can wait for the
+	//!             background thread before new ones get dropped
+	explicit FrameCapture(std::uint32_t buffers_nb = 3u, std::size_t max_queued_frames_nb = 16u);
+	~FrameCapture();
+
+	FrameCapture(FrameCapture const&) = delete;
+	FrameCapture& operator=(FrameCapture const&) = delete;
+
+	//! \brief Start writing captured frames, and the background thread
+	//!        doing so.
+	//!
+	//! @param [in] prefix path the names of the written files start with
+	//! @return false if a raw video file could not be opened, in which
+	//!         case nothing gets captured
+	bool Start(std::string const& prefix, Format format);
+
+	//! \brief Finish the readbacks in flight, wait for all captured frames
+	//!        to be written, and stop the background thread.
+	void Stop();
+
+	bool IsCapturing() const;
+
+	//! \brief Read back the lower-left `size` pixels of a framebuffer
+	//!        attachment, and hand over the frame read back `buffers_nb`
+	//!        calls earlier to the background thread; does nothing unless
+	//!        capturing.
+	//!
+	//! To be called once per frame, after rendering into that attachment.
+	//! The earlier readback has usually completed by then; otherwise, this
+	//! waits for it.
+	//!
+	//! @param [in] framebuffer framebuffer to read from, 0 for the default
+	//!             one
+	//! @param [in] read_buffer which of its colour buffers to read, e.g.
+	//!             GL_COLOR_ATTACHMENT0 or GL_BACK
+	void Capture(GLuint framebuffer, GLenum read_buffer, glm::ivec2 const& size);
+
+	Statistics GetStatistics() const;
+
+private:
+	struct Readback {
+		GLuint buffer{ 0u };
+		GLsizeiptr capacity{ 0 };
+		GLsync fence{ nullptr };
+		glm::ivec2 size{ 0 };
+		std::uint64_t frame_index{ 0u };
+	};
+
+	struct Frame {
+		std::uint64_t index{ 0u };
+		glm::ivec2 size{ 0 };
+		std::vector<std::uint8_t> pixels;   //!< RGBA, bottom row first
+	};
+
+	//! \brief Wait for a readback to complete, copy it out of its buffer
+	//!        and queue it for the background thread.
+	void Collect(Readback& readback);
+	void WorkerLoop();
+	bool Write(Frame const& frame, std::vector<std::uint8_t>& rgb_pixels, std::string& error);
+
+	std::vector<Readback> mReadbacks;
+	std::uint32_t mNextReadback{ 0u };
+	std::uint64_t mNextFrameIndex{ 0u };
+	std::uint64_t mReportedFailedFramesNb{ 0u };
+
+	std::thread mWorker;
+	Format mFormat{ Format::PngSequence };
+	std::string mPrefix;
+	std::ofstream mVideoFile;     //!< only accessed by the background thread while capturing
+	glm::ivec2 mVideoSize{ 0 };   //!< set from the first written frame
+
+	mutable std::mutex mMutex;
+	std::condition_variable mFrameQueued;
+	std::deque<Frame> mQueuedFrames;
+	std::vector<std::vector<std::uint8_t>> mRecycledPixels;   //!< to avoid reallocating each frame
+	std::size_t mMaxQueuedFramesNb{ 0u };
+	bool mIsStopping{ false };
+	Statistics mStatistics;
+	std::string mLastError;   //!< from the background thread, logged by the calling one
+	bool mIsCapturing{ false };
+};
@@ -0,0 +1,188 @@
+#include "FrameDataRing.hpp"
+
+#include "core/Log.h"
+#include "core/opengl.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+FrameDataRing::FrameDataRing(GLsizeiptr frame_size, std::uint32_t frames_nb) : mFramesNb(frames_nb)
+{
+	if (frame_size <= 0 || frames_nb == 0u)
+		throw std::runtime_error("A frame data ring needs a non-zero frame size and frame count.");
+
+	GLint uniform_alignment = 1;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+	mAlignment = std::max<GLsizeiptr>(mAlignment, uniform_alignment);
+	if (GLAD_GL_VERSION_4_3) {
+		GLint storage_alignment = 1;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+		mAlignment = std::max<GLsizeiptr>(mAlignment, storage_alignment);
+	}
+
+	// Round the frame size up, so that each region starts aligned.
+	mFrameSize = ((frame_size + mAlignment - 1) / mAlignment) * mAlignment;
+	auto const buffer_size = mFrameSize * static_cast<GLsizeiptr>(mFramesNb);
+
+	glGenBuffers(1, &mBuffer);
+	assert(mBuffer != 0u);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+	if (GLAD_GL_VERSION_4_4) {
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, buffer_size, nullptr, flags);
+		mMappedData = static_cast<std::uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, buffer_size, flags));
+		if (mMappedData == nullptr)
+			LogWarning("Failed to persistently map the frame data ring; falling back to explicit copies.");
+	}
+	if (mMappedData == nullptr) {
+		if (!GLAD_GL_VERSION_4_4)
+			glBufferData(GL_COPY_WRITE_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+		mStagingData.resize(static_cast<std::size_t>(mFrameSize));
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+	utils::opengl::debug::nameObject(GL_BUFFER, mBuffer, "Frame data ring");
+
+	mFences.resize(mFramesNb, nullptr);
+	mFrameIndex = mFramesNb - 1u;
+}
+
+FrameDataRing::~FrameDataRing()
+{
+	for (auto& fence : mFences)
+		if (fence != nullptr)
+			glDeleteSync(fence);
+
+	if (mMappedData != nullptr) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+		mMappedData = nullptr;
+	}
+	glDeleteBuffers(1, &mBuffer);
+	mBuffer = 0u;
+}
+
+void
+FrameDataRing::BeginFrame()
+{
+	mFrameIndex = (mFrameIndex + 1u) % mFramesNb;
+	mUsedSize = 0;
+	mLastFenceWaitTime = std::chrono::microseconds(0);
+
+	auto& fence = mFences[mFrameIndex];
+	if (fence == nullptr)
+		return;
+
+	auto const wait_start_time = std::chrono::high_resolution_clock::now();
+	auto status = glClientWaitSync(fence, 0, 0);
+	while (status == GL_TIMEOUT_EXPIRED)
+		status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u); // 1 ms
+	if (status == GL_WAIT_FAILED)
+		LogError("Failed to wait on the fence of frame data region %u.", mFrameIndex);
+	auto const wait_end_time = std::chrono::high_resolution_clock::now();
+
+	glDeleteSync(fence);
+	fence = nullptr;
+	mLastFenceWaitTime = std::chrono::duration_cast<std::chrono::microseconds>(wait_end_time - wait_start_time);
+}
+
+void
+FrameDataRing::Flush()
+{
+	// Persistent mappings are coherent, so there is nothing to do.
+	if (mMappedData != nullptr || mUsedSize == 0)
+		return;
+
+	// The fence waited on in `BeginFrame()` guarantees the GPU is no
+	// longer reading this region, so no need for the driver to
+	// synchronise.
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+	auto const region = glMapBufferRange(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(mFrameIndex) * mFrameSize, mUsedSize,
+	                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (region != nullptr) {
+		std::memcpy(region, mStagingData.data(), static_cast<std::size_t>(mUsedSize));
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	} else {
+		LogError("Failed to map frame data region %u.", mFrameIndex);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0u);
+}
+
+void
+FrameDataRing::EndFrame()
+{
+	auto& fence = mFences[mFrameIndex];
+	if (fence != nullptr)
+		glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+FrameDataRing::Allocation
+FrameDataRing::Allocate(GLsizeiptr size)
+{
+	Allocation allocation;
+	auto const aligned_size = ((size + mAlignment - 1) / mAlignment) * mAlignment;
+	if (size <= 0 || mUsedSize + aligned_size > mFrameSize) {
+		LogError("Frame data ring is out of space: %lld bytes requested, %lld out of %lld bytes used.",
+		         static_cast<long long>(size), static_cast<long long>(mUsedSize), static_cast<long long>(mFrameSize));
+		return allocation;
+	}
+
+	allocation.offset = static_cast<GLintptr>(mFrameIndex) * mFrameSize + mUsedSize;
+	allocation.size = size;
+	allocation.data = mMappedData != nullptr ? static_cast<void*>(mMappedData + allocation.offset)
+	                                         : static_cast<void*>(mStagingData.data() + mUsedSize);
+	mUsedSize += aligned_size;
+
+	return allocation;
+}
+
+FrameDataRing::Allocation
+FrameDataRing::Upload(void const* data, GLsizeiptr size)
+{
+	auto const allocation = Allocate(size);
+	if (allocation.data != nullptr)
+		std::memcpy(allocation.data, data, static_cast<std::size_t>(size));
+	return allocation;
+}
+
+void
+FrameDataRing::BindRange(GLenum target, GLuint binding, Allocation const& allocation) const
+{
+	if (allocation.data == nullptr)
+		return;
+
+	glBindBufferRange(target, binding, mBuffer, allocation.offset, allocation.size);
+}
+
+std::chrono::microseconds
+FrameDataRing::GetLastFenceWaitTime() const
+{
+	return mLastFenceWaitTime;
+}
+
+GLsizeiptr
+FrameDataRing::GetUsedSize() const
+{
+	return mUsedSize;
+}
+
+GLsizeiptr
+FrameDataRing::GetFrameSize() const
+{
+	return mFrameSize;
+}
+
+std::uint32_t
+FrameDataRing::GetFramesNb() const
+{
+	return mFramesNb;
+}
+
+bool
+FrameDataRing::IsPersistentlyMapped() const
+{
+	return mMappedData != nullptr;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+//! \brief A ring buffer for data written by the CPU once per frame, and
+//!        read by the GPU during that same frame.
+//!
+//! The buffer is split into as many regions as there are frames in
+//! flight. Each frame writes into its own region, which is guarded by a
+//! fence: a region is only written to again once the GPU is done reading
+//! it, rather than having the driver implicitly synchronise as it would
+//! do with `glBufferSubData()`.
+//!
+//! When OpenGL 4.4 is available, the buffer is persistently mapped and
+//! allocations are written directly into it. Otherwise, allocations are
+//! written into a CPU copy which is copied over by `Flush()`.
+//!
+//! A typical frame looks like:
+//!
+//! \code{.cpp}
+//! ring.BeginFrame();
+//! auto const camera = ring.Upload(camera_transforms);
+//! ring.Flush();
+//! ring.BindRange(GL_UNIFORM_BUFFER, camera_binding, camera);
+//! // Issue all draw calls of the frame.
+//! ring.EndFrame();
+//! \endcode
+class FrameDataRing
+{
+public:
+	//! \brief Sub-allocation within the current frame's region.
+	struct Allocation {
+		GLintptr offset{ 0 };   //!< offset from the start of the buffer
+		GLsizeiptr size{ 0 };   //!< size in bytes of the allocation
+		void* data{ nullptr };  //!< where to write the content; null if the allocation failed
+	};
+
+	//! \brief Allocate and map the ring buffer.
+	//!
+	//! @param [in] frame_size how many bytes can be allocated per frame
+	//! @param [in] frames_nb how many frames can be in flight at once
+	FrameDataRing(GLsizeiptr frame_size, std::uint32_t frames_nb = 3u);
+	~FrameDataRing();
+
+	FrameDataRing(FrameDataRing const&) = delete;
+	FrameDataRing& operator=(FrameDataRing const&) = delete;
+
+	//! \brief Move to the next region, waiting for the GPU to be done
+	//!        with it if needed.
+	void BeginFrame();
+
+	//! \brief Make all allocations done since `BeginFrame()` visible to
+	//!        the GPU; it has to be called before issuing draw calls using
+	//!        them.
+	void Flush();
+
+	//! \brief Insert a fence guarding the current region; it has to be
+	//!        called after the last command using the current region.
+	void EndFrame();
+
+	//! \brief Reserve some bytes in the current region.
+	//!
+	//! The returned offset is aligned so that it can be used with
+	//! `glBindBufferRange()` for uniform and shader storage buffers.
+	//!
+	//! @param [in] size how many bytes to reserve
+	//! @return the allocation, whose `data` is null if the current region
+	//!         is full
+	Allocation Allocate(GLsizeiptr size);
+
+	//! \brief Allocate some bytes in the current region and copy the given
+	//!        data into them.
+	Allocation Upload(void const* data, GLsizeiptr size);
+
+	template<typename T>
+	Allocation Upload(T const& value)
+	{
+		return Upload(&value, static_cast<GLsizeiptr>(sizeof(T)));
+	}
+
+	//! \brief Bind an allocation to an indexed buffer target, like
+	//!        GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER.
+	void BindRange(GLenum target, GLuint binding, Allocation const& allocation) const;
+
+	//! \brief Time spent by the last call to `BeginFrame()` waiting for
+	//!        the GPU to release the region; if it is consistently above
+	//!        zero, more frames should be kept in flight.
+	std::chrono::microseconds GetLastFenceWaitTime() const;
+
+	//! \brief Number of bytes allocated in the current region so far.
+	GLsizeiptr GetUsedSize() const;
+
+	GLsizeiptr GetFrameSize() const;
+	std::uint32_t GetFramesNb() const;
+	bool IsPersistentlyMapped() const;
+
+private:
+	GLuint mBuffer{ 0u };
+	GLsizeiptr mFrameSize{ 0 };
+	GLsizeiptr mAlignment{ 1 };
+	std::uint32_t mFramesNb{ 0u };
+	std::uint32_t mFrameIndex{ 0u };
+	GLsizeiptr mUsedSize{ 0 };
+	std::uint8_t* mMappedData{ nullptr };
+	std::vector<std::uint8_t> mStagingData;
+	std::vector<GLsync> mFences;
+	std::chrono::microseconds mLastFenceWaitTime{ 0 };
+};
@@ -0,0 +1,565 @@
+#include "FrameGraph.hpp"
+
+#include "core/Log.h"
+#include "core/opengl.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	std::size_t getBytesPerPixel(GLenum const internal_format)
+	{
+		switch (internal_format) {
+		case GL_R8:
+			return 1u;
+		case GL_RG8:
+		case GL_R16:
+		case GL_R16F:
+		case GL_DEPTH_COMPONENT16:
+			return 2u;
+		case GL_RGB8:
+			return 3u;
+		case GL_RGBA8:
+		case GL_SRGB8_ALPHA8:
+		case GL_RG16:
+		case GL_RG16F:
+		case GL_R32F:
+		case GL_R32UI:
+		case GL_R11F_G11F_B10F:
+		case GL_RGB10_A2:
+		case GL_DEPTH_COMPONENT24: // Padded to 32 bits by most implementations.
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:
+			return 4u;
+		case GL_RGBA16:
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_DEPTH32F_STENCIL8:
+			return 8u;
+		case GL_RGBA32F:
+			return 16u;
+		default:
+			// Only used for the memory statistics.
+			return 4u;
+		}
+	}
+
+	bool isColorAttachment(GLenum const attachment)
+	{
+		return attachment >= GL_COLOR_ATTACHMENT0 && attachment <= GL_COLOR_ATTACHMENT31;
+	}
+
+	float toMebibytes(std::size_t const bytes_nb)
+	{
+		return static_cast<float>(bytes_nb) / (1024.0f * 1024.0f);
+	}
+}
+
+constexpr std::size_t FrameGraph::invalid_index;
+
+bool
+FrameGraph::TextureKey::operator==(TextureKey const& other) const
+{
+	return internal_format == other.internal_format
+	    && format == other.format
+	    && type == other.type
+	    && size == other.size
+	    && layers_nb == other.layers_nb
+	    && levels_nb == other.levels_nb
+	    && persistent_name == other.persistent_name;
+}
+
+FrameGraph::~FrameGraph()
+{
+	for (auto const& framebuffer : mFramebuffers)
+		glDeleteFramebuffers(1, &framebuffer.id);
+	for (auto const& texture : mPhysicalTextures)
+		glDeleteTextures(1, &texture.id);
+}
+
+void
+FrameGraph::BeginFrame(glm::ivec2 const& framebuffer_size)
+{
+	mFramebufferSize = glm::max(framebuffer_size, glm::ivec2(1));
+	mPasses.clear();
+	mTextures.clear();
+	mIsCompiled = false;
+}
+
+FrameGraph::TextureHandle
+FrameGraph::CreateTexture(TextureDescription const& description)
+{
+	assert(description.size_divisor > 0 && description.layers_nb > 0 && description.levels_nb > 0);
+
+	VirtualTexture texture;
+	texture.description = description;
+	if (description.fixed_size.x > 0 && description.fixed_size.y > 0)
+		texture.size = description.fixed_size;
+	else
+		texture.size = (mFramebufferSize + glm::ivec2(description.size_divisor - 1)) / description.size_divisor;
+	for (GLsizei level = 0; level < description.levels_nb; ++level) {
+		auto const level_size = glm::max(texture.size >> level, glm::ivec2(1));
+		texture.bytes_nb += static_cast<std::size_t>(level_size.x) * static_cast<std::size_t>(level_size.y)
+		                  * static_cast<std::size_t>(description.layers_nb) * getBytesPerPixel(description.internal_format);
+	}
+
+	mTextures.push_back(std::move(texture));
+	return mTextures.size() - 1u;
+}
+
+FrameGraph::PassHandle
+FrameGraph::AddPass(std::string const& name, bool has_side_effects)
+{
+	Pass pass;
+	pass.name = name;
+	pass.has_side_effects = has_side_effects;
+
+	mPasses.push_back(std::move(pass));
+	return mPasses.size() - 1u;
+}
+
+void
+FrameGraph::Read(PassHandle pass, TextureHandle texture, GLenum attachment)
+{
+	assert(pass < mPasses.size() && texture < mTextures.size());
+
+	auto& declared_pass = mPasses[pass];
+	declared_pass.reads.push_back(texture);
+	if (attachment != GL_NONE)
+		declared_pass.read_attachments.push_back({ attachment, texture });
+}
+
+void
+FrameGraph::Write(PassHandle pass, TextureHandle texture, GLenum attachment)
+{
+	assert(pass < mPasses.size() && texture < mTextures.size());
+
+	auto& declared_pass = mPasses[pass];
+	declared_pass.writes.push_back(texture);
+	if (attachment != GL_NONE)
+		declared_pass.draw_attachments.push_back({ attachment, texture });
+}
+
+void
+FrameGraph::Compile()
+{
+	CullPasses();
+	ComputeLifetimes();
+	auto const have_textures_changed = AllocateTextures();
+	mIsCompiled = true;
+	CreateFramebuffers();
+
+	if (have_textures_changed)
+		LogInfo("Frame graph: %zu textures allocated, for %.1f MiB; %.1f MiB saved by culling, %.1f MiB by aliasing.",
+		        mPhysicalTextures.size(), toMebibytes(mMemoryStatistics.allocated_bytes),
+		        toMebibytes(mMemoryStatistics.culled_bytes), toMebibytes(mMemoryStatistics.aliased_bytes));
+}
+
+bool
+FrameGraph::BeginPass(PassHandle pass) const
+{
+	assert(mIsCompiled && pass < mPasses.size());
+
+	auto const& compiled_pass = mPasses[pass];
+	if (compiled_pass.is_culled)
+		return false;
+
+	if (compiled_pass.framebuffer != 0u)
+		glBindFramebuffer(compiled_pass.draw_attachments.empty() ? GL_READ_FRAMEBUFFER : GL_DRAW_FRAMEBUFFER,
+		                  compiled_pass.framebuffer);
+	return true;
+}
+
+bool
+FrameGraph::IsCulled(PassHandle pass) const
+{
+	assert(mIsCompiled && pass < mPasses.size());
+	return mPasses[pass].is_culled;
+}
+
+GLuint
+FrameGraph::GetTexture(TextureHandle texture) const
+{
+	assert(mIsCompiled && texture < mTextures.size());
+
+	auto const physical_texture = mTextures[texture].physical_texture;
+	return physical_texture != invalid_index ? mPhysicalTextures[physical_texture].id : 0u;
+}
+
+GLuint
+FrameGraph::GetFramebuffer(PassHandle pass) const
+{
+	assert(mIsCompiled && pass < mPasses.size());
+	return mPasses[pass].framebuffer;
+}
+
+FrameGraph::MemoryStatistics const&
+FrameGraph::GetMemoryStatistics() const
+{
+	return mMemoryStatistics;
+}
+
+void
+FrameGraph::RenderImGui() const
+{
+	bool const opened = ImGui::Begin("Frame graph", nullptr, ImGuiWindowFlags_None);
+	if (opened) {
+		ImGui::Text("Declared: %.1f MiB, allocated: %.1f MiB",
+		            toMebibytes(mMemoryStatistics.declared_bytes), toMebibytes(mMemoryStatistics.allocated_bytes));
+		ImGui::Text("Saved: %.1f MiB by culling, %.1f MiB by aliasing",
+		            toMebibytes(mMemoryStatistics.culled_bytes), toMebibytes(mMemoryStatistics.aliased_bytes));
+
+		if (ImGui::BeginTable("Passes", 2, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn("Pass");
+			ImGui::TableSetupColumn("Framebuffer");
+			ImGui::TableHeadersRow();
+
+			for (std::size_t i = 0u; i < mPasses.size(); ++i) {
+				auto const& pass = mPasses[i];
+				ImGui::TableNextColumn();
+				if (pass.is_culled)
+					ImGui::TextDisabled("%zu. %s", i, pass.name.c_str());
+				else
+					ImGui::Text("%zu. %s", i, pass.name.c_str());
+				ImGui::TableNextColumn();
+				if (pass.is_culled)
+					ImGui::TextDisabled("culled");
+				else if (pass.framebuffer != 0u)
+					ImGui::Text("%u (%s)", pass.framebuffer, pass.draw_attachments.empty() ? "read" : "draw");
+				else
+					ImGui::TextDisabled("-");
+			}
+
+			ImGui::EndTable();
+		}
+
+		if (ImGui::BeginTable("Textures", 5, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn("Texture");
+			ImGui::TableSetupColumn("Size");
+			ImGui::TableSetupColumn("MiB");
+			ImGui::TableSetupColumn("Passes");
+			ImGui::TableSetupColumn("Storage");
+			ImGui::TableHeadersRow();
+
+			for (auto const& texture : mTextures) {
+				if (!texture.is_used)
+					continue;
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", texture.description.name.c_str());
+				ImGui::TableNextColumn();
+				if (texture.description.layers_nb > 1)
+					ImGui::Text("%d x %d x %d", texture.size.x, texture.size.y, texture.description.layers_nb);
+				else
+					ImGui::Text("%d x %d", texture.size.x, texture.size.y);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f", toMebibytes(texture.bytes_nb));
+				ImGui::TableNextColumn();
+				if (texture.physical_texture == invalid_index) {
+					ImGui::TextDisabled("culled");
+					ImGui::TableNextColumn();
+					ImGui::TextDisabled("-");
+					continue;
+				}
+				ImGui::Text("%zu - %zu", texture.first_pass, texture.last_pass);
+				ImGui::TableNextColumn();
+				ImGui::Text("#%zu%s", texture.physical_texture, texture.description.is_persistent ? " (persistent)" : "");
+			}
+
+			ImGui::EndTable();
+		}
+	}
+	ImGui::End();
+}
+
+FrameGraph::TextureKey
+FrameGraph::GetKey(VirtualTexture const& texture)
+{
+	TextureKey key;
+	key.internal_format = texture.description.internal_format;
+	key.format = texture.description.format;
+	key.type = texture.description.type;
+	key.size = texture.size;
+	key.layers_nb = texture.description.layers_nb;
+	key.levels_nb = texture.description.levels_nb;
+	if (texture.description.is_persistent)
+		key.persistent_name = texture.description.name;
+	return key;
+}
+
+void
+FrameGraph::CullPasses()
+{
+	// Link each read to the latest pass which wrote to the texture before,
+	// and start from the passes which have to run no matter what.
+	std::vector<PassHandle> latest_writers(mTextures.size(), invalid_index);
+	std::vector<PassHandle> needed_passes;
+	for (PassHandle i = 0u; i < mPasses.size(); ++i) {
+		auto& pass = mPasses[i];
+		pass.is_culled = true;
+		pass.dependencies.clear();
+		for (auto const texture : pass.reads)
+			if (latest_writers[texture] != invalid_index && latest_writers[texture] != i)
+				pass.dependencies.push_back(latest_writers[texture]);
+
+		bool writes_persistent_texture = false;
+		for (auto const texture : pass.writes) {
+			latest_writers[texture] = i;
+			writes_persistent_texture = writes_persistent_texture || mTextures[texture].description.is_persistent;
+		}
+		if (pass.has_side_effects || writes_persistent_texture)
+			needed_passes.push_back(i);
+	}
+
+	// Everything those passes depend on, directly or not, runs; the other
+	// passes are culled.
+	while (!needed_passes.empty()) {
+		auto& pass = mPasses[needed_passes.back()];
+		needed_passes.pop_back();
+		if (!pass.is_culled)
+			continue;
+
+		pass.is_culled = false;
+		for (auto const dependency : pass.dependencies)
+			if (mPasses[dependency].is_culled)
+				needed_passes.push_back(dependency);
+	}
+}
+
+void
+FrameGraph::ComputeLifetimes()
+{
+	for (auto& texture : mTextures) {
+		texture.is_used = false;
+		texture.first_pass = invalid_index;
+		texture.last_pass = invalid_index;
+		texture.physical_texture = invalid_index;
+	}
+
+	auto const extend_lifetime = [this](TextureHandle const handle, PassHandle const pass, bool const is_culled){
+		auto& texture = mTextures[handle];
+		texture.is_used = true;
+		if (is_culled)
+			return;
+		if (texture.first_pass == invalid_index)
+			texture.first_pass = pass;
+		texture.last_pass = pass;
+	};
+	for (PassHandle i = 0u; i < mPasses.size(); ++i) {
+		auto const& pass = mPasses[i];
+		for (auto const texture : pass.reads)
+			extend_lifetime(texture, i, pass.is_culled);
+		for (auto const texture : pass.writes)
+			extend_lifetime(texture, i, pass.is_culled);
+	}
+}
+
+bool
+FrameGraph::AllocateTextures()
+{
+	// Go over the textures in the order they start being used, and give
+	// each one the storage of an earlier texture with the same key which
+	// is no longer used by then, if any.
+	struct Slot {
+		TextureKey key;
+		PassHandle last_pass{ invalid_index };
+		std::vector<TextureHandle> textures;
+	};
+	std::vector<TextureHandle> live_textures;
+	for (TextureHandle i = 0u; i < mTextures.size(); ++i)
+		if (mTextures[i].first_pass != invalid_index)
+			live_textures.push_back(i);
+	std::stable_sort(live_textures.begin(), live_textures.end(), [this](TextureHandle const lhs, TextureHandle const rhs){
+		return mTextures[lhs].first_pass < mTextures[rhs].first_pass;
+	});
+
+	std::vector<Slot> slots;
+	for (auto const handle : live_textures) {
+		auto const& texture = mTextures[handle];
+		auto key = GetKey(texture);
+		auto const slot_it = std::find_if(slots.begin(), slots.end(), [&texture,&key](Slot const& slot){
+			return key.persistent_name.empty() && slot.key == key && slot.last_pass < texture.first_pass;
+		});
+		if (slot_it != slots.end()) {
+			slot_it->last_pass = texture.last_pass;
+			slot_it->textures.push_back(handle);
+		} else {
+			Slot slot;
+			slot.key = std::move(key);
+			slot.last_pass = texture.last_pass;
+			slot.textures.push_back(handle);
+			slots.push_back(std::move(slot));
+		}
+	}
+
+	// Back each slot by a texture from the previous frames with the same
+	// key, if any, or by a new one otherwise.
+	bool have_textures_changed = false;
+	for (auto& texture : mPhysicalTextures)
+		texture.is_used = false;
+	std::vector<PhysicalTexture> physical_textures;
+	physical_textures.reserve(slots.size());
+	for (auto const& slot : slots) {
+		auto const previous_it = std::find_if(mPhysicalTextures.begin(), mPhysicalTextures.end(), [&slot](PhysicalTexture const& texture){
+			return !texture.is_used && texture.key == slot.key;
+		});
+		if (previous_it != mPhysicalTextures.end()) {
+			previous_it->is_used = true;
+			physical_textures.push_back(*previous_it);
+		} else {
+			auto const& description = mTextures[slot.textures.front()].description;
+			PhysicalTexture texture;
+			texture.key = slot.key;
+			texture.bytes_nb = mTextures[slot.textures.front()].bytes_nb;
+			glGenTextures(1, &texture.id);
+			auto const target = slot.key.layers_nb > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+			glBindTexture(target, texture.id);
+			for (GLsizei level = 0; level < slot.key.levels_nb; ++level) {
+				auto const level_size = glm::max(slot.key.size >> level, glm::ivec2(1));
+				if (slot.key.layers_nb > 1)
+					glTexImage3D(GL_TEXTURE_2D_ARRAY, level, static_cast<GLint>(slot.key.internal_format), level_size.x, level_size.y,
+					             slot.key.layers_nb, 0, slot.key.format, slot.key.type, nullptr);
+				else
+					glTexImage2D(GL_TEXTURE_2D, level, static_cast<GLint>(slot.key.internal_format), level_size.x, level_size.y,
+					             0, slot.key.format, slot.key.type, nullptr);
+			}
+			glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, slot.key.levels_nb - 1);
+			glBindTexture(target, 0u);
+			utils::opengl::debug::nameObject(GL_TEXTURE, texture.id, description.name);
+			physical_textures.push_back(std::move(texture));
+			have_textures_changed = true;
+		}
+		for (auto const handle : slot.textures)
+			mTextures[handle].physical_texture = physical_textures.size() - 1u;
+	}
+
+	// Textures no longer needed are deleted, alongside the framebuffers
+	// they were attached to.
+	for (auto const& texture : mPhysicalTextures) {
+		if (texture.is_used)
+			continue;
+
+		auto const framebuffers_end = std::remove_if(mFramebuffers.begin(), mFramebuffers.end(), [&texture](Framebuffer const& framebuffer){
+			auto const attachment_it = std::find_if(framebuffer.attachments.begin(), framebuffer.attachments.end(),
+			                                        [&texture](std::pair<GLenum, GLuint> const& attachment){
+				return attachment.second == texture.id;
+			});
+			if (attachment_it == framebuffer.attachments.end())
+				return false;
+			glDeleteFramebuffers(1, &framebuffer.id);
+			return true;
+		});
+		mFramebuffers.erase(framebuffers_end, mFramebuffers.end());
+		glDeleteTextures(1, &texture.id);
+		have_textures_changed = true;
+	}
+	mPhysicalTextures = std::move(physical_textures);
+
+	mMemoryStatistics = MemoryStatistics();
+	for (auto const& texture : mTextures) {
+		if (!texture.is_used)
+			continue;
+		mMemoryStatistics.declared_bytes += texture.bytes_nb;
+		if (texture.physical_texture == invalid_index)
+			mMemoryStatistics.culled_bytes += texture.bytes_nb;
+	}
+	for (auto const& texture : mPhysicalTextures)
+		mMemoryStatistics.allocated_bytes += texture.bytes_nb;
+	mMemoryStatistics.aliased_bytes = mMemoryStatistics.declared_bytes - mMemoryStatistics.culled_bytes - mMemoryStatistics.allocated_bytes;
+
+	return have_textures_changed;
+}
+
+void
+FrameGraph::CreateFramebuffers()
+{
+	for (auto& framebuffer : mFramebuffers)
+		framebuffer.is_used = false;
+	for (auto& pass : mPasses)
+		pass.framebuffer = pass.is_culled ? 0u : AcquireFramebuffer(pass);
+
+	auto const framebuffers_end = std::remove_if(mFramebuffers.begin(), mFramebuffers.end(), [](Framebuffer const& framebuffer){
+		if (framebuffer.is_used)
+			return false;
+		glDeleteFramebuffers(1, &framebuffer.id);
+		return true;
+	});
+	mFramebuffers.erase(framebuffers_end, mFramebuffers.end());
+}
+
+GLuint
+FrameGraph::AcquireFramebuffer(Pass const& pass)
+{
+	// Attachments for reading are only used by passes not drawing into any
+	// texture, such as blits to the default framebuffer.
+	assert(pass.draw_attachments.empty() || pass.read_attachments.empty());
+	auto const is_for_reading = pass.draw_attachments.empty();
+	auto const& attachments = is_for_reading ? pass.read_attachments : pass.draw_attachments;
+	if (attachments.empty())
+		return 0u;
+
+	std::vector<std::pair<GLenum, GLuint>> resolved_attachments;
+	resolved_attachments.reserve(attachments.size());
+	for (auto const& attachment : attachments)
+		resolved_attachments.emplace_back(attachment.point, GetTexture(attachment.texture));
+	std::sort(resolved_attachments.begin(), resolved_attachments.end());
+
+	auto const framebuffer_it = std::find_if(mFramebuffers.begin(), mFramebuffers.end(), [&](Framebuffer const& framebuffer){
+		return framebuffer.is_for_reading == is_for_reading && framebuffer.attachments == resolved_attachments;
+	});
+	if (framebuffer_it != mFramebuffers.end()) {
+		framebuffer_it->is_used = true;
+		return framebuffer_it->id;
+	}
+
+	Framebuffer framebuffer;
+	framebuffer.attachments = resolved_attachments;
+	framebuffer.is_for_reading = is_for_reading;
+	framebuffer.is_used = true;
+	glGenFramebuffers(1, &framebuffer.id);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.id);
+
+	// Fragment shader outputs at location i are written to colour
+	// attachment i, if any.
+	std::vector<GLenum> color_buffers;
+	for (auto const& attachment : attachments) {
+		auto const texture = GetTexture(attachment.texture);
+		// Array textures get all their layers attached, for a geometry
+		// shader to select which one to render to.
+		if (mTextures[attachment.texture].description.layers_nb > 1)
+			glFramebufferTexture(GL_FRAMEBUFFER, attachment.point, texture, 0);
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment.point, GL_TEXTURE_2D, texture, 0);
+
+		if (isColorAttachment(attachment.point)) {
+			auto const index = static_cast<std::size_t>(attachment.point - GL_COLOR_ATTACHMENT0);
+			if (color_buffers.size() <= index)
+				color_buffers.resize(index + 1u, GL_NONE);
+			color_buffers[index] = attachment.point;
+		}
+	}
+	if (is_for_reading) {
+		auto const read_buffer_it = std::find_if(color_buffers.begin(), color_buffers.end(), [](GLenum const buffer){
+			return buffer != GL_NONE;
+		});
+		glReadBuffer(read_buffer_it != color_buffers.end() ? *read_buffer_it : GL_NONE);
+		glDrawBuffer(GL_NONE);
+	} else {
+		glReadBuffer(GL_NONE);
+		if (color_buffers.empty())
+			glDrawBuffer(GL_NONE);
+		else
+			glDrawBuffers(static_cast<GLsizei>(color_buffers.size()), color_buffers.data());
+	}
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		LogError("Framebuffer of pass \"%s\" is not complete: check the logs for additional information.", pass.name.c_str());
+	utils::opengl::debug::nameObject(GL_FRAMEBUFFER, framebuffer.id, pass.name);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0u);
+
+	mFramebuffers.push_back(std::move(framebuffer));
+	return mFramebuffers.back().id;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! \brief Allocates the render targets of a frame, and the framebuffers
+//!        using them, from a description of its passes.
+//!
+//! Every frame, the passes are declared in the order they will run,
+//! alongside the textures each one reads and writes. `Compile()` then:
+//!
+//! * culls the passes whose output is never read, going back from the
+//!   passes with side effects, such as presenting to the screen or
+//!   writing to a persistent texture;
+//! * computes the lifetime of each texture, from the first to the last
+//!   non-culled pass using it;
+//! * lets transient textures with the same description and disjoint
+//!   lifetimes share a single OpenGL texture;
+//! * (re)creates the OpenGL textures and framebuffers needed, keeping the
+//!   ones from previous frames that still match, and deleting the others.
+//!
+//! Texture sizes can be given relative to the framebuffer, in which case
+//! they follow it when the window gets resized. Persistent textures, whose
+//! content is kept from one frame to the next, never share their storage.
+//!
+//! Passes then run as before, each one starting with `BeginPass()`, which
+//! binds its framebuffer and tells whether it was culled:
+//!
+//! \code{.cpp}
+//! frame_graph.BeginFrame(framebuffer_size);
+//! auto const depth = frame_graph.CreateTexture(depth_description);
+//! auto const color = frame_graph.CreateTexture(color_description);
+//! auto const scene_pass = frame_graph.AddPass("Scene");
+//! frame_graph.Write(scene_pass, color, GL_COLOR_ATTACHMENT0);
+//! frame_graph.Write(scene_pass, depth, GL_DEPTH_ATTACHMENT);
+//! auto const present_pass = frame_graph.AddPass("Present", true);
+//! frame_graph.Read(present_pass, color, GL_COLOR_ATTACHMENT0);
+//! frame_graph.Compile();
+//!
+//! if (frame_graph.BeginPass(scene_pass)) {
+//! 	// Draw the scene.
+//! }
+//! if (frame_graph.BeginPass(present_pass)) {
+//! 	// Blit from the read framebuffer to the default one.
+//! }
+//! \endcode
+class FrameGraph
+{
+public:
+	using TextureHandle = std::size_t;
+	using PassHandle = std::size_t;
+
+	//! \brief How to create a texture.
+	struct TextureDescription {
+		std::string name;
+		GLenum internal_format{ GL_RGBA8 };
+		GLenum format{ GL_RGBA };
+		GLenum type{ GL_UNSIGNED_BYTE };
+		//! How many times smaller than the framebuffer the texture is,
+		//! along each axis and rounding up; ignored if `fixed_size` is set.
+		GLsizei size_divisor{ 1 };
+		glm::ivec2 fixed_size{ 0 };
+		GLsizei layers_nb{ 1 };          //!< a 2-D array texture is created when more than one
+		GLsizei levels_nb{ 1 };          //!< mipmap levels; only the first one can be attached
+		bool is_persistent{ false };     //!< whether the content is kept from one frame to the next
+	};
+
+	//! \brief Memory used by the textures of the last compiled frame.
+	struct MemoryStatistics {
+		std::size_t declared_bytes{ 0u };   //!< if every texture used by a pass had its own storage
+		std::size_t culled_bytes{ 0u };     //!< of the textures only used by culled passes
+		std::size_t aliased_bytes{ 0u };    //!< saved by textures sharing their storage
+		std::size_t allocated_bytes{ 0u };
+	};
+
+	FrameGraph() = default;
+	~FrameGraph();
+
+	FrameGraph(FrameGraph const&) = delete;
+	FrameGraph& operator=(FrameGraph const&) = delete;
+
+	//! \brief Forget the passes and textures declared for the previous
+	//!        frame; the OpenGL objects are kept until `Compile()`.
+	//!
+	//! @param [in] framebuffer_size size that relative texture sizes are
+	//!             based on
+	void BeginFrame(glm::ivec2 const& framebuffer_size);
+
+	//! \brief Declare a texture; it only gets allocated if a non-culled
+	//!        pass uses it.
+	TextureHandle CreateTexture(TextureDescription const& description);
+
+	//! \brief Declare a pass, which runs after all previously declared
+	//!        ones.
+	//!
+	//! @param [in] has_side_effects whether the pass has to run even if
+	//!             none of the textures it writes is read afterwards
+	PassHandle AddPass(std::string const& name, bool has_side_effects = false);
+
+	//! \brief Declare that a pass reads the content of a texture, as
+	//!        written by the latest pass declared before it writing to it.
+	//!
+	//! @param [in] attachment where to attach the texture to the pass'
+	//!             framebuffer, which then gets bound for reading (e.g. for
+	//!             blits); GL_NONE if only sampled
+	void Read(PassHandle pass, TextureHandle texture, GLenum attachment = GL_NONE);
+
+	//! \brief Declare that a pass writes to a texture.
+	//!
+	//! @param [in] attachment where to attach the texture to the pass'
+	//!             framebuffer, which then gets bound for drawing; GL_NONE
+	//!             if written otherwise, e.g. as an image
+	void Write(PassHandle pass, TextureHandle texture, GLenum attachment = GL_NONE);
+
+	//! \brief Cull the passes, and create the textures and framebuffers
+	//!        they need.
+	void Compile();
+
+	//! \brief Bind the framebuffer of a pass, if it has any attachment.
+	//!
+	//! @return false if the pass was culled, in which case it should not
+	//!         run
+	bool BeginPass(PassHandle pass) const;
+
+	bool IsCulled(PassHandle pass) const;
+
+	//! \brief OpenGL texture backing a texture handle, or 0 if the texture
+	//!        is not used by any non-culled pass.
+	GLuint GetTexture(TextureHandle texture) const;
+
+	//! \brief Framebuffer of a pass, or 0 if it has none.
+	GLuint GetFramebuffer(PassHandle pass) const;
+
+	MemoryStatistics const& GetMemoryStatistics() const;
+
+	//! \brief Draw the passes, the lifetime and storage of each texture,
+	//!        and how much memory culling and aliasing saved, in their own
+	//!        window.
+	void RenderImGui() const;
+
+private:
+	static constexpr std::size_t invalid_index = std::numeric_limits<std::size_t>::max();
+
+	struct Attachment {
+		GLenum point{ GL_NONE };
+		TextureHandle texture{ 0u };
+	};
+
+	struct Pass {
+		std::string name;
+		bool has_side_effects{ false };
+		std::vector<TextureHandle> reads;
+		std::vector<TextureHandle> writes;
+		std::vector<Attachment> draw_attachments;
+		std::vector<Attachment> read_attachments;
+		std::vector<PassHandle> dependencies;   //!< passes which wrote the content it reads
+		bool is_culled{ true };
+		GLuint framebuffer{ 0u };
+	};
+
+	// Texture as declared; several of them can share one physical texture.
+	struct VirtualTexture {
+		TextureDescription description;
+		glm::ivec2 size{ 0 };
+		std::size_t bytes_nb{ 0u };
+		bool is_used{ false };                   //!< whether any pass, culled or not, uses it
+		PassHandle first_pass{ invalid_index };  //!< first non-culled pass using it
+		PassHandle last_pass{ invalid_index };
+		std::size_t physical_texture{ invalid_index };
+	};
+
+	// What makes two textures interchangeable.
+	struct TextureKey {
+		GLenum internal_format{ GL_NONE };
+		GLenum format{ GL_NONE };
+		GLenum type{ GL_NONE };
+		glm::ivec2 size{ 0 };
+		GLsizei layers_nb{ 1 };
+		GLsizei levels_nb{ 1 };
+		std::string persistent_name;   //!< persistent textures are only interchangeable with themselves
+
+		bool operator==(TextureKey const& other) const;
+	};
+
+	struct PhysicalTexture {
+		TextureKey key;
+		GLuint id{ 0u };
+		std::size_t bytes_nb{ 0u };
+		bool is_used{ false };
+	};
+
+	struct Framebuffer {
+		std::vector<std::pair<GLenum, GLuint>> attachments;  //!< sorted by attachment point
+		bool is_for_reading{ false };
+		GLuint id{ 0u };
+		bool is_used{ false };
+	};
+
+	static TextureKey GetKey(VirtualTexture const& texture);
+	void CullPasses();
+	void ComputeLifetimes();
+	bool AllocateTextures();
+	void CreateFramebuffers();
+	GLuint AcquireFramebuffer(Pass const& pass);
+
+	glm::ivec2 mFramebufferSize{ 0 };
+	std::vector<Pass> mPasses;
+	std::vector<VirtualTexture> mTextures;
+	std::vector<PhysicalTexture> mPhysicalTextures;   //!< kept from one frame to the next
+	std::vector<Framebuffer> mFramebuffers;           //!< kept from one frame to the next
+	MemoryStatistics mMemoryStatistics;
+	bool mIsCompiled{ false };
+};
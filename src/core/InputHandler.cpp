@@ -1,7 +1,42 @@
 #include "InputHandler.h"
 
+#include "Log.h"
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
 /*----------------------------------------------------------------------------*/
 
+namespace
+{
+	// Recordings start with this header, followed by the events. All values
+	// are stored in the byte order of the machine, as they are only meant
+	// to be replayed on the same kind of machines they were recorded on.
+	char const recording_magic[4] = { 'C', 'G', 'I', 'R' };
+	std::uint32_t const recording_version = 1u;
+
+	template<typename T>
+	void WriteValue(std::ostream& stream, T const value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written as is.");
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		stream.write(bytes, sizeof(T));
+	}
+
+	template<typename T>
+	bool ReadValue(std::istream& stream, T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read as is.");
+		char bytes[sizeof(T)];
+		if (!stream.read(bytes, sizeof(T)))
+			return false;
+		std::memcpy(&value, bytes, sizeof(T));
+		return true;
+	}
+}
+
 InputHandler::InputHandler()
 {
 	for (auto& mousePosition : mMousePositionSwitched)
@@ -10,8 +45,38 @@ InputHandler::InputHandler()
 	}
 }
 
+InputHandler::~InputHandler()
+{
+	if (mMode == Mode::Recording)
+		StopRecording();
+}
+
 void InputHandler::Advance()
 {
+	if (mMode == Mode::Replaying && mStartTick <= mTick) {
+		auto const tick = mTick - mStartTick;
+		for (; mNextReplayedEvent < mEvents.size() && mEvents[mNextReplayedEvent].tick <= tick; ++mNextReplayedEvent) {
+			auto const& event = mEvents[mNextReplayedEvent];
+			switch (event.type) {
+				case EventType::Keyboard:
+					ApplyKeyboard(event.key_or_button, event.scancode, event.action);
+					break;
+				case EventType::MouseButton:
+					ApplyMouseButtons(event.key_or_button, event.action);
+					break;
+				case EventType::MouseMotion:
+					mMousePosition = event.position;
+					break;
+				case EventType::UICapture:
+					mMouseCapturedByUI = (event.ui_capture & 1u) != 0u;
+					mKeyboardCapturedByUI = (event.ui_capture & 2u) != 0u;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
 	mTick++;
 }
 
@@ -36,6 +101,21 @@ void InputHandler::UpEvent(InputStateMap& map, size_t loc)
 }
 
 void InputHandler::FeedKeyboard(int key, int scancode, int action)
+{
+	if (mMode == Mode::Replaying)
+		return;
+
+	RecordedEvent event;
+	event.type = EventType::Keyboard;
+	event.key_or_button = key;
+	event.scancode = scancode;
+	event.action = action;
+	Record(event);
+
+	ApplyKeyboard(key, scancode, action);
+}
+
+void InputHandler::ApplyKeyboard(int key, int scancode, int action)
 {
 	switch (action)
 	{
@@ -54,10 +134,32 @@ void InputHandler::FeedKeyboard(int key, int scancode, int action)
 
 void InputHandler::FeedMouseMotion(glm::vec2 const& position)
 {
+	if (mMode == Mode::Replaying)
+		return;
+
+	RecordedEvent event;
+	event.type = EventType::MouseMotion;
+	event.position = position;
+	Record(event);
+
 	mMousePosition = position;
 }
 
 void InputHandler::FeedMouseButtons(int button, int action)
+{
+	if (mMode == Mode::Replaying)
+		return;
+
+	RecordedEvent event;
+	event.type = EventType::MouseButton;
+	event.key_or_button = button;
+	event.action = action;
+	Record(event);
+
+	ApplyMouseButtons(button, action);
+}
+
+void InputHandler::ApplyMouseButtons(int button, int action)
 {
 	switch (action)
 	{
@@ -124,6 +226,228 @@ bool InputHandler::IsKeyboardCapturedByUI() const
 
 void InputHandler::SetUICapture(bool mouseCapture, bool keyboardCapture)
 {
+	// The UI does not see replayed events, so what it captured is part of
+	// the recording instead.
+	if (mMode == Mode::Replaying)
+		return;
+
+	if (mouseCapture != mMouseCapturedByUI || keyboardCapture != mKeyboardCapturedByUI) {
+		RecordedEvent event;
+		event.type = EventType::UICapture;
+		event.ui_capture = static_cast<std::uint8_t>((mouseCapture ? 1u : 0u) | (keyboardCapture ? 2u : 0u));
+		Record(event);
+	}
+
 	mMouseCapturedByUI = mouseCapture;
 	mKeyboardCapturedByUI = keyboardCapture;
 }
+
+void InputHandler::Record(RecordedEvent event)
+{
+	if (mMode != Mode::Recording)
+		return;
+
+	event.tick = static_cast<std::uint32_t>(mTick - mStartTick);
+	mEvents.push_back(event);
+}
+
+bool InputHandler::StartRecording(std::string const& filename, std::chrono::microseconds time_step)
+{
+	if (mMode != Mode::Live) {
+		LogError("Can not start recording inputs while already recording or replaying.");
+		return false;
+	}
+	if (time_step.count() <= 0) {
+		LogError("The time step of a recording has to be positive.");
+		return false;
+	}
+
+	// Fail early rather than after the whole session was recorded.
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		LogError("Failed to open \"%s\" for recording inputs.", filename.c_str());
+		return false;
+	}
+
+	mMode = Mode::Recording;
+	mRecordingFilename = filename;
+	mFixedTimeStep = time_step;
+	mEvents.clear();
+	mStartTick = mTick;
+
+	// Replays start with no key nor button held, so only the mouse
+	// position and what the UI captures need recording upfront.
+	RecordedEvent event;
+	event.type = EventType::MouseMotion;
+	event.position = mMousePosition;
+	Record(event);
+	event.type = EventType::UICapture;
+	event.ui_capture = static_cast<std::uint8_t>((mMouseCapturedByUI ? 1u : 0u) | (mKeyboardCapturedByUI ? 2u : 0u));
+	Record(event);
+
+	LogInfo("Recording inputs to \"%s\", with a fixed time step of %.3f ms.", filename.c_str(),
+	        std::chrono::duration<float, std::milli>(time_step).count());
+	return true;
+}
+
+bool InputHandler::StopRecording()
+{
+	if (mMode != Mode::Recording)
+		return false;
+	mMode = Mode::Live;
+
+	std::ofstream file(mRecordingFilename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		LogError("Failed to open \"%s\" for writing the recorded inputs.", mRecordingFilename.c_str());
+		return false;
+	}
+
+	file.write(recording_magic, sizeof(recording_magic));
+	WriteValue(file, recording_version);
+	WriteValue(file, static_cast<std::uint32_t>(mFixedTimeStep.count()));
+	WriteValue(file, static_cast<std::uint64_t>(mTick - mStartTick));
+	WriteValue(file, static_cast<std::uint64_t>(mEvents.size()));
+
+	// Only the fields used by each type of event are stored.
+	for (auto const& event : mEvents) {
+		WriteValue(file, event.tick);
+		WriteValue(file, static_cast<std::uint8_t>(event.type));
+		switch (event.type) {
+			case EventType::Keyboard:
+				WriteValue(file, event.key_or_button);
+				WriteValue(file, event.scancode);
+				WriteValue(file, static_cast<std::int8_t>(event.action));
+				break;
+			case EventType::MouseButton:
+				WriteValue(file, static_cast<std::int8_t>(event.key_or_button));
+				WriteValue(file, static_cast<std::int8_t>(event.action));
+				break;
+			case EventType::MouseMotion:
+				WriteValue(file, event.position.x);
+				WriteValue(file, event.position.y);
+				break;
+			case EventType::UICapture:
+				WriteValue(file, event.ui_capture);
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (!file.good()) {
+		LogError("Failed to write the recorded inputs to \"%s\".", mRecordingFilename.c_str());
+		return false;
+	}
+	LogInfo("Recorded %zu input events over %llu ticks to \"%s\".", mEvents.size(),
+	        static_cast<unsigned long long>(mTick - mStartTick), mRecordingFilename.c_str());
+	mEvents.clear();
+	return true;
+}
+
+bool InputHandler::LoadReplay(std::string const& filename)
+{
+	if (mMode != Mode::Live) {
+		LogError("Can not load a replay while already recording or replaying.");
+		return false;
+	}
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		LogError("Failed to open the input recording \"%s\".", filename.c_str());
+		return false;
+	}
+
+	char magic[sizeof(recording_magic)];
+	std::uint32_t version = 0u, time_step_us = 0u;
+	std::uint64_t ticks_nb = 0u, events_nb = 0u;
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, recording_magic, sizeof(magic)) != 0
+	    || !ReadValue(file, version) || version != recording_version
+	    || !ReadValue(file, time_step_us) || time_step_us == 0u
+	    || !ReadValue(file, ticks_nb) || !ReadValue(file, events_nb)) {
+		LogError("\"%s\" is not an input recording, or was made by an incompatible version.", filename.c_str());
+		return false;
+	}
+
+	std::vector<RecordedEvent> events;
+	events.reserve(static_cast<size_t>(events_nb));
+	for (std::uint64_t i = 0u; i < events_nb; ++i) {
+		RecordedEvent event;
+		std::uint8_t type = 0u;
+		bool is_valid = ReadValue(file, event.tick) && ReadValue(file, type) && type < static_cast<std::uint8_t>(EventType::Count);
+		if (is_valid) {
+			event.type = static_cast<EventType>(type);
+			std::int8_t small_value = 0, action = 0;
+			switch (event.type) {
+				case EventType::Keyboard:
+					is_valid = ReadValue(file, event.key_or_button) && ReadValue(file, event.scancode) && ReadValue(file, action);
+					event.action = action;
+					break;
+				case EventType::MouseButton:
+					is_valid = ReadValue(file, small_value) && ReadValue(file, action)
+					        && small_value >= 0 && small_value < GLFW_MOUSE_BUTTON_LAST;
+					event.key_or_button = small_value;
+					event.action = action;
+					break;
+				case EventType::MouseMotion:
+					is_valid = ReadValue(file, event.position.x) && ReadValue(file, event.position.y);
+					break;
+				case EventType::UICapture:
+					is_valid = ReadValue(file, event.ui_capture);
+					break;
+				default:
+					break;
+			}
+		}
+		if (!is_valid || (!events.empty() && event.tick < events.back().tick)) {
+			LogError("The input recording \"%s\" is truncated or corrupted.", filename.c_str());
+			return false;
+		}
+		events.push_back(event);
+	}
+
+	mMode = Mode::Replaying;
+	mEvents = std::move(events);
+	mNextReplayedEvent = 0u;
+	mRecordedTicksNb = ticks_nb;
+	mFixedTimeStep = std::chrono::microseconds(time_step_us);
+	mStartTick = std::numeric_limits<std::uint64_t>::max();
+
+	LogInfo("Loaded %zu input events over %llu ticks from \"%s\".", mEvents.size(),
+	        static_cast<unsigned long long>(ticks_nb), filename.c_str());
+	return true;
+}
+
+void InputHandler::StartReplay()
+{
+	if (mMode != Mode::Replaying) {
+		LogError("No replay was loaded.");
+		return;
+	}
+
+	// Start from a clean state, as when the recording started.
+	mScancodeMap.clear();
+	mKeycodeMap.clear();
+	mMouseMap.clear();
+	mNextReplayedEvent = 0u;
+	mStartTick = mTick;
+}
+
+bool InputHandler::IsRecording() const
+{
+	return mMode == Mode::Recording;
+}
+
+bool InputHandler::IsReplaying() const
+{
+	return mMode == Mode::Replaying;
+}
+
+bool InputHandler::IsReplayFinished() const
+{
+	return mMode == Mode::Replaying && mStartTick <= mTick && mTick - mStartTick >= mRecordedTicksNb;
+}
+
+std::chrono::microseconds InputHandler::GetTimeStep(std::chrono::microseconds measured_time_step) const
+{
+	return mMode != Mode::Live ? mFixedTimeStep : measured_time_step;
+}
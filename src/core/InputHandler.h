@@ -1,8 +1,12 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <cstdint>
+#include <limits>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
@@ -26,12 +30,44 @@ public:
 
 public:
 	InputHandler();
+	~InputHandler();
+
+	InputHandler(InputHandler const&) = delete;
+	InputHandler& operator=(InputHandler const&) = delete;
 
 public:
 	void FeedKeyboard(int key, int scancode, int action);
 	void FeedMouseButtons(int button, int action);
 	void FeedMouseMotion(glm::vec2 const& position);
 	void Advance();
+
+	//! \brief Record all events fed from now on, along with the tick they
+	//!        were fed at; they are written to `filename` by
+	//!        `StopRecording()`, or when the handler is destroyed.
+	//!
+	//! While recording, the application should advance by `time_step`
+	//! every tick (see `GetTimeStep()`), so that replaying gives the
+	//! same result.
+	bool StartRecording(std::string const& filename, std::chrono::microseconds time_step);
+	bool StopRecording();
+
+	//! \brief Load events recorded by `StartRecording()`; from then on,
+	//!        events fed by the window are ignored.
+	//!
+	//! The recorded events are only fed back once `StartReplay()` is
+	//! called, each one at the same tick, relative to that call, as it
+	//! was recorded at.
+	bool LoadReplay(std::string const& filename);
+	void StartReplay();
+
+	bool IsRecording() const;
+	bool IsReplaying() const;
+	bool IsReplayFinished() const;
+
+	//! \brief By how much to advance the application this tick: the
+	//!        recording's fixed time step while recording or replaying,
+	//!        `measured_time_step` otherwise.
+	std::chrono::microseconds GetTimeStep(std::chrono::microseconds measured_time_step) const;
 	std::uint32_t GetScancodeState(int scancode);
 	std::uint32_t GetKeycodeState(int key);
 	std::uint32_t GetMouseState(std::uint32_t button);
@@ -44,10 +80,36 @@ public:
 private:
 	using InputStateMap = std::unordered_map<size_t, IState>;
 
+	enum class Mode : std::uint8_t {
+		Live,
+		Recording,
+		Replaying
+	};
+	enum class EventType : std::uint8_t {
+		Keyboard = 0u,
+		MouseButton,
+		MouseMotion,
+		UICapture,
+		Count
+	};
+	struct RecordedEvent {
+		std::uint32_t tick{ 0u };  //!< relative to the start of the recording
+		EventType type{ EventType::Keyboard };
+		std::int32_t key_or_button{ 0 };
+		std::int32_t scancode{ 0 };
+		std::int32_t action{ 0 };
+		glm::vec2 position{ 0.0f };
+		std::uint8_t ui_capture{ 0u };  //!< bit 0 for the mouse, bit 1 for the keyboard
+	};
+
 	void DownEvent(InputStateMap& map, size_t loc);
 	void UpEvent(InputStateMap& map, size_t loc);
 	std::uint32_t GetState(InputStateMap const& map, size_t loc);
 
+	void ApplyKeyboard(int key, int scancode, int action);
+	void ApplyMouseButtons(int button, int action);
+	void Record(RecordedEvent event);
+
 	InputStateMap mScancodeMap;
 	InputStateMap mKeycodeMap;
 	InputStateMap mMouseMap;
@@ -60,5 +122,13 @@ private:
 
 	std::uint64_t mTick{ 0ULL };
 
+	Mode mMode{ Mode::Live };
+	std::string mRecordingFilename;
+	std::chrono::microseconds mFixedTimeStep{ 0 };
+	std::vector<RecordedEvent> mEvents;
+	std::uint64_t mRecordedTicksNb{ 0ULL };   //!< only valid while replaying
+	std::uint64_t mStartTick{ std::numeric_limits<std::uint64_t>::max() };  //!< tick at which recording or replaying started
+	size_t mNextReplayedEvent{ 0u };
+
 };
 
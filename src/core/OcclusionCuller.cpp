@@ -0,0 +1,233 @@
+#include "OcclusionCuller.hpp"
+
+#include "core/helpers.hpp"
+#include "core/Log.h"
+#include "core/opengl.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+OcclusionCuller::~OcclusionCuller()
+{
+	for (auto const& object : mObjects)
+		glDeleteQueries(1, &object.query);
+	glDeleteVertexArrays(1, &mEmptyVao);
+	glDeleteProgram(mBoxProgram);
+}
+
+void
+OcclusionCuller::SetObjectsNb(std::size_t objects_nb)
+{
+	for (auto i = objects_nb; i < mObjects.size(); ++i)
+		glDeleteQueries(1, &mObjects[i].query);
+
+	auto const previous_objects_nb = mObjects.size();
+	mObjects.resize(objects_nb);
+	for (auto i = previous_objects_nb; i < objects_nb; ++i)
+		glGenQueries(1, &mObjects[i].query);
+}
+
+std::size_t
+OcclusionCuller::GetObjectsNb() const
+{
+	return mObjects.size();
+}
+
+void
+OcclusionCuller::SetBox(std::size_t object, glm::vec3 const& min_corner, glm::vec3 const& max_corner)
+{
+	assert(object < mObjects.size());
+	mObjects[object].min_corner = min_corner;
+	mObjects[object].max_corner = max_corner;
+}
+
+void
+OcclusionCuller::SetEnabled(std::size_t object, bool is_enabled)
+{
+	assert(object < mObjects.size());
+	mObjects[object].is_enabled = is_enabled;
+}
+
+void
+OcclusionCuller::SetMode(Mode mode)
+{
+	mMode = mode;
+}
+
+OcclusionCuller::Mode
+OcclusionCuller::GetMode() const
+{
+	return mMode;
+}
+
+void
+OcclusionCuller::SetQuerySkipping(int visible_results_nb, int skipped_frames_nb)
+{
+	mVisibleResultsBeforeSkipping = std::max(visible_results_nb, 1);
+	mSkippedFramesNb = std::max(skipped_frames_nb, 0);
+}
+
+void
+OcclusionCuller::BeginFrame()
+{
+	mStatistics = Statistics();
+
+	for (auto& object : mObjects) {
+		// Never wait for a result: the previous one keeps being used until
+		// the new one is available.
+		if (object.is_query_pending) {
+			GLuint is_available = GL_FALSE;
+			glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &is_available);
+			if (is_available == GL_TRUE) {
+				GLuint any_samples_passed = GL_FALSE;
+				glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &any_samples_passed);
+				object.is_query_pending = false;
+				object.was_visible = any_samples_passed == GL_TRUE;
+				object.visible_results_nb = object.was_visible ? object.visible_results_nb + 1 : 0;
+				if (object.visible_results_nb >= mVisibleResultsBeforeSkipping) {
+					object.visible_results_nb = 0;
+					object.skipped_frames_nb = mSkippedFramesNb;
+				}
+			}
+		}
+
+		if (!object.is_enabled) {
+			object.is_drawn = true;
+			object.is_tested = false;
+			continue;
+		}
+		++mStatistics.tested_objects_nb;
+
+		auto const is_skipping_queries = object.skipped_frames_nb > 0;
+		if (is_skipping_queries) {
+			--object.skipped_frames_nb;
+			++mStatistics.skipped_queries_nb;
+		}
+		// The query object is reused once its result got read back, so
+		// that the draws of an object can always be conditioned on it.
+		object.is_tested = !is_skipping_queries && !object.is_query_pending;
+		object.is_drawn = mMode == Mode::ConditionalRendering || is_skipping_queries || object.was_visible;
+		if (!is_skipping_queries && !object.was_visible)
+			++mStatistics.culled_draws_nb;
+	}
+}
+
+bool
+OcclusionCuller::IsDrawn(std::size_t object) const
+{
+	assert(object < mObjects.size());
+	return mObjects[object].is_drawn;
+}
+
+GLuint
+OcclusionCuller::GetConditionQuery(std::size_t object) const
+{
+	assert(object < mObjects.size());
+	auto const& state = mObjects[object];
+	if (mMode != Mode::ConditionalRendering || !state.is_enabled || state.skipped_frames_nb > 0 || !state.has_been_queried)
+		return 0u;
+	return state.query;
+}
+
+bool
+OcclusionCuller::BeginDraw(std::size_t object) const
+{
+	if (!IsDrawn(object))
+		return false;
+
+	auto const query = GetConditionQuery(object);
+	if (query != 0u)
+		glBeginConditionalRender(query, GL_QUERY_WAIT);
+	return true;
+}
+
+void
+OcclusionCuller::EndDraw(std::size_t object) const
+{
+	if (GetConditionQuery(object) != 0u)
+		glEndConditionalRender();
+}
+
+void
+OcclusionCuller::IssueQueries(glm::mat4 const& world_to_clip, glm::vec3 const& camera_position, float near_plane)
+{
+	if (mBoxProgram == 0u)
+		CreateBoxProgram();
+	if (mBoxProgram == 0u)
+		return;
+
+	utils::opengl::debug::beginDebugGroup("Issue occlusion queries");
+
+	// Back faces are kept, for boxes whose front faces get clipped.
+	GLboolean const was_face_culling_enabled = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	glUseProgram(mBoxProgram);
+	glUniformMatrix4fv(mWorldToClipLocation, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+	glBindVertexArray(mEmptyVao);
+
+	// Boxes closer than that to the camera might cross the near plane.
+	auto const margin = glm::vec3(2.0f * near_plane);
+	for (auto& object : mObjects) {
+		if (!object.is_tested)
+			continue;
+
+		if (glm::clamp(camera_position, object.min_corner - margin, object.max_corner + margin) == camera_position) {
+			// Consider those visible, without conditioning their draws
+			// on an older result either.
+			object.was_visible = true;
+			object.has_been_queried = false;
+			continue;
+		}
+
+		glUniform3fv(mBoxMinCornerLocation, 1, glm::value_ptr(object.min_corner));
+		glUniform3fv(mBoxMaxCornerLocation, 1, glm::value_ptr(object.max_corner));
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		object.is_query_pending = true;
+		object.has_been_queried = true;
+		++mStatistics.issued_queries_nb;
+	}
+
+	glBindVertexArray(0u);
+	glUseProgram(0u);
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	if (was_face_culling_enabled == GL_TRUE)
+		glEnable(GL_CULL_FACE);
+
+	utils::opengl::debug::endDebugGroup();
+}
+
+OcclusionCuller::Statistics const&
+OcclusionCuller::GetStatistics() const
+{
+	return mStatistics;
+}
+
+void
+OcclusionCuller::CreateBoxProgram()
+{
+	mBoxProgram = bonobo::createProgram("common/occlusion_box.vert", "common/occlusion_box.frag");
+	if (mBoxProgram == 0u) {
+		LogError("Failed to load \"occlusion_box.vert\" and \"occlusion_box.frag\"");
+		return;
+	}
+	mBoxMinCornerLocation = glGetUniformLocation(mBoxProgram, "box_min_corner");
+	mBoxMaxCornerLocation = glGetUniformLocation(mBoxProgram, "box_max_corner");
+	mWorldToClipLocation = glGetUniformLocation(mBoxProgram, "vertex_world_to_clip");
+
+	// The box vertices are generated by the vertex shader, but a vertex
+	// array still has to be bound for drawing.
+	glGenVertexArrays(1, &mEmptyVao);
+	utils::opengl::debug::nameObject(GL_VERTEX_ARRAY, mEmptyVao, "Occlusion box VAO");
+}
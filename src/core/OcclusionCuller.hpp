@@ -0,0 +1,143 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+//! \brief Culls objects hidden behind the depth buffer, by rasterising
+//!        their bounding box within hardware occlusion queries.
+//!
+//! Objects are identified by their index, and described by a world-space
+//! axis-aligned bounding box. Once the depth buffer of a frame is
+//! complete, `IssueQueries()` draws the boxes of the tested objects
+//! against it, without writing to any attachment. The results are only
+//! ever consumed during a later frame, so that the CPU never waits for
+//! the GPU:
+//!
+//! * with `Mode::PreviousFrameResults`, `BeginFrame()` reads back the
+//!   results which are available by then, and objects found hidden are
+//!   not drawn at all;
+//! * with `Mode::ConditionalRendering`, draws are wrapped in
+//!   `glBeginConditionalRender()` on the latest query of their object,
+//!   leaving the decision to the GPU, which has that result at hand.
+//!
+//! Either way, an object hidden in one frame shows up one frame late once
+//! it gets uncovered. Queries are skipped for objects which have been
+//! visible several times in a row, as they would most likely be drawn
+//! anyway; they get tested again after a while.
+//!
+//! \code{.cpp}
+//! culler.BeginFrame();
+//! for (std::size_t i = 0; i < objects_nb; ++i) {
+//! 	if (!culler.BeginDraw(i))
+//! 		continue;
+//! 	// Draw object i.
+//! 	culler.EndDraw(i);
+//! }
+//! culler.IssueQueries(world_to_clip, camera_position, near_plane);
+//! \endcode
+class OcclusionCuller
+{
+public:
+	enum class Mode {
+		PreviousFrameResults,
+		ConditionalRendering
+	};
+
+	//! \brief What happened during the last frame.
+	struct Statistics {
+		std::size_t tested_objects_nb{ 0u };   //!< objects not disabled with `SetEnabled()`
+		std::size_t issued_queries_nb{ 0u };
+		std::size_t skipped_queries_nb{ 0u };  //!< for objects which have been visible for a while
+		std::size_t culled_draws_nb{ 0u };     //!< as reported by the latest results read back
+	};
+
+	OcclusionCuller() = default;
+	~OcclusionCuller();
+
+	OcclusionCuller(OcclusionCuller const&) = delete;
+	OcclusionCuller& operator=(OcclusionCuller const&) = delete;
+
+	//! \brief Set how many objects there are; new ones are enabled and
+	//!        considered visible until tested.
+	void SetObjectsNb(std::size_t objects_nb);
+	std::size_t GetObjectsNb() const;
+
+	//! \brief Set the world-space bounding box of an object.
+	void SetBox(std::size_t object, glm::vec3 const& min_corner, glm::vec3 const& max_corner);
+
+	//! \brief Set whether an object gets tested; disabled objects are
+	//!        always drawn, e.g. when too cheap to be worth a query.
+	void SetEnabled(std::size_t object, bool is_enabled);
+
+	void SetMode(Mode mode);
+	Mode GetMode() const;
+
+	//! \brief Set after how many visible results in a row the queries of
+	//!        an object are skipped, and for how many frames.
+	void SetQuerySkipping(int visible_results_nb, int skipped_frames_nb);
+
+	//! \brief Read back the available query results, and decide how to
+	//!        draw each object this frame.
+	void BeginFrame();
+
+	//! \brief Whether an object is drawn this frame; only false with
+	//!        `Mode::PreviousFrameResults`.
+	bool IsDrawn(std::size_t object) const;
+
+	//! \brief Query that the draws of an object should be conditioned on
+	//!        this frame, or 0 if none.
+	//!
+	//! This is meant for recording draws ahead of time, as in a
+	//! `CommandList`; otherwise, see `BeginDraw()`.
+	GLuint GetConditionQuery(std::size_t object) const;
+
+	//! \brief Begin the conditional rendering of an object, if needed.
+	//!
+	//! @return false if the object should not be drawn at all, in which
+	//!         case `EndDraw()` should not be called
+	bool BeginDraw(std::size_t object) const;
+	void EndDraw(std::size_t object) const;
+
+	//! \brief Rasterise the boxes of the objects tested this frame against
+	//!        the depth buffer of the bound framebuffer.
+	//!
+	//! Boxes the camera is inside of, or close to, cannot be rasterised
+	//! reliably and are considered visible instead.
+	//!
+	//! @param [in] near_plane distance from the camera to its near plane
+	void IssueQueries(glm::mat4 const& world_to_clip, glm::vec3 const& camera_position, float near_plane);
+
+	Statistics const& GetStatistics() const;
+
+private:
+	struct Object {
+		glm::vec3 min_corner{ 0.0f };
+		glm::vec3 max_corner{ 0.0f };
+		GLuint query{ 0u };
+		bool is_enabled{ true };
+		bool is_query_pending{ false };   //!< issued, but its result was not read back yet
+		bool has_been_queried{ false };   //!< whether `query` holds a result to condition draws on
+		bool was_visible{ true };         //!< latest result read back
+		int visible_results_nb{ 0 };      //!< in a row
+		int skipped_frames_nb{ 0 };       //!< left before querying again
+		bool is_drawn{ true };
+		bool is_tested{ false };          //!< whether a query gets issued this frame
+	};
+
+	void CreateBoxProgram();
+
+	std::vector<Object> mObjects;
+	Mode mMode{ Mode::PreviousFrameResults };
+	int mVisibleResultsBeforeSkipping{ 4 };
+	int mSkippedFramesNb{ 8 };
+	Statistics mStatistics;
+
+	GLuint mBoxProgram{ 0u };
+	GLint mBoxMinCornerLocation{ -1 };
+	GLint mBoxMaxCornerLocation{ -1 };
+	GLint mWorldToClipLocation{ -1 };
+	GLuint mEmptyVao{ 0u };
+};
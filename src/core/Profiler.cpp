@@ -0,0 +1,510 @@
+#include "Profiler.h"
+
+#include "core/Log.h"
+#include "core/opengl.hpp"
+#include "core/various.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+	constexpr bool is_profiling_enabled = ENABLE_PROFILING != 0;
+
+	// How many frames the graphs span.
+	constexpr std::size_t history_graph_length = 120u;
+
+	constexpr std::size_t no_query = std::numeric_limits<std::size_t>::max();
+
+	std::string escapeJSON(std::string const& text)
+	{
+		std::string escaped;
+		escaped.reserve(text.size());
+		for (auto const c : text) {
+			if (c == '"' || c == '\\')
+				escaped.push_back('\\');
+			if (static_cast<unsigned char>(c) < 0x20u)
+				continue;
+			escaped.push_back(c);
+		}
+		return escaped;
+	}
+
+	double toMicroseconds(std::chrono::nanoseconds const duration)
+	{
+		return static_cast<double>(duration.count()) / 1000.0;
+	}
+
+	float toMilliseconds(std::chrono::nanoseconds const duration)
+	{
+		return static_cast<float>(duration.count()) / 1000000.0f;
+	}
+
+	struct Summary {
+		float min_ms{ 0.0f };
+		float average_ms{ 0.0f };
+		float p95_ms{ 0.0f };
+		float p99_ms{ 0.0f };
+		float max_ms{ 0.0f };
+	};
+
+	Summary summarise(std::vector<float> values)
+	{
+		Summary summary;
+		if (values.empty())
+			return summary;
+
+		std::sort(values.begin(), values.end());
+		summary.min_ms = values.front();
+		summary.average_ms = std::accumulate(values.begin(), values.end(), 0.0f) / static_cast<float>(values.size());
+		summary.p95_ms = utils::get_percentile(values, 95.0);
+		summary.p99_ms = utils::get_percentile(values, 99.0);
+		summary.max_ms = values.back();
+		return summary;
+	}
+
+	void writeSummary(std::ostream& stream, Summary const& summary)
+	{
+		stream << "{\"min_ms\":" << summary.min_ms << ",\"average_ms\":" << summary.average_ms
+		       << ",\"p95_ms\":" << summary.p95_ms << ",\"p99_ms\":" << summary.p99_ms
+		       << ",\"max_ms\":" << summary.max_ms << "}";
+	}
+}
+
+Profiler::Zone const*
+Profiler::Frame::FindZone(std::string const& name) const
+{
+	auto const it = std::find_if(zones.begin(), zones.end(), [&name](Zone const& zone){ return zone.name == name; });
+	return it != zones.end() ? &*it : nullptr;
+}
+
+Profiler::Profiler(std::uint32_t frames_nb, std::uint32_t history_frames_nb) :
+	mFramesNb(std::max(frames_nb, 2u)), mHistoryFramesNb(std::max(history_frames_nb, 1u)),
+	mStartTime(std::chrono::high_resolution_clock::now())
+{
+	if (frames_nb < 2u)
+		LogWarning("The profiler needs at least two frames in flight to avoid waiting for the GPU; using two.");
+
+	mPendingFrames.resize(mFramesNb);
+	mCompletedFrames.reserve(mHistoryFramesNb);
+}
+
+Profiler::~Profiler()
+{
+	for (auto& pending_frame : mPendingFrames)
+		if (!pending_frame.queries.empty())
+			glDeleteQueries(static_cast<GLsizei>(pending_frame.queries.size()), pending_frame.queries.data());
+}
+
+void
+Profiler::BeginFrame()
+{
+	if (!is_profiling_enabled)
+		return;
+
+	if (mIsInFrame) {
+		LogWarning("Profiler::BeginFrame() called twice without calling Profiler::EndFrame() in-between.");
+		EndFrame();
+	}
+
+	// Read back the earlier frames, oldest first; as the GPU processes
+	// them in order, there is no point in looking further than the first
+	// one still unavailable.
+	for (std::uint32_t age = mFramesNb; age > 0u; --age) {
+		auto& pending_frame = mPendingFrames[(mFrameIndex + mFramesNb - age) % mFramesNb];
+		if (!pending_frame.is_pending)
+			continue;
+		if (!TryResolve(pending_frame))
+			break;
+	}
+
+	auto& pending_frame = mPendingFrames[mFrameIndex % mFramesNb];
+	if (pending_frame.is_pending) {
+		// Its queries are about to be reused.
+		++mDroppedFramesNb;
+		pending_frame.is_pending = false;
+	}
+	pending_frame.frame.index = mFrameIndex;
+	pending_frame.frame.zones.clear();
+	pending_frame.zone_queries.clear();
+	pending_frame.used_queries_nb = 0u;
+	pending_frame.is_collected = mIsCollectingStatistics;
+
+	// The GPU timestamps use their own clock; they are brought back to the
+	// CPU one using the difference between both, at about the same time.
+	GLint64 gpu_time = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_time);
+	pending_frame.gpu_to_cpu_offset = GetCpuTime() - std::chrono::nanoseconds(gpu_time);
+
+	mIsInFrame = true;
+}
+
+void
+Profiler::EndFrame()
+{
+	if (!is_profiling_enabled || !mIsInFrame)
+		return;
+
+	if (!mOpenZones.empty()) {
+		LogWarning("%zu profiler zone(s) still open at the end of the frame; closing them.", mOpenZones.size());
+		while (!mOpenZones.empty())
+			EndZone();
+	}
+
+	mPendingFrames[mFrameIndex % mFramesNb].is_pending = true;
+	++mFrameIndex;
+	mIsInFrame = false;
+}
+
+void
+Profiler::BeginZone(std::string const& name, ZoneType type, std::uint32_t flags)
+{
+	if (!is_profiling_enabled || !mIsInFrame)
+		return;
+
+	utils::opengl::debug::beginDebugGroup(name);
+
+	auto& pending_frame = mPendingFrames[mFrameIndex % mFramesNb];
+	Zone zone;
+	zone.name = name;
+	zone.depth = static_cast<std::uint32_t>(mOpenZones.size());
+	zone.has_gpu_times = type == ZoneType::CpuAndGpu;
+	zone.flags = flags;
+
+	auto start_query = no_query;
+	if (zone.has_gpu_times) {
+		start_query = AcquireQuery(pending_frame);
+		glQueryCounter(pending_frame.queries[start_query], GL_TIMESTAMP);
+	}
+
+	mOpenZones.push_back(pending_frame.frame.zones.size());
+	pending_frame.zone_queries.emplace_back(start_query, no_query);
+	zone.cpu_start = GetCpuTime();
+	pending_frame.frame.zones.push_back(std::move(zone));
+}
+
+void
+Profiler::EndZone()
+{
+	if (!is_profiling_enabled || !mIsInFrame)
+		return;
+
+	if (mOpenZones.empty()) {
+		LogWarning("Profiler::EndZone() called without any zone being open.");
+		return;
+	}
+
+	auto& pending_frame = mPendingFrames[mFrameIndex % mFramesNb];
+	auto const zone_index = mOpenZones.back();
+	mOpenZones.pop_back();
+
+	auto& zone = pending_frame.frame.zones[zone_index];
+	zone.cpu_end = GetCpuTime();
+	if (zone.has_gpu_times) {
+		auto const end_query = AcquireQuery(pending_frame);
+		glQueryCounter(pending_frame.queries[end_query], GL_TIMESTAMP);
+		pending_frame.zone_queries[zone_index].second = end_query;
+	}
+
+	utils::opengl::debug::endDebugGroup();
+}
+
+Profiler::Frame const*
+Profiler::GetLatestFrame() const
+{
+	return mHasLatestFrame ? &mLatestFrame : nullptr;
+}
+
+bool
+Profiler::ExportChromeTrace(std::string const& filename) const
+{
+	std::ofstream file(filename, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		LogError("Failed to open \"%s\" for writing the profiler trace.", filename.c_str());
+		return false;
+	}
+
+	// See the “Trace Event Format” document for a description of those
+	// events; timestamps are in microseconds.
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+	file.precision(3);
+	file << std::fixed;
+
+	// Oldest frame first.
+	for (std::size_t i = 0u; i < mCompletedFrames.size(); ++i) {
+		auto const& frame = mCompletedFrames[(mNextCompletedFrame + i) % mCompletedFrames.size()];
+		for (auto const& zone : frame.zones) {
+			auto const name = escapeJSON(zone.name);
+			file << ",\n{\"name\":\"" << name << "\",\"cat\":\"CPU\",\"ph\":\"X\",\"pid\":0,\"tid\":0"
+			     << ",\"ts\":" << toMicroseconds(zone.cpu_start) << ",\"dur\":" << toMicroseconds(zone.GetCpuDuration())
+			     << ",\"args\":{\"frame\":" << frame.index << "}}";
+			if (zone.has_gpu_times)
+				file << ",\n{\"name\":\"" << name << "\",\"cat\":\"GPU\",\"ph\":\"X\",\"pid\":0,\"tid\":1"
+				     << ",\"ts\":" << toMicroseconds(zone.gpu_start) << ",\"dur\":" << toMicroseconds(zone.GetGpuDuration())
+				     << ",\"args\":{\"frame\":" << frame.index << "}}";
+		}
+	}
+	file << "\n]}\n";
+
+	if (!file.good()) {
+		LogError("Failed to write the profiler trace to \"%s\".", filename.c_str());
+		return false;
+	}
+	LogInfo("Wrote %zu frames of profiling data to \"%s\".", mCompletedFrames.size(), filename.c_str());
+	return true;
+}
+
+void
+Profiler::RenderImGui()
+{
+	if (!is_profiling_enabled)
+		return;
+
+	bool const opened = ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_None);
+	if (opened) {
+		ImGui::Text("%llu frames in flight, %llu dropped",
+		            static_cast<unsigned long long>(mFramesNb), static_cast<unsigned long long>(mDroppedFramesNb));
+		ImGui::Checkbox("Pause history", &mIsPaused);
+		ImGui::SameLine();
+		if (ImGui::Button("Export Chrome trace"))
+			ExportChromeTrace("profiler_trace.json");
+
+		if (mHasLatestFrame && ImGui::BeginTable("Zones", 4, ImGuiTableFlags_SizingFixedFit)) {
+			ImGui::TableSetupColumn("Zone");
+			ImGui::TableSetupColumn("CPU [ms]");
+			ImGui::TableSetupColumn("GPU [ms]");
+			ImGui::TableSetupColumn("History");
+			ImGui::TableHeadersRow();
+
+			for (std::size_t i = 0u; i < mLatestFrame.zones.size(); ++i) {
+				auto const& zone = mLatestFrame.zones[i];
+				ImGui::PushID(static_cast<int>(i));
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%*s%s", static_cast<int>(2u * zone.depth), "", zone.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", toMilliseconds(zone.GetCpuDuration()));
+				ImGui::TableNextColumn();
+				if (zone.has_gpu_times)
+					ImGui::Text("%.3f", toMilliseconds(zone.GetGpuDuration()));
+				else
+					ImGui::TextDisabled("-");
+
+				ImGui::TableNextColumn();
+				auto const history_it = mHistories.find(zone.name);
+				if (history_it != mHistories.end()) {
+					auto const& history = history_it->second;
+					auto const& values = zone.has_gpu_times ? history.gpu_ms : history.cpu_ms;
+					ImGui::PlotLines("##history", values.data(), static_cast<int>(values.size()), static_cast<int>(history.offset),
+					                 nullptr, 0.0f, FLT_MAX, ImVec2(120.0f, ImGui::GetTextLineHeight()));
+				}
+
+				ImGui::PopID();
+			}
+
+			ImGui::EndTable();
+		}
+	}
+	ImGui::End();
+}
+
+std::uint64_t
+Profiler::GetDroppedFramesNb() const
+{
+	return mDroppedFramesNb;
+}
+
+std::uint32_t
+Profiler::GetFramesNb() const
+{
+	return mFramesNb;
+}
+
+void
+Profiler::SetCollectingStatistics(bool is_collecting)
+{
+	mIsCollectingStatistics = is_collecting;
+}
+
+bool
+Profiler::ReportStatistics(std::string const& filename)
+{
+	if (!is_profiling_enabled)
+		return true;
+
+	// This is only done once measurements are over, so waiting is fine.
+	glFinish();
+	for (std::uint32_t age = mFramesNb; age > 0u; --age) {
+		auto& pending_frame = mPendingFrames[(mFrameIndex + mFramesNb - age) % mFramesNb];
+		if (pending_frame.is_pending)
+			TryResolve(pending_frame);
+	}
+
+	LogInfo("Timings over %llu frames, as min / average / 95th percentile / 99th percentile / max, in ms:",
+	        static_cast<unsigned long long>(mCollectedFramesNb));
+	for (auto const& name : mStatisticsOrder) {
+		auto const& statistics = mStatistics[name];
+		auto const cpu = summarise(statistics.cpu_ms);
+		if (statistics.has_gpu_times) {
+			auto const gpu = summarise(statistics.gpu_ms);
+			LogInfo("  %s: CPU %.3f / %.3f / %.3f / %.3f / %.3f, GPU %.3f / %.3f / %.3f / %.3f / %.3f", name.c_str(),
+			        cpu.min_ms, cpu.average_ms, cpu.p95_ms, cpu.p99_ms, cpu.max_ms,
+			        gpu.min_ms, gpu.average_ms, gpu.p95_ms, gpu.p99_ms, gpu.max_ms);
+		} else {
+			LogInfo("  %s: CPU %.3f / %.3f / %.3f / %.3f / %.3f", name.c_str(),
+			        cpu.min_ms, cpu.average_ms, cpu.p95_ms, cpu.p99_ms, cpu.max_ms);
+		}
+	}
+
+	bool is_written = true;
+	if (!filename.empty()) {
+		std::ofstream file(filename, std::ios::out | std::ios::trunc);
+		if (file.is_open()) {
+			file.precision(4);
+			file << std::fixed;
+			file << "{\n\t\"frames_nb\": " << mCollectedFramesNb << ",\n\t\"zones\": [";
+			for (std::size_t i = 0u; i < mStatisticsOrder.size(); ++i) {
+				auto const& statistics = mStatistics[mStatisticsOrder[i]];
+				file << (i == 0u ? "\n" : ",\n") << "\t\t{\"name\":\"" << escapeJSON(mStatisticsOrder[i]) << "\",\"cpu\":";
+				writeSummary(file, summarise(statistics.cpu_ms));
+				if (statistics.has_gpu_times) {
+					file << ",\"gpu\":";
+					writeSummary(file, summarise(statistics.gpu_ms));
+				}
+				file << "}";
+			}
+			file << "\n\t]\n}\n";
+		}
+		is_written = file.is_open() && file.good();
+		if (is_written)
+			LogInfo("Wrote the profiler statistics to \"%s\".", filename.c_str());
+		else
+			LogError("Failed to write the profiler statistics to \"%s\".", filename.c_str());
+	}
+
+	mCollectedFramesNb = 0u;
+	mStatistics.clear();
+	mStatisticsOrder.clear();
+	return is_written;
+}
+
+std::chrono::nanoseconds
+Profiler::GetCpuTime() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - mStartTime);
+}
+
+std::size_t
+Profiler::AcquireQuery(PendingFrame& frame)
+{
+	if (frame.used_queries_nb == frame.queries.size()) {
+		GLuint query = 0u;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+	return frame.used_queries_nb++;
+}
+
+bool
+Profiler::TryResolve(PendingFrame& frame)
+{
+	// Queries complete in order, so the last one being available means all
+	// of them are.
+	if (frame.used_queries_nb > 0u) {
+		GLint is_available = GL_FALSE;
+		glGetQueryObjectiv(frame.queries[frame.used_queries_nb - 1u], GL_QUERY_RESULT_AVAILABLE, &is_available);
+		if (is_available != GL_TRUE)
+			return false;
+	}
+
+	for (std::size_t i = 0u; i < frame.frame.zones.size(); ++i) {
+		auto& zone = frame.frame.zones[i];
+		auto const& queries = frame.zone_queries[i];
+		if (!zone.has_gpu_times || queries.second == no_query) {
+			zone.has_gpu_times = false;
+			continue;
+		}
+
+		GLuint64 start_time = 0u, end_time = 0u;
+		glGetQueryObjectui64v(frame.queries[queries.first], GL_QUERY_RESULT, &start_time);
+		glGetQueryObjectui64v(frame.queries[queries.second], GL_QUERY_RESULT, &end_time);
+		zone.gpu_start = std::chrono::nanoseconds(static_cast<std::int64_t>(start_time)) + frame.gpu_to_cpu_offset;
+		zone.gpu_end = std::chrono::nanoseconds(static_cast<std::int64_t>(end_time)) + frame.gpu_to_cpu_offset;
+	}
+
+	frame.is_pending = false;
+	AddCompletedFrame(std::move(frame.frame), frame.is_collected);
+	return true;
+}
+
+void
+Profiler::AddCompletedFrame(Frame&& frame, bool is_collected)
+{
+	mLatestFrame = std::move(frame);
+	mHasLatestFrame = true;
+
+	if (is_collected) {
+		++mCollectedFramesNb;
+		for (auto const& zone : mLatestFrame.zones) {
+			auto statistics_it = mStatistics.find(zone.name);
+			if (statistics_it == mStatistics.end()) {
+				statistics_it = mStatistics.emplace(zone.name, Statistics()).first;
+				mStatisticsOrder.push_back(zone.name);
+			}
+
+			auto& statistics = statistics_it->second;
+			auto const cpu_ms = toMilliseconds(zone.GetCpuDuration());
+			auto const gpu_ms = zone.has_gpu_times ? toMilliseconds(zone.GetGpuDuration()) : 0.0f;
+			statistics.has_gpu_times |= zone.has_gpu_times;
+			if (statistics.last_frame_index == mLatestFrame.index) {
+				statistics.cpu_ms.back() += cpu_ms;
+				statistics.gpu_ms.back() += gpu_ms;
+			} else {
+				statistics.cpu_ms.push_back(cpu_ms);
+				statistics.gpu_ms.push_back(gpu_ms);
+				statistics.last_frame_index = mLatestFrame.index;
+			}
+		}
+	}
+
+	if (mIsPaused)
+		return;
+
+	for (auto const& zone : mLatestFrame.zones) {
+		auto history_it = mHistories.find(zone.name);
+		if (history_it == mHistories.end()) {
+			History history;
+			history.cpu_ms.resize(history_graph_length, 0.0f);
+			history.gpu_ms.resize(history_graph_length, 0.0f);
+			history_it = mHistories.emplace(zone.name, std::move(history)).first;
+		}
+
+		auto& history = history_it->second;
+		auto const gpu_ms = zone.has_gpu_times ? toMilliseconds(zone.GetGpuDuration()) : 0.0f;
+		if (history.last_frame_index == mLatestFrame.index) {
+			auto const previous = (history.offset + history_graph_length - 1u) % history_graph_length;
+			history.cpu_ms[previous] += toMilliseconds(zone.GetCpuDuration());
+			history.gpu_ms[previous] += gpu_ms;
+		} else {
+			history.cpu_ms[history.offset] = toMilliseconds(zone.GetCpuDuration());
+			history.gpu_ms[history.offset] = gpu_ms;
+			history.offset = (history.offset + 1u) % history_graph_length;
+			history.last_frame_index = mLatestFrame.index;
+		}
+	}
+
+	if (mCompletedFrames.size() < mHistoryFramesNb) {
+		mCompletedFrames.push_back(mLatestFrame);
+	} else {
+		mCompletedFrames[mNextCompletedFrame] = mLatestFrame;
+		mNextCompletedFrame = (mNextCompletedFrame + 1u) % mCompletedFrames.size();
+	}
+}
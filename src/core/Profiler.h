@@ -0,0 +1,220 @@
+#pragma once
+
+#include "BuildSettings.h"
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! \brief Measures how long nested zones of a frame take, on the CPU and
+//!        on the GPU, without ever waiting for the GPU.
+//!
+//! GPU zones are timed with timestamp queries taken from per-frame pools,
+//! ring-buffered over several frames: the results of a frame are only read
+//! back once available, a few frames later. If they still are not once its
+//! pool is needed again, that frame is dropped rather than waited for.
+//!
+//! Zones nest like debug groups, which they also open so that the same
+//! names show up in tools like RenderDoc. They have to be opened and closed
+//! from the thread calling `BeginFrame()`.
+//!
+//! A typical frame looks like:
+//!
+//! \code{.cpp}
+//! profiler.BeginFrame();
+//! {
+//! 	PROFILE_CPU_ZONE(profiler, "Prepare frame");
+//! 	// Compute transforms, record command lists, etc.
+//! }
+//! profiler.BeginZone("Shadow maps", Profiler::ZoneType::CpuAndGpu);
+//! // Issue the draw calls of that pass.
+//! profiler.EndZone();
+//! profiler.EndFrame();
+//! profiler.RenderImGui();
+//! \endcode
+//!
+//! When `ENABLE_PROFILING` is set to 0 in BuildSettings.h, all methods
+//! become no-ops, and no queries are allocated.
+class Profiler
+{
+public:
+	enum class ZoneType {
+		Cpu,       //!< only measured on the CPU
+		CpuAndGpu  //!< measured on the CPU as well as on the GPU
+	};
+
+	//! \brief Timings of a zone, as measured during a given frame.
+	struct Zone {
+		std::string name;
+		std::uint32_t depth{ 0u };       //!< how many zones enclose this one
+		bool has_gpu_times{ false };
+		std::uint32_t flags{ 0u };       //!< as given to `BeginZone()`
+		std::chrono::nanoseconds cpu_start{ 0 };  //!< relative to the start of the profiler
+		std::chrono::nanoseconds cpu_end{ 0 };
+		std::chrono::nanoseconds gpu_start{ 0 };  //!< relative to the start of the profiler, converted to the CPU clock
+		std::chrono::nanoseconds gpu_end{ 0 };
+
+		std::chrono::nanoseconds GetCpuDuration() const { return cpu_end - cpu_start; }
+		std::chrono::nanoseconds GetGpuDuration() const { return gpu_end - gpu_start; }
+	};
+
+	//! \brief All zones of a frame, in the order they were opened.
+	struct Frame {
+		std::uint64_t index{ 0u };
+		std::vector<Zone> zones;
+
+		//! \brief Look for a zone by name; returns null if not found.
+		Zone const* FindZone(std::string const& name) const;
+	};
+
+	//! \brief Create a profiler keeping `frames_nb` frames of queries in
+	//!        flight, and the results of the last `history_frames_nb`
+	//!        frames for the graphs and trace exports.
+	explicit Profiler(std::uint32_t frames_nb = 3u, std::uint32_t history_frames_nb = 240u);
+	~Profiler();
+
+	Profiler(Profiler const&) = delete;
+	Profiler& operator=(Profiler const&) = delete;
+
+	//! \brief Read back the results of earlier frames whose queries are
+	//!        available, then start a new frame.
+	void BeginFrame();
+
+	//! \brief End the current frame; all zones should be closed by then.
+	void EndFrame();
+
+	//! \brief Open a zone, nested within the currently opened one.
+	//!
+	//! @param [in] flags application-defined bits, kept along with the
+	//!             timings of the zone, e.g. to tell which ones to sum up
+	void BeginZone(std::string const& name, ZoneType type = ZoneType::CpuAndGpu, std::uint32_t flags = 0u);
+
+	//! \brief Close the most recently opened zone.
+	void EndZone();
+
+	//! \brief Most recent frame whose results were all read back, or null
+	//!        if there is none yet.
+	Frame const* GetLatestFrame() const;
+
+	//! \brief Write the frames kept in the history as a Chrome trace, to be
+	//!        opened in chrome://tracing or ui.perfetto.dev; CPU and GPU
+	//!        zones are shown as two separate threads.
+	//!
+	//! @return whether the file could be written
+	bool ExportChromeTrace(std::string const& filename) const;
+
+	//! \brief Draw the latest timings of all zones, with graphs of their
+	//!        recent history, in their own window.
+	void RenderImGui();
+
+	//! \brief Number of frames whose results were dropped, as not yet
+	//!        available by the time their queries had to be reused.
+	std::uint64_t GetDroppedFramesNb() const;
+
+	std::uint32_t GetFramesNb() const;
+
+	//! \brief Keep the timings of all frames begun from now on, until
+	//!        disabled, for `ReportStatistics()`.
+	void SetCollectingStatistics(bool is_collecting);
+
+	//! \brief Wait for the GPU to finish the frames still in flight, then
+	//!        log the minimum, average, 95th and 99th percentiles and
+	//!        maximum of the CPU and GPU times of each zone, over the frames
+	//!        collected since the last report.
+	//!
+	//! @param [in] filename where to also write them as JSON, if not empty
+	//! @return whether the file, if any, could be written
+	bool ReportStatistics(std::string const& filename);
+
+private:
+	// Queries and CPU-side results of a frame, until they are read back.
+	struct PendingFrame {
+		Frame frame;
+		std::vector<GLuint> queries;         //!< pool of timestamp queries, grown as needed
+		std::size_t used_queries_nb{ 0u };
+		std::vector<std::pair<std::size_t, std::size_t>> zone_queries;  //!< per zone, indices of its start and end queries
+		std::chrono::nanoseconds gpu_to_cpu_offset{ 0 };  //!< CPU time minus GPU timestamp, sampled at the start of the frame
+		bool is_pending{ false };
+		bool is_collected{ false };  //!< whether its timings go into the statistics
+	};
+
+	// Durations of a zone over the last frames, for the graphs; zones
+	// opened several times in a frame are summed up.
+	struct History {
+		std::vector<float> cpu_ms;
+		std::vector<float> gpu_ms;
+		std::size_t offset{ 0u };  //!< where the next frame goes
+		std::uint64_t last_frame_index{ ~std::uint64_t(0u) };
+	};
+
+	// Durations of a zone over all collected frames, summed up per frame
+	// like the history.
+	struct Statistics {
+		std::vector<float> cpu_ms;
+		std::vector<float> gpu_ms;
+		bool has_gpu_times{ false };
+		std::uint64_t last_frame_index{ ~std::uint64_t(0u) };
+	};
+
+	std::chrono::nanoseconds GetCpuTime() const;
+	std::size_t AcquireQuery(PendingFrame& frame);
+	bool TryResolve(PendingFrame& frame);
+	void AddCompletedFrame(Frame&& frame, bool is_collected);
+
+	std::uint32_t mFramesNb{ 0u };
+	std::uint32_t mHistoryFramesNb{ 0u };
+	std::uint64_t mFrameIndex{ 0u };
+	std::uint64_t mDroppedFramesNb{ 0u };
+	bool mIsInFrame{ false };
+	bool mIsPaused{ false };
+	std::chrono::high_resolution_clock::time_point mStartTime;
+
+	std::vector<PendingFrame> mPendingFrames;
+	std::vector<std::size_t> mOpenZones;   //!< indices of the zones opened in the current frame
+	bool mHasLatestFrame{ false };
+	Frame mLatestFrame;
+	std::vector<Frame> mCompletedFrames;   //!< ring of the last `mHistoryFramesNb` completed frames, for trace exports
+	std::size_t mNextCompletedFrame{ 0u };
+	std::unordered_map<std::string, History> mHistories;
+
+	bool mIsCollectingStatistics{ false };
+	std::uint64_t mCollectedFramesNb{ 0u };
+	std::unordered_map<std::string, Statistics> mStatistics;
+	std::vector<std::string> mStatisticsOrder;  //!< zone names, in the order they were first collected
+};
+
+//! \brief Helper opening a zone for as long as it stays in scope.
+class ProfilerScope
+{
+public:
+	ProfilerScope(Profiler& profiler, std::string const& name, Profiler::ZoneType type) : mProfiler(profiler)
+	{
+		mProfiler.BeginZone(name, type);
+	}
+	~ProfilerScope()
+	{
+		mProfiler.EndZone();
+	}
+
+	ProfilerScope(ProfilerScope const&) = delete;
+	ProfilerScope& operator=(ProfilerScope const&) = delete;
+
+private:
+	Profiler& mProfiler;
+};
+
+#define PROFILER_CONCATENATE_(a, b) a##b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE_(a, b)
+
+#if defined ENABLE_PROFILING && ENABLE_PROFILING != 0
+#	define PROFILE_CPU_ZONE(profiler, name) ProfilerScope PROFILER_CONCATENATE(profiler_scope_, __LINE__)((profiler), (name), Profiler::ZoneType::Cpu)
+#	define PROFILE_ZONE(profiler, name)     ProfilerScope PROFILER_CONCATENATE(profiler_scope_, __LINE__)((profiler), (name), Profiler::ZoneType::CpuAndGpu)
+#else
+#	define PROFILE_CPU_ZONE(profiler, name)
+#	define PROFILE_ZONE(profiler, name)
+#endif
@@ -8,8 +8,62 @@
 
 #include <imgui.h>
 
+#include <sstream>
 #include <type_traits>
 
+namespace
+{
+	//! \brief Replace each `#include "<path>"` line of a shader source with
+	//!        the content of that file.
+	//!
+	//! `#line` directives are inserted around each snippet, so that
+	//! compilation errors still report the lines of the original file; the
+	//! snippets are numbered as source strings 1, 2, etc., in the order
+	//! they are included.
+	//!
+	//! @return the expanded source, or an empty string if a snippet could
+	//!         not be read
+	std::string expandIncludes(std::string const& source, std::string const& filename)
+	{
+		std::string const directive = "#include";
+
+		std::istringstream lines(source);
+		std::ostringstream expanded;
+		std::string line;
+		int line_number = 0;
+		int includes_nb = 0;
+		while (std::getline(lines, line)) {
+			++line_number;
+
+			auto const directive_start = line.find_first_not_of(" \t");
+			if (directive_start == std::string::npos || line.compare(directive_start, directive.size(), directive) != 0) {
+				expanded << line << '\n';
+				continue;
+			}
+
+			auto const path_start = line.find('"', directive_start + directive.size());
+			auto const path_end = path_start != std::string::npos ? line.find('"', path_start + 1) : std::string::npos;
+			if (path_end == std::string::npos) {
+				LogError("Malformed include directive on line %d of shader '%s'.", line_number, filename.c_str());
+				return "";
+			}
+
+			std::string const snippet_filename = config::shaders_path(line.substr(path_start + 1, path_end - path_start - 1));
+			auto const snippet = utils::slurp_file(snippet_filename);
+			if (snippet.empty()) {
+				LogError("Retrieval of snippet '%s', included by shader '%s', failed; see previous message for details.", snippet_filename.c_str(), filename.c_str());
+				return "";
+			}
+
+			expanded << "#line 1 " << ++includes_nb << '\n'
+			         << snippet << '\n'
+			         << "#line " << line_number + 1 << " 0\n";
+		}
+
+		return expanded.str();
+	}
+}
+
 ShaderProgramManager::~ShaderProgramManager()
 {
 	for (auto const& i : program_entries) {
@@ -90,9 +144,11 @@ void ShaderProgramManager::ProcessProgram(std::size_t const program_index)
 
 	for (auto const& i : program_data) {
 		std::string const full_filename = config::shaders_path(i.second);
-		auto const shader_source = utils::slurp_file(full_filename);
+		auto const shader_source = expandIncludes(utils::slurp_file(full_filename), full_filename);
 		if (shader_source.empty()) {
 			LogError("Retrieval of shader '%s' failed; see previous message for details.", full_filename.c_str());
+			for (auto& shader : shaders)
+				glDeleteShader(shader);
 			return;
 		}
 
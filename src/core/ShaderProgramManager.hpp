@@ -19,6 +19,13 @@ enum class ShaderType : std::uint32_t {
 	compute = GL_COMPUTE_SHADER
 };
 
+//! \brief Creates shader programs from files, and recreates them on
+//!        demand.
+//!
+//! Shader files can pull in a snippet of GLSL shared between several of
+//! them with a line of the form `#include "common/snippet.glsl"`, the
+//! path being relative to the shaders folder; snippets cannot include
+//! others themselves.
 class ShaderProgramManager
 {
 public:
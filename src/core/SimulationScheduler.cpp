@@ -0,0 +1,175 @@
+#include "SimulationScheduler.hpp"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <utility>
+
+SimulationScheduler::SimulationScheduler(std::chrono::microseconds timestep, StepFunction step) :
+	mTimestep(timestep), mStep(std::move(step))
+{
+}
+
+SimulationScheduler::~SimulationScheduler()
+{
+	Stop();
+}
+
+void
+SimulationScheduler::Start()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mIsRunning)
+		return;
+
+	mIsRunning = true;
+	mThread = std::thread(&SimulationScheduler::ThreadLoop, this);
+}
+
+void
+SimulationScheduler::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mIsRunning)
+			return;
+		mIsRunning = false;
+	}
+	mStateChanged.notify_all();
+
+	mThread.join();
+}
+
+bool
+SimulationScheduler::IsRunning() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mIsRunning;
+}
+
+void
+SimulationScheduler::RunSteps(std::uint32_t steps_nb)
+{
+	if (IsRunning()) {
+		LogError("Steps can only be run manually while the scheduler is stopped.");
+		return;
+	}
+
+	for (std::uint32_t i = 0u; i < steps_nb; ++i)
+		RunStep(Clock::now());
+}
+
+void
+SimulationScheduler::SetPaused(bool is_paused)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mIsPaused = is_paused;
+	}
+	mStateChanged.notify_all();
+}
+
+bool
+SimulationScheduler::IsPaused() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mIsPaused;
+}
+
+void
+SimulationScheduler::SetTimeScale(float time_scale)
+{
+	if (time_scale <= 0.0f) {
+		LogError("The time scale has to be strictly positive; pause the scheduler instead.");
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTimeScale = time_scale;
+	}
+	mStateChanged.notify_all();
+}
+
+float
+SimulationScheduler::GetTimeScale() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mTimeScale;
+}
+
+std::chrono::microseconds
+SimulationScheduler::GetTimestep() const
+{
+	return mTimestep;
+}
+
+std::uint64_t
+SimulationScheduler::GetStepsNb() const
+{
+	return mStepsNb.load();
+}
+
+std::uint64_t
+SimulationScheduler::GetSkippedStepsNb() const
+{
+	return mSkippedStepsNb.load();
+}
+
+std::chrono::microseconds
+SimulationScheduler::GetLastStepDuration() const
+{
+	return std::chrono::microseconds(mLastStepDuration.load());
+}
+
+void
+SimulationScheduler::ThreadLoop()
+{
+	auto next_step_time = Clock::now();
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (mIsRunning) {
+		if (mIsPaused) {
+			mStateChanged.wait(lock, [this](){ return !mIsRunning || !mIsPaused; });
+			next_step_time = Clock::now();
+			continue;
+		}
+
+		auto const now = Clock::now();
+		if (now < next_step_time) {
+			mStateChanged.wait_until(lock, next_step_time);
+			continue;
+		}
+
+		// With a time scale of 2, steps are run twice as often.
+		auto const step_interval = std::max(Clock::duration(1),
+		                                    std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(static_cast<double>(mTimestep.count()) / static_cast<double>(mTimeScale))));
+
+		lock.unlock();
+
+		std::uint32_t late_steps_nb = 0u;
+		while (next_step_time <= now && late_steps_nb < max_catch_up_steps_nb) {
+			next_step_time += step_interval;
+			RunStep(next_step_time);
+			++late_steps_nb;
+		}
+		if (next_step_time <= now) {
+			auto const skipped_steps_nb = static_cast<std::uint64_t>((now - next_step_time) / step_interval) + 1u;
+			mSkippedStepsNb += skipped_steps_nb;
+			next_step_time += static_cast<Clock::duration::rep>(skipped_steps_nb) * step_interval;
+		}
+
+		lock.lock();
+	}
+}
+
+void
+SimulationScheduler::RunStep(Clock::time_point time)
+{
+	auto const start_time = Clock::now();
+
+	mStep({ mTimestep, mStepsNb.load(), time });
+	++mStepsNb;
+
+	mLastStepDuration = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+}
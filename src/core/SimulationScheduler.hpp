@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//! \brief Runs a simulation with a fixed timestep, on its own thread.
+//!
+//! The step function is called once per timestep, at a pace following the
+//! wall clock (scaled by the time scale), independently of the frame rate.
+//! It typically writes its results into a `SnapshotBuffer`, using the
+//! `time` of the step as timestamp, and the renderer interpolates between
+//! the two latest snapshots.
+//!
+//! As each step always advances the simulation by the same amount, a
+//! given number of steps always produces the same result. For
+//! reproducible runs, like benchmarks, the scheduler can also be left
+//! stopped and stepped manually with `RunSteps()`.
+//!
+//! If the simulation cannot keep up, at most `max_catch_up_steps_nb` late
+//! steps are run back-to-back; the remaining ones are skipped rather than
+//! letting the delay grow further.
+class SimulationScheduler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	//! \brief Information given to the step function.
+	struct Step {
+		std::chrono::microseconds timestep;  //!< by how much to advance the simulation
+		std::uint64_t index;                 //!< number of steps run before this one
+		Clock::time_point time;              //!< wall-clock time at which the step result should be displayed
+	};
+	using StepFunction = std::function<void (Step const& step)>;
+
+	static constexpr std::uint32_t max_catch_up_steps_nb = 4u;
+
+	//! \brief Create a stopped scheduler.
+	//!
+	//! @param [in] timestep by how much each step advances the simulation
+	//! @param [in] step function called for each step; it is called from
+	//!             the simulation thread while running, so it should not
+	//!             make any OpenGL calls
+	SimulationScheduler(std::chrono::microseconds timestep, StepFunction step);
+	~SimulationScheduler();
+
+	SimulationScheduler(SimulationScheduler const&) = delete;
+	SimulationScheduler& operator=(SimulationScheduler const&) = delete;
+
+	//! \brief Start running steps on the simulation thread.
+	void Start();
+
+	//! \brief Stop the simulation thread, after the current step if any.
+	void Stop();
+
+	bool IsRunning() const;
+
+	//! \brief Run `steps_nb` steps on the calling thread; the scheduler has
+	//!        to be stopped.
+	void RunSteps(std::uint32_t steps_nb = 1u);
+
+	//! \brief Stop calling the step function until un-paused; the
+	//!        simulation resumes from where it was, without trying to catch
+	//!        up on the paused duration.
+	void SetPaused(bool is_paused);
+	bool IsPaused() const;
+
+	//! \brief Set how fast simulated time passes compared to the wall
+	//!        clock; the timestep is not affected, only how often steps are
+	//!        run.
+	void SetTimeScale(float time_scale);
+	float GetTimeScale() const;
+
+	std::chrono::microseconds GetTimestep() const;
+
+	//! \brief Number of steps run since the creation of the scheduler.
+	std::uint64_t GetStepsNb() const;
+
+	//! \brief Number of steps skipped because the simulation could not
+	//!        keep up.
+	std::uint64_t GetSkippedStepsNb() const;
+
+	//! \brief Time spent running the last step.
+	std::chrono::microseconds GetLastStepDuration() const;
+
+private:
+	void ThreadLoop();
+	void RunStep(Clock::time_point time);
+
+	std::chrono::microseconds const mTimestep;
+	StepFunction const mStep;
+
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	std::condition_variable mStateChanged;
+	bool mIsRunning{ false };
+	bool mIsPaused{ false };
+	float mTimeScale{ 1.0f };
+
+	std::atomic<std::uint64_t> mStepsNb{ 0u };
+	std::atomic<std::uint64_t> mSkippedStepsNb{ 0u };
+	std::atomic<std::int64_t> mLastStepDuration{ 0 };
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+//! \brief Hands over snapshots of a simulation from the thread running it
+//!        to the one rendering it.
+//!
+//! The renderer always reads the two latest published snapshots, so that
+//! it can interpolate between them, while the simulation writes the next
+//! one into a separate slot; neither side ever copies a snapshot. Four
+//! slots are used, so that the writer only has to wait if the reader is
+//! still holding on to a pair older than the latest one.
+//!
+//! Slots are reused without being cleared: when `BeginWrite()` returns, the
+//! slot still contains a snapshot from a few steps ago, which lets
+//! snapshots keep large buffers allocated.
+//!
+//! Writer side:
+//!
+//! \code{.cpp}
+//! auto& snapshot = buffer.BeginWrite();
+//! // Fill in `snapshot`.
+//! buffer.EndWrite(step_time);
+//! \endcode
+//!
+//! Reader side:
+//!
+//! \code{.cpp}
+//! auto const view = buffer.AcquireRead();
+//! if (view.IsValid())
+//! 	draw(*view.previous, *view.current, view.GetInterpolationFactor());
+//! buffer.ReleaseRead();
+//! \endcode
+template<typename T>
+class SnapshotBuffer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	//! \brief The two latest snapshots, as seen by the reader.
+	struct ReadView {
+		T const* previous{ nullptr };  //!< snapshot published before `current`; same as `current` if there is only one
+		T const* current{ nullptr };   //!< latest published snapshot; null if none was published yet
+		Clock::time_point previous_time;
+		Clock::time_point current_time;
+
+		bool IsValid() const;
+
+		//! \brief How far to interpolate from `previous` to `current`
+		//!        when rendering at time `now`.
+		//!
+		//! Snapshots are timestamped with the time at which they should
+		//! be displayed, which is usually ahead of when they were
+		//! computed. The factor is clamped to [0, 1], meaning the current
+		//! snapshot is held if the simulation falls behind.
+		float GetInterpolationFactor(Clock::time_point now = Clock::now()) const;
+	};
+
+	SnapshotBuffer() = default;
+
+	SnapshotBuffer(SnapshotBuffer const&) = delete;
+	SnapshotBuffer& operator=(SnapshotBuffer const&) = delete;
+
+	//! \brief Get a slot to write the next snapshot into, waiting for the
+	//!        reader to release one if needed.
+	T& BeginWrite();
+
+	//! \brief Publish the snapshot written since `BeginWrite()`.
+	//!
+	//! @param [in] time when the snapshot should be displayed
+	void EndWrite(Clock::time_point time);
+
+	//! \brief Lock the two latest snapshots until `ReleaseRead()` is
+	//!        called; they will not be modified in the meantime.
+	ReadView AcquireRead();
+
+	//! \brief Unlock the snapshots returned by `AcquireRead()`.
+	void ReleaseRead();
+
+	//! \brief Number of snapshots published so far.
+	std::uint64_t GetPublishedNb() const;
+
+private:
+	static constexpr std::size_t slots_nb = 4u;
+	static constexpr std::size_t no_slot = static_cast<std::size_t>(-1);
+
+	bool IsSlotBusy(std::size_t slot) const;
+
+	struct Slot {
+		T data{};
+		Clock::time_point time;
+	};
+	std::array<Slot, slots_nb> mSlots;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mSlotReleased;
+	std::size_t mLatest{ no_slot };
+	std::size_t mPrevious{ no_slot };
+	std::size_t mWriting{ no_slot };
+	std::size_t mReadingLatest{ no_slot };
+	std::size_t mReadingPrevious{ no_slot };
+	std::uint64_t mPublishedNb{ 0u };
+};
+
+#include "SnapshotBuffer.inl"
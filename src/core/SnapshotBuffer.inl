@@ -0,0 +1,95 @@
+#include <algorithm>
+
+template<typename T>
+bool SnapshotBuffer<T>::ReadView::IsValid() const
+{
+	return current != nullptr;
+}
+
+template<typename T>
+float SnapshotBuffer<T>::ReadView::GetInterpolationFactor(Clock::time_point now) const
+{
+	if (!IsValid() || current_time <= previous_time)
+		return 1.0f;
+
+	auto const elapsed = std::chrono::duration<float>(now - previous_time).count();
+	auto const interval = std::chrono::duration<float>(current_time - previous_time).count();
+	return std::min(std::max(elapsed / interval, 0.0f), 1.0f);
+}
+
+template<typename T>
+T& SnapshotBuffer<T>::BeginWrite()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	std::size_t slot = no_slot;
+	mSlotReleased.wait(lock, [this, &slot](){
+		for (std::size_t i = 0u; i < slots_nb; ++i) {
+			if (!IsSlotBusy(i)) {
+				slot = i;
+				return true;
+			}
+		}
+		return false;
+	});
+
+	mWriting = slot;
+	return mSlots[slot].data;
+}
+
+template<typename T>
+void SnapshotBuffer<T>::EndWrite(Clock::time_point time)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mSlots[mWriting].time = time;
+	mPrevious = mLatest;
+	mLatest = mWriting;
+	mWriting = no_slot;
+	++mPublishedNb;
+}
+
+template<typename T>
+typename SnapshotBuffer<T>::ReadView SnapshotBuffer<T>::AcquireRead()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	ReadView view;
+	if (mLatest == no_slot)
+		return view;
+
+	auto const previous = mPrevious != no_slot ? mPrevious : mLatest;
+	mReadingLatest = mLatest;
+	mReadingPrevious = previous;
+
+	view.previous = &mSlots[previous].data;
+	view.current = &mSlots[mLatest].data;
+	view.previous_time = mSlots[previous].time;
+	view.current_time = mSlots[mLatest].time;
+	return view;
+}
+
+template<typename T>
+void SnapshotBuffer<T>::ReleaseRead()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mReadingLatest = no_slot;
+		mReadingPrevious = no_slot;
+	}
+	mSlotReleased.notify_one();
+}
+
+template<typename T>
+std::uint64_t SnapshotBuffer<T>::GetPublishedNb() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPublishedNb;
+}
+
+template<typename T>
+bool SnapshotBuffer<T>::IsSlotBusy(std::size_t slot) const
+{
+	return slot == mLatest || slot == mPrevious || slot == mWriting
+	    || slot == mReadingLatest || slot == mReadingPrevious;
+}
@@ -0,0 +1,104 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	void runChunk(ThreadPool::Task const& task, std::size_t count, std::size_t chunks_nb, std::size_t chunk_index)
+	{
+		auto const chunk_size = (count + chunks_nb - 1u) / chunks_nb;
+		auto const begin = std::min(count, chunk_index * chunk_size);
+		auto const end = std::min(count, begin + chunk_size);
+		if (begin < end)
+			task(begin, end, chunk_index);
+	}
+}
+
+ThreadPool::ThreadPool(std::size_t workers_nb)
+{
+	mWorkers.reserve(workers_nb);
+	for (std::size_t i = 0u; i < workers_nb; ++i)
+		mWorkers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mIsStopping = true;
+	}
+	mWorkAvailable.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+void
+ThreadPool::ParallelFor(std::size_t count, Task const& task)
+{
+	if (count == 0u)
+		return;
+
+	if (mWorkers.empty()) {
+		task(0u, count, 0u);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mCount = count;
+		mPendingWorkersNb = mWorkers.size();
+		++mGeneration;
+	}
+	mWorkAvailable.notify_all();
+
+	// The calling thread takes care of the first chunk.
+	runChunk(task, count, GetChunksNb(), 0u);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [this](){ return mPendingWorkersNb == 0u; });
+	mTask = nullptr;
+}
+
+std::size_t
+ThreadPool::GetChunksNb() const
+{
+	return mWorkers.size() + 1u;
+}
+
+std::size_t
+ThreadPool::GetDefaultWorkersNb()
+{
+	auto const hardware_threads_nb = static_cast<std::size_t>(std::thread::hardware_concurrency());
+	return hardware_threads_nb > 1u ? hardware_threads_nb - 1u : 0u;
+}
+
+void
+ThreadPool::WorkerLoop(std::size_t worker_index)
+{
+	std::uint64_t last_generation = 0u;
+	for (;;) {
+		Task const* task = nullptr;
+		std::size_t count = 0u;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkAvailable.wait(lock, [this, last_generation](){ return mIsStopping || mGeneration != last_generation; });
+			if (mIsStopping)
+				return;
+			last_generation = mGeneration;
+			task = mTask;
+			count = mCount;
+		}
+
+		runChunk(*task, count, GetChunksNb(), worker_index + 1u);
+
+		bool is_last = false;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			is_last = --mPendingWorkersNb == 0u;
+		}
+		if (is_last)
+			mWorkDone.notify_one();
+	}
+}
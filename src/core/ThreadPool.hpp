@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \brief A fixed set of worker threads to spread CPU work over several
+//!        cores.
+//!
+//! Work is submitted with `ParallelFor()`, which splits a range into one
+//! contiguous chunk per thread, the calling thread included. As chunks are
+//! always assigned in the same order, chunk `i` can safely write into
+//! per-chunk storage such as a `CommandList`, without any locking.
+//!
+//! No OpenGL calls should be made from the tasks, as the OpenGL context is
+//! only current on the calling thread.
+class ThreadPool
+{
+public:
+	//! \brief Task run on each chunk: it receives the range [begin, end)
+	//!        to process, and the index of the chunk.
+	using Task = std::function<void (std::size_t begin, std::size_t end, std::size_t chunk_index)>;
+
+	//! \brief Start the worker threads.
+	//!
+	//! @param [in] workers_nb how many threads to start besides the calling
+	//!             one; by default, one less than the number of hardware
+	//!             threads
+	explicit ThreadPool(std::size_t workers_nb = GetDefaultWorkersNb());
+	~ThreadPool();
+
+	ThreadPool(ThreadPool const&) = delete;
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	//! \brief Run `task` over [0, count), and return once all chunks have
+	//!        been processed.
+	//!
+	//! @param [in] count size of the range to process
+	//! @param [in] task function to run on each chunk
+	void ParallelFor(std::size_t count, Task const& task);
+
+	//! \brief Number of chunks a range gets split into, i.e. the number of
+	//!        workers plus the calling thread.
+	std::size_t GetChunksNb() const;
+
+	static std::size_t GetDefaultWorkersNb();
+
+private:
+	void WorkerLoop(std::size_t worker_index);
+
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkAvailable;
+	std::condition_variable mWorkDone;
+	Task const* mTask{ nullptr };
+	std::size_t mCount{ 0u };
+	std::uint64_t mGeneration{ 0u };
+	std::size_t mPendingWorkersNb{ 0u };
+	bool mIsStopping{ false };
+};
@@ -2,11 +2,20 @@
 
 #include "Log.h"
 #include "opengl.hpp"
+#include "various.hpp"
 
 #include <glad/glad.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
 
 namespace
 {
@@ -14,6 +23,40 @@ namespace
 	const int default_opengl_minor_version = 1;
 	const int default_glsl_version = default_opengl_major_version * 100 + default_opengl_minor_version * 10;
 
+	// Used when no monitor is available to pick a size from, as is the
+	// case when running headless.
+	const int default_headless_width = 1600;
+	const int default_headless_height = 900;
+
+	int GetGLFWContextAPI(WindowManager::ContextAPI api)
+	{
+		switch (api) {
+		case WindowManager::ContextAPI::native:
+			return GLFW_NATIVE_CONTEXT_API;
+		case WindowManager::ContextAPI::egl:
+			return GLFW_EGL_CONTEXT_API;
+		case WindowManager::ContextAPI::osmesa:
+#ifdef GLFW_OSMESA_CONTEXT_API
+			return GLFW_OSMESA_CONTEXT_API;
+#else
+			LogWarning("OSMesa contexts require GLFW 3.3 or later; using EGL instead.");
+			return GLFW_EGL_CONTEXT_API;
+#endif
+		default:
+			return GLFW_NATIVE_CONTEXT_API;
+		}
+	}
+
+	bool ParseFrameCount(char const* text, unsigned int& count)
+	{
+		char* end = nullptr;
+		auto const value = std::strtoul(text, &end, 10);
+		if (end == text || *end != '\0' || text[0] == '-')
+			return false;
+		count = static_cast<unsigned int>(value);
+		return true;
+	}
+
 	void ErrorCallback(int error, char const* description)
 	{
 		if (error == 65543 || error == 65545)
@@ -67,7 +110,12 @@ namespace
 
 std::mutex WindowManager::mMutex;
 
-WindowManager::WindowManager()
+WindowManager::WindowManager() : WindowManager(BenchmarkSettings())
+{
+}
+
+WindowManager::WindowManager(BenchmarkSettings const& benchmark_settings) :
+	mBenchmarkSettings(benchmark_settings)
 {
 	bool const is_first_instance = WindowManager::mMutex.try_lock();
 	if (!is_first_instance)
@@ -103,21 +151,31 @@ GLFWwindow* WindowManager::CreateGLFWWindow(std::string const& title, WindowDatu
 	glfwWindowHint(GLFW_RESIZABLE, resizable ? GLFW_TRUE : GLFW_FALSE);
 	glfwWindowHint(GLFW_SAMPLES, static_cast<int>(msaa));
 
+	if (mBenchmarkSettings.is_headless) {
+		// The window is never shown, so its default framebuffer is only
+		// used as an offscreen surface.
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GetGLFWContextAPI(mBenchmarkSettings.context_api));
+		fullscreen = false;
+	}
+
 	GLFWmonitor* const monitor = glfwGetPrimaryMonitor();
-	GLFWvidmode const* const video_mode = glfwGetVideoMode(monitor);
+	GLFWvidmode const* const video_mode = monitor != nullptr ? glfwGetVideoMode(monitor) : nullptr;
 	int width  = fullscreen ? data.fullscreen_width  : data.windowed_width;
 	int height = fullscreen ? data.fullscreen_height : data.windowed_height;
 	if (width == 0)
-		width = video_mode->width;
+		width = video_mode != nullptr ? video_mode->width : default_headless_width;
 	if (height == 0)
-		height = video_mode->height;
+		height = video_mode != nullptr ? video_mode->height : default_headless_height;
 
-	glfwWindowHint(GLFW_RED_BITS, video_mode->redBits);
-	glfwWindowHint(GLFW_GREEN_BITS, video_mode->greenBits);
-	glfwWindowHint(GLFW_BLUE_BITS, video_mode->blueBits);
-	glfwWindowHint(GLFW_REFRESH_RATE, video_mode->refreshRate);
+	if (video_mode != nullptr) {
+		glfwWindowHint(GLFW_RED_BITS, video_mode->redBits);
+		glfwWindowHint(GLFW_GREEN_BITS, video_mode->greenBits);
+		glfwWindowHint(GLFW_BLUE_BITS, video_mode->blueBits);
+		glfwWindowHint(GLFW_REFRESH_RATE, video_mode->refreshRate);
+	}
 
-	GLFWwindow* window = glfwCreateWindow(width, height, title.c_str(), fullscreen ? monitor : nullptr, nullptr);
+	GLFWwindow* window = glfwCreateWindow(width, height, title.c_str(), fullscreen && monitor != nullptr ? monitor : nullptr, nullptr);
 
 	if (window == nullptr)
 		return nullptr;
@@ -195,6 +253,10 @@ GLFWwindow* WindowManager::CreateGLFWWindow(std::string const& title, WindowDatu
 		LogInfo("DebugCallback is not core in OpenGL %d.%d, and sadly the GL_KHR_DEBUG extension is not available either.", GLVersion.major, GLVersion.minor);
 	}
 
+	// Benchmarks measure how fast frames can be rendered, rather than the
+	// refresh rate of the monitor.
+	if (mBenchmarkSettings.is_headless || IsBenchmarking())
+		swap = SwapStrategy::disable_vsync;
 	glfwSwapInterval(static_cast<std::underlying_type<SwapStrategy>::type>(swap));
 
 	auto& datum_copy = mWindowData[window] = std::make_unique<WindowDatum>(data);
@@ -202,6 +264,26 @@ GLFWwindow* WindowManager::CreateGLFWWindow(std::string const& title, WindowDatu
 	datum_copy->fullscreen_height = height;
 	glfwSetWindowUserPointer(window, datum_copy.get());
 
+	if (!mBenchmarkSettings.record_filename.empty())
+		data.input_handler.StartRecording(mBenchmarkSettings.record_filename, mBenchmarkSettings.time_step);
+	if (!mBenchmarkSettings.replay_filename.empty() && !data.input_handler.LoadReplay(mBenchmarkSettings.replay_filename))
+		mBenchmarkSettings.replay_filename.clear();
+
+	if (IsBenchmarking()) {
+		if (!mBenchmarkSettings.replay_filename.empty())
+			LogInfo("Benchmarking the replay of \"%s\" at %d x %d, after %u warm-up frames%s.", mBenchmarkSettings.replay_filename.c_str(),
+			        width, height, mBenchmarkSettings.warmup_frames_nb, mBenchmarkSettings.is_headless ? ", headless" : "");
+		else
+			LogInfo("Benchmarking %u frames at %d x %d, after %u warm-up frames%s.", mBenchmarkSettings.frames_nb, width, height,
+			        mBenchmarkSettings.warmup_frames_nb, mBenchmarkSettings.is_headless ? ", headless" : "");
+	}
+	if (!mBenchmarkSettings.replay_filename.empty() && mBenchmarkSettings.warmup_frames_nb == 0u)
+		data.input_handler.StartReplay();
+	mBenchmarkFramesNb = 0u;
+	mFrameTimes.clear();
+	mFrameTimes.reserve(mBenchmarkSettings.frames_nb);
+	mLastSwapTime = std::chrono::steady_clock::now();
+
 	return window;
 }
 
@@ -253,3 +335,222 @@ void WindowManager::ToggleFullscreenStatusForWindow(GLFWwindow* const window) no
 		glfwSetWindowMonitor(window, nullptr, datum->xpos, datum->ypos, datum->windowed_width, datum->windowed_height, 0);
 	}
 }
+
+WindowManager::BenchmarkSettings WindowManager::ParseBenchmarkSettings(int argc, char const* const argv[])
+{
+	BenchmarkSettings settings;
+
+	for (int i = 1; i < argc; ++i) {
+		char const* const argument = argv[i];
+		char const* const value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		auto const is_option = [argument](char const* name){ return std::strcmp(argument, name) == 0; };
+
+		if (is_option("--headless")) {
+			settings.is_headless = true;
+		} else if (is_option("--context-api") && value != nullptr) {
+			++i;
+			if (std::strcmp(value, "native") == 0)
+				settings.context_api = ContextAPI::native;
+			else if (std::strcmp(value, "egl") == 0)
+				settings.context_api = ContextAPI::egl;
+			else if (std::strcmp(value, "osmesa") == 0)
+				settings.context_api = ContextAPI::osmesa;
+			else
+				LogWarning("Unknown context API \"%s\"; expected native, egl or osmesa.", value);
+		} else if (is_option("--frames") && value != nullptr) {
+			++i;
+			if (!ParseFrameCount(value, settings.frames_nb))
+				LogWarning("Invalid number of frames \"%s\".", value);
+		} else if (is_option("--warmup-frames") && value != nullptr) {
+			++i;
+			if (!ParseFrameCount(value, settings.warmup_frames_nb))
+				LogWarning("Invalid number of warm-up frames \"%s\".", value);
+		} else if (is_option("--statistics") && value != nullptr) {
+			++i;
+			settings.statistics_filename = value;
+		} else if (is_option("--pass-statistics") && value != nullptr) {
+			++i;
+			settings.pass_statistics_filename = value;
+		} else if (is_option("--screenshot") && value != nullptr) {
+			++i;
+			settings.image_filename = value;
+		} else if (is_option("--capture") && value != nullptr) {
+			++i;
+			settings.capture_prefix = value;
+		} else if (is_option("--capture-format") && value != nullptr) {
+			++i;
+			if (std::strcmp(value, "png") == 0)
+				settings.capture_raw_video = false;
+			else if (std::strcmp(value, "raw") == 0)
+				settings.capture_raw_video = true;
+			else
+				LogWarning("Unknown capture format \"%s\"; expected png or raw.", value);
+		} else if (is_option("--record") && value != nullptr) {
+			++i;
+			settings.record_filename = value;
+		} else if (is_option("--replay") && value != nullptr) {
+			++i;
+			settings.replay_filename = value;
+		} else {
+			LogWarning("Ignoring command-line argument \"%s\"; recognised ones are --headless, --context-api <native|egl|osmesa>, "
+			           "--frames <count>, --warmup-frames <count>, --statistics <file.json>, --pass-statistics <file.json>, "
+			           "--screenshot <file.png>, --capture <prefix>, --capture-format <png|raw>, --record <file> and --replay <file>.", argument);
+		}
+	}
+
+	if (!settings.record_filename.empty() && !settings.replay_filename.empty()) {
+		LogWarning("Inputs can not be recorded while replaying; ignoring --record.");
+		settings.record_filename.clear();
+	}
+
+	// Without a limit, a headless run would never end.
+	if (settings.is_headless && settings.frames_nb == 0u && settings.replay_filename.empty()) {
+		settings.frames_nb = 1000u;
+		LogInfo("No number of frames given for the headless run; using %u.", settings.frames_nb);
+	}
+
+	return settings;
+}
+
+void WindowManager::SwapBuffers(GLFWwindow* const window)
+{
+	if (!IsBenchmarking()) {
+		glfwSwapBuffers(window);
+		return;
+	}
+
+	auto const window_datum_iter = mWindowData.find(window);
+	InputHandler* const input_handler = window_datum_iter != mWindowData.end() ? &window_datum_iter->second->input_handler : nullptr;
+	bool const is_replaying = input_handler != nullptr && input_handler->IsReplaying();
+
+	++mBenchmarkFramesNb;
+	auto const warmup_frames_nb = mBenchmarkSettings.warmup_frames_nb;
+	auto const last_frame = is_replaying ? std::numeric_limits<unsigned int>::max() : warmup_frames_nb + mBenchmarkSettings.frames_nb;
+	bool const is_last_frame = is_replaying ? input_handler->IsReplayFinished() : mBenchmarkFramesNb == last_frame;
+
+	// Read back before swapping, while the back buffer still holds the
+	// frame.
+	if (is_last_frame && !mBenchmarkSettings.image_filename.empty())
+		SaveFramebuffer(window, mBenchmarkSettings.image_filename);
+
+	glfwSwapBuffers(window);
+
+	auto const now = std::chrono::steady_clock::now();
+	if (mBenchmarkFramesNb > warmup_frames_nb && mBenchmarkFramesNb <= last_frame)
+		mFrameTimes.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLastSwapTime));
+	mLastSwapTime = now;
+
+	// The replay drives the measured frames only.
+	if (is_replaying && mBenchmarkFramesNb == warmup_frames_nb)
+		input_handler->StartReplay();
+
+	if (is_last_frame) {
+		ReportBenchmarkResults();
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	}
+}
+
+bool WindowManager::IsBenchmarking() const noexcept
+{
+	return mBenchmarkSettings.frames_nb > 0u || !mBenchmarkSettings.replay_filename.empty();
+}
+
+bool WindowManager::IsHeadless() const noexcept
+{
+	return mBenchmarkSettings.is_headless;
+}
+
+bool WindowManager::IsMeasuringFrames() const noexcept
+{
+	return IsBenchmarking() && mBenchmarkFramesNb >= mBenchmarkSettings.warmup_frames_nb;
+}
+
+WindowManager::BenchmarkSettings const& WindowManager::GetBenchmarkSettings() const noexcept
+{
+	return mBenchmarkSettings;
+}
+
+void WindowManager::ReportBenchmarkResults() const
+{
+	if (mFrameTimes.empty())
+		return;
+
+	std::vector<double> frame_times_ms(mFrameTimes.size());
+	std::transform(mFrameTimes.begin(), mFrameTimes.end(), frame_times_ms.begin(),
+	               [](std::chrono::nanoseconds const time){ return std::chrono::duration<double, std::milli>(time).count(); });
+	std::vector<double> sorted_frame_times_ms(frame_times_ms);
+	std::sort(sorted_frame_times_ms.begin(), sorted_frame_times_ms.end());
+
+	double total_ms = 0.0;
+	for (auto const time : frame_times_ms)
+		total_ms += time;
+	auto const average_ms = total_ms / static_cast<double>(frame_times_ms.size());
+	auto const median_ms = utils::get_percentile(sorted_frame_times_ms, 50.0);
+	auto const p95_ms = utils::get_percentile(sorted_frame_times_ms, 95.0);
+	auto const p99_ms = utils::get_percentile(sorted_frame_times_ms, 99.0);
+
+	LogInfo("Benchmark over %zu frames: average %.3f ms (%.1f FPS), min %.3f ms, median %.3f ms, 95th percentile %.3f ms, 99th percentile %.3f ms, max %.3f ms.",
+	        frame_times_ms.size(), average_ms, 1000.0 / average_ms, sorted_frame_times_ms.front(), median_ms, p95_ms, p99_ms, sorted_frame_times_ms.back());
+
+	if (mBenchmarkSettings.statistics_filename.empty())
+		return;
+
+	std::ofstream file(mBenchmarkSettings.statistics_filename, std::ios::out | std::ios::trunc);
+	if (!file.is_open()) {
+		LogError("Failed to open \"%s\" for writing the benchmark statistics.", mBenchmarkSettings.statistics_filename.c_str());
+		return;
+	}
+	file.precision(4);
+	file << std::fixed;
+	file << "{\n"
+	     << "\t\"frames_nb\": " << frame_times_ms.size() << ",\n"
+	     << "\t\"warmup_frames_nb\": " << mBenchmarkSettings.warmup_frames_nb << ",\n"
+	     << "\t\"headless\": " << (mBenchmarkSettings.is_headless ? "true" : "false") << ",\n"
+	     << "\t\"average_ms\": " << average_ms << ",\n"
+	     << "\t\"min_ms\": " << sorted_frame_times_ms.front() << ",\n"
+	     << "\t\"median_ms\": " << median_ms << ",\n"
+	     << "\t\"p95_ms\": " << p95_ms << ",\n"
+	     << "\t\"p99_ms\": " << p99_ms << ",\n"
+	     << "\t\"max_ms\": " << sorted_frame_times_ms.back() << ",\n"
+	     << "\t\"frame_times_ms\": [";
+	for (size_t i = 0; i < frame_times_ms.size(); ++i)
+		file << (i == 0 ? "" : ", ") << frame_times_ms[i];
+	file << "]\n}\n";
+
+	if (!file.good())
+		LogError("Failed to write the benchmark statistics to \"%s\".", mBenchmarkSettings.statistics_filename.c_str());
+	else
+		LogInfo("Wrote the benchmark statistics to \"%s\".", mBenchmarkSettings.statistics_filename.c_str());
+}
+
+void WindowManager::SaveFramebuffer(GLFWwindow* const window, std::string const& filename) const
+{
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return;
+
+	// Assignments are free to leave any framebuffer bound for reading.
+	GLint previous_read_framebuffer = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_read_framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0u);
+	glReadBuffer(GL_BACK);
+
+	// The alpha channel of the default framebuffer is not meaningful.
+	auto const row_size = static_cast<size_t>(width) * 3u;
+	std::vector<unsigned char> pixels(row_size * static_cast<size_t>(height));
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previous_read_framebuffer));
+
+	// OpenGL stores the bottom row first, whereas PNG starts from the top.
+	for (int y = 0; y < height / 2; ++y)
+		std::swap_ranges(pixels.begin() + static_cast<std::ptrdiff_t>(y * row_size),
+		                 pixels.begin() + static_cast<std::ptrdiff_t>((y + 1) * row_size),
+		                 pixels.begin() + static_cast<std::ptrdiff_t>((height - 1 - y) * row_size));
+
+	if (stbi_write_png(filename.c_str(), width, height, 3, pixels.data(), static_cast<int>(row_size)) == 0)
+		LogError("Failed to write the last frame to \"%s\".", filename.c_str());
+	else
+		LogInfo("Wrote the last frame to \"%s\".", filename.c_str());
+}
@@ -6,9 +6,12 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include <chrono>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 #include <memory>
+#include <vector>
 
 //! \brief A simple class for creating and interacting with windows, using the
 //!        GLFW library.
@@ -26,6 +29,27 @@ public:
 		enable_vsync = 1,
 		late_swap_tearing = -1
 	};
+	enum class ContextAPI : int {
+		native = 0,  //!< WGL, GLX or NSGL, depending on the platform
+		egl,         //!< supports surfaceless and pbuffer contexts
+		osmesa       //!< software rendering, requires GLFW 3.3 or later
+	};
+	//! \brief Settings for running a fixed number of frames, as fast as
+	//!        possible, and reporting how long they took.
+	struct BenchmarkSettings {
+		bool         is_headless{ false };              //!< hide the window and create its context through `context_api`
+		ContextAPI   context_api{ ContextAPI::egl };
+		unsigned int frames_nb{ 0u };                   //!< frames to measure before closing the window; 0 to run until closed, or until the end of the replay
+		unsigned int warmup_frames_nb{ 30u };           //!< frames rendered before starting to measure
+		std::string  statistics_filename;               //!< where to write the frame times as JSON, if not empty
+		std::string  image_filename;                    //!< where to write the last frame as PNG, if not empty
+		std::string  pass_statistics_filename;          //!< where applications should write the timings of their passes as JSON, if not empty
+		std::string  capture_prefix;                    //!< where applications should capture the measured frames to, if not empty; see `FrameCapture`
+		bool         capture_raw_video{ false };        //!< capture to a single raw video file, rather than one PNG image per frame
+		std::string  record_filename;                   //!< where to record the inputs to, if not empty
+		std::string  replay_filename;                   //!< inputs to replay once warmed up, if not empty; the run ends with the replay
+		std::chrono::microseconds time_step{ 1000000 / 60 };  //!< by how much the application advances each frame while recording
+	};
 	struct WindowDatum {
 		InputHandler& input_handler;
 		FPSCameraf&   camera;
@@ -35,16 +59,52 @@ public:
 	};
 
 	WindowManager();
+	explicit WindowManager(BenchmarkSettings const& benchmark_settings);
 	~WindowManager();
 
+	//! \brief Read the benchmark settings from the command line.
+	//!
+	//! Recognised arguments are `--headless`, `--context-api
+	//! <native|egl|osmesa>`, `--frames <count>`, `--warmup-frames <count>`,
+	//! `--statistics <file.json>`, `--pass-statistics <file.json>`,
+	//! `--screenshot <file.png>`, `--capture <prefix>`, `--capture-format
+	//! <png|raw>`, `--record <file>` and `--replay <file>`; any other one is
+	//! reported and ignored.
+	static BenchmarkSettings ParseBenchmarkSettings(int argc, char const* const argv[]);
+
 	GLFWwindow* CreateGLFWWindow(std::string const& title, WindowDatum const& data, unsigned int msaa = 1u, bool fullscreen = false, bool resizable = false, SwapStrategy swap = SwapStrategy::enable_vsync);
 	void DestroyWindow(GLFWwindow* const window);
 	void NewImGuiFrame();
 	void RenderImGuiFrame(bool show_gui);
 	void ToggleFullscreenStatusForWindow(GLFWwindow* const window) noexcept;
 
+	//! \brief Present the current frame; to be used instead of
+	//!        `glfwSwapBuffers()`.
+	//!
+	//! When benchmarking, this also measures the time between successive
+	//! frames, and once enough of them were measured, saves the last one
+	//! if requested, reports the statistics and asks the window to close.
+	void SwapBuffers(GLFWwindow* const window);
+
+	bool IsBenchmarking() const noexcept;
+	bool IsHeadless() const noexcept;
+
+	//! \brief Whether the warm-up frames of the benchmark are over, and
+	//!        frames are being measured.
+	bool IsMeasuringFrames() const noexcept;
+
+	BenchmarkSettings const& GetBenchmarkSettings() const noexcept;
+
 private:
+	void ReportBenchmarkResults() const;
+	void SaveFramebuffer(GLFWwindow* const window, std::string const& filename) const;
+
 	std::unordered_map<GLFWwindow*, std::unique_ptr<WindowDatum>> mWindowData;
 
+	BenchmarkSettings mBenchmarkSettings;
+	unsigned int mBenchmarkFramesNb{ 0u };  //!< frames swapped since the window was created, warm-up included
+	std::chrono::steady_clock::time_point mLastSwapTime;
+	std::vector<std::chrono::nanoseconds> mFrameTimes;
+
 	static std::mutex mMutex;
 };
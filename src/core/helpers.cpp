@@ -12,10 +12,15 @@
 #include <imgui.h>
 #include <stb_image.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <limits>
+#include <map>
 #include <memory>
+#include <utility>
 
 namespace
 {
@@ -105,8 +110,100 @@ getTextureData(std::string const& filename, std::uint32_t& width, std::uint32_t&
 	return image;
 }
 
+namespace
+{
+	//! \brief Texture referenced by one or more materials, waiting to be
+	//!        loaded into a 2D-array texture.
+	struct batched_texture {
+		std::string path;
+		std::uint32_t width{ 0u };
+		std::uint32_t height{ 0u };
+		std::vector<std::pair<std::size_t, glm::length_t>> users{}; //!< (material index, texture slot) pairs
+	};
+}
+
+static void
+fillMaterialTextureBatch(std::vector<batched_texture> const& textures, std::size_t materials_nb, bonobo::material_texture_batch& batch)
+{
+	batch.materials.assign(materials_nb, bonobo::material_texture_layers{});
+
+	GLint max_layers_nb = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers_nb);
+	assert(max_layers_nb > 0);
+
+	// `getTextureData()` always returns RGBA8 data, so grouping by size is
+	// enough to also group by format.
+	std::map<std::pair<std::uint32_t, std::uint32_t>, std::vector<std::size_t>> textures_per_size;
+	for (std::size_t i = 0u; i < textures.size(); ++i)
+		textures_per_size[std::make_pair(textures[i].width, textures[i].height)].push_back(i);
+
+	for (auto const& size_and_textures : textures_per_size) {
+		auto const width = size_and_textures.first.first;
+		auto const height = size_and_textures.first.second;
+		auto const& texture_indices = size_and_textures.second;
+
+		for (std::size_t first = 0u; first < texture_indices.size(); first += static_cast<std::size_t>(max_layers_nb)) {
+			if (batch.texture_arrays.size() == bonobo::max_material_texture_arrays) {
+				LogWarning("All %zu texture arrays are already in use: %zu textures of %ux%u will not be available.",
+				           bonobo::max_material_texture_arrays, texture_indices.size() - first, width, height);
+				break;
+			}
+
+			auto const array_index = static_cast<int>(batch.texture_arrays.size());
+			auto const layers_nb = std::min(texture_indices.size() - first, static_cast<std::size_t>(max_layers_nb));
+
+			GLuint texture = 0u;
+			glGenTextures(1, &texture);
+			assert(texture != 0u);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, static_cast<GLsizei>(width), static_cast<GLsizei>(height), static_cast<GLsizei>(layers_nb), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+			for (std::size_t layer = 0u; layer < layers_nb; ++layer) {
+				auto const& batched = textures[texture_indices[first + layer]];
+
+				std::uint32_t image_width, image_height;
+				auto const data = getTextureData(batched.path, image_width, image_height, true);
+				if (image_width != width || image_height != height) {
+					LogWarning("Texture \"%s\" was expected to be %ux%u but is %ux%u: skipping it.",
+					           batched.path.c_str(), width, height, image_width, image_height);
+					continue;
+				}
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, static_cast<GLint>(layer), static_cast<GLsizei>(width), static_cast<GLsizei>(height), 1, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<GLvoid const*>(data.data()));
+
+				for (auto const& user : batched.users) {
+					auto& material = batch.materials[user.first];
+					material.arrays[user.second] = array_index;
+					material.layers[user.second] = static_cast<int>(layer);
+				}
+			}
+
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, 0u);
+
+			utils::opengl::debug::nameObject(GL_TEXTURE, texture, "Material textures " + std::to_string(width) + "x" + std::to_string(height) + " #" + std::to_string(array_index));
+			batch.texture_arrays.push_back(texture);
+
+			LogTrivia("│ %s Texture array %d of %ux%u created with %zu layers",
+			          array_index == 0 ? "┌" : "├", array_index, width, height, layers_nb);
+		}
+	}
+
+	// The uniform buffer is always allocated for the maximum amount of
+	// materials, as that is the size the shaders will declare; the
+	// materials past it are unused, see `loadObjects()`.
+	glGenBuffers(1, &batch.materials_ubo);
+	assert(batch.materials_ubo != 0u);
+	glBindBuffer(GL_UNIFORM_BUFFER, batch.materials_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, bonobo::max_batched_materials * sizeof(bonobo::material_texture_layers), nullptr, GL_STATIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, std::min(materials_nb, bonobo::max_batched_materials) * sizeof(bonobo::material_texture_layers), batch.materials.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+	utils::opengl::debug::nameObject(GL_BUFFER, batch.materials_ubo, "Material texture layers");
+}
+
 std::vector<bonobo::mesh_data>
-bonobo::loadObjects(std::string const& filename)
+bonobo::loadObjects(std::string const& filename, material_texture_batch* batch)
 {
 	auto const scene_start_time = std::chrono::high_resolution_clock::now();
 
@@ -138,9 +235,23 @@ bonobo::loadObjects(std::string const& filename)
 			are_materials_used[material_id] = true;
 	}
 
+	// The shaders would index past the uniform block holding the batched
+	// materials, and sample the wrong layers.
+	if (batch != nullptr) {
+		for (size_t i = bonobo::max_batched_materials; i < are_materials_used.size(); ++i) {
+			if (are_materials_used[i]) {
+				LogError("\"%s\" uses %u materials, but at most %zu can have batched textures.",
+				         filename.c_str(), assimp_scene->mNumMaterials, bonobo::max_batched_materials);
+				return objects;
+			}
+		}
+	}
+
 	auto const materials_start_time = std::chrono::high_resolution_clock::now();
 	std::vector<texture_bindings> materials_bindings(assimp_scene->mNumMaterials);
 	std::vector<material_data> material_constants(assimp_scene->mNumMaterials);
+	std::vector<batched_texture> batched_textures;
+	std::unordered_map<std::string, std::size_t> batched_texture_indices;
 	uint32_t texture_count = 0u;
 	for (size_t i = 0; i < assimp_scene->mNumMaterials; ++i) {
 		if (!are_materials_used[i])
@@ -150,8 +261,9 @@ bonobo::loadObjects(std::string const& filename)
 		texture_bindings& bindings = materials_bindings[i];
 		material_data& constants = material_constants[i];
 		auto const material = assimp_scene->mMaterials[i];
+		std::size_t material_textures_nb = 0u;
 
-		auto const process_texture = [&bindings,&material,i,&parent_folder,&texture_count](aiTextureType type, std::string const& type_as_str, std::string const& name){
+		auto const process_texture = [&](aiTextureType type, std::string const& type_as_str, std::string const& name, glm::length_t slot){
 			if (material->GetTextureCount(type)) {
 				auto const texture_start_time = std::chrono::high_resolution_clock::now();
 
@@ -159,19 +271,49 @@ bonobo::loadObjects(std::string const& filename)
 					LogWarning("Material \"%s\" has more than one %s texture: discarding all but the first one.", material->GetName().C_Str(), type_as_str.c_str());
 				aiString path;
 				material->GetTexture(type, 0, &path);
-				auto const id = bonobo::loadTexture2D(parent_folder + std::string(path.C_Str()));
+				auto const texture_path = parent_folder + std::string(path.C_Str());
+
+				if (batch != nullptr) {
+					// Only look up the size for now: the texture will be
+					// loaded into its 2D-array texture once all textures
+					// are known.
+					auto texture_index = batched_texture_indices.find(texture_path);
+					if (texture_index == batched_texture_indices.end()) {
+						int width = 0, height = 0;
+						if (stbi_info(texture_path.c_str(), &width, &height, nullptr) == 0) {
+							LogWarning("Failed to load the %s texture for material \"%s\".", type_as_str.c_str(), material->GetName().C_Str());
+							return;
+						}
+						batched_texture texture;
+						texture.path = texture_path;
+						texture.width = static_cast<std::uint32_t>(width);
+						texture.height = static_cast<std::uint32_t>(height);
+						texture_index = batched_texture_indices.emplace(texture_path, batched_textures.size()).first;
+						batched_textures.push_back(std::move(texture));
+						++texture_count;
+					}
+					batched_textures[texture_index->second].users.emplace_back(i, slot);
+					++material_textures_nb;
+
+					LogTrivia("│ %s Texture \"%s\" queued for batching",
+					          material_textures_nb == 1 ? "┌" : "├", path.C_Str());
+					return;
+				}
+
+				auto const id = bonobo::loadTexture2D(texture_path);
 				if (id == 0u) {
 					LogWarning("Failed to load the %s texture for material \"%s\".", type_as_str.c_str(), material->GetName().C_Str());
 					return;
 				}
 				bindings.emplace(name, id);
 				++texture_count;
+				++material_textures_nb;
 
 				utils::opengl::debug::nameObject(GL_TEXTURE, id, std::string(material->GetName().C_Str()) + " " + type_as_str);
 
 				auto const texture_end_time = std::chrono::high_resolution_clock::now();
 				LogTrivia("│ %s Texture \"%s\" loaded in %.3f ms",
-				          bindings.size() == 1 ? "┌" : "├", path.C_Str(),
+				          material_textures_nb == 1 ? "┌" : "├", path.C_Str(),
 				          std::chrono::duration<float, std::milli>(texture_end_time - texture_start_time).count());
 			}
 		};
@@ -190,16 +332,18 @@ bonobo::loadObjects(std::string const& filename)
 		material->Get(AI_MATKEY_REFRACTI, constants.indexOfRefraction);
 		material->Get(AI_MATKEY_OPACITY, constants.opacity);
 
-		process_texture(aiTextureType_DIFFUSE,  "diffuse",  "diffuse_texture");
-		process_texture(aiTextureType_SPECULAR, "specular", "specular_texture");
-		process_texture(aiTextureType_NORMALS,  "normals",  "normals_texture");
-		process_texture(aiTextureType_OPACITY,  "opacity",  "opacity_texture");
+		process_texture(aiTextureType_DIFFUSE,  "diffuse",  "diffuse_texture",  0);
+		process_texture(aiTextureType_SPECULAR, "specular", "specular_texture", 1);
+		process_texture(aiTextureType_NORMALS,  "normals",  "normals_texture",  2);
+		process_texture(aiTextureType_OPACITY,  "opacity",  "opacity_texture",  3);
 
 		auto const material_end_time = std::chrono::high_resolution_clock::now();
 		LogTrivia("│ %s Material \"%s\" loaded in %.3f ms",
-		          bindings.empty() ? "╺" : "┕", material->GetName().C_Str(),
+		          material_textures_nb == 0u ? "╺" : "┕", material->GetName().C_Str(),
 		          std::chrono::duration<float, std::milli>(material_end_time - material_start_time).count());
 	}
+	if (batch != nullptr)
+		fillMaterialTextureBatch(batched_textures, assimp_scene->mNumMaterials, *batch);
 	auto const materials_end_time = std::chrono::high_resolution_clock::now();
 
 	auto const meshes_start_time = std::chrono::high_resolution_clock::now();
@@ -234,6 +378,14 @@ bonobo::loadObjects(std::string const& filename)
 			object.name = std::string(assimp_object_mesh->mName.C_Str());
 		}
 
+		object.bounding_box_min = glm::vec3(std::numeric_limits<float>::max());
+		object.bounding_box_max = glm::vec3(std::numeric_limits<float>::lowest());
+		for (unsigned int i = 0u; i < assimp_object_mesh->mNumVertices; ++i) {
+			auto const& vertex = assimp_object_mesh->mVertices[i];
+			object.bounding_box_min = glm::min(object.bounding_box_min, glm::vec3(vertex.x, vertex.y, vertex.z));
+			object.bounding_box_max = glm::max(object.bounding_box_max, glm::vec3(vertex.x, vertex.y, vertex.z));
+		}
+
 		glGenVertexArrays(1, &object.vao);
 		assert(object.vao != 0u);
 		glBindVertexArray(object.vao);
@@ -322,6 +474,7 @@ bonobo::loadObjects(std::string const& filename)
 		if (material_id < materials_bindings.size()) {
 			object.bindings = materials_bindings[material_id];
 			object.material = material_constants[material_id];
+			object.material_id = material_id;
 		}
 
 		objects.push_back(object);
@@ -467,7 +620,7 @@ bonobo::createProgram(std::string const& vert_shader_source_path, std::string co
 }
 
 void
-bonobo::displayTexture(glm::vec2 const& lower_left, glm::vec2 const& upper_right, GLuint texture, GLuint sampler, glm::ivec4 const& swizzle, glm::ivec2 const& window_size, bool linearise, float nearPlane, float farPlane)
+bonobo::displayTexture(glm::vec2 const& lower_left, glm::vec2 const& upper_right, GLuint texture, GLuint sampler, glm::ivec4 const& swizzle, glm::ivec2 const& window_size, bool linearise, float nearPlane, float farPlane, int layer)
 {
 	auto const relative_to_absolute = [](float coord, int size) {
 		return static_cast<GLint>((coord + 1.0f) / 2.0f * size);
@@ -481,17 +634,24 @@ bonobo::displayTexture(glm::vec2 const& lower_left, glm::vec2 const& upper_right
 	glViewport(viewport_origin.x, viewport_origin.y, viewport_size.x, viewport_size.y);
 	glUseProgram(local::fullscreen_shader);
 	glBindVertexArray(local::display_vao);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glBindSampler(0, sampler);
+	// 2-D textures and 2-D array textures go to different units, as
+	// samplers of different types cannot share a unit.
+	auto const unit = layer < 0 ? 0u : 1u;
+	auto const target = layer < 0 ? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY;
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(target, texture);
+	glBindSampler(unit, sampler);
 	glUniform1i(glGetUniformLocation(local::fullscreen_shader, "tex"), 0);
+	glUniform1i(glGetUniformLocation(local::fullscreen_shader, "tex_array"), 1);
+	glUniform1i(glGetUniformLocation(local::fullscreen_shader, "layer"), layer);
 	glUniform4iv(glGetUniformLocation(local::fullscreen_shader, "swizzle"), 1, glm::value_ptr(swizzle));
 	glUniform1i(glGetUniformLocation(local::fullscreen_shader, "linearise"), linearise);
 	glUniform1f(glGetUniformLocation(local::fullscreen_shader, "near"), nearPlane);
 	glUniform1f(glGetUniformLocation(local::fullscreen_shader, "far"), farPlane);
 	glDrawArrays(GL_TRIANGLES, 0, 3);
-	glBindSampler(0, 0u);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindSampler(unit, 0u);
+	glBindTexture(target, 0);
+	glActiveTexture(GL_TEXTURE0);
 	glUseProgram(0);
 }
 
@@ -49,6 +49,39 @@ namespace bonobo
 		material_data material{};                //!< constant values for the material of this mesh
 		GLenum drawing_mode{GL_TRIANGLES};       //!< OpenGL drawing mode, i.e. GL_TRIANGLES, GL_LINES, etc.
 		std::string name{"un-named mesh"};       //!< Name of the mesh; used for debugging purposes.
+		GLuint material_id{0u};                  //!< Index of the material of this mesh in the scene file
+		glm::vec3 bounding_box_min{0.0f};        //!< Minimum corner of the axis-aligned box bounding the vertices, in model space; only filled in by `loadObjects()`.
+		glm::vec3 bounding_box_max{0.0f};        //!< Maximum corner of the axis-aligned box bounding the vertices, in model space; only filled in by `loadObjects()`.
+	};
+
+	//! \brief Maximum number of 2D-array textures a batched material set
+	//!        can be spread over; the shaders sampling them declare an array
+	//!        of that many samplers.
+	constexpr std::size_t max_material_texture_arrays = 8u;
+
+	//! \brief Maximum number of materials a batched material set can
+	//!        reference; the shaders sampling them declare a uniform block
+	//!        holding that many `material_texture_layers`.
+	constexpr std::size_t max_batched_materials = 256u;
+
+	//! \brief Location of the textures of a material within the 2D-array
+	//!        textures of a `material_texture_batch`.
+	//!
+	//! The components of each vector refer, in order, to the diffuse,
+	//! specular, normals and opacity textures. The layout matches std140,
+	//! so an array of those can be copied as is into a uniform buffer.
+	struct material_texture_layers {
+		glm::ivec4 arrays{ -1 }; //!< index of the 2D-array texture to sample, or -1 if the material has no such texture
+		glm::ivec4 layers{ 0 };  //!< layer to sample within that 2D-array texture
+	};
+
+	//! \brief Textures of all the materials of a scene, grouped by size and
+	//!        format into 2D-array textures, so that all of them can be
+	//!        bound once rather than before every draw call.
+	struct material_texture_batch {
+		std::vector<GLuint> texture_arrays{};                     //!< OpenGL names of the GL_TEXTURE_2D_ARRAY textures
+		std::vector<material_texture_layers> materials{};         //!< per-material texture locations, indexed by `mesh_data::material_id`
+		GLuint materials_ubo{0u};                                 //!< OpenGL name of the uniform buffer holding `materials`
 	};
 
 	enum class cull_mode_t : unsigned int {
@@ -72,9 +105,16 @@ namespace bonobo
 	//! \brief Load objects found in an object/scene file, using assimp.
 	//!
 	//! @param [in] filename of the object/scene file to load.
+	//! @param [out] batch if not null, the material textures are loaded
+	//!              into 2D-array textures described by `batch` instead of
+	//!              individual 2D textures, and the `bindings` of the
+	//!              returned meshes are left empty.
 	//! @return a vector of filled in `mesh_data` structures, one per
-	//!         object found in the input file
-	std::vector<mesh_data> loadObjects(std::string const& filename);
+	//!         object found in the input file; empty if batching was
+	//!         requested but the meshes use more than
+	//!         `max_batched_materials` materials
+	std::vector<mesh_data> loadObjects(std::string const& filename,
+	                                   material_texture_batch* batch = nullptr);
 
 	//! \brief Creates an OpenGL texture without any content nor parameters.
 	//!
@@ -150,11 +190,14 @@ namespace bonobo
 	//!             textures; it is ignored if |linearise| is false.
 	//! @param [in] farPlane the far plane used when linearising depth
 	//!             textures; it is ignored if |linearise| is false.
+	//! @param [in] layer which layer to display if |texture| is a
+	//!             GL_TEXTURE_2D_ARRAY texture; -1 for GL_TEXTURE_2D ones.
 	void displayTexture(glm::vec2 const& lower_left,
 	                    glm::vec2 const& upper_right, GLuint texture,
 	                    GLuint sampler, glm::ivec4 const& swizzle,
 	                    glm::ivec2 const& window_size, bool linearise = false,
-	                    float nearPlane = 0.0f, float farPlane = 0.0f);
+	                    float nearPlane = 0.0f, float farPlane = 0.0f,
+	                    int layer = -1);
 
 	//! \brief Create an OpenGL FrameBuffer Object using the specified
 	//!        attachments.
@@ -2,11 +2,70 @@
 #include "helpers.hpp"
 
 #include "core/Log.h"
+#include "core/OcclusionCuller.hpp"
 #include "core/opengl.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cassert>
+#include <vector>
+
+constexpr GLuint Node::material_block_binding;
+
+namespace
+{
+	//! \brief std140 layout of the `Material` uniform block.
+	struct MaterialBlock
+	{
+		glm::vec3 diffuse{ 0.0f };
+		float shininess{ 0.0f };
+		glm::vec3 specular{ 0.0f };
+		float index_of_refraction{ 1.0f };
+		glm::vec3 ambient{ 0.0f };
+		float opacity{ 1.0f };
+		glm::vec3 emissive{ 0.0f };
+		float padding{ 0.0f };
+	};
+	static_assert(sizeof(MaterialBlock) == 16u * sizeof(float), "MaterialBlock does not match the std140 layout.");
+
+	//! \brief Uniform buffer holding the material constants of all nodes,
+	//!        each one in its own slot.
+	class MaterialBlockPool
+	{
+	public:
+		std::size_t acquire();
+		void release(std::size_t index);
+		void upload(std::size_t index, bonobo::material_data const& constants);
+		void bind(std::size_t index, GLuint binding) const;
+
+	private:
+		void grow();
+
+		GLuint _buffer{ 0u };
+		GLsizeiptr _stride{ 0 };
+		std::vector<MaterialBlock> _blocks;
+		std::vector<std::size_t> _free_indices;
+	};
+
+	MaterialBlockPool& getMaterialBlockPool()
+	{
+		static MaterialBlockPool pool;
+		return pool;
+	}
+
+	bool areMaterialsEqual(bonobo::material_data const& lhs, bonobo::material_data const& rhs)
+	{
+		return lhs.diffuse == rhs.diffuse
+		    && lhs.specular == rhs.specular
+		    && lhs.ambient == rhs.ambient
+		    && lhs.emissive == rhs.emissive
+		    && lhs.shininess == rhs.shininess
+		    && lhs.indexOfRefraction == rhs.indexOfRefraction
+		    && lhs.opacity == rhs.opacity;
+	}
+}
+
 void
 Node::render(glm::mat4 const& view_projection, glm::mat4 const& parent_transform) const
 {
@@ -19,6 +78,8 @@ Node::render(glm::mat4 const& view_projection, glm::mat4 const& world, GLuint pr
 {
 	if (_vao == 0u || program == 0u)
 		return;
+	if (_occlusion_culler != nullptr && !_occlusion_culler->IsDrawn(_occlusion_object))
+		return;
 
 	utils::opengl::debug::beginDebugGroup(_name);
 
@@ -42,19 +103,27 @@ Node::render(glm::mat4 const& view_projection, glm::mat4 const& world, GLuint pr
 		glUniform1i(glGetUniformLocation(program, texture_presence_var_name.c_str()), 1);
 	}
 
-	glUniform3fv(glGetUniformLocation(program, "diffuse_colour"), 1, glm::value_ptr(_constants.diffuse));
-	glUniform3fv(glGetUniformLocation(program, "specular_colour"), 1, glm::value_ptr(_constants.specular));
-	glUniform3fv(glGetUniformLocation(program, "ambient_colour"), 1, glm::value_ptr(_constants.ambient));
-	glUniform3fv(glGetUniformLocation(program, "emissive_colour"), 1, glm::value_ptr(_constants.emissive));
-	glUniform1f(glGetUniformLocation(program, "shininess_value"), _constants.shininess);
-	glUniform1f(glGetUniformLocation(program, "index_of_refraction_value"), _constants.indexOfRefraction);
-	glUniform1f(glGetUniformLocation(program, "opacity_value"), _constants.opacity);
+	if (utils::opengl::shader::has_material_block(program)) {
+		_constants_slot.bind(_constants);
+	} else {
+		glUniform3fv(glGetUniformLocation(program, "diffuse_colour"), 1, glm::value_ptr(_constants.diffuse));
+		glUniform3fv(glGetUniformLocation(program, "specular_colour"), 1, glm::value_ptr(_constants.specular));
+		glUniform3fv(glGetUniformLocation(program, "ambient_colour"), 1, glm::value_ptr(_constants.ambient));
+		glUniform3fv(glGetUniformLocation(program, "emissive_colour"), 1, glm::value_ptr(_constants.emissive));
+		glUniform1f(glGetUniformLocation(program, "shininess_value"), _constants.shininess);
+		glUniform1f(glGetUniformLocation(program, "index_of_refraction_value"), _constants.indexOfRefraction);
+		glUniform1f(glGetUniformLocation(program, "opacity_value"), _constants.opacity);
+	}
 
 	glBindVertexArray(_vao);
+	if (_occlusion_culler != nullptr)
+		_occlusion_culler->BeginDraw(_occlusion_object);
 	if (_has_indices)
 		glDrawElements(_drawing_mode, _indices_nb, GL_UNSIGNED_INT, reinterpret_cast<GLvoid const*>(0x0));
 	else
 		glDrawArrays(_drawing_mode, 0, _vertices_nb);
+	if (_occlusion_culler != nullptr)
+		_occlusion_culler->EndDraw(_occlusion_object);
 	glBindVertexArray(0u);
 
 	for (auto const& texture : _textures) {
@@ -85,13 +154,17 @@ Node::set_geometry(bonobo::mesh_data const& shape)
 			add_texture(binding.first, binding.second, GL_TEXTURE_2D);
 	}
 
-	_constants = shape.material;
+	set_material_constants(shape.material);
 }
 
 void
 Node::set_material_constants(bonobo::material_data const& constants)
 {
+	if (areMaterialsEqual(_constants, constants))
+		return;
+
 	_constants = constants;
+	_constants_slot.invalidate();
 }
 
 void
@@ -182,3 +255,122 @@ Node::get_transform()
 {
 	return _transform;
 }
+
+void
+Node::set_occlusion_culler(OcclusionCuller* culler, size_t object)
+{
+	_occlusion_culler = culler;
+	_occlusion_object = object;
+}
+
+Node::MaterialBlockSlot::MaterialBlockSlot(MaterialBlockSlot const& /*other*/)
+{
+}
+
+Node::MaterialBlockSlot&
+Node::MaterialBlockSlot::operator=(MaterialBlockSlot const& /*other*/)
+{
+	// Keep the current slot, but the constants it contains are now
+	// outdated.
+	_is_dirty = true;
+	return *this;
+}
+
+Node::MaterialBlockSlot::~MaterialBlockSlot()
+{
+	if (_index != static_cast<std::size_t>(-1))
+		getMaterialBlockPool().release(_index);
+}
+
+void
+Node::MaterialBlockSlot::bind(bonobo::material_data const& constants)
+{
+	auto& pool = getMaterialBlockPool();
+	if (_index == static_cast<std::size_t>(-1))
+		_index = pool.acquire();
+	if (_is_dirty) {
+		pool.upload(_index, constants);
+		_is_dirty = false;
+	}
+	pool.bind(_index, material_block_binding);
+}
+
+void
+Node::MaterialBlockSlot::invalidate()
+{
+	_is_dirty = true;
+}
+
+std::size_t
+MaterialBlockPool::acquire()
+{
+	if (_free_indices.empty())
+		grow();
+
+	auto const index = _free_indices.back();
+	_free_indices.pop_back();
+	return index;
+}
+
+void
+MaterialBlockPool::release(std::size_t index)
+{
+	assert(index < _blocks.size());
+	_free_indices.push_back(index);
+}
+
+void
+MaterialBlockPool::upload(std::size_t index, bonobo::material_data const& constants)
+{
+	assert(index < _blocks.size());
+	auto& block = _blocks[index];
+	block.diffuse = constants.diffuse;
+	block.shininess = constants.shininess;
+	block.specular = constants.specular;
+	block.index_of_refraction = constants.indexOfRefraction;
+	block.ambient = constants.ambient;
+	block.opacity = constants.opacity;
+	block.emissive = constants.emissive;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(index) * _stride, sizeof(MaterialBlock), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+}
+
+void
+MaterialBlockPool::bind(std::size_t index, GLuint binding) const
+{
+	assert(index < _blocks.size());
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, _buffer, static_cast<GLintptr>(index) * _stride, sizeof(MaterialBlock));
+}
+
+void
+MaterialBlockPool::grow()
+{
+	if (_stride == 0) {
+		// Each block has to start at an offset which is a multiple of
+		// that alignment, to be usable with `glBindBufferRange()`.
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		auto const block_size = static_cast<GLsizeiptr>(sizeof(MaterialBlock));
+		_stride = alignment > 0 ? ((block_size + alignment - 1) / alignment) * alignment : block_size;
+	}
+
+	auto const previous_capacity = _blocks.size();
+	auto const capacity = previous_capacity == 0u ? 64u : 2u * previous_capacity;
+	_blocks.resize(capacity);
+	for (auto i = capacity; i > previous_capacity; --i)
+		_free_indices.push_back(i - 1u);
+
+	// Recreate the buffer with the new capacity, and copy over the blocks
+	// that were already in use.
+	if (_buffer == 0u)
+		glGenBuffers(1, &_buffer);
+	assert(_buffer != 0u);
+	glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+	glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(capacity) * _stride, nullptr, GL_DYNAMIC_DRAW);
+	for (std::size_t i = 0u; i < previous_capacity; ++i)
+		glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(i) * _stride, sizeof(MaterialBlock), &_blocks[i]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0u);
+	utils::opengl::debug::nameObject(GL_BUFFER, _buffer, "Node material constants");
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "helpers.hpp"
+#include "opengl.hpp"
 #include "TRSTransform.h"
 
 #include <glad/glad.h>
@@ -12,10 +13,37 @@
 #include <tuple>
 #include <vector>
 
+class OcclusionCuller;
+
 //! \brief Represents a node of a scene graph
+//!
+//! The material constants of a node are stored in a uniform buffer
+//! shared by all nodes, and are only uploaded when they change. Shader
+//! programs can access them by declaring the following uniform block:
+//!
+//! \code{.glsl}
+//! layout (std140) uniform Material
+//! {
+//! 	vec3  diffuse_colour;
+//! 	float shininess_value;
+//! 	vec3  specular_colour;
+//! 	float index_of_refraction_value;
+//! 	vec3  ambient_colour;
+//! 	float opacity_value;
+//! 	vec3  emissive_colour;
+//! };
+//! \endcode
+//!
+//! Programs which do not declare that block instead get the material
+//! constants as individual uniforms of the same names. Which of the two a
+//! program uses is found out once, when it gets linked through
+//! `utils::opengl::shader::link_program()`.
 class Node
 {
 public:
+	//! \brief Uniform buffer binding point used for the `Material` block.
+	static constexpr GLuint material_block_binding = utils::opengl::shader::material_block_binding;
+
 	//! \brief Render this node.
 	//!
 	//! @param [in] view_projection Matrix transforming from world-space to clip-space
@@ -130,7 +158,45 @@ public:
 	TRSTransformf const& get_transform() const;
 	TRSTransformf& get_transform();
 
+	//! \brief Have this node skip its draws when found hidden by an
+	//!        occlusion culler.
+	//!
+	//! Children are not affected. The bounding box of the object has to
+	//! be kept up to date in the culler, in world space, and the culler
+	//! has to outlive this node or be reset with a null pointer.
+	//!
+	//! @param [in] culler the culler to use, or null to always draw
+	//! @param [in] object index of the object representing this node
+	//!             within the culler
+	void set_occlusion_culler(OcclusionCuller* culler, size_t object);
+
 private:
+	//! \brief Location of the material constants of a node within the
+	//!        shared material uniform buffer.
+	//!
+	//! Copies of a node get their own location, rather than sharing the
+	//! one of the original node.
+	class MaterialBlockSlot
+	{
+	public:
+		MaterialBlockSlot() = default;
+		MaterialBlockSlot(MaterialBlockSlot const& other);
+		MaterialBlockSlot& operator=(MaterialBlockSlot const& other);
+		~MaterialBlockSlot();
+
+		//! \brief Upload the given constants if they were invalidated
+		//!        since the last call, and bind their range of the
+		//!        shared uniform buffer to `material_block_binding`.
+		void bind(bonobo::material_data const& constants);
+
+		//! \brief Mark the constants as needing to be uploaded again.
+		void invalidate();
+
+	private:
+		std::size_t _index{ static_cast<std::size_t>(-1) };
+		bool _is_dirty{ true };
+	};
+
 	// Geometry data
 	GLuint _vao{ 0u };
 	GLsizei _vertices_nb{ 0u };
@@ -145,10 +211,15 @@ private:
 	// Material data
 	std::vector<std::tuple<std::string, GLuint, GLenum>> _textures;
 	bonobo::material_data _constants;
+	mutable MaterialBlockSlot _constants_slot;
 
 	// Transformation data
 	TRSTransformf _transform;
 
+	// Occlusion culling data
+	OcclusionCuller* _occlusion_culler{ nullptr };
+	size_t _occlusion_object{ 0u };
+
 	// Children data
 	std::vector<Node const*> _children;
 
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <unordered_set>
 
 
 namespace utils
@@ -215,6 +216,14 @@ generate_shader(GLenum type, std::string const& source)
 	}
 }
 
+namespace
+{
+	// Looked up once per link, rather than on each draw; an entry gets
+	// updated whenever its program name is linked again, as deleted names
+	// can be handed out anew.
+	std::unordered_set<GLuint> programs_with_material_block;
+}
+
 bool
 link_program(GLuint id)
 {
@@ -244,6 +253,15 @@ link_program(GLuint id)
 		LogError("Program failed to link but no log available.");
 	}
 
+	programs_with_material_block.erase(id);
+	if (wasLinkingSuccessful) {
+		auto const material_block_index = glGetUniformBlockIndex(id, "Material");
+		if (material_block_index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(id, material_block_index, material_block_binding);
+			programs_with_material_block.insert(id);
+		}
+	}
+
 	return wasLinkingSuccessful;
 }
 
@@ -256,6 +274,12 @@ reload_program(GLuint id, std::vector<GLuint> const& ids, std::vector<std::strin
 	link_program(id);
 }
 
+bool
+has_material_block(GLuint id)
+{
+	return programs_with_material_block.find(id) != programs_with_material_block.end();
+}
+
 GLuint
 generate_program(std::vector<GLuint> const& shaders_id)
 {
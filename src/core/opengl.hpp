@@ -66,9 +66,20 @@ opengl_error_callback( GLenum source, GLenum type, GLuint id
 namespace shader
 {
 
+//! \brief Uniform buffer binding point given to the `Material` block of
+//!        every program linked through `link_program()`; see `Node`.
+constexpr GLuint material_block_binding = 31u;
+
 bool source_and_build_shader(GLuint id, std::string const& source);
 GLuint generate_shader(GLenum type, std::string const& source);
+
+//! \brief Link a program and, if it declares a `Material` uniform block,
+//!        bind that block to `material_block_binding`.
 bool link_program(GLuint id);
+
+//! \brief Whether the program, as last linked through `link_program()`,
+//!        declares a `Material` uniform block.
+bool has_material_block(GLuint id);
 void reload_program(GLuint id, std::vector<GLuint> const& ids, std::vector<std::string> const& sources);
 GLuint generate_program(std::vector<GLuint> const& shaders_id);
 
@@ -1,7 +1,11 @@
 #pragma once
 
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <string>
+#include <vector>
 
 
 namespace utils
@@ -17,4 +21,16 @@ inline std::string const& widen(std::string const& utf8) { return utf8; }
 
 std::string slurp_file(std::string const& path);
 
+//! \brief Return the given percentile of some values, using the
+//!        nearest-rank method.
+//!
+//! @param [in] sorted_values values in ascending order; must not be empty
+//! @param [in] percentile in [0, 100]
+template<typename T>
+T get_percentile(std::vector<T> const& sorted_values, double percentile)
+{
+	auto const rank = static_cast<std::size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sorted_values.size())));
+	return sorted_values[std::min(std::max(rank, std::size_t(1u)), sorted_values.size()) - 1u];
+}
+
 } // end of namespace